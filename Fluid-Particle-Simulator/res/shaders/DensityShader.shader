@@ -0,0 +1,77 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec2 a_Position;    // Simulation bounds corners
+layout(location = 1) in vec2 a_TexCoord;
+
+out vec2 v_TexCoord;
+
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
+void main()
+{
+    gl_Position = u_MVP * vec4(a_Position, 0.0, 1.0);
+    v_TexCoord = a_TexCoord;
+}
+
+#shader fragment
+#version 330 core
+
+in vec2 v_TexCoord;
+out vec4 FragColor;
+
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
+// r = particle count, g = speed sum, b = temperature sum
+uniform sampler2D u_Texture;
+uniform int u_Quantity;      // 0 = count, 1 = speed, 2 = temperature
+uniform float u_MaxCount;
+
+// Same colour scale used by ParticleShader (blue -> cyan -> green -> yellow -> red)
+vec3 ColorMap(float value)
+{
+    if (value < 0.25) {
+        return vec3(0.0, value / 0.25, 1.0);
+    }
+    else if (value < 0.5) {
+        return vec3(0.0, 1.0, 1.0 - (value - 0.25) / 0.25);
+    }
+    else if (value < 0.75) {
+        return vec3((value - 0.5) / 0.25, 1.0, 0.0);
+    }
+    return vec3(1.0, 1.0 - (value - 0.75) / 0.25, 0.0);
+}
+
+void main()
+{
+    vec3 bin = texture(u_Texture, v_TexCoord).rgb;
+    float count = bin.r;
+
+    // Empty texel, keep the background
+    if (count < 0.5) discard;
+
+    float value;
+    if (u_Quantity == 1) {
+        value = min(bin.g / count / u_MaxSpeed, 1.0);
+    }
+    else if (u_Quantity == 2) {
+        value = clamp((bin.b / count - 20.0) / 80.0, 0.0, 1.0);
+    }
+    else {
+        value = log(1.0 + count) / log(1.0 + u_MaxCount);
+    }
+
+    FragColor = vec4(ColorMap(value), 1.0);
+}
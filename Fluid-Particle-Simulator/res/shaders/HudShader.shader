@@ -0,0 +1,34 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec2 a_Position;    // Pixels from the top left corner of the window
+layout(location = 1) in vec2 a_TexCoord;    // Font atlas texels
+layout(location = 2) in vec4 a_Color;       // Normalized from 8-bit RGBA
+
+out vec2 v_TexCoord;
+out vec4 v_Color;
+
+uniform vec2 u_ScreenSize;
+
+void main()
+{
+    gl_Position = vec4(a_Position.x / u_ScreenSize.x * 2.0 - 1.0, 1.0 - a_Position.y / u_ScreenSize.y * 2.0, 0.0, 1.0);
+    v_TexCoord = a_TexCoord;
+    v_Color = a_Color;
+}
+
+#shader fragment
+#version 330 core
+
+in vec2 v_TexCoord;
+in vec4 v_Color;
+out vec4 FragColor;
+
+// One channel atlas, glyph pixels are 1 and the rest 0. Solid quads sample a lit texel
+uniform sampler2D u_Font;
+
+void main()
+{
+    float coverage = texelFetch(u_Font, ivec2(v_TexCoord), 0).r;
+    FragColor = vec4(v_Color.rgb, v_Color.a * coverage);
+}
@@ -0,0 +1,32 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec2 a_Position;    // Simulation units
+layout(location = 1) in vec4 a_Color;       // Normalized from 8-bit RGBA
+
+out vec4 v_Color;
+
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
+void main()
+{
+    gl_Position = u_MVP * vec4(a_Position, 0.0, 1.0);
+    v_Color = a_Color;
+}
+
+#shader fragment
+#version 330 core
+
+in vec4 v_Color;
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = v_Color;
+}
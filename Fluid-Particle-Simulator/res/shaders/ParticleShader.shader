@@ -14,7 +14,13 @@ layout(location = 4) in float a_Size;       // Particle size
 out vec2 v_TexCoord;
 out vec2 v_Velocity;
 
-uniform mat4 u_MVP;
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
 
 void main()
 {
@@ -39,6 +45,14 @@ in vec2 v_TexCoord;
 in vec2 v_Velocity;  
 out vec4 FragColor;
 
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
 void main()
 {
     // Calculate distance from center (0.5, 0.5) in texture space
@@ -49,7 +63,7 @@ void main()
     float circleShape = 1.0 - smoothstep(0.9, 1.0, distance);
 
     float speed = length(v_Velocity);
-    float normalizedV = min(speed / 200.0, 1.0);
+    float normalizedV = min(speed / u_MaxSpeed, 1.0);
 
     vec3 colorRGB;
     if (normalizedV < 0.25) {
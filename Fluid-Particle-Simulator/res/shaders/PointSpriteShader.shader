@@ -0,0 +1,77 @@
+#shader vertex
+#version 330 core
+
+// One vertex per particle, read straight from the instance buffer
+layout(location = 0) in vec2 a_ParticlePos; // Particle center position
+layout(location = 1) in vec2 a_Velocity;    // Particle velocity
+layout(location = 2) in float a_Size;       // Particle size
+
+out vec2 v_Velocity;
+
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
+void main()
+{
+    gl_Position = u_MVP * vec4(a_ParticlePos, 0.0, 1.0);
+
+    // a_Size is the radius, the point covers the whole diameter
+    gl_PointSize = 2.0 * a_Size * u_PixelsPerUnit;
+
+    v_Velocity = a_Velocity;
+}
+
+#shader fragment
+#version 330 core
+
+in vec2 v_Velocity;
+out vec4 FragColor;
+
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
+void main()
+{
+    // gl_PointCoord goes from (0,0) to (1,1) across the point
+    vec2 center = vec2(0.5, 0.5);
+    float distance = length(gl_PointCoord - center) * 2.0; // *2 to normalize to [0,1] range
+
+    // Create a soft circle shape with smooth edges
+    float circleShape = 1.0 - smoothstep(0.9, 1.0, distance);
+
+    float speed = length(v_Velocity);
+    float normalizedV = min(speed / u_MaxSpeed, 1.0);
+
+    vec3 colorRGB;
+    if (normalizedV < 0.25) {
+        float t = normalizedV / 0.25;
+        colorRGB = vec3(0.0, t, 1.0);
+    }
+    else if (normalizedV < 0.5) {
+        float t = (normalizedV - 0.25) / 0.25;
+        colorRGB = vec3(0.0, 1.0, 1.0 - t);
+    }
+    else if (normalizedV < 0.75) {
+        float t = (normalizedV - 0.5) / 0.25;
+        colorRGB = vec3(t, 1.0, 0.0);
+    }
+    else {
+        float t = (normalizedV - 0.75) / 0.25;
+        colorRGB = vec3(1.0, 1.0 - t, 0.0);
+    }
+
+    // Discard pixels outside the circle to create a clean edge
+    if (circleShape < 0.1) discard;
+
+    FragColor = vec4(colorRGB, circleShape);
+}
@@ -0,0 +1,89 @@
+#shader vertex
+#version 330 core
+
+// No vertex attributes: the quad corner comes from gl_VertexID and the
+// particle data is fetched from the instance buffer through a texture buffer
+uniform samplerBuffer u_Instances;  // 5 floats per particle: position, velocity, size
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
+out vec2 v_TexCoord;
+out vec2 v_Velocity;
+
+// Same two triangles as the quad index buffer (0, 1, 2, 2, 3, 0)
+const vec2 CORNERS[6] = vec2[6](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(1.0, 1.0), vec2(-1.0, 1.0), vec2(-1.0, -1.0)
+);
+
+void main()
+{
+    int base = (gl_VertexID / 6) * 5;
+    vec2 corner = CORNERS[gl_VertexID % 6];
+
+    vec2 particlePos = vec2(texelFetch(u_Instances, base).r, texelFetch(u_Instances, base + 1).r);
+    vec2 velocity = vec2(texelFetch(u_Instances, base + 2).r, texelFetch(u_Instances, base + 3).r);
+    float size = texelFetch(u_Instances, base + 4).r;
+
+    vec2 vertexPos = particlePos + corner * size;
+    gl_Position = u_MVP * vec4(vertexPos, 0.0, 1.0);
+
+    v_TexCoord = corner * 0.5 + 0.5;
+    v_Velocity = velocity;
+}
+
+#shader fragment
+#version 330 core
+
+in vec2 v_TexCoord;
+in vec2 v_Velocity;
+out vec4 FragColor;
+
+// Per-frame state shared by every shader, see FrameData in ShaderManager.h
+layout(std140) uniform FrameData {
+    mat4 u_MVP;
+    float u_Zoom;
+    float u_PixelsPerUnit;  // Screen pixels covered by one simulation unit
+    float u_MaxSpeed;       // Speed at the top of the colour scale
+};
+
+void main()
+{
+    // Calculate distance from center (0.5, 0.5) in texture space
+    vec2 center = vec2(0.5, 0.5);
+    float distance = length(v_TexCoord - center) * 2.0; // *2 to normalize to [0,1] range
+
+    // Create a soft circle shape with smooth edges
+    float circleShape = 1.0 - smoothstep(0.9, 1.0, distance);
+
+    float speed = length(v_Velocity);
+    float normalizedV = min(speed / u_MaxSpeed, 1.0);
+
+    vec3 colorRGB;
+    if (normalizedV < 0.25) {
+        float t = normalizedV / 0.25;
+        colorRGB = vec3(0.0, t, 1.0);
+    }
+    else if (normalizedV < 0.5) {
+        float t = (normalizedV - 0.25) / 0.25;
+        colorRGB = vec3(0.0, 1.0, 1.0 - t);
+    }
+    else if (normalizedV < 0.75) {
+        float t = (normalizedV - 0.5) / 0.25;
+        colorRGB = vec3(t, 1.0, 0.0);
+    }
+    else {
+        float t = (normalizedV - 0.75) / 0.25;
+        colorRGB = vec3(1.0, 1.0 - t, 0.0);
+    }
+
+    // Discard pixels outside the circle to create a clean edge
+    if (circleShape < 0.1) discard;
+
+    FragColor = vec4(colorRGB, circleShape);
+}
@@ -1,13 +1,35 @@
 ﻿#include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
 #include "physics/SimulationSystem.h"
 #include "physics/Physics.h"
+#include "physics/FluidSurface.h"
+#include "physics/ConservationMonitor.h"
+#include "physics/PhysicsStepper.h"
 
 #include "Shader.h"
+#include "ShaderManager.h"
 #include "Texture.h"
 #include "core/Time.h"
+#include "core/Profiler.h"
+#include "core/AllocationGuard.h"
+#include "core/MetricsServer.h"
+#include "core/FlightRecorder.h"
+#include "core/MemoryTracker.h"
 #include "ParticleRenderer.h"
+#include "OverlayRenderer.h"
+#include "HudRenderer.h"
+#include "GpuTimer.h"
+#include "SoftwareRenderer.h"
+#include "ParticleBackend.h"
+#include "benchmark/PhysicsBenchmark.h"
+#include "benchmark/RegressionRunner.h"
+#include "benchmark/BroadphaseFuzzer.h"
 #include "Utils.h" // other includes are in Utils.h
 
 
@@ -24,12 +46,59 @@ const float zoom = 0.7f;
 // Toggle space partitioning
 bool useSpacePartitioning = true;
 
+// Threads splitting the physics update and the fluid surface extraction, 0 uses every hardware thread
+const int workerThreads = 0;
+
+// Broadphase and solver counters (pairs, contacts, cell occupancy, residual overlap) shown
+// in the window title. Adds a pass over the grid and the pairs to every step
+const bool collectPhysicsStats = false;
+
+// Check energy, momentum, interpenetration, escaped and NaN particles after every step and
+// print an alert when a limit is crossed. Costs a parallel pass over the particles and pairs
+const bool monitorConservation = false;
+const float maxEnergyGainPerStep = 0.01f;   // Relative to the total energy, 0 disables the check
+const float maxPenetrationRadii = 0.5f;     // Deepest overlap after the solve, 0 disables the check
+
+// Store the particles with fixed point positions and fp16 velocities and temperatures, 14
+// bytes per particle instead of 40. The renderers decode them as they read them
+const bool compactParticleStorage = false;
+
 // Number of substeps for simulation
 const unsigned int subSteps = 6;
 
 // Particle size (in simulation units)
 const float particleRadius = 6.0f;
 
+// Draw particles as discs, as a heat map, or pick automatically based on their size on screen
+const ParticleRenderMode renderMode = ParticleRenderMode::Auto;
+
+// Submit discs as instanced quads, point sprites or vertex pulling, Auto benchmarks them on this GPU
+const ParticleDrawPath drawPath = ParticleDrawPath::Auto;
+
+// Draw one particle every lodStride in sub-pixel or overcrowded grid cells (1 draws every particle)
+const int lodStride = 1;
+
+// Speed shown at the top of the colour scale (red)
+const float colorMapMaxSpeed = 200.0f;
+
+// Recompile the shaders when their file is saved, for tuning them while the simulation runs
+const bool shaderHotReload = true;
+
+// --------- HEADLESS ---------
+
+// Run with --headless <frames> <output folder> to render frames on the CPU without a window,
+// the output folder must already exist. Frames are written as frame_00000.ppm, frame_00001.ppm ...
+const unsigned int headlessWidth = 1920;
+const unsigned int headlessHeight = 1080;
+
+// Threads used by the software renderer and the physics (0 uses every hardware thread)
+const int headlessThreads = 0;
+
+// Serve Prometheus metrics on this port while the run lasts (curl localhost:<port>/metrics),
+// 0 turns the server off. Only this machine can connect unless metricsLoopbackOnly is false
+const int metricsPort = 0;
+const bool metricsLoopbackOnly = true;
+
 // --------- PARTICLE CREATION --------- 
 
 // --- GRID ---
@@ -59,12 +128,58 @@ glm::vec4 simBorderColor(1.0f, 1.0f, 1.0f, 0.5f); // White
 glm::vec4 gridBorderColor(0.0f, 1.0f, 0.0f, 0.5f); // Green
 float borderWidth = 2.0f;
 
+// ---------  DEBUG OVERLAYS --------- 
+
+// Layers shown at startup, keys 1-4 toggle them while running
+const bool showBounds = true;
+const bool showGridOccupancy = false;  // Spatial grid cells tinted by particle count
+const bool showContacts = false;       // Normals of overlapping pairs, red for deep overlaps
+const bool showVelocities = false;     // Velocity vectors
+
+// --------- FLUID SURFACE ---------
+
+// Outline of the fluid traced with marching squares, key 5 toggles it and key E
+// writes the current strips to surfaceExportPath
+const bool showFluidSurface = false;
+const glm::vec4 fluidSurfaceColor(0.3f, 0.8f, 1.0f, 1.0f);
+const std::string surfaceExportPath = "surface.txt";
+
+// --------- HUD ---------
+
+// Rolling graphs of the frame phases, GPU time, substeps, particles, contacts and memory,
+// key H toggles them. hudScale enlarges them on high resolution screens
+const bool showHud = true;
+const int hudScale = 1;
+
+// --------- PROFILER ---------
+
+// Zones are recorded when the project defines PROFILER_ENABLED. Key P writes them to
+// profilerTracePath (open it in chrome://tracing or ui.perfetto.dev), headless runs write it at the end
+const std::string profilerTracePath = "trace.json";
+
+// --------- ALLOCATION GUARD ---------
+
+// Debug builds report every heap allocation inside UpdatePhysics, with a stack trace, once
+// this many steps have run (the first steps grow the buffers). Abort stops at the first one
+const int allocationGuardWarmupSteps = 120;
+const AllocationGuard::Action allocationGuardAction = AllocationGuard::Action::Log;
+
+// --------- FLIGHT RECORDER ---------
+
+// The last flightRecorderFrames frames are kept with their phase timings and counters. A frame
+// slower than frameBudgetMs writes the frames around it to <flightDumpPrefix><frame>.csv,
+// frameBudgetMs 0 never writes
+const size_t flightRecorderFrames = 240;
+const float frameBudgetMs = 50.0f;
+const std::string flightDumpPrefix = "flight_";
+
 // =======================================================================
 
 
 
 // Updates the window title with formatted performance metrics
-void UpdateWindowTitle(GLFWwindow* window, const Time& timeManager, const std::string& appName = "Particle Simulation")
+void UpdateWindowTitle(GLFWwindow* window, const Time& timeManager, const SimulationSystem& sim,
+    const std::string& appName = "Particle Simulation")
 {
     // Format FPS with consistent width (6 chars: ####.#)
     char fpsBuffer[32];
@@ -80,10 +195,16 @@ void UpdateWindowTitle(GLFWwindow* window, const Time& timeManager, const std::s
     char avgMspfBuffer[32];
     snprintf(avgMspfBuffer, sizeof(avgMspfBuffer), "%6.2f", timeManager.getAverageFrameTimeMs());
 
+    // Frame time distribution over the same window
+    char percentileBuffer[80];
+    snprintf(percentileBuffer, sizeof(percentileBuffer), "p50: %6.2f p95: %6.2f p99: %6.2f Max: %6.2f",
+        timeManager.getFrameTimePercentileMs(50.0), timeManager.getFrameTimePercentileMs(95.0),
+        timeManager.getFrameTimePercentileMs(99.0), timeManager.getMaxFrameTimeMs());
+
     // Combine into a nicely formatted title with fixed width fields
     std::string title = appName + " | " +
         "FPS: " + fpsBuffer + " (Avg: " + avgFpsBuffer + ") | " +
-        "MS: " + mspfBuffer + " (Avg: " + avgMspfBuffer + ")";
+        "MS: " + mspfBuffer + " (Avg: " + avgMspfBuffer + " " + percentileBuffer + ")";
 
     // Use fixed-width status indicators
     float targetFPS = 60.0f;
@@ -99,13 +220,390 @@ void UpdateWindowTitle(GLFWwindow* window, const Time& timeManager, const std::s
         title += " [Poor]    "; // Same width as other indicators
     }
 
+    // Counters of the last physics step
+    if (sim.IsCollectingStats() && !sim.GetStatsHistory().Empty())
+    {
+        const PhysicsStepStats& stats = sim.GetLastStepStats();
+        char statsBuffer[160];
+        snprintf(statsBuffer, sizeof(statsBuffer), " | Pairs: %d (%.0f%% of tests) Contacts: %.0f%% | Cell max: %d Empty: %.0f%% | Overlap max: %.3f",
+            stats.candidatePairs, stats.candidateRatio * 100.0f, stats.contactRatio * 100.0f,
+            stats.maxPerCell, stats.emptyCellFraction * 100.0f, stats.maxOverlap);
+        title += statsBuffer;
+    }
+
     // Update the window title
     glfwSetWindowTitle(window, title.c_str());
 }
 
 
-int main(void)
+// Simulation boundaries centered on the origin with the same ratio as the screen
+void GetSimulationBounds(unsigned int width, unsigned int height, Vec2& bottomLeft, Vec2& topRight)
+{
+    // Use normalized device coordinates for simplicity, then scale with view matrix
+    const float aspectRatio = (float)width / (float)height;
+
+    // Make simulation rectangle the same ratio of the screen for simplicity
+    const float simHeight = simWidth / aspectRatio;
+
+    bottomLeft = Vec2(-simWidth / 2, -simHeight / 2);
+    topRight = Vec2(simWidth / 2, simHeight / 2);
+}
+
+// Streams used by both the windowed and the headless run
+void AddParticleStreams(SimulationSystem& sim)
+{
+    sim.AddParticleStream(totalParticlesPerStream, StreamSpeed,
+        initialVelocityStream0, particleMassStream,
+        { 0.0, 0.0 });
+
+    sim.AddParticleStream(totalParticlesPerStream, StreamSpeed,
+        initialVelocityStream1,
+        particleMassStream,
+        { 1996.0, 0.0 });
+
+    sim.AddParticleStream(totalParticlesPerStream, StreamSpeed,
+        initialVelocityStream2,
+        particleMassStream,
+        { 1000.0, 0.0 });
+}
+
+// Attach the monitor to the simulation when monitorConservation is set, alerts go to the console
+void AttachConservationMonitor(SimulationSystem& sim, ConservationMonitor& monitor)
+{
+    if (!monitorConservation)
+        return;
+
+    ConservationThresholds thresholds;
+    thresholds.maxEnergyGain = maxEnergyGainPerStep;
+    thresholds.maxPenetration = maxPenetrationRadii;
+    monitor.SetThresholds(thresholds);
+    monitor.SetAlertCallback([](const ConservationSample& sample, uint32_t alerts)
+    {
+        std::cerr << "Step " << sample.step << ": " << ConservationMonitor::DescribeAlerts(alerts)
+            << " (energy " << sample.totalEnergy << ", max penetration " << sample.maxPenetration
+            << ", out of bounds " << sample.outOfBounds << ", non finite " << sample.nonFinite << ")" << std::endl;
+    });
+    sim.SetConservationMonitor(&monitor);
+}
+
+// Count a physics step and arm the allocation guard when the warm-up steps are done
+void CountStepForAllocationGuard(int& steps)
+{
+    if (++steps == allocationGuardWarmupSteps && AllocationGuard::IsEnabled())
+        AllocationGuard::Arm(allocationGuardAction);
+}
+
+// Print the policies the physics step runs with each time the scene changes them,
+// e.g. when the first particle of a stream sets the uniform mass
+void ReportPhysicsStepper(const SimulationSystem& sim, const PhysicsStepper*& current)
+{
+    const PhysicsStepper& stepper = GetPhysicsStepper(GetStepperConfig(sim, useSpacePartitioning));
+    if (&stepper == current)
+        return;
+
+    current = &stepper;
+    std::cout << "Physics step: " << stepper.GetName() << std::endl;
+}
+
+// Simulate frameCount frames at a fixed 60 fps and write each one to outputFolder,
+// no window or OpenGL context is created so this runs on machines without a GPU
+int RunHeadless(int frameCount, const std::string& outputFolder)
+{
+    Vec2 bottomLeft, topRight;
+    GetSimulationBounds(headlessWidth, headlessHeight, bottomLeft, topRight);
+
+    // Declared first so it outlives the simulation it is attached to
+    ConservationMonitor monitor;
+
+    SimulationSystem sim(bottomLeft, topRight, particleRadius, headlessWidth);
+    sim.SetParticleStorage(compactParticleStorage ? ParticleStorage::Compact : ParticleStorage::Full);
+    AddParticleStreams(sim);
+
+    AttachConservationMonitor(sim, monitor);
+    sim.SetZoom(zoom);
+
+    ThreadPool threadPool(headlessThreads);
+    SoftwareRenderer renderer(sim, threadPool, headlessWidth, headlessHeight, colorMapMaxSpeed);
+    ParticleBackend& particleBackend = renderer;
+
+    MetricsServer metrics(metricsPort, metricsLoopbackOnly);
+    if (metricsPort > 0)
+    {
+        if (metrics.Start())
+            std::cout << "Serving metrics on port " << metricsPort << std::endl;
+        else
+            std::cerr << "Metrics server off: " << metrics.GetError() << std::endl;
+    }
+
+    const float frameDeltaTime = 1.0f / 60.0f;
+    int physicsSteps = 0;
+    const PhysicsStepper* stepper = nullptr;
+
+    for (int frame = 0; frame < frameCount; frame++)
+    {
+        PROFILE_SCOPE("Frame");
+
+        for (unsigned int j = 0; j < subSteps; j++)
+        {
+            UpdatePhysics(sim, frameDeltaTime / subSteps, useSpacePartitioning, &threadPool);
+            CountStepForAllocationGuard(physicsSteps);
+            if (metrics.IsRunning())
+                metrics.RecordStep(sim.GetLastStepStats(), subSteps);
+        }
+        ReportPhysicsStepper(sim, stepper);
+
+        particleBackend.UpdateBuffers();
+        particleBackend.Render();
+
+        PROFILE_SCOPE("WriteFrame");
+        char fileName[32];
+        snprintf(fileName, sizeof(fileName), "/frame_%05d.ppm", frame);
+        if (!renderer.WriteFrame(outputFolder + fileName))
+        {
+            std::cerr << "Failed to write " << outputFolder + fileName << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << "Wrote " << frameCount << " frames to " << outputFolder << std::endl;
+    if (AllocationGuard::IsEnabled())
+        std::cout << AllocationGuard::GetViolationCount() << " allocations inside the step loop after warm-up" << std::endl;
+
+    if (Profiler::IsEnabled() && Profiler::ExportChromeTrace(profilerTracePath))
+        std::cout << "Wrote profiler trace to " << profilerTracePath << std::endl;
+    return 0;
+}
+
+
+// Time the software renderer on particleCount particles spread over the headless view, from
+// 1 to every hardware thread. Nothing is simulated or written, each of frameCount frames
+// runs UpdateBuffers and Render on the same particles and the medians are printed
+int RunHeadlessTiming(int particleCount, int frameCount)
 {
+    Vec2 bottomLeft, topRight;
+    GetSimulationBounds(headlessWidth, headlessHeight, bottomLeft, topRight);
+
+    SimulationSystem sim(bottomLeft, topRight, particleRadius, headlessWidth);
+    sim.SetParticleStorage(compactParticleStorage ? ParticleStorage::Compact : ParticleStorage::Full);
+    sim.SetZoom(zoom);
+
+    // Jittered grid over the visible rectangle, speeds spanning the whole colour scale
+    const Bounds view = sim.GetViewBounds();
+    const float viewWidth = view.topRight.x - view.bottomLeft.x;
+    const float viewHeight = view.topRight.y - view.bottomLeft.y;
+    const int cols = std::max(1, static_cast<int>(std::sqrt(particleCount * viewWidth / viewHeight)));
+    const float spacing = viewWidth / cols;
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = 0; i < particleCount; i++)
+    {
+        const Vec2 position(view.bottomLeft.x + ((i % cols) + unit(rng)) * spacing,
+            view.topRight.y - ((i / cols) + unit(rng)) * spacing);
+        const float angle = unit(rng) * 6.2831853f;
+        const float speed = unit(rng) * colorMapMaxSpeed;
+        sim.AddParticle(position, Vec2(std::cos(angle) * speed, std::sin(angle) * speed));
+    }
+
+    const int hardwareThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < hardwareThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(hardwareThreads);
+
+    printf("%d particles at %ux%u\n", particleCount, headlessWidth, headlessHeight);
+    printf("%7s %14s %10s %10s\n", "threads", "UpdateBuffers", "Render", "frame ms");
+    for (const int threads : threadCounts)
+    {
+        ThreadPool threadPool(threads);
+        SoftwareRenderer renderer(sim, threadPool, headlessWidth, headlessHeight, colorMapMaxSpeed);
+
+        // The first frame sizes the buffers and isn't timed
+        renderer.UpdateBuffers();
+        renderer.Render();
+
+        std::vector<double> updateMs, renderMs, frameMs;
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            renderer.UpdateBuffers();
+            const auto updated = std::chrono::steady_clock::now();
+            renderer.Render();
+            const auto end = std::chrono::steady_clock::now();
+
+            updateMs.push_back(std::chrono::duration<double, std::milli>(updated - start).count());
+            renderMs.push_back(std::chrono::duration<double, std::milli>(end - updated).count());
+            frameMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        const auto median = [](std::vector<double>& values)
+        {
+            std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+            return values[values.size() / 2];
+        };
+        printf("%7d %14.2f %10.2f %10.2f\n", threads, median(updateMs), median(renderMs), median(frameMs));
+    }
+    return 0;
+}
+
+
+// Toggle the overlay layers with keys 1-4, a layer flips once per key press
+void HandleOverlayKeys(GLFWwindow* window, OverlayRenderer& overlay)
+{
+    static const int keys[4] = { GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4 };
+    static const OverlayLayer layers[4] = { OverlayLayer::Bounds, OverlayLayer::GridOccupancy,
+        OverlayLayer::Contacts, OverlayLayer::Velocities };
+    static bool wasPressed[4] = { false, false, false, false };
+
+    for (int i = 0; i < 4; i++)
+    {
+        const bool pressed = glfwGetKey(window, keys[i]) == GLFW_PRESS;
+        if (pressed && !wasPressed[i])
+            overlay.ToggleLayer(layers[i]);
+        wasPressed[i] = pressed;
+    }
+}
+
+
+// Key 5 toggles the fluid surface, key E exports it. Each acts once per key press
+void HandleSurfaceKeys(GLFWwindow* window, bool& showSurface, const FluidSurface& surface)
+{
+    static bool wasTogglePressed = false;
+    static bool wasExportPressed = false;
+
+    const bool togglePressed = glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS;
+    if (togglePressed && !wasTogglePressed)
+        showSurface = !showSurface;
+    wasTogglePressed = togglePressed;
+
+    const bool exportPressed = glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS;
+    if (exportPressed && !wasExportPressed && showSurface)
+    {
+        if (surface.ExportStrips(surfaceExportPath))
+            std::cout << "Wrote " << surface.GetStripCount() << " surface strips to " << surfaceExportPath << std::endl;
+        else
+            std::cerr << "Failed to write " << surfaceExportPath << std::endl;
+    }
+    wasExportPressed = exportPressed;
+}
+
+
+// Key H shows or hides the HUD, once per key press
+void HandleHudKey(GLFWwindow* window, HudRenderer& hud)
+{
+    static bool wasPressed = false;
+
+    const bool pressed = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    if (pressed && !wasPressed)
+        hud.Toggle();
+    wasPressed = pressed;
+}
+
+
+// Add the last finished frame to the HUD graphs
+void AddHudSamples(HudRenderer& hud, const FlightRecorder& recorder, const GpuTimer& gpuTimer, const SimulationSystem& sim)
+{
+    if (recorder.GetFrames().Empty())
+        return;
+
+    const FlightFrame& frame = recorder.GetFrames().Back();
+    hud.AddSample(HudGraph::Physics, static_cast<float>(frame.phaseNs[static_cast<int>(FramePhase::Physics)] / 1e6));
+    hud.AddSample(HudGraph::Upload, static_cast<float>(frame.phaseNs[static_cast<int>(FramePhase::Upload)] / 1e6));
+    hud.AddSample(HudGraph::Render, static_cast<float>(frame.phaseNs[static_cast<int>(FramePhase::Render)] / 1e6));
+    hud.AddSample(HudGraph::Gpu, gpuTimer.GetLastMs());
+    hud.AddSample(HudGraph::Substeps, static_cast<float>(frame.physicsSteps));
+    hud.AddSample(HudGraph::Particles, static_cast<float>(sim.GetParticleCount()));
+    hud.AddSample(HudGraph::Contacts, static_cast<float>(frame.contacts));
+
+    int64_t memoryBytes = 0;
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+        memoryBytes += MemoryTracker::GetStats(static_cast<MemoryTag>(tag)).currentBytes;
+    hud.AddSample(HudGraph::Memory, static_cast<float>(memoryBytes / (1024.0 * 1024.0)));
+}
+
+
+// Key P writes the recorded profiler zones, once per key press
+void HandleProfilerKey(GLFWwindow* window)
+{
+    static bool wasPressed = false;
+
+    const bool pressed = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (pressed && !wasPressed)
+    {
+        if (!Profiler::IsEnabled())
+            std::cout << "Profiler disabled, build with PROFILER_ENABLED to record zones" << std::endl;
+        else if (Profiler::ExportChromeTrace(profilerTracePath))
+            std::cout << "Wrote profiler trace to " << profilerTracePath << std::endl;
+        else
+            std::cerr << "Failed to write " << profilerTracePath << std::endl;
+    }
+    wasPressed = pressed;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (Profiler::IsEnabled())
+        Profiler::SetThreadName("Main");
+
+    // Headless run, skips GLFW entirely
+    if (argc > 1 && std::string(argv[1]) == "--headless")
+    {
+        // Timing of the software renderer alone
+        if (argc > 2 && std::string(argv[2]) == "--time")
+        {
+            int particleCount = 1000000;
+            int frameCount = 20;
+            for (int i = 3; i < argc; i++)
+            {
+                const std::string option = argv[i];
+                if (option == "--particles" && i + 1 < argc)
+                    particleCount = std::atoi(argv[++i]);
+                else if (option == "--frames" && i + 1 < argc)
+                    frameCount = std::atoi(argv[++i]);
+                else
+                    particleCount = 0;
+            }
+            if (particleCount <= 0 || frameCount <= 0)
+            {
+                std::cerr << "Usage: " << argv[0] << " --headless --time [--particles <n>] [--frames <n>]" << std::endl;
+                return -1;
+            }
+            return RunHeadlessTiming(particleCount, frameCount);
+        }
+
+        if (argc < 4 || std::atoi(argv[2]) <= 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " --headless <frames> <output folder>" << std::endl;
+            std::cerr << "       " << argv[0] << " --headless --time [--particles <n>] [--frames <n>]" << std::endl;
+            return -1;
+        }
+        return RunHeadless(std::atoi(argv[2]), argv[3]);
+    }
+
+    // Physics timings, no window either
+    if (argc > 1 && std::string(argv[1]) == "--benchmark")
+        return RunPhysicsBenchmark(argc, argv);
+
+    // Strong and weak thread scaling of every phase
+    if (argc > 1 && std::string(argv[1]) == "--scaling")
+        return RunScalingBenchmark(argc, argv);
+
+    // Heap bytes of every subsystem from 1k to 1M particles
+    if (argc > 1 && std::string(argv[1]) == "--memory")
+        return RunMemoryReport(argc, argv);
+
+    // Golden scenarios against the stored baseline, exits with 1 on a regression
+    if (argc > 1 && std::string(argv[1]) == "--regression")
+        return RunRegression(argc, argv);
+
+    // Compact particle storage against full precision, exits with 1 past the tolerances
+    if (argc > 1 && std::string(argv[1]) == "--precision")
+        return RunPrecisionReport(argc, argv);
+
+    // Broadphase pairs against brute force on random layouts, exits with 1 on a mismatch
+    if (argc > 1 && std::string(argv[1]) == "--fuzz-broadphase")
+        return RunBroadphaseFuzzer(argc, argv);
+
     // Initialize GLFW
     if (!glfwInit())
     {
@@ -117,6 +615,7 @@ int main(void)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_DEBUG_CONTEXT ? GLFW_TRUE : GLFW_FALSE);
 
     // Window dimensions
     const unsigned int WINDOW_WIDTH = 1280;
@@ -143,6 +642,9 @@ int main(void)
         return -1;
     }
 
+    // Report GL errors through the driver callback in debug builds
+    EnableGLDebugOutput();
+
     // Print debug information
     std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
     std::cout << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
@@ -153,35 +655,20 @@ int main(void)
     { // Additional scope to avoid memory leaks
       
       // Set up simulation boundaries based on screen coordinates
-        // Use normalized device coordinates for simplicity, then scale with view matrix
-        const float aspectRatio = (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
-
-        // Make simulation rectangle the same ratio of the screen for simplicity
-        const float simHeight = simWidth / aspectRatio;
+        Vec2 bottomLeft, topRight;
+        GetSimulationBounds(WINDOW_WIDTH, WINDOW_HEIGHT, bottomLeft, topRight);
 
-        // Define simulation boundaries centered on the origin
-        Vec2 bottomLeft(-simWidth / 2, -simHeight / 2);
-        Vec2 topRight(simWidth / 2, simHeight / 2);
+        // Declared first so it outlives the simulation it is attached to
+        ConservationMonitor monitor;
 
         // Create simulation system
         SimulationSystem sim(bottomLeft, topRight, particleRadius, WINDOW_WIDTH);
+        sim.SetCollectStats(collectPhysicsStats);
+        AttachConservationMonitor(sim, monitor);
        
         // Add particle streams
-        sim.AddParticleStream(totalParticlesPerStream, StreamSpeed,
-            initialVelocityStream0, particleMassStream,
-            { 0.0, 0.0 });
-
-        
-
-        sim.AddParticleStream(totalParticlesPerStream, StreamSpeed,
-            initialVelocityStream1,
-            particleMassStream,
-            { 1996.0, 0.0 });
-
-        sim.AddParticleStream(totalParticlesPerStream, StreamSpeed,
-            initialVelocityStream2,
-            particleMassStream,
-            { 1000.0, 0.0 });
+        sim.SetParticleStorage(compactParticleStorage ? ParticleStorage::Compact : ParticleStorage::Full);
+        AddParticleStreams(sim);
 
         // Enable blending
         GLCall(glEnable(GL_BLEND));
@@ -197,21 +684,53 @@ int main(void)
         if (!IsShaderPathOk(shaderPath)) 
             return 0;
 
-        // initialize shader outside of renderer (easier but not permanent)
-        Shader shader(shaderPath);
+        // Compiles every shader once and holds the uniforms shared by all of them
+        ShaderManager shaderManager;
 
         // initialize particle renderer
-        ParticleRenderer renderer(sim, shader);
+        ParticleRenderer renderer(sim, shaderManager);
+        renderer.SetRenderMode(renderMode);
+        renderer.SetLodStride(lodStride);
+        renderer.SetDrawPath(drawPath);
+
+        // The frame loop only draws the particles through the backend interface
+        ParticleBackend& particleBackend = renderer;
+
+        // Bounds and debug layers, drawn on top of the particles
+        OverlayRenderer overlay(sim, shaderManager);
+        overlay.SetBorderStyle(borderWidth, simBorderColor);
+        overlay.SetLayerEnabled(OverlayLayer::Bounds, showBounds);
+        overlay.SetLayerEnabled(OverlayLayer::GridOccupancy, showGridOccupancy);
+        overlay.SetLayerEnabled(OverlayLayer::Contacts, showContacts);
+        overlay.SetLayerEnabled(OverlayLayer::Velocities, showVelocities);
+
+        // Shared by the physics and the fluid outline, which is only extracted while it is shown
+        ThreadPool threadPool(workerThreads);
+        FluidSurface surface(sim, threadPool);
+        bool showSurface = showFluidSurface;
+
+        // Performance graphs on top of everything, the GPU graph times the upload and draws of each frame
+        HudRenderer hud(shaderManager, hudScale);
+        hud.SetVisible(showHud);
+        GpuTimer gpuTimer;
 
         // Create time manager
         Time timeManager(1.0f / 60.0f);
 
+        // Phase timings of the last frames, dumped around slow ones
+        FlightRecorder flightRecorder(flightRecorderFrames, frameBudgetMs, flightDumpPrefix);
+
         // Initialize counter for fps 
         int counter = 0;
+        int physicsSteps = 0;
+        const PhysicsStepper* stepper = nullptr;
 
         // Main loop
         while (!glfwWindowShouldClose(window))
         {
+            PROFILE_SCOPE("Frame");
+            flightRecorder.BeginFrame();
+
             // Clear the screen
             GLCall(glClear(GL_COLOR_BUFFER_BIT));
             GLCall(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));  // Black background
@@ -219,44 +738,97 @@ int main(void)
             // Set zoom for simulation
             sim.SetZoom(zoom);
 
-            // Setup border mvp, this in the future will be inside 
-            // particle renderer of sim system (maybe)
-            glm::mat4 borderMVP = sim.GetProjMatrix() * sim.GetViewMatrix();
+            // Upload the state every shader reads this frame
+            FrameData frameData;
+            frameData.mvp = sim.GetProjMatrix() * sim.GetViewMatrix();
+            frameData.zoom = zoom;
+            frameData.pixelsPerUnit = sim.GetPixelsPerUnit();
+            frameData.maxSpeed = colorMapMaxSpeed;
+            frameData.padding = 0.0f;
+            shaderManager.UpdateFrameData(frameData);
 
             // Update physics before rendering
             int steps = timeManager.update();
-            for (int i = 0; i < steps; i++)
             {
-                for (int j = 0; j < subSteps; j++)
+                PROFILE_SCOPE("Physics");
+                FramePhaseTimer phaseTimer(flightRecorder, FramePhase::Physics);
+                for (int i = 0; i < steps; i++)
                 {
-                    UpdatePhysics(sim, timeManager.getFixedDeltaTime() / subSteps, useSpacePartitioning);
+                    for (int j = 0; j < subSteps; j++)
+                    {
+                        UpdatePhysics(sim, timeManager.getFixedDeltaTime() / subSteps, useSpacePartitioning, &threadPool);
+                        CountStepForAllocationGuard(physicsSteps);
+                        flightRecorder.RecordPhysicsStep(sim.GetLastStepStats());
+                    }
                 }
+                ReportPhysicsStepper(sim, stepper);
             }
 
+            // The GPU graph covers the upload and the draws, not the physics the CPU runs before them
+            gpuTimer.Begin();
+
             // Update buffers with new particle data
-            renderer.UpdateBuffers();
+            {
+                FramePhaseTimer phaseTimer(flightRecorder, FramePhase::Upload);
+                particleBackend.UpdateBuffers();
+            }
 
             // Render the particles 
-            renderer.Render();
+            {
+                FramePhaseTimer phaseTimer(flightRecorder, FramePhase::Render);
+                particleBackend.Render();
+            }
 
-            // Render simulation borders
-            // This implementation isn't the best but good enough
-            const auto& bounds = sim.GetBounds();
+            {
+                PROFILE_SCOPE("Overlay");
+                FramePhaseTimer phaseTimer(flightRecorder, FramePhase::Overlay);
+
+                // Add the fluid outline to the overlay
+                if (showSurface)
+                {
+                    surface.Update();
+                    for (int strip = 0; strip < surface.GetStripCount(); strip++)
+                        overlay.AddLineStrip(surface.GetStripPoints(strip), surface.GetStripPointCount(strip),
+                            surface.IsStripClosed(strip), fluidSurfaceColor);
+                }
+
+                // Render the bounds and the enabled debug layers
+                overlay.UpdateBuffers();
+                overlay.Render();
 
-            BoundsRenderer(bounds.bottomLeft, bounds.topRight, borderWidth, simBorderColor, borderMVP);
+                // Graphs of the previous frame, the current one is still running
+                AddHudSamples(hud, flightRecorder, gpuTimer, sim);
+                hud.UpdateBuffers(WINDOW_WIDTH, WINDOW_HEIGHT);
+                hud.Render();
+            }
 
             // Display fps and mspf
             if (++counter > 75)
             {
-                UpdateWindowTitle(window, timeManager);
+                UpdateWindowTitle(window, timeManager, sim);
                 counter = 0;
+
+                // Checking the files here keeps the stat calls off most frames
+                if (shaderHotReload)
+                    shaderManager.ReloadChanged();
             }
 
-            // Swap front and back buffers
-            glfwSwapBuffers(window);
+            gpuTimer.End();
+
+            // Swap front and back buffers, waits for vsync
+            {
+                PROFILE_SCOPE("SwapBuffers");
+                FramePhaseTimer phaseTimer(flightRecorder, FramePhase::Present);
+                glfwSwapBuffers(window);
+            }
 
             // Poll for and process events
             glfwPollEvents();
+            HandleOverlayKeys(window, overlay);
+            HandleSurfaceKeys(window, showSurface, surface);
+            HandleProfilerKey(window);
+            HandleHudKey(window, hud);
+            flightRecorder.EndFrame();
         }
     }
 
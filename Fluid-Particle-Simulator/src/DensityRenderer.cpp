@@ -0,0 +1,173 @@
+#include "DensityRenderer.h"
+#include "Renderer.h"
+#include "VertexBufferLayout.h"
+#include <algorithm>
+#include <cmath>
+
+// Size of a heat map texel on screen (in pixels)
+const float TEXEL_SIZE_PX = 2.0f;
+
+// Upper limit for the heat map size, only reached when zooming far into the simulation
+const int MAX_TEXTURE_SIZE = 2048;
+
+DensityRenderer::DensityRenderer(const SimulationSystem& simulation, Shader& shader)
+    : m_Simulation(simulation), m_Shader(shader), m_VertexArray(nullptr),
+    m_VertexBuffer(nullptr), m_IndexBuffer(nullptr), m_TextureID(0),
+    m_TextureWidth(0), m_TextureHeight(0), m_MaxCount(1.0f), m_Quantity(DensityQuantity::Count)
+{
+    m_TextureUniform = m_Shader.GetUniform<int>("u_Texture");
+    m_QuantityUniform = m_Shader.GetUniform<int>("u_Quantity");
+    m_MaxCountUniform = m_Shader.GetUniform<float>("u_MaxCount");
+
+    InitBuffers();
+}
+
+DensityRenderer::~DensityRenderer()
+{
+    if (m_VertexBuffer) {
+        delete m_VertexBuffer;
+        m_VertexBuffer = nullptr;
+    }
+
+    if (m_IndexBuffer) {
+        delete m_IndexBuffer;
+        m_IndexBuffer = nullptr;
+    }
+
+    if (m_VertexArray) {
+        delete m_VertexArray;
+        m_VertexArray = nullptr;
+    }
+
+    if (m_TextureID) {
+        GLCall(glDeleteTextures(1, &m_TextureID));
+    }
+}
+
+void DensityRenderer::InitBuffers()
+{
+    m_VertexArray = new VertexArray();
+
+    // The quad covers exactly the simulation bounds so the texture
+    // follows the zoom like the particles do
+    const Bounds& bounds = m_Simulation.GetBounds();
+    float quadVertices[] = {
+        // positions                                // texture coords
+        bounds.bottomLeft.x, bounds.bottomLeft.y,   0.0f, 0.0f,  // bottom left
+        bounds.topRight.x,   bounds.bottomLeft.y,   1.0f, 0.0f,  // bottom right
+        bounds.topRight.x,   bounds.topRight.y,     1.0f, 1.0f,  // top right
+        bounds.bottomLeft.x, bounds.topRight.y,     0.0f, 1.0f   // top left
+    };
+
+    unsigned int quadIndices[] = {
+        0, 1, 2,
+        2, 3, 0
+    };
+
+    m_VertexBuffer = new VertexBuffer(quadVertices, sizeof(quadVertices), GL_STATIC_DRAW);
+    m_IndexBuffer = new IndexBuffer(quadIndices, 6);
+
+    VertexBufferLayout quadLayout;
+    quadLayout.Push<float>(2);  // Position (vec2)
+    quadLayout.Push<float>(2);  // Texture coordinates (vec2)
+    m_VertexArray->AddBuffer(*m_VertexBuffer, quadLayout);
+
+    m_VertexArray->Bind();
+    m_IndexBuffer->Bind();
+    m_VertexArray->UnBind();
+    m_IndexBuffer->UnBind();
+
+    // Texture storage is allocated in UpdateResolution once the zoom is known
+    GLCall(glGenTextures(1, &m_TextureID));
+    GLCall(glBindTexture(GL_TEXTURE_2D, m_TextureID));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void DensityRenderer::UpdateResolution()
+{
+    // The projection shows (simWidth / zoom) units over the whole window width
+    const float pixelsPerUnit = m_Simulation.GetWindowWidth() * m_Simulation.GetZoom() / m_Simulation.GetSimWidth();
+
+    const int width = std::max(1, std::min(MAX_TEXTURE_SIZE,
+        static_cast<int>(std::ceil(m_Simulation.GetSimWidth() * pixelsPerUnit / TEXEL_SIZE_PX))));
+    const int height = std::max(1, std::min(MAX_TEXTURE_SIZE,
+        static_cast<int>(std::ceil(m_Simulation.GetSimHeight() * pixelsPerUnit / TEXEL_SIZE_PX))));
+
+    if (width == m_TextureWidth && height == m_TextureHeight)
+        return;
+
+    m_TextureWidth = width;
+    m_TextureHeight = height;
+    m_Bins.assign(static_cast<size_t>(width) * height * 3, 0.0f);
+
+    GLCall(glBindTexture(GL_TEXTURE_2D, m_TextureID));
+    GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, nullptr));
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+template<typename Particles>
+float DensityRenderer::BinParticles(const Particles& particles)
+{
+    const Vec2& bottomLeft = m_Simulation.GetBounds().bottomLeft;
+    const float scaleX = m_TextureWidth / m_Simulation.GetSimWidth();
+    const float scaleY = m_TextureHeight / m_Simulation.GetSimHeight();
+    float maxCount = 1.0f;
+
+    const int count = static_cast<int>(particles.size());
+    for (int i = 0; i < count; i++)
+    {
+        const Particle& particle = LoadParticle(particles, i);
+        int x = static_cast<int>((particle.position.x - bottomLeft.x) * scaleX);
+        x = (x < 0) ? 0 : ((x >= m_TextureWidth) ? m_TextureWidth - 1 : x);
+        int y = static_cast<int>((particle.position.y - bottomLeft.y) * scaleY);
+        y = (y < 0) ? 0 : ((y >= m_TextureHeight) ? m_TextureHeight - 1 : y);
+
+        float* bin = &m_Bins[(static_cast<size_t>(y) * m_TextureWidth + x) * 3];
+        bin[0] += 1.0f;
+        bin[1] += particle.velocity.length();
+        bin[2] += particle.temperature;
+        maxCount = std::max(maxCount, bin[0]);
+    }
+    return maxCount;
+}
+
+void DensityRenderer::UpdateBuffers()
+{
+    UpdateResolution();
+    std::fill(m_Bins.begin(), m_Bins.end(), 0.0f);
+
+    if (m_Simulation.GetParticleStorage() == ParticleStorage::Compact)
+        m_MaxCount = BinParticles(m_Simulation.GetCompactParticles());
+    else
+        m_MaxCount = BinParticles(m_Simulation.GetParticles());
+
+    GLCall(glBindTexture(GL_TEXTURE_2D, m_TextureID));
+    GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_TextureWidth, m_TextureHeight, GL_RGB, GL_FLOAT, m_Bins.data()));
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void DensityRenderer::Render()
+{
+    // The MVP comes from the FrameData block
+    m_Shader.Bind();
+    m_TextureUniform.Set(0);
+    m_QuantityUniform.Set(static_cast<int>(m_Quantity));
+    m_MaxCountUniform.Set(m_MaxCount);
+
+    GLCall(glActiveTexture(GL_TEXTURE0));
+    GLCall(glBindTexture(GL_TEXTURE_2D, m_TextureID));
+
+    m_VertexArray->Bind();
+    m_IndexBuffer->Bind();
+
+    GLCall(glDrawElements(GL_TRIANGLES, m_IndexBuffer->GetCount(), GL_UNSIGNED_INT, nullptr));
+
+    m_VertexArray->UnBind();
+    m_IndexBuffer->UnBind();
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+    m_Shader.UnBind();
+}
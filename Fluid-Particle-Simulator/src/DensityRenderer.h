@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "VertexArray.h"
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include "Shader.h"
+#include "physics/SimulationSystem.h"
+
+// Quantity accumulated in every texel of the heat map
+enum class DensityQuantity {
+    Count = 0,       // Number of particles (log scaled)
+    Speed = 1,       // Mean speed, same colour scale as the particle shader
+    Temperature = 2  // Mean temperature
+};
+
+// Renders the particles as a low resolution heat map instead of one quad per particle.
+// Particles are binned on the CPU into a texture aligned with the simulation bounds whose
+// texels have a fixed size on screen, then the texture is colour mapped with a single draw.
+// The GPU cost doesn't depend on the particle count.
+class DensityRenderer {
+private:
+    const SimulationSystem& m_Simulation;
+    Shader& m_Shader;
+    Uniform<int> m_TextureUniform;
+    Uniform<int> m_QuantityUniform;
+    Uniform<float> m_MaxCountUniform;
+    VertexArray* m_VertexArray;
+    VertexBuffer* m_VertexBuffer;    // Quad covering the simulation bounds
+    IndexBuffer* m_IndexBuffer;
+    unsigned int m_TextureID;
+    int m_TextureWidth;
+    int m_TextureHeight;
+    float m_MaxCount;                // Highest particle count in a texel this frame
+    DensityQuantity m_Quantity;
+    std::vector<float> m_Bins;       // count, speed sum, temperature sum for each texel
+
+    // Resize the heat map when the zoom or the window changes the on-screen size of the bounds
+    void UpdateResolution();
+
+    // Add every particle to the texel containing its center and return the highest count.
+    // Particles is the simulation's storage, compact particles are decoded here
+    template<typename Particles>
+    float BinParticles(const Particles& particles);
+
+public:
+    DensityRenderer(const SimulationSystem& simulation, Shader& shader);
+    ~DensityRenderer();
+
+    void InitBuffers();
+    void UpdateBuffers();
+    void Render();
+
+    void SetQuantity(DensityQuantity quantity) { m_Quantity = quantity; }
+    DensityQuantity GetQuantity() const { return m_Quantity; }
+};
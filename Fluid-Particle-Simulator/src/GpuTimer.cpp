@@ -0,0 +1,55 @@
+#include "GpuTimer.h"
+#include "Renderer.h"
+
+GpuTimer::GpuTimer()
+    : m_Current(0), m_LastMs(0.0f), m_HasResult(false)
+{
+    GLCall(glGenQueries(QUERY_FRAMES * 2, &m_Queries[0][0]));
+    for (bool& pending : m_Pending) {
+        pending = false;
+    }
+}
+
+GpuTimer::~GpuTimer()
+{
+    GLCall(glDeleteQueries(QUERY_FRAMES * 2, &m_Queries[0][0]));
+}
+
+void GpuTimer::ReadResults()
+{
+    // Oldest slot first, so m_LastMs ends on the newest result. m_Current is the oldest,
+    // Begin is about to overwrite it
+    for (int i = 0; i < QUERY_FRAMES; i++)
+    {
+        const int slot = (m_Current + i) % QUERY_FRAMES;
+        if (!m_Pending[slot])
+            continue;
+
+        GLint available = 0;
+        GLCall(glGetQueryObjectiv(m_Queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available));
+        if (!available)
+            continue;
+
+        GLuint64 start = 0, end = 0;
+        GLCall(glGetQueryObjectui64v(m_Queries[slot][0], GL_QUERY_RESULT, &start));
+        GLCall(glGetQueryObjectui64v(m_Queries[slot][1], GL_QUERY_RESULT, &end));
+        m_LastMs = static_cast<float>((end - start) / 1e6);
+        m_HasResult = true;
+        m_Pending[slot] = false;
+    }
+}
+
+void GpuTimer::Begin()
+{
+    ReadResults();
+
+    // A slot still pending after QUERY_FRAMES frames is overwritten, its result is lost
+    GLCall(glQueryCounter(m_Queries[m_Current][0], GL_TIMESTAMP));
+}
+
+void GpuTimer::End()
+{
+    GLCall(glQueryCounter(m_Queries[m_Current][1], GL_TIMESTAMP));
+    m_Pending[m_Current] = true;
+    m_Current = (m_Current + 1) % QUERY_FRAMES;
+}
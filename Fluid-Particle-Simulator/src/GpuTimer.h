@@ -0,0 +1,33 @@
+#pragma once
+
+// GPU time between Begin and End, read back a few frames later so the CPU never waits
+// for the result. Uses timestamp queries, which unlike GL_TIME_ELAPSED can be nested
+// inside other timer queries
+class GpuTimer {
+private:
+    // Frames in flight, results older than this are dropped
+    static const int QUERY_FRAMES = 4;
+
+    unsigned int m_Queries[QUERY_FRAMES][2];
+    bool m_Pending[QUERY_FRAMES];
+    int m_Current;          // Slot Begin writes next
+    float m_LastMs;
+    bool m_HasResult;
+
+    // Collect every finished pair without blocking
+    void ReadResults();
+
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void Begin();
+    void End();
+
+    // Latest finished measurement, 2 or 3 frames old
+    float GetLastMs() const { return m_LastMs; }
+    bool HasResult() const { return m_HasResult; }
+};
@@ -0,0 +1,328 @@
+#include "HudRenderer.h"
+#include "Renderer.h"
+#include "VertexBufferLayout.h"
+#include "core/Profiler.h"
+#include <algorithm>
+#include <cstdio>
+
+// Frames shown by each graph, one bar per frame
+const size_t HISTORY_FRAMES = 160;
+
+// Layout in font pixels, multiplied by the scale
+const float MARGIN = 8.0f;
+const float GLYPH_ADVANCE = 6.0f;
+const float LINE_HEIGHT = 10.0f;
+const float GRAPH_HEIGHT = 16.0f;
+const float ROW_GAP = 3.0f;
+// Label, value and unit of a graph take 22 glyphs, plus a gap before the bars
+const int LABEL_COLUMNS = 23;
+
+const glm::vec4 PANEL_COLOR(0.0f, 0.0f, 0.0f, 0.6f);
+const glm::vec4 GRAPH_BACKGROUND(1.0f, 1.0f, 1.0f, 0.08f);
+const glm::vec4 TEXT_COLOR(1.0f, 1.0f, 1.0f, 0.9f);
+
+// Enough for every graph and a few lines of text, the buffer grows past this when needed
+const size_t INITIAL_VERTEX_CAPACITY = 16384;
+
+// 5x7 glyphs for ASCII 32 to 126, one byte per column with the top row in bit 0.
+// Bit 7 holds descenders
+const uint8_t FONT_GLYPHS[95][5] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5F, 0x00, 0x00 }, { 0x00, 0x07, 0x00, 0x07, 0x00 }, // space ! "
+    { 0x14, 0x7F, 0x14, 0x7F, 0x14 }, { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 }, // # $ %
+    { 0x36, 0x49, 0x56, 0x20, 0x50 }, { 0x00, 0x05, 0x03, 0x00, 0x00 }, { 0x00, 0x1C, 0x22, 0x41, 0x00 }, // & ' (
+    { 0x00, 0x41, 0x22, 0x1C, 0x00 }, { 0x2A, 0x1C, 0x7F, 0x1C, 0x2A }, { 0x08, 0x08, 0x3E, 0x08, 0x08 }, // ) * +
+    { 0x00, 0xA0, 0x60, 0x00, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 }, { 0x00, 0x60, 0x60, 0x00, 0x00 }, // , - .
+    { 0x20, 0x10, 0x08, 0x04, 0x02 }, { 0x3E, 0x51, 0x49, 0x45, 0x3E }, { 0x00, 0x42, 0x7F, 0x40, 0x00 }, // / 0 1
+    { 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4B, 0x31 }, { 0x18, 0x14, 0x12, 0x7F, 0x10 }, // 2 3 4
+    { 0x27, 0x45, 0x45, 0x45, 0x39 }, { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 }, // 5 6 7
+    { 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1E }, { 0x00, 0x36, 0x36, 0x00, 0x00 }, // 8 9 :
+    { 0x00, 0x56, 0x36, 0x00, 0x00 }, { 0x08, 0x14, 0x22, 0x41, 0x00 }, { 0x14, 0x14, 0x14, 0x14, 0x14 }, // ; < =
+    { 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x51, 0x09, 0x06 }, { 0x32, 0x49, 0x79, 0x41, 0x3E }, // > ? @
+    { 0x7E, 0x11, 0x11, 0x11, 0x7E }, { 0x7F, 0x49, 0x49, 0x49, 0x36 }, { 0x3E, 0x41, 0x41, 0x41, 0x22 }, // A B C
+    { 0x7F, 0x41, 0x41, 0x22, 0x1C }, { 0x7F, 0x49, 0x49, 0x49, 0x41 }, { 0x7F, 0x09, 0x09, 0x09, 0x01 }, // D E F
+    { 0x3E, 0x41, 0x49, 0x49, 0x7A }, { 0x7F, 0x08, 0x08, 0x08, 0x7F }, { 0x00, 0x41, 0x7F, 0x41, 0x00 }, // G H I
+    { 0x20, 0x40, 0x41, 0x3F, 0x01 }, { 0x7F, 0x08, 0x14, 0x22, 0x41 }, { 0x7F, 0x40, 0x40, 0x40, 0x40 }, // J K L
+    { 0x7F, 0x02, 0x0C, 0x02, 0x7F }, { 0x7F, 0x04, 0x08, 0x10, 0x7F }, { 0x3E, 0x41, 0x41, 0x41, 0x3E }, // M N O
+    { 0x7F, 0x09, 0x09, 0x09, 0x06 }, { 0x3E, 0x41, 0x51, 0x21, 0x5E }, { 0x7F, 0x09, 0x19, 0x29, 0x46 }, // P Q R
+    { 0x46, 0x49, 0x49, 0x49, 0x31 }, { 0x01, 0x01, 0x7F, 0x01, 0x01 }, { 0x3F, 0x40, 0x40, 0x40, 0x3F }, // S T U
+    { 0x1F, 0x20, 0x40, 0x20, 0x1F }, { 0x3F, 0x40, 0x38, 0x40, 0x3F }, { 0x63, 0x14, 0x08, 0x14, 0x63 }, // V W X
+    { 0x07, 0x08, 0x70, 0x08, 0x07 }, { 0x61, 0x51, 0x49, 0x45, 0x43 }, { 0x00, 0x7F, 0x41, 0x41, 0x00 }, // Y Z [
+    { 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x7F, 0x00 }, { 0x04, 0x02, 0x01, 0x02, 0x04 }, // \ ] ^
+    { 0x40, 0x40, 0x40, 0x40, 0x40 }, { 0x00, 0x01, 0x02, 0x04, 0x00 }, { 0x20, 0x54, 0x54, 0x54, 0x78 }, // _ ` a
+    { 0x7F, 0x48, 0x44, 0x44, 0x38 }, { 0x38, 0x44, 0x44, 0x44, 0x20 }, { 0x38, 0x44, 0x44, 0x48, 0x7F }, // b c d
+    { 0x38, 0x54, 0x54, 0x54, 0x18 }, { 0x08, 0x7E, 0x09, 0x01, 0x02 }, { 0x18, 0xA4, 0xA4, 0xA4, 0x7C }, // e f g
+    { 0x7F, 0x08, 0x04, 0x04, 0x78 }, { 0x00, 0x44, 0x7D, 0x40, 0x00 }, { 0x40, 0x80, 0x84, 0x7D, 0x00 }, // h i j
+    { 0x7F, 0x10, 0x28, 0x44, 0x00 }, { 0x00, 0x41, 0x7F, 0x40, 0x00 }, { 0x7C, 0x04, 0x18, 0x04, 0x78 }, // k l m
+    { 0x7C, 0x08, 0x04, 0x04, 0x78 }, { 0x38, 0x44, 0x44, 0x44, 0x38 }, { 0xFC, 0x24, 0x24, 0x24, 0x18 }, // n o p
+    { 0x18, 0x24, 0x24, 0x24, 0xFC }, { 0x7C, 0x08, 0x04, 0x04, 0x08 }, { 0x48, 0x54, 0x54, 0x54, 0x20 }, // q r s
+    { 0x04, 0x3F, 0x44, 0x40, 0x20 }, { 0x3C, 0x40, 0x40, 0x20, 0x7C }, { 0x1C, 0x20, 0x40, 0x20, 0x1C }, // t u v
+    { 0x3C, 0x40, 0x30, 0x40, 0x3C }, { 0x44, 0x28, 0x10, 0x28, 0x44 }, { 0x1C, 0xA0, 0xA0, 0xA0, 0x7C }, // w x y
+    { 0x44, 0x64, 0x54, 0x4C, 0x44 }, { 0x00, 0x08, 0x36, 0x41, 0x00 }, { 0x00, 0x00, 0x7F, 0x00, 0x00 }, // z { |
+    { 0x00, 0x41, 0x36, 0x08, 0x00 }, { 0x08, 0x04, 0x08, 0x10, 0x08 }                                    // } ~
+};
+
+// Atlas of 16 x 6 cells of 6 x 8 texels, glyph i in cell i. The last cell is lit
+// everywhere and textures the solid quads
+const int ATLAS_COLUMNS = 16;
+const int ATLAS_ROWS = 6;
+const int CELL_WIDTH = 6;
+const int CELL_HEIGHT = 8;
+const int SOLID_CELL = ATLAS_COLUMNS * ATLAS_ROWS - 1;
+const float SOLID_U = (SOLID_CELL % ATLAS_COLUMNS) * CELL_WIDTH + 0.5f * CELL_WIDTH;
+const float SOLID_V = (SOLID_CELL / ATLAS_COLUMNS) * CELL_HEIGHT + 0.5f * CELL_HEIGHT;
+
+// Label, unit, decimals and colour of each graph
+struct GraphStyle {
+    const char* label;
+    const char* unit;
+    int decimals;
+    glm::vec4 color;
+};
+
+const GraphStyle GRAPH_STYLES[HUD_GRAPH_COUNT] = {
+    { "physics",   "ms", 2, glm::vec4(1.0f, 0.55f, 0.2f, 0.9f) },
+    { "upload",    "ms", 2, glm::vec4(0.3f, 0.8f, 1.0f, 0.9f) },
+    { "render",    "ms", 2, glm::vec4(0.4f, 1.0f, 0.4f, 0.9f) },
+    { "gpu",       "ms", 2, glm::vec4(1.0f, 0.3f, 0.8f, 0.9f) },
+    { "substeps",  "",   0, glm::vec4(0.9f, 0.9f, 0.9f, 0.9f) },
+    { "particles", "",   0, glm::vec4(1.0f, 1.0f, 0.3f, 0.9f) },
+    { "contacts",  "",   0, glm::vec4(1.0f, 0.35f, 0.35f, 0.9f) },
+    { "memory",    "MB", 1, glm::vec4(0.6f, 0.6f, 1.0f, 0.9f) }
+};
+
+HudRenderer::HudRenderer(ShaderManager& shaderManager, int scale)
+    : m_Shader(shaderManager.Load("res/shaders/HudShader.shader")), m_VertexArray(nullptr),
+    m_VertexBuffer(nullptr), m_FontTexture(0), m_VertexCount(0),
+    m_History(HUD_GRAPH_COUNT, RingBuffer<float>(HISTORY_FRAMES)), m_Scale(std::max(scale, 1)),
+    m_ScreenSize(1.0f, 1.0f), m_Visible(true), m_CostMs(0.0f), m_PendingCostMs(0.0f)
+{
+    m_ScreenSizeUniform = m_Shader.GetUniform<glm::vec2>("u_ScreenSize");
+    m_FontUniform = m_Shader.GetUniform<int>("u_Font");
+
+    m_Vertices.reserve(INITIAL_VERTEX_CAPACITY);
+
+    m_VertexArray = new VertexArray();
+    m_VertexBuffer = new VertexBuffer(nullptr, INITIAL_VERTEX_CAPACITY * sizeof(HudVertex), GL_DYNAMIC_DRAW);
+
+    VertexBufferLayout layout;
+    layout.Push<float>(2);          // Position (vec2)
+    layout.Push<float>(2);          // Atlas texel (vec2)
+    layout.Push<unsigned char>(4);  // Colour (normalized RGBA)
+    m_VertexArray->AddBuffer(*m_VertexBuffer, layout);
+    m_VertexArray->UnBind();
+
+    CreateFontTexture();
+}
+
+HudRenderer::~HudRenderer()
+{
+    if (m_FontTexture) {
+        GLCall(glDeleteTextures(1, &m_FontTexture));
+        m_FontTexture = 0;
+    }
+
+    if (m_VertexBuffer) {
+        delete m_VertexBuffer;
+        m_VertexBuffer = nullptr;
+    }
+
+    if (m_VertexArray) {
+        delete m_VertexArray;
+        m_VertexArray = nullptr;
+    }
+}
+
+void HudRenderer::CreateFontTexture()
+{
+    const int width = ATLAS_COLUMNS * CELL_WIDTH;
+    const int height = ATLAS_ROWS * CELL_HEIGHT;
+    std::vector<uint8_t> texels(static_cast<size_t>(width) * height, 0);
+
+    // Texel row 0 is the top of the glyph, the shader fetches texels by index so the
+    // atlas doesn't need to follow the bottom-up OpenGL convention
+    for (int glyph = 0; glyph <= SOLID_CELL; glyph++)
+    {
+        const int cellX = (glyph % ATLAS_COLUMNS) * CELL_WIDTH;
+        const int cellY = (glyph / ATLAS_COLUMNS) * CELL_HEIGHT;
+        for (int column = 0; column < CELL_WIDTH; column++)
+        {
+            for (int row = 0; row < CELL_HEIGHT; row++)
+            {
+                bool lit = glyph == SOLID_CELL;
+                if (glyph < 95 && column < 5)
+                    lit = (FONT_GLYPHS[glyph][column] >> row) & 1;
+                texels[static_cast<size_t>(cellY + row) * width + cellX + column] = lit ? 255 : 0;
+            }
+        }
+    }
+
+    GLCall(glGenTextures(1, &m_FontTexture));
+    GLCall(glBindTexture(GL_TEXTURE_2D, m_FontTexture));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data()));
+    GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void HudRenderer::AddQuad(float x0, float y0, float x1, float y1, float u, float v, float texWidth, float texHeight, const glm::vec4& color)
+{
+    HudVertex corners[4];
+    const float xs[4] = { x0, x1, x1, x0 };
+    const float ys[4] = { y0, y0, y1, y1 };
+    const float us[4] = { u, u + texWidth, u + texWidth, u };
+    const float vs[4] = { v, v, v + texHeight, v + texHeight };
+    for (int i = 0; i < 4; i++)
+    {
+        corners[i].x = xs[i];
+        corners[i].y = ys[i];
+        corners[i].u = us[i];
+        corners[i].v = vs[i];
+        for (int c = 0; c < 4; c++) {
+            corners[i].color[c] = static_cast<uint8_t>(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+    }
+
+    m_Vertices.push_back(corners[0]);
+    m_Vertices.push_back(corners[1]);
+    m_Vertices.push_back(corners[2]);
+    m_Vertices.push_back(corners[2]);
+    m_Vertices.push_back(corners[3]);
+    m_Vertices.push_back(corners[0]);
+}
+
+void HudRenderer::AddRect(float x0, float y0, float x1, float y1, const glm::vec4& color)
+{
+    AddQuad(x0, y0, x1, y1, SOLID_U, SOLID_V, 0.0f, 0.0f, color);
+}
+
+float HudRenderer::AddText(float x, float y, const char* text, const glm::vec4& color)
+{
+    const float scale = static_cast<float>(m_Scale);
+    for (const char* character = text; *character; character++)
+    {
+        int glyph = static_cast<unsigned char>(*character) - 32;
+        if (glyph < 0 || glyph >= 95)
+            glyph = '?' - 32;
+
+        // Spaces only move the pen
+        if (glyph != 0)
+        {
+            const float u = static_cast<float>((glyph % ATLAS_COLUMNS) * CELL_WIDTH);
+            const float v = static_cast<float>((glyph / ATLAS_COLUMNS) * CELL_HEIGHT);
+            AddQuad(x, y, x + 5.0f * scale, y + CELL_HEIGHT * scale, u, v, 5.0f, static_cast<float>(CELL_HEIGHT), color);
+        }
+        x += GLYPH_ADVANCE * scale;
+    }
+    return x;
+}
+
+void HudRenderer::AddGraph(HudGraph graph, float x, float y)
+{
+    const GraphStyle& style = GRAPH_STYLES[static_cast<int>(graph)];
+    const RingBuffer<float>& history = m_History[static_cast<int>(graph)];
+    const float scale = static_cast<float>(m_Scale);
+
+    float maxValue = 0.0f;
+    for (size_t i = 0; i < history.Size(); i++)
+        maxValue = std::max(maxValue, history[i]);
+    const float last = history.Empty() ? 0.0f : history.Back();
+
+    // Label and latest value, then the bars scaled to the largest value in the window
+    char label[48];
+    snprintf(label, sizeof(label), "%-9s %9.*f %s", style.label, style.decimals, last, style.unit);
+    AddText(x, y + (GRAPH_HEIGHT - CELL_HEIGHT) * 0.5f * scale, label, TEXT_COLOR);
+
+    const float graphX = x + LABEL_COLUMNS * GLYPH_ADVANCE * scale;
+    const float graphBottom = y + GRAPH_HEIGHT * scale;
+    AddRect(graphX, y, graphX + HISTORY_FRAMES * scale, graphBottom, GRAPH_BACKGROUND);
+
+    // Newest sample on the right edge
+    const float barX = graphX + (HISTORY_FRAMES - history.Size()) * scale;
+    if (maxValue > 0.0f)
+    {
+        for (size_t i = 0; i < history.Size(); i++)
+        {
+            const float height = history[i] / maxValue * GRAPH_HEIGHT * scale;
+            if (height <= 0.0f) continue;
+            AddRect(barX + i * scale, graphBottom - height, barX + (i + 1) * scale, graphBottom, style.color);
+        }
+    }
+
+    snprintf(label, sizeof(label), "max %.*f", style.decimals, maxValue);
+    AddText(graphX + (HISTORY_FRAMES + 4.0f) * scale, y + (GRAPH_HEIGHT - CELL_HEIGHT) * 0.5f * scale, label, TEXT_COLOR);
+}
+
+void HudRenderer::UpdateBuffers(int screenWidth, int screenHeight)
+{
+    m_VertexCount = 0;
+    if (!m_Visible)
+    {
+        m_CostMs = 0.0f;
+        return;
+    }
+
+    const uint64_t start = Profiler::Now();
+    const float scale = static_cast<float>(m_Scale);
+    m_ScreenSize = glm::vec2(static_cast<float>(screenWidth), static_cast<float>(screenHeight));
+
+    // Panel behind everything, sized for the title line and the graph rows
+    const float left = MARGIN * scale;
+    const float top = MARGIN * scale;
+    const float rowHeight = (GRAPH_HEIGHT + ROW_GAP) * scale;
+    const float width = (LABEL_COLUMNS * GLYPH_ADVANCE + HISTORY_FRAMES + 4.0f + 12.0f * GLYPH_ADVANCE) * scale;
+    const float height = LINE_HEIGHT * scale + HUD_GRAPH_COUNT * rowHeight;
+    AddRect(left - 4.0f * scale, top - 4.0f * scale, left + width, top + height + 2.0f * scale, PANEL_COLOR);
+
+    char title[64];
+    snprintf(title, sizeof(title), "HUD (H)  cost %.3f ms", m_CostMs);
+    AddText(left, top, title, TEXT_COLOR);
+
+    float y = top + LINE_HEIGHT * scale;
+    for (int graph = 0; graph < HUD_GRAPH_COUNT; graph++)
+    {
+        AddGraph(static_cast<HudGraph>(graph), left, y);
+        y += rowHeight;
+    }
+
+    m_VertexCount = m_Vertices.size();
+    const size_t bytes = m_VertexCount * sizeof(HudVertex);
+    if (bytes > m_VertexBuffer->GetSize()) {
+        m_VertexBuffer->Resize(bytes * 2);
+    }
+
+    m_VertexBuffer->Bind();
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_Vertices.data()));
+    m_VertexBuffer->UnBind();
+
+    // The vector keeps its capacity so steady frames don't allocate
+    m_Vertices.clear();
+    m_PendingCostMs = static_cast<float>((Profiler::Now() - start) / 1e6);
+}
+
+void HudRenderer::Render()
+{
+    if (m_VertexCount == 0)
+        return;
+
+    const uint64_t start = Profiler::Now();
+
+    m_Shader.Bind();
+    m_ScreenSizeUniform.Set(m_ScreenSize);
+    m_FontUniform.Set(0);
+
+    GLCall(glActiveTexture(GL_TEXTURE0));
+    GLCall(glBindTexture(GL_TEXTURE_2D, m_FontTexture));
+    m_VertexArray->Bind();
+
+    GLCall(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(m_VertexCount)));
+
+    m_VertexArray->UnBind();
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+
+    m_VertexCount = 0;
+    m_CostMs = m_PendingCostMs + static_cast<float>((Profiler::Now() - start) / 1e6);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "VertexArray.h"
+#include "VertexBuffer.h"
+#include "Shader.h"
+#include "ShaderManager.h"
+#include "core/RingBuffer.h"
+#include "glm/glm.hpp"
+
+// Values the HUD keeps a rolling graph of, one sample per frame
+enum class HudGraph {
+    Physics = 0,    // CPU ms of the physics steps
+    Upload = 1,     // CPU ms writing the particle instance data
+    Render = 2,     // CPU ms of the draw calls
+    Gpu = 3,        // GPU ms of the upload and draws, from timer queries
+    Substeps = 4,   // Physics steps run this frame
+    Particles = 5,
+    Contacts = 6,
+    Memory = 7,     // MB held by the MemoryTracker subsystems
+    Count = 8
+};
+
+const int HUD_GRAPH_COUNT = static_cast<int>(HudGraph::Count);
+
+// Vertex of a HUD quad, 20 bytes
+struct HudVertex {
+    float x, y;         // Pixels from the top left corner of the window
+    float u, v;         // Font atlas texels
+    uint8_t color[4];   // RGBA
+};
+
+// Text and graphs drawn in window pixels on top of everything else. Glyphs come from a
+// built-in 5x7 bitmap font uploaded once as a small texture, so text and graph bars are
+// all quads of one buffer and the whole HUD is a single draw call. The CPU time of
+// UpdateBuffers and Render is measured and shown in the HUD itself
+class HudRenderer {
+private:
+    Shader& m_Shader;
+    Uniform<glm::vec2> m_ScreenSizeUniform;
+    Uniform<int> m_FontUniform;
+    VertexArray* m_VertexArray;
+    VertexBuffer* m_VertexBuffer;
+    unsigned int m_FontTexture;
+    std::vector<HudVertex> m_Vertices;
+    size_t m_VertexCount;           // Vertices uploaded by the last UpdateBuffers
+    std::vector<RingBuffer<float>> m_History;
+    int m_Scale;                    // Screen pixels per font pixel
+    glm::vec2 m_ScreenSize;
+    bool m_Visible;
+    float m_CostMs;                 // CPU time of the last UpdateBuffers and Render
+    float m_PendingCostMs;
+
+    void CreateFontTexture();
+
+    // Quad between two pixel corners, textured from the atlas rectangle starting at texel
+    void AddQuad(float x0, float y0, float x1, float y1, float u, float v, float texWidth, float texHeight, const glm::vec4& color);
+    void AddRect(float x0, float y0, float x1, float y1, const glm::vec4& color);
+    // Returns the x after the last glyph
+    float AddText(float x, float y, const char* text, const glm::vec4& color);
+    void AddGraph(HudGraph graph, float x, float y);
+
+public:
+    // scale enlarges text and graphs for high resolution screens
+    HudRenderer(ShaderManager& shaderManager, int scale = 1);
+    ~HudRenderer();
+
+    HudRenderer(const HudRenderer&) = delete;
+    HudRenderer& operator=(const HudRenderer&) = delete;
+
+    void SetVisible(bool visible) { m_Visible = visible; }
+    bool IsVisible() const { return m_Visible; }
+    void Toggle() { m_Visible = !m_Visible; }
+
+    // Add this frame's value of a graph. Samples are kept while the HUD is hidden
+    void AddSample(HudGraph graph, float value) { m_History[static_cast<int>(graph)].Push(value); }
+
+    // Build the text and graphs for a window of this size and upload them
+    void UpdateBuffers(int screenWidth, int screenHeight);
+
+    // Draw what the last UpdateBuffers uploaded
+    void Render();
+
+    float GetCostMs() const { return m_CostMs; }
+};
@@ -0,0 +1,284 @@
+#include "OverlayRenderer.h"
+#include "Renderer.h"
+#include "VertexBufferLayout.h"
+#include <algorithm>
+#include <cmath>
+
+// Opacity of the occupancy tint, low enough to see the particles underneath
+const float OCCUPANCY_ALPHA = 0.35f;
+
+// Velocity vectors show the distance travelled in this many seconds
+const float VELOCITY_LINE_SECONDS = 0.1f;
+
+// Colour of the velocity vectors
+const glm::vec4 VELOCITY_COLOR(1.0f, 1.0f, 1.0f, 0.6f);
+
+// Vertices reserved up front, the buffers grow past this when needed
+const size_t INITIAL_VERTEX_CAPACITY = 4096;
+
+// Blue -> green -> red as t goes from 0 to 1
+static glm::vec4 HeatColor(float t, float alpha)
+{
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    if (t < 0.5f)
+        return glm::vec4(0.0f, t * 2.0f, 1.0f - t * 2.0f, alpha);
+    return glm::vec4((t - 0.5f) * 2.0f, 1.0f - (t - 0.5f) * 2.0f, 0.0f, alpha);
+}
+
+OverlayRenderer::OverlayRenderer(const SimulationSystem& simulation, ShaderManager& shaderManager)
+    : m_Simulation(simulation), m_Shader(shaderManager.Load("res/shaders/OverlayShader.shader")),
+    m_VertexArray(nullptr), m_VertexBuffer(nullptr), m_TriangleCount(0), m_LineCount(0),
+    m_BorderWidth(2.0f), m_BorderColor(1.0f, 1.0f, 1.0f, 0.5f)
+{
+    for (bool& enabled : m_LayerEnabled) {
+        enabled = false;
+    }
+    m_LayerEnabled[static_cast<int>(OverlayLayer::Bounds)] = true;
+
+    m_Triangles.reserve(INITIAL_VERTEX_CAPACITY);
+    m_Lines.reserve(INITIAL_VERTEX_CAPACITY);
+
+    m_VertexArray = new VertexArray();
+    m_VertexBuffer = new VertexBuffer(nullptr, INITIAL_VERTEX_CAPACITY * sizeof(OverlayVertex), GL_DYNAMIC_DRAW);
+
+    VertexBufferLayout layout;
+    layout.Push<float>(2);          // Position (vec2)
+    layout.Push<unsigned char>(4);  // Colour (normalized RGBA)
+    m_VertexArray->AddBuffer(*m_VertexBuffer, layout);
+    m_VertexArray->UnBind();
+}
+
+OverlayRenderer::~OverlayRenderer()
+{
+    if (m_VertexBuffer) {
+        delete m_VertexBuffer;
+        m_VertexBuffer = nullptr;
+    }
+
+    if (m_VertexArray) {
+        delete m_VertexArray;
+        m_VertexArray = nullptr;
+    }
+}
+
+inline void OverlayRenderer::AddVertex(std::vector<OverlayVertex>& vertices, const Vec2& position, const glm::vec4& color)
+{
+    OverlayVertex vertex;
+    vertex.x = position.x;
+    vertex.y = position.y;
+    for (int i = 0; i < 4; i++) {
+        vertex.color[i] = static_cast<uint8_t>(std::min(std::max(color[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+    vertices.push_back(vertex);
+}
+
+void OverlayRenderer::AddLine(const Vec2& start, const Vec2& end, const glm::vec4& color)
+{
+    AddVertex(m_Lines, start, color);
+    AddVertex(m_Lines, end, color);
+}
+
+void OverlayRenderer::AddQuad(const Vec2& bottomLeft, const Vec2& topRight, const glm::vec4& color)
+{
+    const Vec2 bottomRight(topRight.x, bottomLeft.y);
+    const Vec2 topLeft(bottomLeft.x, topRight.y);
+
+    AddVertex(m_Triangles, bottomLeft, color);
+    AddVertex(m_Triangles, bottomRight, color);
+    AddVertex(m_Triangles, topRight, color);
+
+    AddVertex(m_Triangles, topRight, color);
+    AddVertex(m_Triangles, topLeft, color);
+    AddVertex(m_Triangles, bottomLeft, color);
+}
+
+void OverlayRenderer::AddRectOutline(const Vec2& bottomLeft, const Vec2& topRight, float width, const glm::vec4& color)
+{
+    // Four bands outside the rectangle, the bottom and top ones cover the corners
+    AddQuad(Vec2(bottomLeft.x - width, bottomLeft.y - width), Vec2(topRight.x + width, bottomLeft.y), color);
+    AddQuad(Vec2(bottomLeft.x - width, topRight.y), Vec2(topRight.x + width, topRight.y + width), color);
+    AddQuad(Vec2(bottomLeft.x - width, bottomLeft.y), Vec2(bottomLeft.x, topRight.y), color);
+    AddQuad(Vec2(topRight.x, bottomLeft.y), Vec2(topRight.x + width, topRight.y), color);
+}
+
+void OverlayRenderer::AddLineStrip(const Vec2* points, size_t count, bool closed, const glm::vec4& color)
+{
+    if (count < 2) return;
+
+    for (size_t i = 0; i + 1 < count; i++) {
+        AddLine(points[i], points[i + 1], color);
+    }
+    if (closed) {
+        AddLine(points[count - 1], points[0], color);
+    }
+}
+
+void OverlayRenderer::AddGridOccupancy()
+{
+    const SpatialGrid* grid = m_Simulation.GetSpatialGrid();
+    if (!grid) return;
+
+    const Bounds view = m_Simulation.GetViewBounds();
+    int minX, minY, maxX, maxY;
+    grid->GetCellRange(view.bottomLeft, view.topRight, minX, minY, maxX, maxY);
+
+    // Scale the heat to the fullest visible cell
+    size_t maxCount = 1;
+    for (int y = minY; y <= maxY; y++)
+        for (int x = minX; x <= maxX; x++)
+            maxCount = std::max(maxCount, grid->GetCell(x, y).size());
+
+    const float cellSize = grid->GetCellSize();
+    const Vec2& origin = grid->GetMinBound();
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+        {
+            const size_t count = grid->GetCell(x, y).size();
+            if (count == 0) continue;
+
+            const Vec2 cellMin(origin.x + x * cellSize, origin.y + y * cellSize);
+            const Vec2 cellMax(cellMin.x + cellSize, cellMin.y + cellSize);
+            AddQuad(cellMin, cellMax, HeatColor(static_cast<float>(count) / maxCount, OCCUPANCY_ALPHA));
+        }
+    }
+}
+
+template<typename Particles>
+void OverlayRenderer::AddContacts(const Particles& particles)
+{
+    const SpatialGrid* grid = m_Simulation.GetSpatialGrid();
+    if (!grid) return;
+
+    const float radius = m_Simulation.GetParticleRadius();
+    const float contactDistance = 2.0f * radius;
+
+    const Bounds view = m_Simulation.GetViewBounds();
+    int minX, minY, maxX, maxY;
+    grid->GetCellRange(view.bottomLeft, view.topRight, minX, minY, maxX, maxY);
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+        {
+            for (const int a : grid->GetCell(x, y))
+            {
+                const Vec2 positionA = GetParticlePosition(particles, a);
+
+                // Every neighbour, the index test keeps each pair once
+                for (int ny = std::max(0, y - 1); ny <= std::min(grid->GetGridHeight() - 1, y + 1); ny++)
+                {
+                    for (int nx = std::max(0, x - 1); nx <= std::min(grid->GetGridWidth() - 1, x + 1); nx++)
+                    {
+                        for (const int b : grid->GetCell(nx, ny))
+                        {
+                            if (b <= a) continue;
+
+                            const Vec2 delta = GetParticlePosition(particles, b) - positionA;
+                            const float distanceSq = delta.length_sq();
+                            if (distanceSq >= contactDistance * contactDistance || distanceSq == 0.0f) continue;
+
+                            // Normal through the middle of the overlap, one radius long
+                            const float distance = std::sqrt(distanceSq);
+                            const Vec2 normal = delta / distance;
+                            const Vec2 middle = positionA + delta * 0.5f;
+                            const float penetration = contactDistance - distance;
+                            const glm::vec4 color(1.0f, 1.0f - std::min(penetration / radius, 1.0f), 0.0f, 0.9f);
+                            AddLine(middle - normal * (radius * 0.5f), middle + normal * (radius * 0.5f), color);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<typename Particles>
+void OverlayRenderer::AddVelocities(const Particles& particles)
+{
+    const Bounds view = m_Simulation.GetViewBounds();
+    const int count = static_cast<int>(particles.size());
+    for (int i = 0; i < count; i++)
+    {
+        const Particle& particle = LoadParticle(particles, i);
+        const Vec2& position = particle.position;
+        if (position.x < view.bottomLeft.x || position.x > view.topRight.x ||
+            position.y < view.bottomLeft.y || position.y > view.topRight.y)
+            continue;
+
+        AddLine(position, position + particle.velocity * VELOCITY_LINE_SECONDS, VELOCITY_COLOR);
+    }
+}
+
+void OverlayRenderer::UpdateBuffers()
+{
+    if (IsLayerEnabled(OverlayLayer::Bounds)) {
+        const Bounds& bounds = m_Simulation.GetBounds();
+        AddRectOutline(bounds.bottomLeft, bounds.topRight, m_BorderWidth, m_BorderColor);
+    }
+
+    if (IsLayerEnabled(OverlayLayer::GridOccupancy))
+        AddGridOccupancy();
+
+    const bool compact = m_Simulation.GetParticleStorage() == ParticleStorage::Compact;
+    if (IsLayerEnabled(OverlayLayer::Contacts)) {
+        if (compact)
+            AddContacts(m_Simulation.GetCompactParticles());
+        else
+            AddContacts(m_Simulation.GetParticles());
+    }
+
+    if (IsLayerEnabled(OverlayLayer::Velocities)) {
+        if (compact)
+            AddVelocities(m_Simulation.GetCompactParticles());
+        else
+            AddVelocities(m_Simulation.GetParticles());
+    }
+
+    m_TriangleCount = m_Triangles.size();
+    m_LineCount = m_Lines.size();
+    if (m_TriangleCount + m_LineCount == 0)
+        return;
+
+    // Triangles first, lines right after them in the same buffer
+    const size_t triangleBytes = m_TriangleCount * sizeof(OverlayVertex);
+    const size_t lineBytes = m_LineCount * sizeof(OverlayVertex);
+    if (triangleBytes + lineBytes > m_VertexBuffer->GetSize()) {
+        m_VertexBuffer->Resize((triangleBytes + lineBytes) * 2);
+    }
+
+    m_VertexBuffer->Bind();
+    if (m_TriangleCount > 0) {
+        GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, triangleBytes, m_Triangles.data()));
+    }
+    if (m_LineCount > 0) {
+        GLCall(glBufferSubData(GL_ARRAY_BUFFER, triangleBytes, lineBytes, m_Lines.data()));
+    }
+    m_VertexBuffer->UnBind();
+
+    // The vectors keep their capacity so steady frames don't allocate
+    m_Triangles.clear();
+    m_Lines.clear();
+}
+
+void OverlayRenderer::Render()
+{
+    if (m_TriangleCount + m_LineCount == 0)
+        return;
+
+    // The MVP comes from the FrameData block
+    m_Shader.Bind();
+    m_VertexArray->Bind();
+
+    if (m_TriangleCount > 0) {
+        GLCall(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(m_TriangleCount)));
+    }
+    if (m_LineCount > 0) {
+        GLCall(glDrawArrays(GL_LINES, static_cast<GLsizei>(m_TriangleCount), static_cast<GLsizei>(m_LineCount)));
+    }
+
+    m_VertexArray->UnBind();
+
+    m_TriangleCount = 0;
+    m_LineCount = 0;
+}
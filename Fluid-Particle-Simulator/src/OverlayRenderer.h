@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "VertexArray.h"
+#include "VertexBuffer.h"
+#include "Shader.h"
+#include "ShaderManager.h"
+#include "physics/SimulationSystem.h"
+#include "glm/glm.hpp"
+
+// Built-in debug layers, each one can be toggled independently
+enum class OverlayLayer {
+    Bounds = 0,         // Outline of the simulation bounds
+    GridOccupancy = 1,  // Spatial grid cells tinted by how many particles they hold
+    Contacts = 2,       // Normal of every overlapping pair, coloured by penetration depth
+    Velocities = 3,     // Velocity vector of every visible particle
+    Count = 4
+};
+
+// Vertex of an overlay primitive, 12 bytes
+struct OverlayVertex {
+    float x, y;         // Simulation units
+    uint8_t color[4];   // RGBA
+};
+
+// Collects debug lines and quads for one frame and draws them all with at most two
+// draw calls (triangles, then lines) from a single dynamic buffer.
+// Any subsystem can add primitives between Render calls, the built-in layers are
+// generated in UpdateBuffers. With every layer off and nothing added, UpdateBuffers
+// and Render return immediately.
+class OverlayRenderer {
+private:
+    const SimulationSystem& m_Simulation;
+    Shader& m_Shader;
+    VertexArray* m_VertexArray;
+    VertexBuffer* m_VertexBuffer;
+    std::vector<OverlayVertex> m_Triangles;
+    std::vector<OverlayVertex> m_Lines;
+    size_t m_TriangleCount;         // Vertices uploaded by the last UpdateBuffers
+    size_t m_LineCount;
+    bool m_LayerEnabled[static_cast<int>(OverlayLayer::Count)];
+    float m_BorderWidth;
+    glm::vec4 m_BorderColor;
+
+    void AddVertex(std::vector<OverlayVertex>& vertices, const Vec2& position, const glm::vec4& color);
+
+    void AddGridOccupancy();
+
+    // Particles is the simulation's storage, compact particles are decoded here
+    template<typename Particles>
+    void AddContacts(const Particles& particles);
+    template<typename Particles>
+    void AddVelocities(const Particles& particles);
+
+public:
+    OverlayRenderer(const SimulationSystem& simulation, ShaderManager& shaderManager);
+    ~OverlayRenderer();
+
+    void SetLayerEnabled(OverlayLayer layer, bool enabled) { m_LayerEnabled[static_cast<int>(layer)] = enabled; }
+    bool IsLayerEnabled(OverlayLayer layer) const { return m_LayerEnabled[static_cast<int>(layer)]; }
+    void ToggleLayer(OverlayLayer layer) { SetLayerEnabled(layer, !IsLayerEnabled(layer)); }
+
+    // Outline drawn by the Bounds layer, width in simulation units outside the bounds
+    void SetBorderStyle(float width, const glm::vec4& color) { m_BorderWidth = width; m_BorderColor = color; }
+
+    // Primitives in simulation units, add them before UpdateBuffers. They are drawn once
+    void AddLine(const Vec2& start, const Vec2& end, const glm::vec4& color);
+    void AddQuad(const Vec2& bottomLeft, const Vec2& topRight, const glm::vec4& color);
+    void AddRectOutline(const Vec2& bottomLeft, const Vec2& topRight, float width, const glm::vec4& color);
+    // Polyline through count points, closed adds the segment back to the first point
+    void AddLineStrip(const Vec2* points, size_t count, bool closed, const glm::vec4& color);
+
+    // Generate the enabled layers and upload them with the added primitives
+    void UpdateBuffers();
+
+    // Draw what the last UpdateBuffers uploaded
+    void Render();
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+// Draws the simulation's particles once per frame, UpdateBuffers then Render.
+// ParticleRenderer does it with OpenGL, SoftwareRenderer on the CPU into an image
+class ParticleBackend {
+public:
+    virtual ~ParticleBackend() {}
+
+    // Read the particles of the current state
+    virtual void UpdateBuffers() = 0;
+
+    // Draw what the last UpdateBuffers read
+    virtual void Render() = 0;
+};
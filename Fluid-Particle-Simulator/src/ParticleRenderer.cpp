@@ -1,11 +1,42 @@
 #include "ParticleRenderer.h"
 #include "Renderer.h"
 #include "VertexBufferLayout.h"
+#include "core/Profiler.h"
 #include <iostream>
+#include <cmath>
 
-ParticleRenderer::ParticleRenderer(const SimulationSystem& simulation, const Shader& shader)
-    : m_Simulation(simulation), m_Shader(shader), m_VertexArray(nullptr),
-    m_VertexBuffer(nullptr), m_InstanceBuffer(nullptr), m_IndexBuffer(nullptr)
+// In auto mode particles smaller than this on screen (in pixels) are drawn as a heat map
+const float DENSITY_MIN_DIAMETER_PX = 2.0f;
+
+// In auto mode the heat map is used when every pixel is covered by this many particles on average
+const float DENSITY_MAX_OVERDRAW = 4.0f;
+
+// Frames timed for each draw path before the auto mode picks the fastest
+const int DRAW_PATH_BENCHMARK_FRAMES = 8;
+
+// Below this many visible particles fixed costs dominate the timings, so the benchmark waits
+const size_t DRAW_PATH_BENCHMARK_MIN_PARTICLES = 1000;
+
+// Names used when printing the draw path benchmark
+const char* DRAW_PATH_NAMES[3] = { "instanced quads", "point sprites", "vertex pulling" };
+
+// With LOD enabled, cells whose particles are smaller than this on screen (in pixels) are decimated
+const float LOD_MIN_DIAMETER_PX = 3.0f;
+
+// With LOD enabled, cells where the particle area exceeds the cell area this many times are decimated
+const float LOD_MAX_CELL_COVERAGE = 1.0f;
+
+ParticleRenderer::ParticleRenderer(const SimulationSystem& simulation, ShaderManager& shaderManager)
+    : m_Simulation(simulation), m_ShaderManager(shaderManager),
+    m_Shader(shaderManager.Load("res/shaders/ParticleShader.shader")), m_VertexArray(nullptr),
+    m_VertexBuffer(nullptr), m_InstanceBuffer(nullptr), m_IndexBuffer(nullptr),
+    m_DensityRenderer(nullptr), m_RenderMode(ParticleRenderMode::Auto), m_UsingDensity(false),
+    m_VisibleCount(0), m_LodStride(1), m_PointShader(nullptr), m_PullingShader(nullptr),
+    m_PointVertexArray(nullptr), m_EmptyVertexArray(nullptr), m_InstanceTexture(0),
+    m_MaxPointSize(1.0f), m_MaxTextureBufferSize(0), m_DrawPath(ParticleDrawPath::Auto),
+    m_TimerQuery(0), m_QueryPending(false), m_PendingPath(ParticleDrawPath::InstancedQuads),
+    m_PendingCount(0), m_PathCost{ 0.0, 0.0, 0.0 }, m_PathSamples{ 0, 0, 0 },
+    m_BenchmarkSizeBucket(-1), m_Benchmarking(false), m_BenchmarkReported(false)
 {
     // Initialize buffers
     InitBuffers();
@@ -33,6 +64,29 @@ ParticleRenderer::~ParticleRenderer()
         delete m_VertexArray;
         m_VertexArray = nullptr;
     }
+
+    if (m_DensityRenderer) {
+        delete m_DensityRenderer;
+        m_DensityRenderer = nullptr;
+    }
+
+    if (m_PointVertexArray) {
+        delete m_PointVertexArray;
+        m_PointVertexArray = nullptr;
+    }
+
+    if (m_EmptyVertexArray) {
+        delete m_EmptyVertexArray;
+        m_EmptyVertexArray = nullptr;
+    }
+
+    if (m_InstanceTexture) {
+        GLCall(glDeleteTextures(1, &m_InstanceTexture));
+    }
+
+    if (m_TimerQuery) {
+        GLCall(glDeleteQueries(1, &m_TimerQuery));
+    }
 }
 
 void ParticleRenderer::InitBuffers()
@@ -75,7 +129,7 @@ void ParticleRenderer::InitBuffers()
     m_IndexBuffer->Bind();
 
     // Allocate based on current particle count
-    const size_t initialBufferSize = sizeof(ParticleInstance) * m_Simulation.GetParticles().size();
+    const size_t initialBufferSize = sizeof(ParticleInstance) * m_Simulation.GetParticleCount();
     m_InstanceBuffer = new VertexBuffer(nullptr, initialBufferSize, GL_STREAM_DRAW);
 
     // Set up instance buffer layout
@@ -107,37 +161,255 @@ void ParticleRenderer::InitBuffers()
     m_VertexBuffer->UnBind();
     m_InstanceBuffer->UnBind();
     m_IndexBuffer->UnBind();
+
+    // Heat map used when the particles are too small to be drawn as discs
+    m_DensityRenderer = new DensityRenderer(m_Simulation, m_ShaderManager.Load("res/shaders/DensityShader.shader"));
+
+    // Point sprites read the instance buffer as regular per-vertex attributes
+    m_PointVertexArray = new VertexArray();
+    VertexBufferLayout pointLayout;
+    pointLayout.Push<float>(2);  // Position (vec2)
+    pointLayout.Push<float>(2);  // Velocity (vec2)
+    pointLayout.Push<float>(1);  // Size (float)
+    m_PointVertexArray->AddBuffer(*m_InstanceBuffer, pointLayout);
+    m_PointShader = &m_ShaderManager.Load("res/shaders/PointSpriteShader.shader");
+
+    // Vertex pulling reads the instance buffer through a texture buffer, one float per texel.
+    // The texture references the buffer object so it follows its reallocations
+    m_EmptyVertexArray = new VertexArray();
+    GLCall(glGenTextures(1, &m_InstanceTexture));
+    GLCall(glBindTexture(GL_TEXTURE_BUFFER, m_InstanceTexture));
+    GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, m_InstanceBuffer->GetRendererID()));
+    GLCall(glBindTexture(GL_TEXTURE_BUFFER, 0));
+    m_PullingShader = &m_ShaderManager.Load("res/shaders/VertexPullingShader.shader");
+
+    // Driver limits deciding which paths can draw the current particles
+    float pointSizeRange[2] = { 1.0f, 1.0f };
+    GLCall(glGetFloatv(GL_POINT_SIZE_RANGE, pointSizeRange));
+    m_MaxPointSize = pointSizeRange[1];
+    GLCall(glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &m_MaxTextureBufferSize));
+
+    // Let the vertex shader set the point size
+    GLCall(glEnable(GL_PROGRAM_POINT_SIZE));
+
+    GLCall(glGenQueries(1, &m_TimerQuery));
+}
+
+bool ParticleRenderer::IsDrawPathSupported(ParticleDrawPath path) const
+{
+    switch (path)
+    {
+    case ParticleDrawPath::PointSprites:
+        // LOD representatives are larger than the particle radius
+        return 2.0f * m_Simulation.GetParticleRadius() * std::sqrt(static_cast<float>(m_LodStride)) *
+            m_Simulation.GetPixelsPerUnit() <= m_MaxPointSize;
+    case ParticleDrawPath::VertexPulling:
+        return m_VisibleCount * 5 <= static_cast<size_t>(m_MaxTextureBufferSize);
+    default:
+        return true;
+    }
+}
+
+ParticleDrawPath ParticleRenderer::SelectDrawPath()
+{
+    // Collect the timing of the previous frame. This waits for the GPU, but only
+    // for the few frames the benchmark runs
+    if (m_QueryPending)
+    {
+        GLuint64 elapsedNs = 0;
+        GLCall(glGetQueryObjectui64v(m_TimerQuery, GL_QUERY_RESULT, &elapsedNs));
+        const int index = static_cast<int>(m_PendingPath);
+        m_PathCost[index] += static_cast<double>(elapsedNs) / m_PendingCount;
+        m_PathSamples[index]++;
+        m_QueryPending = false;
+    }
+
+    // The fastest path depends on how many pixels each particle covers,
+    // measure again when the zoom moves the size to another power of two
+    const float diameterPx = 2.0f * m_Simulation.GetParticleRadius() * m_Simulation.GetPixelsPerUnit();
+    const int sizeBucket = static_cast<int>(std::floor(std::log2(std::max(diameterPx, 1.0f))));
+    if (sizeBucket != m_BenchmarkSizeBucket)
+    {
+        m_BenchmarkSizeBucket = sizeBucket;
+        m_BenchmarkReported = false;
+        for (int i = 0; i < 3; i++) {
+            m_PathCost[i] = 0.0;
+            m_PathSamples[i] = 0;
+        }
+    }
+
+    // Too few particles to measure anything meaningful yet
+    const bool benchmarkDone = m_BenchmarkReported;
+    if (!benchmarkDone && m_VisibleCount < DRAW_PATH_BENCHMARK_MIN_PARTICLES) {
+        m_Benchmarking = false;
+        return ParticleDrawPath::InstancedQuads;
+    }
+
+    // Time every supported path that doesn't have enough samples yet
+    for (int i = 0; i < 3; i++)
+    {
+        const ParticleDrawPath path = static_cast<ParticleDrawPath>(i);
+        if (m_PathSamples[i] < DRAW_PATH_BENCHMARK_FRAMES && IsDrawPathSupported(path)) {
+            m_Benchmarking = true;
+            return path;
+        }
+    }
+    m_Benchmarking = false;
+
+    // Pick the cheapest path per particle
+    ParticleDrawPath best = ParticleDrawPath::InstancedQuads;
+    double bestCost = -1.0;
+    for (int i = 0; i < 3; i++)
+    {
+        const ParticleDrawPath path = static_cast<ParticleDrawPath>(i);
+        if (m_PathSamples[i] == 0 || !IsDrawPathSupported(path)) continue;
+
+        const double cost = m_PathCost[i] / m_PathSamples[i];
+        if (bestCost < 0.0 || cost < bestCost) {
+            bestCost = cost;
+            best = path;
+        }
+    }
+
+    if (!m_BenchmarkReported)
+    {
+        std::cout << "Draw path benchmark (" << diameterPx << " px particles):";
+        for (int i = 0; i < 3; i++) {
+            if (m_PathSamples[i] > 0)
+                std::cout << " " << DRAW_PATH_NAMES[i] << " " << m_PathCost[i] / m_PathSamples[i] << " ns/particle,";
+        }
+        std::cout << " using " << DRAW_PATH_NAMES[static_cast<int>(best)] << std::endl;
+        m_BenchmarkReported = true;
+    }
+    return best;
+}
+
+bool ParticleRenderer::ShouldUseDensity() const
+{
+    const float pixelsPerUnit = m_Simulation.GetPixelsPerUnit();
+    const float diameterPx = 2.0f * m_Simulation.GetParticleRadius() * pixelsPerUnit;
+    if (diameterPx < DENSITY_MIN_DIAMETER_PX)
+        return true;
+
+    // Average number of discs drawn on top of each pixel inside the bounds
+    const float boundsAreaPx = m_Simulation.GetSimWidth() * m_Simulation.GetSimHeight() * pixelsPerUnit * pixelsPerUnit;
+    const float discAreaPx = 0.25f * 3.14159265f * diameterPx * diameterPx;
+    const float overdraw = m_Simulation.GetParticleCount() * discAreaPx / boundsAreaPx;
+    return overdraw > DENSITY_MAX_OVERDRAW;
+}
+
+template<typename Particles>
+size_t ParticleRenderer::CullParticles(const Particles& particles)
+{
+    const SpatialGrid* grid = m_Simulation.GetSpatialGrid();
+    const float particleRadius = m_Simulation.GetParticleRadius();
+
+    // The grid was built before the collision response moved the particles, so
+    // the view is expanded by a cell to keep particles that crossed a cell border
+    Bounds view = m_Simulation.GetViewBounds();
+    const float margin = particleRadius + (grid ? grid->GetCellSize() : 0.0f);
+    view.bottomLeft -= Vec2(margin, margin);
+    view.topRight += Vec2(margin, margin);
+
+    size_t count = 0;
+    int firstUnbinned = 0;
+
+    if (grid && grid->GetInsertedCount() > 0)
+    {
+        const float pixelsPerUnit = m_Simulation.GetPixelsPerUnit();
+        const bool subPixel = 2.0f * particleRadius * pixelsPerUnit < LOD_MIN_DIAMETER_PX;
+        const float discArea = 3.14159265f * particleRadius * particleRadius;
+        const float cellArea = grid->GetCellSize() * grid->GetCellSize();
+
+        // Representatives are enlarged so a decimated cell covers the same area
+        const float lodSize = particleRadius * std::sqrt(static_cast<float>(m_LodStride));
+
+        int minX, minY, maxX, maxY;
+        grid->GetCellRange(view.bottomLeft, view.topRight, minX, minY, maxX, maxY);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            for (int x = minX; x <= maxX; x++)
+            {
+                const SpatialGrid::Cell cell = grid->GetCell(x, y);
+                if (cell.empty()) continue;
+
+                const bool crowded = subPixel || cell.size() * discArea > LOD_MAX_CELL_COVERAGE * cellArea;
+                const size_t stride = crowded ? m_LodStride : 1;
+                const float size = crowded ? lodSize : particleRadius;
+
+                for (size_t k = 0; k < cell.size(); k += stride)
+                {
+                    const Particle& particle = LoadParticle(particles, cell[k]);
+                    m_InstanceData[count].position = particle.position;
+                    m_InstanceData[count].velocity = particle.velocity;
+                    m_InstanceData[count].size = size;
+                    count++;
+                }
+            }
+        }
+        firstUnbinned = grid->GetInsertedCount();
+    }
+
+    // Particles spawned after the grid was built (or every particle when the
+    // grid isn't used) are tested one by one
+    for (int i = firstUnbinned; i < static_cast<int>(particles.size()); i++)
+    {
+        const Particle& particle = LoadParticle(particles, i);
+        if (particle.position.x < view.bottomLeft.x || particle.position.x > view.topRight.x ||
+            particle.position.y < view.bottomLeft.y || particle.position.y > view.topRight.y)
+            continue;
+
+        m_InstanceData[count].position = particle.position;
+        m_InstanceData[count].velocity = particle.velocity;
+        m_InstanceData[count].size = particleRadius;
+        count++;
+    }
+
+    return count;
 }
 
 
 void ParticleRenderer::UpdateBuffers()
 {
-    // Get particles from simulation
-    const std::vector<Particle>& particles = m_Simulation.GetParticles();
-    const size_t particleCount = particles.size();
+    PROFILE_SCOPE("ParticleRenderer::UpdateBuffers");
+
+    const size_t particleCount = m_Simulation.GetParticleCount();
 
     if (particleCount == 0) {
         return;
     }
 
+    // Pick the draw mode once per frame so Render uses the same one
+    m_UsingDensity = (m_RenderMode == ParticleRenderMode::Density) ||
+        (m_RenderMode == ParticleRenderMode::Auto && ShouldUseDensity());
+
+    if (m_UsingDensity) {
+        m_DensityRenderer->UpdateBuffers();
+        return;
+    }
+
     // Resize only if needed, preserving capacity
     if (m_InstanceData.size() < particleCount) {
         m_InstanceData.resize(particleCount);
     }
 
-    // Update instance data with particle positions and velocities
-    float particleRadius = m_Simulation.GetParticleRadius();
-    for (size_t i = 0; i < particleCount; i++) {
-        const Particle& particle = particles[i];
-        m_InstanceData[i].position = particle.position;
-        m_InstanceData[i].velocity = particle.velocity;
-        m_InstanceData[i].size = particleRadius;
+    // Update instance data with the positions and velocities of the visible particles
+    {
+        PROFILE_SCOPE("CullParticles");
+        if (m_Simulation.GetParticleStorage() == ParticleStorage::Compact)
+            m_VisibleCount = CullParticles(m_Simulation.GetCompactParticles());
+        else
+            m_VisibleCount = CullParticles(m_Simulation.GetParticles());
+    }
+    if (m_VisibleCount == 0) {
+        return;
     }
-
 
     // Update buffer
+    PROFILE_SCOPE("Upload instances");
     m_InstanceBuffer->Bind();
-    size_t dataSize = sizeof(ParticleInstance) * particleCount;
+    size_t dataSize = sizeof(ParticleInstance) * m_VisibleCount;
 
     // Only reallocate if buffer is too small
     if (dataSize > m_InstanceBuffer->GetSize()) {
@@ -154,16 +426,60 @@ void ParticleRenderer::UpdateBuffers()
 
 void ParticleRenderer::Render()
 {
+    PROFILE_SCOPE("ParticleRenderer::Render");
+
     // No particles to render
-    if (m_Simulation.GetParticles().empty())
+    if (m_Simulation.GetParticleCount() == 0)
+        return;
+
+    if (m_UsingDensity) {
+        m_DensityRenderer->Render();
         return;
+    }
+
+    // Every particle is outside the view
+    if (m_VisibleCount == 0)
+        return;
+
+    ParticleDrawPath path = m_DrawPath;
+    bool benchmark = false;
+    if (path == ParticleDrawPath::Auto) {
+        path = SelectDrawPath();
+        benchmark = m_Benchmarking;
+    }
+    else if (!IsDrawPathSupported(path)) {
+        path = ParticleDrawPath::InstancedQuads;
+    }
+
+    // Only frames that still feed the benchmark are timed
+    if (benchmark) {
+        GLCall(glBeginQuery(GL_TIME_ELAPSED, m_TimerQuery));
+    }
+
+    switch (path)
+    {
+    case ParticleDrawPath::PointSprites:
+        DrawPointSprites();
+        break;
+    case ParticleDrawPath::VertexPulling:
+        DrawVertexPulling();
+        break;
+    default:
+        DrawInstancedQuads();
+        break;
+    }
 
-    // Create MVP for particles
-    glm::mat4 particleMVP = m_Simulation.GetProjMatrix() * m_Simulation.GetViewMatrix();
+    if (benchmark) {
+        GLCall(glEndQuery(GL_TIME_ELAPSED));
+        m_QueryPending = true;
+        m_PendingPath = path;
+        m_PendingCount = m_VisibleCount;
+    }
+}
 
-    // Bind shader and set uniforms
+void ParticleRenderer::DrawInstancedQuads()
+{
     m_Shader.Bind();
-    m_Shader.setUniformMat4f("u_MVP", particleMVP);
 
     // Bind vertex array and index buffer
     m_VertexArray->Bind();
@@ -175,11 +491,40 @@ void ParticleRenderer::Render()
         6,                                                       // 6 indices per quad (2 triangles)
         GL_UNSIGNED_INT,
         0,
-        static_cast<GLsizei>(m_Simulation.GetParticles().size()) // Number of instances
+        static_cast<GLsizei>(m_VisibleCount)                     // Number of visible instances
     ));
 
     // Unbind everything
     m_VertexArray->UnBind();
     m_IndexBuffer->UnBind();
     m_Shader.UnBind();
+}
+
+void ParticleRenderer::DrawPointSprites()
+{
+    m_PointShader->Bind();
+
+    // One point per particle
+    m_PointVertexArray->Bind();
+    GLCall(glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(m_VisibleCount)));
+
+    m_PointVertexArray->UnBind();
+    m_PointShader->UnBind();
+}
+
+void ParticleRenderer::DrawVertexPulling()
+{
+    // u_Instances is left at its default texture unit 0
+    m_PullingShader->Bind();
+
+    GLCall(glActiveTexture(GL_TEXTURE0));
+    GLCall(glBindTexture(GL_TEXTURE_BUFFER, m_InstanceTexture));
+
+    // 6 vertices per particle, the shader builds the quad from gl_VertexID
+    m_EmptyVertexArray->Bind();
+    GLCall(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(m_VisibleCount * 6)));
+
+    m_EmptyVertexArray->UnBind();
+    GLCall(glBindTexture(GL_TEXTURE_BUFFER, 0));
+    m_PullingShader->UnBind();
 }
\ No newline at end of file
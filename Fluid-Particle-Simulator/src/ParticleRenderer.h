@@ -4,6 +4,9 @@
 #include "VertexBuffer.h"
 #include "IndexBuffer.h"
 #include "Shader.h"
+#include "ShaderManager.h"
+#include "DensityRenderer.h"
+#include "ParticleBackend.h"
 #include "physics/SimulationSystem.h"
 
 // Structure for the particle instance data that will be sent to the GPU
@@ -13,23 +16,102 @@ struct ParticleInstance {
     float size;          // Particle size
 };
 
-class ParticleRenderer {
+// How the particles are drawn
+enum class ParticleRenderMode {
+    Auto,    // Switch between discs and heat map based on the on-screen particle density
+    Discs,   // One instanced quad per particle
+    Density  // Heat map of the particles binned into a low resolution texture
+};
+
+// How the discs are submitted to the GPU
+enum class ParticleDrawPath {
+    Auto = -1,          // Time the paths below with GPU queries and keep the fastest for the current particle size
+    InstancedQuads = 0, // Quad vertex buffer and 6 indices per instance
+    PointSprites = 1,   // One GL_POINTS vertex per particle, the disc is cut in the fragment shader
+    VertexPulling = 2   // Quad corners from gl_VertexID, particle data fetched from a texture buffer
+};
+
+class ParticleRenderer : public ParticleBackend {
 private:
     const SimulationSystem& m_Simulation;
-    const Shader& m_Shader;
+    ShaderManager& m_ShaderManager;
+    Shader& m_Shader;
     VertexArray* m_VertexArray;
     VertexBuffer* m_VertexBuffer;    // For the quad vertices
     VertexBuffer* m_InstanceBuffer;  // For the particle instance data
     IndexBuffer* m_IndexBuffer;      // For the quad indices
-    std::vector<ParticleInstance> m_InstanceData; // Optimize memory allocation
+    TrackedVector<ParticleInstance, MemoryTag::Renderer> m_InstanceData; // Optimize memory allocation
+    DensityRenderer* m_DensityRenderer;
+    ParticleRenderMode m_RenderMode;
+    bool m_UsingDensity;             // Mode picked for the current frame
+    size_t m_VisibleCount;           // Instances written by the last UpdateBuffers
+    int m_LodStride;                 // Draw one particle every m_LodStride in crowded cells, 1 disables LOD
+
+    // Alternative draw paths, they read the same instance buffer. Shaders are owned by the manager
+    Shader* m_PointShader;
+    Shader* m_PullingShader;
+    VertexArray* m_PointVertexArray; // Instance buffer bound as per-vertex attributes
+    VertexArray* m_EmptyVertexArray; // Core profile needs a VAO bound even without attributes
+    unsigned int m_InstanceTexture;  // Texture buffer view of the instance buffer
+    float m_MaxPointSize;
+    int m_MaxTextureBufferSize;
+    ParticleDrawPath m_DrawPath;
+
+    // Auto draw path benchmark
+    unsigned int m_TimerQuery;
+    bool m_QueryPending;
+    ParticleDrawPath m_PendingPath;
+    size_t m_PendingCount;
+    double m_PathCost[3];            // Accumulated GPU nanoseconds per particle for each path
+    int m_PathSamples[3];
+    int m_BenchmarkSizeBucket;       // log2 of the particle size in pixels the costs were measured at
+    bool m_Benchmarking;             // The path returned by SelectDrawPath still needs samples
+    bool m_BenchmarkReported;
+
+    bool IsDrawPathSupported(ParticleDrawPath path) const;
+
+    // Read back the timing of the previous benchmark frame and return the path to use this frame.
+    // Sets m_Benchmarking when this frame has to be timed
+    ParticleDrawPath SelectDrawPath();
+
+    // MVP and pixel size come from the FrameData block, the draws set no uniforms
+    void DrawInstancedQuads();
+    void DrawPointSprites();
+    void DrawVertexPulling();
+
+    // Returns true if the particles are too small or overlap too much on screen to be drawn as discs
+    bool ShouldUseDensity() const;
+
+    // Fill m_InstanceData with the particles inside the view and return how many were written.
+    // Whole spatial grid cells outside the view are skipped. Particles is the simulation's
+    // storage, compact particles are decoded straight into the instances
+    template<typename Particles>
+    size_t CullParticles(const Particles& particles);
 
 public:
-    ParticleRenderer(const SimulationSystem& simulation, const Shader& shader);
+    // Shaders are loaded through the manager, which also provides the per-frame uniforms
+    ParticleRenderer(const SimulationSystem& simulation, ShaderManager& shaderManager);
     ~ParticleRenderer();
 
     void InitBuffers();
-    void UpdateInstanceDataColorVelocity(std::vector<ParticleInstance>& data, const std::vector<Particle>& particles);
-    void UpdateInstanceDataPlaneColor(std::vector<ParticleInstance>& data, const std::vector<Particle>& particles);
-    void UpdateBuffers();
-    void Render();
+    void UpdateInstanceDataColorVelocity(std::vector<ParticleInstance>& data, const ParticleVector& particles);
+    void UpdateInstanceDataPlaneColor(std::vector<ParticleInstance>& data, const ParticleVector& particles);
+    void UpdateBuffers() override;
+    void Render() override;
+
+    void SetRenderMode(ParticleRenderMode mode) { m_RenderMode = mode; }
+    ParticleRenderMode GetRenderMode() const { return m_RenderMode; }
+    bool IsUsingDensity() const { return m_UsingDensity; }
+
+    // Draw one representative every lodStride particles in cells where particles are
+    // sub-pixel or pile up on top of each other. 1 draws every particle
+    void SetLodStride(int lodStride) { m_LodStride = lodStride < 1 ? 1 : lodStride; }
+    size_t GetVisibleCount() const { return m_VisibleCount; }
+
+    // Force a draw path or let the renderer benchmark them (ParticleDrawPath::Auto)
+    void SetDrawPath(ParticleDrawPath path) { m_DrawPath = path; }
+    ParticleDrawPath GetDrawPath() const { return m_DrawPath; }
+
+    // Select what the heat map shows when the density mode is active
+    void SetDensityQuantity(DensityQuantity quantity) { m_DensityRenderer->SetQuantity(quantity); }
 };
\ No newline at end of file
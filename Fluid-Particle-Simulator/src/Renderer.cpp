@@ -16,6 +16,82 @@ bool GLLogCall(const char* function, const char* file, int line)
     return true;
 }
 
+static const char* GLDebugSourceName(GLenum source)
+{
+    switch (source)
+    {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "Window System";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "Third Party";
+    case GL_DEBUG_SOURCE_APPLICATION: return "Application";
+    default: return "Other";
+    }
+}
+
+static const char* GLDebugTypeName(GLenum type)
+{
+    switch (type)
+    {
+    case GL_DEBUG_TYPE_ERROR: return "Error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "Deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "Undefined Behavior";
+    case GL_DEBUG_TYPE_PORTABILITY: return "Portability";
+    case GL_DEBUG_TYPE_PERFORMANCE: return "Performance";
+    default: return "Other";
+    }
+}
+
+static const char* GLDebugSeverityName(GLenum severity)
+{
+    switch (severity)
+    {
+    case GL_DEBUG_SEVERITY_HIGH: return "High";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "Medium";
+    case GL_DEBUG_SEVERITY_LOW: return "Low";
+    default: return "Notification";
+    }
+}
+
+static void GLAPIENTRY GLDebugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei /*length*/, const GLchar* message, const void* /*userParam*/)
+{
+    std::cout << "[OpenGL " << GLDebugTypeName(type) << "] (" << id << ", " << GLDebugSourceName(source)
+        << ", " << GLDebugSeverityName(severity) << "): " << message << std::endl;
+
+    // Output is synchronous, so the call stack shows the GL call that failed
+    if (type == GL_DEBUG_TYPE_ERROR)
+        DEBUG_BREAK();
+}
+
+bool EnableGLDebugOutput()
+{
+#if GL_DEBUG_CONTEXT
+    if (!GLEW_KHR_debug && !GLEW_VERSION_4_3)
+    {
+        std::cout << "KHR_debug not available, define GL_VALIDATE_CALLS to check every GL call" << std::endl;
+        return false;
+    }
+
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+    if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+    {
+        std::cout << "Not a debug context, OpenGL messages may be incomplete" << std::endl;
+    }
+
+    glEnable(GL_DEBUG_OUTPUT);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(GLDebugMessageCallback, nullptr);
+
+    // Drivers are chatty about buffer placement and such, keep only real problems
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+    return true;
+#else
+    return false;
+#endif
+}
+
 void Renderer::Draw(const VertexArray& va, const IndexBuffer& ib, const Shader& shader) const
 {
     shader.Bind();
@@ -5,14 +5,51 @@
 #include "VertexArray.h"
 #include "Shader.h"
 
-#define ASSERT(x) if (!(x)) __debugbreak();
+// Stop in the debugger, portable replacement for __debugbreak. Like it, the break can be
+// continued from; outside a debugger SIGTRAP ends the process
+#if defined(_MSC_VER)
+#define DEBUG_BREAK() __debugbreak()
+#elif defined(__clang__)
+#define DEBUG_BREAK() __builtin_debugtrap()
+#elif defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#define DEBUG_BREAK() std::raise(SIGTRAP)
+#else
+#include <cstdlib>
+#define DEBUG_BREAK() std::abort()
+#endif
+
+#define ASSERT(x) if (!(x)) DEBUG_BREAK();
+
+// OpenGL error checking has three levels:
+//  - Release (NDEBUG): GLCall(x) is just x, nothing is checked
+//  - Debug: GLCall(x) is still just x, the driver reports errors through the
+//    KHR_debug callback installed by EnableGLDebugOutput, no glGetError round trips
+//  - GL_VALIDATE_CALLS defined (any build): every GLCall clears and reads glGetError
+//    like before. It stalls the driver on every call, but works on drivers without
+//    KHR_debug and points at the exact call even without a debugger
+#if defined(GL_VALIDATE_CALLS)
 #define GLCall(x) GLClearError();\
 	x;\
 	ASSERT(GLLogCall(#x, __FILE__, __LINE__ ))
+#else
+#define GLCall(x) x
+#endif
+
+// Debug builds ask GLFW for a debug context so the callback receives every message
+#if !defined(NDEBUG)
+#define GL_DEBUG_CONTEXT 1
+#else
+#define GL_DEBUG_CONTEXT 0
+#endif
 
 void GLClearError();
 bool GLLogCall(const char* function, const char* file, int line);
 
+// Install the KHR_debug message callback, call once after glewInit.
+// Does nothing in release builds, returns false if the context can't report messages
+bool EnableGLDebugOutput();
+
 class Renderer
 {
 private:
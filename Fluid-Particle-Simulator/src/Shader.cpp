@@ -8,8 +8,10 @@
 
 #include "Renderer.h"   
 
+unsigned int Shader::s_BoundProgram = 0;
+
 Shader::Shader(const std::string& filepath)
-	: m_FilePath(filepath), m_RendererID(0) 
+	: m_FilePath(filepath), m_RendererID(0), m_Version(0)
 {
     ShaderProgramSource source = ParseShader(filepath);
     m_RendererID = CreateShader(source.VertexSource, source.FragmentSource);      
@@ -17,9 +19,33 @@ Shader::Shader(const std::string& filepath)
 
 Shader::~Shader()
 {
+    if (s_BoundProgram == m_RendererID)
+        s_BoundProgram = 0;
     GLCall(glDeleteProgram(m_RendererID));
 }
 
+bool Shader::Reload()
+{
+    ShaderProgramSource source = ParseShader(m_FilePath);
+    unsigned int program = CreateShader(source.VertexSource, source.FragmentSource);
+    if (program == 0)
+        return false;
+
+    if (s_BoundProgram == m_RendererID)
+        s_BoundProgram = 0;
+    GLCall(glDeleteProgram(m_RendererID));
+    m_RendererID = program;
+    m_Version++;
+
+    // Locations can change between programs, resolve everything again
+    m_UniformLocationCache.clear();
+    for (size_t i = 0; i < m_ResolvedNames.size(); i++)
+    {
+        GLCall(m_ResolvedLocations[i] = glGetUniformLocation(m_RendererID, m_ResolvedNames[i].c_str()));
+    }
+    return true;
+}
+
 ShaderProgramSource Shader::ParseShader(const std::string& filepath)
 {
     std::ifstream stream(filepath); //open file
@@ -120,6 +146,13 @@ unsigned int Shader::CreateShader(const std::string& vertexShader, const std::st
 
     GLCall(glValidateProgram(program));
 
+    // Connect the shared per-frame block if this program uses it
+    GLCall(unsigned int frameDataIndex = glGetUniformBlockIndex(program, "FrameData"));
+    if (frameDataIndex != GL_INVALID_INDEX)
+    {
+        GLCall(glUniformBlockBinding(program, frameDataIndex, FRAME_DATA_BINDING));
+    }
+
     GLCall(glDeleteShader(vs));
     GLCall(glDeleteShader(fs));
 
@@ -128,12 +161,20 @@ unsigned int Shader::CreateShader(const std::string& vertexShader, const std::st
 
 void Shader::Bind() const
 {
+    if (s_BoundProgram == m_RendererID)
+        return;
+
     GLCall(glUseProgram(m_RendererID));
+    s_BoundProgram = m_RendererID;
 }
 
 void Shader::UnBind() const
 {
+    if (s_BoundProgram == 0)
+        return;
+
     GLCall(glUseProgram(0));
+    s_BoundProgram = 0;
 }
 
 void Shader::setUniform1i(const std::string& name, int value) const
@@ -170,4 +211,47 @@ int Shader::GetUniformLocation(const std::string& name) const
     
     m_UniformLocationCache[name] = location;
     return location;
-}
\ No newline at end of file
+}
+
+int Shader::ResolveUniform(const std::string& name) const
+{
+    for (size_t i = 0; i < m_ResolvedNames.size(); i++)
+    {
+        if (m_ResolvedNames[i] == name)
+            return static_cast<int>(i);
+    }
+
+    m_ResolvedNames.push_back(name);
+    m_ResolvedLocations.push_back(GetUniformLocation(name));
+    return static_cast<int>(m_ResolvedNames.size()) - 1;
+}
+
+template<>
+void Uniform<int>::Set(const int& value) const
+{
+    GLCall(glUniform1i(m_Shader->GetResolvedLocation(m_Index), value));
+}
+
+template<>
+void Uniform<float>::Set(const float& value) const
+{
+    GLCall(glUniform1f(m_Shader->GetResolvedLocation(m_Index), value));
+}
+
+template<>
+void Uniform<glm::vec2>::Set(const glm::vec2& value) const
+{
+    GLCall(glUniform2f(m_Shader->GetResolvedLocation(m_Index), value.x, value.y));
+}
+
+template<>
+void Uniform<glm::vec4>::Set(const glm::vec4& value) const
+{
+    GLCall(glUniform4f(m_Shader->GetResolvedLocation(m_Index), value.x, value.y, value.z, value.w));
+}
+
+template<>
+void Uniform<glm::mat4>::Set(const glm::mat4& value) const
+{
+    GLCall(glUniformMatrix4fv(m_Shader->GetResolvedLocation(m_Index), 1, GL_FALSE, &value[0][0]));
+}
@@ -2,20 +2,49 @@
 #include <string>
 #include <unordered_map>
 
+#include <vector>
+
 #include "glm/glm.hpp"
 
+// Binding point of the FrameData uniform block, filled once per frame by ShaderManager
+const unsigned int FRAME_DATA_BINDING = 0;
+
 struct ShaderProgramSource
 {
 	std::string VertexSource;
 	std::string FragmentSource;
 };
+
+class Shader;
+
+// Uniform resolved once when it is requested, setting it doesn't look up the name.
+// The handle stays valid when the shader is hot reloaded
+template<typename T>
+class Uniform
+{
+private:
+	const Shader* m_Shader;
+	int m_Index; // Index in the shader's resolved uniforms
+
+public:
+	Uniform() : m_Shader(nullptr), m_Index(-1) {}
+	Uniform(const Shader* shader, int index) : m_Shader(shader), m_Index(index) {}
+
+	// The shader must be bound
+	void Set(const T& value) const;
+};
 	
 class Shader
 {
 private:
 	std::string m_FilePath; 
 	unsigned int m_RendererID;
+	unsigned int m_Version; // Incremented by every successful reload, uniform values are lost then
 	mutable  std::unordered_map<std::string, int> m_UniformLocationCache; //cache system
+	mutable std::vector<std::string> m_ResolvedNames; // Uniforms handed out as handles
+	mutable std::vector<int> m_ResolvedLocations;
+
+	static unsigned int s_BoundProgram; // Skip glUseProgram when the program is already bound
 
 public:
 	Shader(const std::string& filepath); // since I only have one shader file I need one path to it
@@ -29,11 +58,30 @@ public:
 	void setUniform1f(const std::string& name, float value) const;
 	void SetUniform4f(const std::string& name, float v0, float v1, float v2, float v3) const;
 	void setUniformMat4f(const std::string& name, const glm::mat4& matrix) const;
+
+	// Resolve a uniform once, prefer this over the name based setters for uniforms set every frame
+	template<typename T>
+	Uniform<T> GetUniform(const std::string& name) const { return Uniform<T>(this, ResolveUniform(name)); }
+	int GetResolvedLocation(int index) const { return m_ResolvedLocations[index]; }
+
+	// Parse and compile the file again. On failure the previous program is kept
+	bool Reload();
+
+	const std::string& GetFilePath() const { return m_FilePath; }
+	unsigned int GetVersion() const { return m_Version; }
+	bool IsValid() const { return m_RendererID != 0; }
 private:
 	ShaderProgramSource ParseShader(const std::string& filepath);
 	unsigned int CompileShader(unsigned int type, const std::string& source);
 	unsigned int CreateShader(const std::string& vertexShader, const std::string& fragmentShader);
 
 	int GetUniformLocation(const std::string& name) const;
+	int ResolveUniform(const std::string& name) const;
 };
 
+template<> void Uniform<int>::Set(const int& value) const;
+template<> void Uniform<float>::Set(const float& value) const;
+template<> void Uniform<glm::vec2>::Set(const glm::vec2& value) const;
+template<> void Uniform<glm::vec4>::Set(const glm::vec4& value) const;
+template<> void Uniform<glm::mat4>::Set(const glm::mat4& value) const;
+
@@ -0,0 +1,76 @@
+#include "ShaderManager.h"
+#include "Renderer.h"
+#include <iostream>
+#include <sys/stat.h>
+
+ShaderManager::ShaderManager()
+    : m_FrameDataBuffer(0)
+{
+    GLCall(glGenBuffers(1, &m_FrameDataBuffer));
+    GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_FrameDataBuffer));
+    GLCall(glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW));
+    GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+    // The buffer stays bound to its binding point, programs only reference the index
+    GLCall(glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, m_FrameDataBuffer));
+}
+
+ShaderManager::~ShaderManager()
+{
+    for (auto& pair : m_Shaders) {
+        delete pair.second.shader;
+    }
+
+    GLCall(glDeleteBuffers(1, &m_FrameDataBuffer));
+}
+
+std::time_t ShaderManager::GetModifiedTime(const std::string& path)
+{
+    struct stat fileInfo;
+    if (stat(path.c_str(), &fileInfo) != 0)
+        return 0;
+    return fileInfo.st_mtime;
+}
+
+Shader& ShaderManager::Load(const std::string& path)
+{
+    auto it = m_Shaders.find(path);
+    if (it != m_Shaders.end())
+        return *it->second.shader;
+
+    Entry entry;
+    entry.shader = new Shader(path);
+    entry.modifiedTime = GetModifiedTime(path);
+    m_Shaders[path] = entry;
+    return *entry.shader;
+}
+
+void ShaderManager::UpdateFrameData(const FrameData& frameData)
+{
+    GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_FrameDataBuffer));
+    GLCall(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frameData));
+    GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+}
+
+int ShaderManager::ReloadChanged()
+{
+    int reloaded = 0;
+    for (auto& pair : m_Shaders)
+    {
+        Entry& entry = pair.second;
+        const std::time_t modifiedTime = GetModifiedTime(pair.first);
+        if (modifiedTime == 0 || modifiedTime == entry.modifiedTime)
+            continue;
+
+        // Don't retry a broken file every frame, wait for the next save
+        entry.modifiedTime = modifiedTime;
+        if (entry.shader->Reload()) {
+            std::cout << "Reloaded shader " << pair.first << std::endl;
+            reloaded++;
+        }
+        else {
+            std::cerr << "Failed to reload shader " << pair.first << ", keeping the previous version" << std::endl;
+        }
+    }
+    return reloaded;
+}
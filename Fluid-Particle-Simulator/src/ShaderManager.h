@@ -0,0 +1,50 @@
+#pragma once
+#include <ctime>
+#include <string>
+#include <unordered_map>
+
+#include "Shader.h"
+#include "glm/glm.hpp"
+
+// Per-frame state shared by every shader through the FrameData uniform block.
+// Must match the std140 layout of the block declared in the .shader files
+struct FrameData {
+    glm::mat4 mvp;          // Simulation projection * view
+    float zoom;
+    float pixelsPerUnit;    // Screen pixels covered by one simulation unit
+    float maxSpeed;         // Speed at the top of the colour scale
+    float padding;          // std140 rounds the block up to 16 bytes
+};
+
+// Owns the shader programs so every file is parsed and compiled once, no matter
+// how many renderers use it. Also owns the FrameData uniform buffer and reloads
+// the shaders whose file changed on disk.
+class ShaderManager {
+private:
+    struct Entry {
+        Shader* shader;
+        std::time_t modifiedTime;   // Last write time of the file when it was compiled
+    };
+
+    std::unordered_map<std::string, Entry> m_Shaders;
+    unsigned int m_FrameDataBuffer;
+
+    static std::time_t GetModifiedTime(const std::string& path);
+
+public:
+    ShaderManager();
+    ~ShaderManager();
+
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator=(const ShaderManager&) = delete;
+
+    // Return the shader for this file, compiling it the first time it is requested
+    Shader& Load(const std::string& path);
+
+    // Upload the shared state, call once per frame before rendering
+    void UpdateFrameData(const FrameData& frameData);
+
+    // Recompile the shaders whose file changed since they were compiled.
+    // Returns how many were reloaded, a shader that fails to compile keeps its old program
+    int ReloadChanged();
+};
@@ -0,0 +1,257 @@
+#include "SoftwareRenderer.h"
+#include "core/Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+// Tile size in pixels, a tile of floats fits in L1
+const int TILE_SIZE = 32;
+
+// Coverage above which the pixel can't change by a full 8-bit step anymore
+const float OPAQUE_COVERAGE = 1.0f - 0.5f / 255.0f;
+
+// Particles handled by one binning chunk
+const int BIN_CHUNK = 16384;
+
+// Same colour scale as ParticleShader: speed / maxSpeed mapped blue -> cyan -> green -> yellow -> red
+static void SpeedColor(float speed, float maxSpeed, float& r, float& g, float& b)
+{
+    const float normalizedV = std::min(speed / maxSpeed, 1.0f);
+
+    if (normalizedV < 0.25f) {
+        r = 0.0f; g = normalizedV / 0.25f; b = 1.0f;
+    }
+    else if (normalizedV < 0.5f) {
+        r = 0.0f; g = 1.0f; b = 1.0f - (normalizedV - 0.25f) / 0.25f;
+    }
+    else if (normalizedV < 0.75f) {
+        r = (normalizedV - 0.5f) / 0.25f; g = 1.0f; b = 0.0f;
+    }
+    else {
+        r = 1.0f; g = 1.0f - (normalizedV - 0.75f) / 0.25f; b = 0.0f;
+    }
+}
+
+SoftwareRenderer::SoftwareRenderer(const SimulationSystem& simulation, ThreadPool& threadPool, int width, int height, float maxSpeed)
+    : m_Simulation(simulation), m_ThreadPool(threadPool), m_Width(width), m_Height(height),
+    m_MaxSpeed(maxSpeed), m_RadiusPx(0.0f), m_Scale(1.0f), m_OffsetX(0.0f), m_OffsetY(0.0f)
+{
+    m_TilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    m_TilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    m_TileStart.resize(m_TilesX * m_TilesY + 1);
+    m_Image.resize(static_cast<size_t>(width) * height * 3);
+}
+
+inline void SoftwareRenderer::GetTileRange(const Splat& splat, int& minX, int& minY, int& maxX, int& maxY) const
+{
+    // Half a pixel of margin for the anti-aliased edge
+    const float extent = m_RadiusPx + 0.5f;
+    minX = std::max(0, static_cast<int>(std::floor(splat.x - extent)) / TILE_SIZE);
+    minY = std::max(0, static_cast<int>(std::floor(splat.y - extent)) / TILE_SIZE);
+    maxX = std::min(m_TilesX - 1, static_cast<int>(std::floor(splat.x + extent)) / TILE_SIZE);
+    maxY = std::min(m_TilesY - 1, static_cast<int>(std::floor(splat.y + extent)) / TILE_SIZE);
+}
+
+template<typename Particles>
+void SoftwareRenderer::ProjectParticles(const Particles& particles, const Bounds& view, int chunkCount)
+{
+    const int particleCount = static_cast<int>(particles.size());
+    const int tileCount = m_TilesX * m_TilesY;
+
+    m_ThreadPool.ParallelFor(chunkCount, [&](int chunkBegin, int chunkEnd, int)
+    {
+        for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+        {
+            int* counts = &m_ThreadTileCounts[static_cast<size_t>(chunk) * tileCount];
+            const int end = std::min(particleCount, (chunk + 1) * BIN_CHUNK);
+
+            for (int i = chunk * BIN_CHUNK; i < end; i++)
+            {
+                const Particle& particle = LoadParticle(particles, i);
+                Splat& splat = m_Splats[i];
+                splat.x = m_OffsetX + (particle.position.x - view.bottomLeft.x) * m_Scale;
+                splat.y = m_OffsetY + (view.topRight.y - particle.position.y) * m_Scale; // Image rows go down
+                SpeedColor(particle.velocity.length(), m_MaxSpeed, splat.r, splat.g, splat.b);
+
+                int minX, minY, maxX, maxY;
+                GetTileRange(splat, minX, minY, maxX, maxY);
+                for (int ty = minY; ty <= maxY; ty++)
+                    for (int tx = minX; tx <= maxX; tx++)
+                        counts[tx + ty * m_TilesX]++;
+            }
+        }
+    });
+}
+
+void SoftwareRenderer::UpdateBuffers()
+{
+    PROFILE_SCOPE("SoftwareRenderer::UpdateBuffers");
+
+    const int particleCount = static_cast<int>(m_Simulation.GetParticleCount());
+    const int tileCount = m_TilesX * m_TilesY;
+
+    // Fit the visible rectangle in the image keeping the aspect ratio, centered
+    const Bounds view = m_Simulation.GetViewBounds();
+    const float viewWidth = view.topRight.x - view.bottomLeft.x;
+    const float viewHeight = view.topRight.y - view.bottomLeft.y;
+    m_Scale = std::min(m_Width / viewWidth, m_Height / viewHeight);
+    m_OffsetX = (m_Width - viewWidth * m_Scale) * 0.5f;
+    m_OffsetY = (m_Height - viewHeight * m_Scale) * 0.5f;
+    m_RadiusPx = m_Simulation.GetParticleRadius() * m_Scale;
+
+    m_Splats.resize(particleCount);
+
+    // Chunks are fixed so each one can count and then fill its own slots
+    const int chunkCount = (particleCount + BIN_CHUNK - 1) / BIN_CHUNK;
+    m_ThreadTileCounts.assign(static_cast<size_t>(chunkCount) * tileCount, 0);
+
+    // Project particles and count how many entries each chunk adds to every tile
+    if (m_Simulation.GetParticleStorage() == ParticleStorage::Compact)
+        ProjectParticles(m_Simulation.GetCompactParticles(), view, chunkCount);
+    else
+        ProjectParticles(m_Simulation.GetParticles(), view, chunkCount);
+
+    // Turn the counts into write offsets, tile major then chunk so every tile
+    // keeps the particles in their original order (later particles on top)
+    int offset = 0;
+    for (int tile = 0; tile < tileCount; tile++)
+    {
+        m_TileStart[tile] = offset;
+        for (int chunk = 0; chunk < chunkCount; chunk++)
+        {
+            int& count = m_ThreadTileCounts[static_cast<size_t>(chunk) * tileCount + tile];
+            const int chunkEntries = count;
+            count = offset;
+            offset += chunkEntries;
+        }
+    }
+    m_TileStart[tileCount] = offset;
+    m_TileEntries.resize(offset);
+
+    // Scatter splat indices into their tiles
+    m_ThreadPool.ParallelFor(chunkCount, [&](int chunkBegin, int chunkEnd, int)
+    {
+        for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+        {
+            int* cursors = &m_ThreadTileCounts[static_cast<size_t>(chunk) * tileCount];
+            const int end = std::min(particleCount, (chunk + 1) * BIN_CHUNK);
+
+            for (int i = chunk * BIN_CHUNK; i < end; i++)
+            {
+                int minX, minY, maxX, maxY;
+                GetTileRange(m_Splats[i], minX, minY, maxX, maxY);
+                for (int ty = minY; ty <= maxY; ty++)
+                    for (int tx = minX; tx <= maxX; tx++)
+                        m_TileEntries[cursors[tx + ty * m_TilesX]++] = i;
+            }
+        }
+    });
+}
+
+void SoftwareRenderer::RasteriseTile(int tileIndex)
+{
+    const int tileX = (tileIndex % m_TilesX) * TILE_SIZE;
+    const int tileY = (tileIndex / m_TilesX) * TILE_SIZE;
+    const int tileW = std::min(TILE_SIZE, m_Width - tileX);
+    const int tileH = std::min(TILE_SIZE, m_Height - tileY);
+    const int tilePixels = tileW * tileH;
+
+    // Splats are composited front to back (last particle first) with the "under"
+    // operator. Over a black background this gives the same image as drawing them
+    // in order with GL_SRC_ALPHA / GL_ONE_MINUS_SRC_ALPHA, but a pixel can be
+    // skipped once it is opaque, a row once all its pixels are and the tile once every pixel is
+    float color[TILE_SIZE * TILE_SIZE * 3] = {};
+    float coverage[TILE_SIZE * TILE_SIZE] = {};
+    int rowOpaquePixels[TILE_SIZE] = {};
+    int opaquePixels = 0;
+
+    const float radius = m_RadiusPx;
+    const float outer = radius + 0.5f;
+    const float outerSq = outer * outer;
+    const float innerSq = (radius > 0.5f) ? (radius - 0.5f) * (radius - 0.5f) : 0.0f;
+
+    for (int entry = m_TileStart[tileIndex + 1] - 1; entry >= m_TileStart[tileIndex] && opaquePixels < tilePixels; entry--)
+    {
+        const Splat& splat = m_Splats[m_TileEntries[entry]];
+
+        // Rows of this tile touched by the disc. Truncating instead of flooring only differs
+        // for negative coordinates, those are clamped to the tile or fail the distance test
+        const int minY = std::max(tileY, static_cast<int>(splat.y - outer));
+        const int maxY = std::min(tileY + tileH - 1, static_cast<int>(splat.y + outer));
+
+        for (int py = minY; py <= maxY; py++)
+        {
+            int& rowOpaque = rowOpaquePixels[py - tileY];
+            if (rowOpaque == tileW) continue;
+
+            const float dy = py + 0.5f - splat.y;
+            const float dySq = dy * dy;
+            if (dySq >= outerSq) continue;
+
+            // Horizontal span of the disc on this row
+            const float halfSpan = std::sqrt(outerSq - dySq);
+            const int minX = std::max(tileX, static_cast<int>(splat.x - halfSpan));
+            const int maxX = std::min(tileX + tileW - 1, static_cast<int>(splat.x + halfSpan));
+
+            const int rowStart = (py - tileY) * TILE_SIZE - tileX;
+            for (int px = minX; px <= maxX; px++)
+            {
+                float& covered = coverage[rowStart + px];
+                if (covered >= OPAQUE_COVERAGE) continue;
+
+                const float dx = px + 0.5f - splat.x;
+                const float distanceSq = dx * dx + dySq;
+                if (distanceSq >= outerSq) continue;
+
+                // Pixel coverage of the disc edge, fully covered inside the inner radius
+                float alpha = 1.0f;
+                if (distanceSq > innerSq)
+                    alpha = outer - std::sqrt(distanceSq);
+
+                const float weight = (1.0f - covered) * alpha;
+                float* pixel = &color[(rowStart + px) * 3];
+                pixel[0] += splat.r * weight;
+                pixel[1] += splat.g * weight;
+                pixel[2] += splat.b * weight;
+
+                covered += weight;
+                if (covered >= OPAQUE_COVERAGE)
+                {
+                    opaquePixels++;
+                    rowOpaque++;
+                }
+            }
+        }
+    }
+
+    // Copy the tile into the image
+    for (int y = 0; y < tileH; y++)
+    {
+        const float* src = &color[(y * TILE_SIZE) * 3];
+        uint8_t* dst = &m_Image[(static_cast<size_t>(tileY + y) * m_Width + tileX) * 3];
+        for (int i = 0; i < tileW * 3; i++)
+            dst[i] = static_cast<uint8_t>(std::min(src[i], 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+void SoftwareRenderer::Render()
+{
+    PROFILE_SCOPE("SoftwareRenderer::Render");
+
+    m_ThreadPool.ParallelFor(m_TilesX * m_TilesY, [&](int begin, int end, int)
+    {
+        for (int tile = begin; tile < end; tile++)
+            RasteriseTile(tile);
+    });
+}
+
+bool SoftwareRenderer::WriteFrame(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.good())
+        return false;
+
+    file << "P6\n" << m_Width << " " << m_Height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(m_Image.data()), m_Image.size());
+    return file.good();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ParticleBackend.h"
+#include "core/MemoryTracker.h"
+#include "core/ThreadPool.h"
+#include "physics/SimulationSystem.h"
+
+// CPU replacement for ParticleRenderer on machines without a GPU. Both are a
+// ParticleBackend, driven by UpdateBuffers then Render every frame, this one draws into
+// an RGB image that can be written to disk with WriteFrame.
+// The image is split into square tiles, UpdateBuffers bins every particle into the
+// tiles its disc overlaps and Render rasterises the tiles in parallel, so no two
+// threads ever write the same pixel.
+class SoftwareRenderer : public ParticleBackend {
+private:
+    // Particle projected to image space, ready to be rasterised
+    struct Splat {
+        float x, y;      // Center in pixels
+        float r, g, b;   // Speed colour
+    };
+
+    const SimulationSystem& m_Simulation;
+    ThreadPool& m_ThreadPool;
+    int m_Width;
+    int m_Height;
+    float m_MaxSpeed;                       // Speed at the top of the colour scale
+    int m_TilesX;
+    int m_TilesY;
+    float m_RadiusPx;
+    float m_Scale;                          // Pixels per simulation unit
+    float m_OffsetX;                        // Image position of the view's left edge
+    float m_OffsetY;                        // Image position of the view's top edge
+
+    TrackedVector<Splat, MemoryTag::Renderer> m_Splats;
+    TrackedVector<int, MemoryTag::Renderer> m_TileStart;           // First entry of each tile in m_TileEntries (size tiles + 1)
+    TrackedVector<int, MemoryTag::Renderer> m_TileEntries;         // Splat indices grouped by tile, in particle order
+    TrackedVector<int, MemoryTag::Renderer> m_ThreadTileCounts;    // Per chunk tile counters used while binning
+    TrackedVector<uint8_t, MemoryTag::Renderer> m_Image;           // RGB, top row first
+
+    // Range of tiles covered by a splat
+    inline void GetTileRange(const Splat& splat, int& minX, int& minY, int& maxX, int& maxY) const;
+
+    // Project the particles into m_Splats and count the entries each chunk adds to every tile.
+    // Particles is the simulation's storage, compact particles are decoded here
+    template<typename Particles>
+    void ProjectParticles(const Particles& particles, const Bounds& view, int chunkCount);
+
+    void RasteriseTile(int tileIndex);
+
+public:
+    // maxSpeed is the speed coloured red, the u_MaxSpeed the GPU renderers get in FrameData
+    SoftwareRenderer(const SimulationSystem& simulation, ThreadPool& threadPool, int width, int height, float maxSpeed);
+
+    // Project the particles and bin them into tiles
+    void UpdateBuffers() override;
+
+    // Rasterise every tile into the image
+    void Render() override;
+
+    // Write the last rendered image as a binary PPM, returns false if the file can't be written
+    bool WriteFrame(const std::string& path) const;
+
+    const TrackedVector<uint8_t, MemoryTag::Renderer>& GetImage() const { return m_Image; }
+    int GetWidth() const { return m_Width; }
+    int GetHeight() const { return m_Height; }
+
+    void SetMaxSpeed(float maxSpeed) { m_MaxSpeed = maxSpeed; }
+    float GetMaxSpeed() const { return m_MaxSpeed; }
+};
@@ -17,8 +17,3 @@
 
 // Returns true if shaderPath is valid
 bool IsShaderPathOk(std::string shaderPath);
-
-// Renders the edges of the simulations
-// IN THE FUTURE I WILL MAEK GLM::VEC4 CONSINSTENT WITH ALL THE REST
-void BoundsRenderer(Vec2 bottomLeft, Vec2 topRight, float borderWidth,
-    glm::vec4 color, const glm::mat4& simulationViewMatrix);
\ No newline at end of file
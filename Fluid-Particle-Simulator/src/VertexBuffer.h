@@ -13,4 +13,5 @@ public:
 	void UnBind() const;
 	void Resize(size_t newSize);
 	size_t GetSize() const { return m_Size; }
+	unsigned int GetRendererID() const { return m_RendererID; }
 };
\ No newline at end of file
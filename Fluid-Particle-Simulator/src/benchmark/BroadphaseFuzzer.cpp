@@ -0,0 +1,371 @@
+#include "BroadphaseFuzzer.h"
+#include "../physics/Physics.h"
+#include "../core/ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+const int DEFAULT_CASES = 200;
+const unsigned int DEFAULT_SEED = 1;
+
+// Particles per case, brute force is quadratic so cases stay small
+const int MIN_PARTICLES = 2;
+const int MAX_PARTICLES = 1500;
+
+// Cell size as a multiple of the pair distance. The simulation uses 2.1 (InitSpatialGrid),
+// the other cases draw a factor in this range. Below 1 a cell can't see every neighbour
+const float SIMULATION_CELL_FACTOR = 2.1f;
+const float MIN_CELL_FACTOR = 1.0f;
+const float MAX_CELL_FACTOR = 3.0f;
+
+// Threads of the threaded broadphase, enough bands to split a small grid
+const int FUZZ_THREADS = 4;
+
+// Examples printed for the first failing case of each broadphase
+const int MAX_REPORTED_PAIRS = 5;
+
+typedef std::pair<int, int> ParticlePair;
+
+// --- Broadphases under test, add new ones to BROADPHASES ---
+
+struct FuzzCase {
+    ParticleVector particles;
+    Bounds bounds;
+    float maxDistance;
+    float cellSize;
+};
+
+static void GridPairs(const FuzzCase& fuzzCase, ThreadPool*, std::vector<ParticlePair>& pairs)
+{
+    SpatialGrid grid(fuzzCase.bounds.bottomLeft, fuzzCase.bounds.topRight, fuzzCase.cellSize,
+        static_cast<int>(fuzzCase.particles.size()));
+    grid.Build(fuzzCase.particles);
+    const CollisionPairList& gridPairs = grid.GetPotentialCollisionPairs(fuzzCase.particles, fuzzCase.maxDistance);
+    pairs.assign(gridPairs.begin(), gridPairs.end());
+}
+
+static void ThreadedGridPairs(const FuzzCase& fuzzCase, ThreadPool* threadPool, std::vector<ParticlePair>& pairs)
+{
+    SpatialGrid grid(fuzzCase.bounds.bottomLeft, fuzzCase.bounds.topRight, fuzzCase.cellSize,
+        static_cast<int>(fuzzCase.particles.size()));
+    grid.Build(fuzzCase.particles);
+    const CollisionPairList& gridPairs = grid.GetPotentialCollisionPairs(fuzzCase.particles, fuzzCase.maxDistance, *threadPool);
+    pairs.assign(gridPairs.begin(), gridPairs.end());
+}
+
+struct Broadphase {
+    const char* name;
+    void (*findPairs)(const FuzzCase& fuzzCase, ThreadPool* threadPool, std::vector<ParticlePair>& pairs);
+};
+
+const Broadphase BROADPHASES[] = {
+    { "grid",          GridPairs },
+    { "grid_threaded", ThreadedGridPairs }
+};
+
+// --- Particle distributions ---
+
+enum class Distribution {
+    Uniform = 0,        // Anywhere in the box
+    Clustered = 1,      // Gaussian blobs a few diameters wide
+    BoundaryHugging = 2,// On the box edges and corners, and on the cell borders
+    OutOfBounds = 3,    // Part of the particles outside the box, the grid clamps them to the edge cells
+    Coincident = 4,     // Many particles on the same few points
+    Lattice = 5,        // Square lattice with a pair distance spacing, neighbours exactly at the limit
+    Count = 6
+};
+
+const char* DISTRIBUTION_NAMES[] = { "uniform", "clustered", "boundary", "out_of_bounds", "coincident", "lattice" };
+
+// Move value by steps representable floats, up for positive steps
+static float Nudge(float value, int steps)
+{
+    for (; steps > 0; steps--)
+        value = std::nextafter(value, INFINITY);
+    for (; steps < 0; steps++)
+        value = std::nextafter(value, -INFINITY);
+    return value;
+}
+
+static FuzzCase GenerateCase(Distribution distribution, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> countDistribution(MIN_PARTICLES, MAX_PARTICLES);
+
+    FuzzCase fuzzCase;
+    const float radius = 0.5f + unit(rng) * 5.5f;
+    fuzzCase.maxDistance = 2.0f * radius;
+
+    // Half the cases use the simulation's cell size, the rest sweep the allowed range
+    const float cellFactor = unit(rng) < 0.5f ? SIMULATION_CELL_FACTOR
+        : MIN_CELL_FACTOR + unit(rng) * (MAX_CELL_FACTOR - MIN_CELL_FACTOR);
+    fuzzCase.cellSize = cellFactor * fuzzCase.maxDistance;
+
+    // Boxes from a single cell to a few dozen, placed anywhere so the grid origin isn't 0
+    const float width = fuzzCase.cellSize * (1.0f + unit(rng) * 40.0f);
+    const float height = fuzzCase.cellSize * (1.0f + unit(rng) * 40.0f);
+    const Vec2 origin((unit(rng) - 0.5f) * 2000.0f, (unit(rng) - 0.5f) * 2000.0f);
+    fuzzCase.bounds.bottomLeft = origin;
+    fuzzCase.bounds.topRight = Vec2(origin.x + width, origin.y + height);
+
+    const int count = countDistribution(rng);
+    std::vector<Vec2> positions;
+    positions.reserve(count);
+
+    switch (distribution)
+    {
+    case Distribution::Uniform:
+        for (int i = 0; i < count; i++)
+            positions.push_back(Vec2(origin.x + unit(rng) * width, origin.y + unit(rng) * height));
+        break;
+
+    case Distribution::Clustered:
+    {
+        std::normal_distribution<float> spread(0.0f, fuzzCase.maxDistance * (0.5f + unit(rng) * 3.0f));
+        const int clusters = 1 + static_cast<int>(unit(rng) * 8.0f);
+        std::vector<Vec2> centres;
+        for (int c = 0; c < clusters; c++)
+            centres.push_back(Vec2(origin.x + unit(rng) * width, origin.y + unit(rng) * height));
+        for (int i = 0; i < count; i++)
+        {
+            const Vec2& centre = centres[i % clusters];
+            positions.push_back(Vec2(centre.x + spread(rng), centre.y + spread(rng)));
+        }
+        break;
+    }
+
+    case Distribution::BoundaryHugging:
+    {
+        // Exactly on, or a few rounding steps away from, the box edges and the cell borders
+        const int columns = static_cast<int>(width / fuzzCase.cellSize) + 1;
+        const int rows = static_cast<int>(height / fuzzCase.cellSize) + 1;
+        std::uniform_int_distribution<int> columnDistribution(0, columns);
+        std::uniform_int_distribution<int> rowDistribution(0, rows);
+        std::uniform_int_distribution<int> nudgeDistribution(-2, 2);
+        for (int i = 0; i < count; i++)
+        {
+            float x = origin.x + columnDistribution(rng) * fuzzCase.cellSize;
+            float y = origin.y + rowDistribution(rng) * fuzzCase.cellSize;
+            x = Nudge(x, nudgeDistribution(rng));
+            y = Nudge(y, nudgeDistribution(rng));
+
+            // Most points slide along one border, the others stay on a crossing
+            const float slide = unit(rng);
+            if (slide < 0.4f)
+                x = origin.x + unit(rng) * width;
+            else if (slide < 0.8f)
+                y = origin.y + unit(rng) * height;
+
+            positions.push_back(Vec2(std::min(std::max(x, origin.x), origin.x + width),
+                std::min(std::max(y, origin.y), origin.y + height)));
+        }
+        break;
+    }
+
+    case Distribution::OutOfBounds:
+        // Up to three cells outside on every side, and a few far away
+        for (int i = 0; i < count; i++)
+        {
+            const float margin = unit(rng) < 0.05f ? 100.0f * fuzzCase.cellSize : 3.0f * fuzzCase.cellSize;
+            positions.push_back(Vec2(origin.x - margin + unit(rng) * (width + 2.0f * margin),
+                origin.y - margin + unit(rng) * (height + 2.0f * margin)));
+        }
+        break;
+
+    case Distribution::Coincident:
+    {
+        const int points = 1 + static_cast<int>(unit(rng) * 10.0f);
+        std::vector<Vec2> spots;
+        for (int p = 0; p < points; p++)
+            spots.push_back(Vec2(origin.x + unit(rng) * width, origin.y + unit(rng) * height));
+        for (int i = 0; i < count; i++)
+            positions.push_back(spots[i % points]);
+        break;
+    }
+
+    case Distribution::Lattice:
+    {
+        const int columns = std::max(1, static_cast<int>(width / fuzzCase.maxDistance));
+        for (int i = 0; i < count; i++)
+            positions.push_back(Vec2(origin.x + (i % columns) * fuzzCase.maxDistance,
+                origin.y + (i / columns) * fuzzCase.maxDistance));
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    for (const Vec2& position : positions)
+        fuzzCase.particles.push_back(Particle(position, Vec2(0.0f, 0.0f)));
+    return fuzzCase;
+}
+
+// Every pair within maxDistance, same test as the grid (squared distance, inclusive)
+static void BruteForcePairs(const FuzzCase& fuzzCase, std::vector<ParticlePair>& pairs)
+{
+    const ParticleVector& particles = fuzzCase.particles;
+    const float maxDistanceSq = fuzzCase.maxDistance * fuzzCase.maxDistance;
+    const int count = static_cast<int>(particles.size());
+
+    pairs.clear();
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = i + 1; j < count; j++)
+        {
+            const float dx = particles[i].position.x - particles[j].position.x;
+            const float dy = particles[i].position.y - particles[j].position.y;
+            if (dx * dx + dy * dy <= maxDistanceSq)
+                pairs.emplace_back(i, j);
+        }
+    }
+}
+
+struct PairDifference {
+    std::vector<ParticlePair> missing;  // Found by brute force only
+    std::vector<ParticlePair> extra;    // Found by the broadphase only
+    int duplicates = 0;                 // Pairs the broadphase reported more than once
+    int selfPairs = 0;                  // Particle paired with itself
+};
+
+// expected must be sorted, found is normalised (smaller index first) and sorted in place
+static PairDifference ComparePairs(const std::vector<ParticlePair>& expected, std::vector<ParticlePair>& found)
+{
+    PairDifference difference;
+    for (ParticlePair& pair : found)
+    {
+        if (pair.first > pair.second)
+            std::swap(pair.first, pair.second);
+        difference.selfPairs += pair.first == pair.second;
+    }
+    std::sort(found.begin(), found.end());
+
+    const size_t unique = std::unique(found.begin(), found.end()) - found.begin();
+    difference.duplicates = static_cast<int>(found.size() - unique);
+    found.resize(unique);
+
+    std::set_difference(expected.begin(), expected.end(), found.begin(), found.end(), std::back_inserter(difference.missing));
+    std::set_difference(found.begin(), found.end(), expected.begin(), expected.end(), std::back_inserter(difference.extra));
+    return difference;
+}
+
+static void PrintPair(const char* kind, const FuzzCase& fuzzCase, const ParticlePair& pair)
+{
+    const Vec2& a = fuzzCase.particles[pair.first].position;
+    const Vec2& b = fuzzCase.particles[pair.second].position;
+    const Vec2& minBound = fuzzCase.bounds.bottomLeft;
+    printf("    %s %d (%.9g, %.9g) cell (%d, %d) - %d (%.9g, %.9g) cell (%d, %d), distance %.9g\n", kind,
+        pair.first, a.x, a.y, static_cast<int>((a.x - minBound.x) / fuzzCase.cellSize), static_cast<int>((a.y - minBound.y) / fuzzCase.cellSize),
+        pair.second, b.x, b.y, static_cast<int>((b.x - minBound.x) / fuzzCase.cellSize), static_cast<int>((b.y - minBound.y) / fuzzCase.cellSize),
+        (a - b).length());
+}
+
+// Totals of one broadphase over one distribution
+struct FuzzTotals {
+    int cases = 0;
+    int failedCases = 0;
+    long long expectedPairs = 0;
+    long long missing = 0;
+    long long extra = 0;
+    long long duplicates = 0;
+    long long selfPairs = 0;
+};
+
+int RunBroadphaseFuzzer(int argc, char** argv)
+{
+    int cases = DEFAULT_CASES;
+    unsigned int seed = DEFAULT_SEED;
+
+    // argv[1] is --fuzz-broadphase
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--cases") == 0 && i + 1 < argc)
+            cases = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        else
+        {
+            std::cerr << "Unknown fuzzer option " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " --fuzz-broadphase [--cases <n>] [--seed <n>]" << std::endl;
+            return -1;
+        }
+    }
+
+    const int broadphaseCount = static_cast<int>(sizeof(BROADPHASES) / sizeof(BROADPHASES[0]));
+    const int distributionCount = static_cast<int>(Distribution::Count);
+    std::vector<FuzzTotals> totals(broadphaseCount * distributionCount);
+    std::vector<bool> reported(broadphaseCount, false);
+
+    ThreadPool threadPool(FUZZ_THREADS);
+    std::vector<ParticlePair> expected;
+    std::vector<ParticlePair> found;
+
+    for (int c = 0; c < cases; c++)
+    {
+        const unsigned int caseSeed = seed + c;
+        for (int d = 0; d < distributionCount; d++)
+        {
+            std::mt19937 rng(caseSeed * distributionCount + d);
+            const FuzzCase fuzzCase = GenerateCase(static_cast<Distribution>(d), rng);
+            BruteForcePairs(fuzzCase, expected);
+
+            for (int b = 0; b < broadphaseCount; b++)
+            {
+                BROADPHASES[b].findPairs(fuzzCase, &threadPool, found);
+                const PairDifference difference = ComparePairs(expected, found);
+
+                FuzzTotals& total = totals[b * distributionCount + d];
+                const bool failed = !difference.missing.empty() || !difference.extra.empty() ||
+                    difference.duplicates > 0 || difference.selfPairs > 0;
+                total.cases++;
+                total.failedCases += failed;
+                total.expectedPairs += expected.size();
+                total.missing += difference.missing.size();
+                total.extra += difference.extra.size();
+                total.duplicates += difference.duplicates;
+                total.selfPairs += difference.selfPairs;
+
+                if (!failed || reported[b])
+                    continue;
+
+                // Details of the first failure only, the totals cover the rest
+                reported[b] = true;
+                printf("%s failed on %s, case seed %u: %d particles, pair distance %.9g, cell %.9g, box (%.9g, %.9g) - (%.9g, %.9g)\n",
+                    BROADPHASES[b].name, DISTRIBUTION_NAMES[d], caseSeed, static_cast<int>(fuzzCase.particles.size()),
+                    fuzzCase.maxDistance, fuzzCase.cellSize, fuzzCase.bounds.bottomLeft.x, fuzzCase.bounds.bottomLeft.y,
+                    fuzzCase.bounds.topRight.x, fuzzCase.bounds.topRight.y);
+                for (size_t i = 0; i < difference.missing.size() && i < MAX_REPORTED_PAIRS; i++)
+                    PrintPair("missing", fuzzCase, difference.missing[i]);
+                for (size_t i = 0; i < difference.extra.size() && i < MAX_REPORTED_PAIRS; i++)
+                    PrintPair("extra  ", fuzzCase, difference.extra[i]);
+            }
+        }
+    }
+
+    printf("\n%-14s %-14s %6s %7s %12s %9s %9s %9s %6s\n",
+        "broadphase", "distribution", "cases", "failed", "pairs", "missing", "extra", "dupes", "self");
+
+    bool passed = true;
+    for (int b = 0; b < broadphaseCount; b++)
+    {
+        for (int d = 0; d < distributionCount; d++)
+        {
+            const FuzzTotals& total = totals[b * distributionCount + d];
+            passed = passed && total.failedCases == 0;
+            printf("%-14s %-14s %6d %7d %12lld %9lld %9lld %9lld %6lld\n",
+                BROADPHASES[b].name, DISTRIBUTION_NAMES[d], total.cases, total.failedCases,
+                total.expectedPairs, total.missing, total.extra, total.duplicates, total.selfPairs);
+        }
+    }
+
+    printf("\n%s\n", passed ? "Every broadphase matches brute force" : "BROADPHASE MISMATCH");
+    return passed ? 0 : 1;
+}
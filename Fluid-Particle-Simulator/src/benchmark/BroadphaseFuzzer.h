@@ -0,0 +1,9 @@
+#pragma once
+
+// Differential test of the broadphases against brute force. Every case draws random
+// particles (uniform, clustered, boundary hugging, out of bounds, coincident, lattice),
+// runs each broadphase and compares its pairs with every pair closer than a diameter,
+// reporting missing, extra and duplicated pairs. Returns 1 if any broadphase disagrees.
+// Started with --fuzz-broadphase [--cases <n>] [--seed <n>], argv is the full command line.
+// Case i of a run uses seed + i, so --seed <case seed> --cases 1 replays a failing case
+int RunBroadphaseFuzzer(int argc, char** argv);
@@ -0,0 +1,858 @@
+#include "PhysicsBenchmark.h"
+#include "../physics/Physics.h"
+#include "../physics/ConservationMonitor.h"
+#include "../physics/FluidSurface.h"
+#include "../core/MemoryTracker.h"
+#include "../core/PerfCounters.h"
+#include "../core/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Radius of every benchmark particle, the box is sized from the packing fraction
+const float PARTICLE_RADIUS = 1.0f;
+
+// Step used by the integration and stream kernels, the simulation runs 60 Hz with 6 substeps
+const float DELTA_TIME = 1.0f / 360.0f;
+
+// Initial speed range of the particles, in units per second on each axis
+const float MAX_INITIAL_SPEED = 10.0f;
+
+// Streams timed by the UpdateStreams kernel and how many particles each spawns per call
+const int STREAM_COUNT = 16;
+const int PARTICLES_PER_STREAM_CALL = 8;
+
+// Repetitions scale with the particle count so every measurement takes a similar time
+const double TARGET_PARTICLES_PER_KERNEL = 2.0e6;
+const int MIN_REPETITIONS = 5;
+const int MAX_REPETITIONS = 30;
+const int QUICK_MAX_REPETITIONS = 10;
+const int WARMUP_REPETITIONS = 1;
+
+const std::vector<int> PARTICLE_COUNTS = { 1000, 10000, 100000, 1000000 };
+const std::vector<int> QUICK_PARTICLE_COUNTS = { 1000, 10000, 100000 };
+
+// How the particles are laid out. Packing is the fraction of the box covered by particles
+struct Scenario {
+    const char* name;
+    float packing;
+    bool lattice;   // Hexagonal lattice, otherwise uniformly random positions
+    float jitter;   // Random offset on the lattice, as a fraction of the lattice spacing
+};
+
+const Scenario SCENARIOS[] = {
+    { "gas",   0.05f, false, 0.0f },    // Sparse, few contacts
+    { "fluid", 0.60f, true,  0.20f },   // Some neighbours touching
+    { "dense", 0.90f, true,  0.10f }    // Resting pile, most neighbours overlap
+};
+
+enum class Kernel {
+    GridBuild = 0,      // SpatialGrid Build
+    FindPairs = 1,      // GetPotentialCollisionPairs
+    SolvePairs = 2,     // SolveCollisionParticle over every pair
+    SolveBorder = 3,    // SolveCollisionBorder over every particle
+    Integrate = 4,      // Forces, velocities, positions and temperatures
+    UpdateStreams = 5,  // Particle streams spawning new particles
+    Count = 6
+};
+
+const char* KERNEL_NAMES[] = { "grid_build", "find_pairs", "solve_pairs", "solve_border", "integrate", "update_streams" };
+
+// Kernels that take a thread pool, the others only run with one thread
+const bool KERNEL_THREADED[] = { false, true, false, true, true, false };
+
+struct BenchmarkOptions {
+    bool quick = false;
+    bool perf = false;      // Hardware counters per physics phase, single threaded
+    bool genericKernels = false;    // Skip the kernels specialised for the scene
+    std::string outputPath = "physics_benchmark.json";
+};
+
+struct BenchmarkResult {
+    const char* kernel;
+    const char* scenario;
+    int particles;
+    int threads;
+    int repetitions;
+    double medianMs;
+    double meanMs;
+    double stddevMs;
+    double minMs;
+    double maxMs;
+    double nsPerParticle;   // Median time over the particles the kernel processed
+    size_t pairs;           // Pairs found or solved, 0 for the other kernels
+    double pairsPerSecond;
+};
+
+static bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+    // argv[1] is --benchmark
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+            options.quick = true;
+        else if (std::strcmp(argv[i], "--perf") == 0)
+            options.perf = true;
+        else if (std::strcmp(argv[i], "--generic-kernels") == 0)
+            options.genericKernels = true;
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            options.outputPath = argv[++i];
+        else
+        {
+            std::cerr << "Unknown benchmark option " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " --benchmark [--quick] [--perf] [--generic-kernels] [--output <file.json>]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 1, 2, 4 ... up to the hardware threads, which are always included
+static std::vector<int> GetThreadCounts()
+{
+    const int hardwareThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    std::vector<int> counts;
+    for (int threads = 1; threads < hardwareThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(hardwareThreads);
+    return counts;
+}
+
+// Positions and bounds of a box that particleCount particles fill at the scenario's
+// packing. The seed is fixed so every run times the same layout
+static void GenerateScene(const Scenario& scenario, int particleCount,
+    std::vector<Vec2>& positions, Vec2& bottomLeft, Vec2& topRight)
+{
+    const float particleArea = 3.14159265f * PARTICLE_RADIUS * PARTICLE_RADIUS;
+    const float side = std::sqrt(particleCount * particleArea / scenario.packing);
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> unit(-0.5f, 0.5f);
+    positions.clear();
+    positions.reserve(particleCount);
+
+    float top = side * 0.5f;
+    float margin = 2.0f * PARTICLE_RADIUS;
+    if (scenario.lattice)
+    {
+        // Hexagonal lattice whose cell area gives the requested packing
+        const float spacing = std::sqrt(2.0f * particleArea / (std::sqrt(3.0f) * scenario.packing));
+        const float rowHeight = spacing * std::sqrt(3.0f) * 0.5f;
+        const int columns = std::max(1, static_cast<int>(side / spacing));
+
+        for (int i = 0; i < particleCount; i++)
+        {
+            const int row = i / columns;
+            const int column = i % columns;
+            const float x = -side * 0.5f + (column + 0.5f * (row % 2)) * spacing;
+            const float y = -side * 0.5f + row * rowHeight;
+            positions.push_back(Vec2(x + unit(rng) * scenario.jitter * spacing, y + unit(rng) * scenario.jitter * spacing));
+        }
+
+        // The rows don't tile the square exactly, the box grows to hold the last one
+        top = std::max(top, -side * 0.5f + ((particleCount - 1) / columns) * rowHeight);
+        margin += spacing;
+    }
+    else
+    {
+        for (int i = 0; i < particleCount; i++)
+            positions.push_back(Vec2(unit(rng) * side, unit(rng) * side));
+    }
+
+    bottomLeft = Vec2(-side * 0.5f - margin, -side * 0.5f - margin);
+    topRight = Vec2(side * 0.5f + margin, top + margin);
+}
+
+static int GetRepetitions(int particleCount, bool quick)
+{
+    const int repetitions = static_cast<int>(TARGET_PARTICLES_PER_KERNEL / particleCount);
+    return std::min(std::max(repetitions, MIN_REPETITIONS), quick ? QUICK_MAX_REPETITIONS : MAX_REPETITIONS);
+}
+
+// Restart the streams so every repetition spawns the same particles
+static void ResetStreams(SimulationSystem& sim)
+{
+    sim.ClearStreams();
+    for (int i = 0; i < STREAM_COUNT; i++)
+    {
+        sim.AddParticleStream(1 << 30, PARTICLES_PER_STREAM_CALL / DELTA_TIME, Vec2(MAX_INITIAL_SPEED, 0.0f),
+            1.0f, Vec2(i * 4.0f * PARTICLE_RADIUS, 0.0f));
+    }
+}
+
+// Run the kernel once on the current state and return its time in milliseconds.
+// processed is set to the number of particles it handled
+static double RunKernel(Kernel kernel, SimulationSystem& sim, const CollisionPairList& pairs,
+    ThreadPool* threadPool, size_t& processed)
+{
+    ParticleVector& particles = sim.GetParticles();
+    processed = particles.size();
+
+    // Untimed setup
+    if (kernel == Kernel::FindPairs)
+    {
+        BuildSpatialGrid(sim);
+        sim.ResetStepArena(threadPool ? threadPool->GetThreadCount() : 1);
+    }
+    if (kernel == Kernel::UpdateStreams)
+        ResetStreams(sim);
+
+    const auto start = std::chrono::steady_clock::now();
+    switch (kernel)
+    {
+    case Kernel::GridBuild:     BuildSpatialGrid(sim); break;
+    case Kernel::FindPairs:     FindCollisionPairs(sim, threadPool); break;
+    case Kernel::SolvePairs:    SolveParticleCollisions(sim, pairs); break;
+    case Kernel::SolveBorder:   SolveBorderCollisions(sim, threadPool); break;
+    case Kernel::Integrate:     IntegrateParticles(sim, DELTA_TIME, threadPool); break;
+    case Kernel::UpdateStreams: sim.UpdateStreams(DELTA_TIME); break;
+    default: break;
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    if (kernel == Kernel::UpdateStreams)
+        processed = particles.size() - processed;
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Full serial steps from the initial particles with the counters around every phase.
+// Counters only follow the calling thread, which is why --perf runs single threaded
+static void ReportPerfCounters(const Scenario& scenario, SimulationSystem& sim,
+    const ParticleVector& initialParticles, int steps)
+{
+    sim.ClearStreams();
+    sim.GetParticles() = initialParticles;
+
+    PerfCounters::Reset();
+    for (int step = 0; step < steps; step++)
+        UpdatePhysics(sim, DELTA_TIME, true);
+
+    printf("\nHardware counters, %s with %d particles, %d steps\n",
+        scenario.name, static_cast<int>(initialParticles.size()), steps);
+    PerfCounters::WriteReport(std::cout);
+    printf("\n");
+    fflush(stdout);
+}
+
+static BenchmarkResult MeasureKernel(Kernel kernel, const Scenario& scenario, SimulationSystem& sim,
+    const ParticleVector& initialParticles, const CollisionPairList& pairs,
+    ThreadPool* threadPool, int threads, int repetitions)
+{
+    std::vector<double> samples;
+    size_t processed = 0;
+
+    for (int repetition = 0; repetition < WARMUP_REPETITIONS + repetitions; repetition++)
+    {
+        // Every repetition starts from the same particles
+        sim.GetParticles() = initialParticles;
+
+        const double milliseconds = RunKernel(kernel, sim, pairs, threadPool, processed);
+        if (repetition >= WARMUP_REPETITIONS)
+            samples.push_back(milliseconds);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const size_t count = samples.size();
+
+    double sum = 0.0;
+    for (const double sample : samples)
+        sum += sample;
+    const double mean = sum / count;
+
+    double squares = 0.0;
+    for (const double sample : samples)
+        squares += (sample - mean) * (sample - mean);
+
+    BenchmarkResult result;
+    result.kernel = KERNEL_NAMES[static_cast<int>(kernel)];
+    result.scenario = scenario.name;
+    result.particles = static_cast<int>(initialParticles.size());
+    result.threads = threads;
+    result.repetitions = static_cast<int>(count);
+    result.medianMs = (count % 2) ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) * 0.5;
+    result.meanMs = mean;
+    result.stddevMs = count > 1 ? std::sqrt(squares / (count - 1)) : 0.0;
+    result.minMs = samples.front();
+    result.maxMs = samples.back();
+    result.nsPerParticle = processed > 0 ? result.medianMs * 1.0e6 / processed : 0.0;
+
+    const bool pairKernel = kernel == Kernel::FindPairs || kernel == Kernel::SolvePairs;
+    result.pairs = pairKernel ? pairs.size() : 0;
+    result.pairsPerSecond = (pairKernel && result.medianMs > 0.0) ? result.pairs / (result.medianMs * 1.0e-3) : 0.0;
+    return result;
+}
+
+static bool WriteJson(const std::string& path, const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream file(path);
+    if (!file.good())
+        return false;
+
+    file << "{\n";
+    file << "  \"benchmark\": \"physics\",\n";
+    file << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    file << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& r = results[i];
+        char line[512];
+        snprintf(line, sizeof(line),
+            "    { \"kernel\": \"%s\", \"scenario\": \"%s\", \"particles\": %d, \"threads\": %d, \"repetitions\": %d, "
+            "\"median_ms\": %.6f, \"mean_ms\": %.6f, \"stddev_ms\": %.6f, \"min_ms\": %.6f, \"max_ms\": %.6f, "
+            "\"ns_per_particle\": %.3f, \"pairs\": %zu, \"pairs_per_second\": %.1f }%s\n",
+            r.kernel, r.scenario, r.particles, r.threads, r.repetitions,
+            r.medianMs, r.meanMs, r.stddevMs, r.minMs, r.maxMs,
+            r.nsPerParticle, r.pairs, r.pairsPerSecond, (i + 1 < results.size()) ? "," : "");
+        file << line;
+    }
+    file << "  ]\n";
+    file << "}\n";
+    return file.good();
+}
+
+int RunPhysicsBenchmark(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, options))
+        return -1;
+
+    const std::vector<int>& particleCounts = options.quick ? QUICK_PARTICLE_COUNTS : PARTICLE_COUNTS;
+
+    // Without counters the option only costs the extra report lines
+    if (options.perf && !PerfCounters::Enable())
+    {
+        std::cout << "Hardware counters unavailable, running without them: " << PerfCounters::GetStatus() << std::endl;
+        options.perf = false;
+    }
+    else if (options.perf)
+        std::cout << "Hardware counters enabled, " << PerfCounters::GetStatus() << ", timing one thread" << std::endl;
+
+    const std::vector<int> threadCounts = options.perf ? std::vector<int>{ 1 } : GetThreadCounts();
+
+    // One pool per thread count, a single thread runs the serial code without a pool
+    std::vector<std::unique_ptr<ThreadPool>> threadPools;
+    for (const int threads : threadCounts)
+        threadPools.emplace_back(threads > 1 ? new ThreadPool(threads) : nullptr);
+
+    std::vector<BenchmarkResult> results;
+    std::vector<Vec2> positions;
+
+    printf("%-8s %9s %-15s %7s %11s %10s %14s %9s\n",
+        "scene", "particles", "kernel", "threads", "median ms", "ns/part", "pairs/s", "stddev");
+
+    for (const int particleCount : particleCounts)
+    {
+        for (const Scenario& scenario : SCENARIOS)
+        {
+            Vec2 bottomLeft, topRight;
+            GenerateScene(scenario, particleCount, positions, bottomLeft, topRight);
+
+            SimulationSystem sim(bottomLeft, topRight, PARTICLE_RADIUS, 1920);
+            sim.SetUseSpecializedKernels(!options.genericKernels);
+            std::mt19937 rng(54321);
+            std::uniform_real_distribution<float> speed(-MAX_INITIAL_SPEED, MAX_INITIAL_SPEED);
+            for (const Vec2& position : positions)
+                sim.AddParticle(position, Vec2(speed(rng), speed(rng)));
+
+            // The grid is sized for the particles it is created with
+            sim.InitSpatialGrid();
+            const ParticleVector initialParticles = sim.GetParticles();
+
+            // The copy of the arena list is kept on the heap for every repetition
+            BuildSpatialGrid(sim);
+            sim.ResetStepArena(1);
+            const CollisionPairList pairs = FindCollisionPairs(sim);
+
+            const int repetitions = GetRepetitions(particleCount, options.quick);
+            for (int kernel = 0; kernel < static_cast<int>(Kernel::Count); kernel++)
+            {
+                for (size_t t = 0; t < threadCounts.size(); t++)
+                {
+                    if (threadCounts[t] > 1 && !KERNEL_THREADED[kernel]) continue;
+
+                    const BenchmarkResult result = MeasureKernel(static_cast<Kernel>(kernel), scenario, sim,
+                        initialParticles, pairs, threadPools[t].get(), threadCounts[t], repetitions);
+                    results.push_back(result);
+
+                    printf("%-8s %9d %-15s %7d %11.4f %10.2f %14.0f %8.1f%%\n",
+                        result.scenario, result.particles, result.kernel, result.threads, result.medianMs,
+                        result.nsPerParticle, result.pairsPerSecond,
+                        result.medianMs > 0.0 ? 100.0 * result.stddevMs / result.medianMs : 0.0);
+                    fflush(stdout);
+                }
+            }
+
+            if (options.perf)
+                ReportPerfCounters(scenario, sim, initialParticles, repetitions);
+        }
+    }
+
+    if (!WriteJson(options.outputPath, results))
+    {
+        std::cerr << "Failed to write " << options.outputPath << std::endl;
+        return -1;
+    }
+
+    std::cout << "Wrote " << results.size() << " results to " << options.outputPath << std::endl;
+    return 0;
+}
+
+// --- Thread scaling ---
+
+// Strong scaling times the same particles with every thread count, weak scaling gives
+// every thread the same number of particles
+const int SCALING_PARTICLES = 100000;
+const int SCALING_PARTICLES_PER_THREAD = 25000;
+const int SCALING_STEPS = 20;
+const int QUICK_SCALING_STEPS = 5;
+const int SCALING_WARMUP_STEPS = 2;
+
+// Scene of the scaling runs, a settled fluid with contacts in every cell
+const int SCALING_SCENARIO = 1;
+
+// Phases of a space partitioned step, in the order UpdatePhysics runs them. The scaling
+// scene has no streams, so UpdateStreams is left out
+const Kernel STEP_KERNELS[] = { Kernel::Integrate, Kernel::SolveBorder, Kernel::GridBuild, Kernel::FindPairs, Kernel::SolvePairs };
+const int STEP_KERNEL_COUNT = 5;
+
+struct ScalingOptions {
+    bool quick = false;
+    int particles = SCALING_PARTICLES;
+    int particlesPerThread = SCALING_PARTICLES_PER_THREAD;
+    std::string outputPath = "scaling_benchmark.json";
+};
+
+struct ScalingResult {
+    const char* mode;       // "strong" or "weak"
+    const char* kernel;     // A phase, or "step" for the whole step
+    int threads;
+    int particles;
+    double msPerStep;
+    double speedup;         // Strong: t1 / tN. Weak: scaled speedup, N * t1 / tN
+    double efficiency;      // Strong: speedup / N. Weak: t1 / tN
+    double imbalance;       // Max over mean thread busy time, 1 is perfectly balanced
+    double barrierFraction; // Share of the threads' time spent waiting for the others or for work
+};
+
+// Wall time of one phase and the busy time of each thread, summed over the steps
+struct PhaseTotals {
+    double wallNs = 0.0;
+    double poolWallNs = 0.0;
+    std::vector<double> busyNs;
+};
+
+static bool ParseScalingOptions(int argc, char** argv, ScalingOptions& options)
+{
+    // argv[1] is --scaling
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+            options.quick = true;
+        else if (std::strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+            options.particles = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--per-thread") == 0 && i + 1 < argc)
+            options.particlesPerThread = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            options.outputPath = argv[++i];
+        else
+        {
+            std::cerr << "Unknown scaling option " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " --scaling [--quick] [--particles <n>] [--per-thread <n>] [--output <file.json>]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run the step phase by phase on a fresh scene and add each phase's times to totals
+static void MeasureScaling(int particleCount, ThreadPool& threadPool, int steps, std::vector<PhaseTotals>& totals)
+{
+    std::vector<Vec2> positions;
+    Vec2 bottomLeft, topRight;
+    GenerateScene(SCENARIOS[SCALING_SCENARIO], particleCount, positions, bottomLeft, topRight);
+
+    SimulationSystem sim(bottomLeft, topRight, PARTICLE_RADIUS, 1920);
+    std::mt19937 rng(54321);
+    std::uniform_real_distribution<float> speed(-MAX_INITIAL_SPEED, MAX_INITIAL_SPEED);
+    for (const Vec2& position : positions)
+        sim.AddParticle(position, Vec2(speed(rng), speed(rng)));
+    sim.InitSpatialGrid();
+
+    const int threads = threadPool.GetThreadCount();
+    totals.assign(STEP_KERNEL_COUNT, PhaseTotals());
+    for (PhaseTotals& phase : totals)
+        phase.busyNs.assign(threads, 0.0);
+
+    threadPool.SetCollectTimings(true);
+    const CollisionPairList* pairs = nullptr;
+    for (int step = 0; step < SCALING_WARMUP_STEPS + steps; step++)
+    {
+        sim.ResetStepArena(threads);
+        for (int k = 0; k < STEP_KERNEL_COUNT; k++)
+        {
+            threadPool.ResetTimings();
+            const auto start = std::chrono::steady_clock::now();
+            switch (STEP_KERNELS[k])
+            {
+            case Kernel::Integrate:   IntegrateParticles(sim, DELTA_TIME, &threadPool); break;
+            case Kernel::SolveBorder: SolveBorderCollisions(sim, &threadPool); break;
+            case Kernel::GridBuild:   BuildSpatialGrid(sim); break;
+            case Kernel::FindPairs:   pairs = &FindCollisionPairs(sim, &threadPool); break;
+            case Kernel::SolvePairs:  SolveParticleCollisions(sim, *pairs); break;
+            default: break;
+            }
+            const double wallNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (step < SCALING_WARMUP_STEPS)
+                continue;
+
+            // Serial phases run on the calling thread while the others idle
+            const ThreadPoolTimings timings = threadPool.GetTimings();
+            PhaseTotals& phase = totals[k];
+            phase.wallNs += wallNs;
+            if (timings.parallelCalls == 0)
+            {
+                phase.poolWallNs += wallNs;
+                phase.busyNs[0] += wallNs;
+            }
+            else
+            {
+                phase.poolWallNs += static_cast<double>(timings.wallNs);
+                for (int t = 0; t < threads; t++)
+                    phase.busyNs[t] += static_cast<double>(timings.busyNs[t]);
+            }
+        }
+    }
+    threadPool.SetCollectTimings(false);
+}
+
+static ScalingResult MakeScalingResult(const char* mode, const char* kernel, int threads, int particles, int steps,
+    const PhaseTotals& phase)
+{
+    ScalingResult result;
+    result.mode = mode;
+    result.kernel = kernel;
+    result.threads = threads;
+    result.particles = particles;
+    result.msPerStep = phase.wallNs * 1.0e-6 / steps;
+    result.speedup = 1.0;
+    result.efficiency = 1.0;
+
+    double busySum = 0.0;
+    double busyMax = 0.0;
+    for (const double busy : phase.busyNs)
+    {
+        busySum += busy;
+        busyMax = std::max(busyMax, busy);
+    }
+    const double busyMean = busySum / threads;
+    result.imbalance = busyMean > 0.0 ? busyMax / busyMean : 1.0;
+    result.barrierFraction = phase.poolWallNs > 0.0 ? std::max(0.0, 1.0 - busySum / (threads * phase.poolWallNs)) : 0.0;
+    return result;
+}
+
+// Speedup and efficiency against the single thread run of the same mode and kernel
+static void SetScalingSpeedups(std::vector<ScalingResult>& results)
+{
+    for (ScalingResult& result : results)
+    {
+        for (const ScalingResult& single : results)
+        {
+            if (single.threads != 1 || std::strcmp(single.mode, result.mode) != 0 || std::strcmp(single.kernel, result.kernel) != 0)
+                continue;
+            if (result.msPerStep <= 0.0)
+                break;
+
+            const double ratio = single.msPerStep / result.msPerStep;
+            const bool strong = std::strcmp(result.mode, "strong") == 0;
+            result.speedup = strong ? ratio : ratio * result.threads;
+            result.efficiency = strong ? ratio / result.threads : ratio;
+            break;
+        }
+    }
+}
+
+static bool WriteScalingJson(const std::string& path, const std::vector<ScalingResult>& results)
+{
+    std::ofstream file(path);
+    if (!file.good())
+        return false;
+
+    file << "{\n";
+    file << "  \"benchmark\": \"scaling\",\n";
+    file << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    file << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const ScalingResult& r = results[i];
+        char line[512];
+        snprintf(line, sizeof(line),
+            "    { \"mode\": \"%s\", \"kernel\": \"%s\", \"threads\": %d, \"particles\": %d, \"ms_per_step\": %.6f, "
+            "\"speedup\": %.4f, \"efficiency\": %.4f, \"imbalance\": %.4f, \"barrier_fraction\": %.4f }%s\n",
+            r.mode, r.kernel, r.threads, r.particles, r.msPerStep,
+            r.speedup, r.efficiency, r.imbalance, r.barrierFraction, (i + 1 < results.size()) ? "," : "");
+        file << line;
+    }
+    file << "  ]\n";
+    file << "}\n";
+    return file.good();
+}
+
+int RunScalingBenchmark(int argc, char** argv)
+{
+    ScalingOptions options;
+    if (!ParseScalingOptions(argc, argv, options))
+        return -1;
+
+    const int steps = options.quick ? QUICK_SCALING_STEPS : SCALING_STEPS;
+    const std::vector<int> threadCounts = GetThreadCounts();
+    const char* modes[2] = { "strong", "weak" };
+
+    std::vector<ScalingResult> results;
+    std::vector<PhaseTotals> totals;
+    for (const char* mode : modes)
+    {
+        for (const int threads : threadCounts)
+        {
+            const int particles = std::strcmp(mode, "strong") == 0 ? options.particles : options.particlesPerThread * threads;
+
+            ThreadPool threadPool(threads);
+            MeasureScaling(particles, threadPool, steps, totals);
+
+            // The step is the sum of its phases
+            PhaseTotals step;
+            step.busyNs.assign(threads, 0.0);
+            for (int k = 0; k < STEP_KERNEL_COUNT; k++)
+            {
+                results.push_back(MakeScalingResult(mode, KERNEL_NAMES[static_cast<int>(STEP_KERNELS[k])],
+                    threads, particles, steps, totals[k]));
+
+                step.wallNs += totals[k].wallNs;
+                step.poolWallNs += totals[k].poolWallNs;
+                for (int t = 0; t < threads; t++)
+                    step.busyNs[t] += totals[k].busyNs[t];
+            }
+            results.push_back(MakeScalingResult(mode, "step", threads, particles, steps, step));
+        }
+    }
+    SetScalingSpeedups(results);
+
+    printf("%-6s %-13s %7s %9s %11s %8s %10s %9s %8s\n",
+        "mode", "kernel", "threads", "particles", "ms/step", "speedup", "efficiency", "imbalance", "barrier");
+    for (const ScalingResult& r : results)
+    {
+        printf("%-6s %-13s %7d %9d %11.4f %7.2fx %9.0f%% %9.2f %7.0f%%\n",
+            r.mode, r.kernel, r.threads, r.particles, r.msPerStep, r.speedup,
+            r.efficiency * 100.0, r.imbalance, r.barrierFraction * 100.0);
+    }
+
+    if (!WriteScalingJson(options.outputPath, results))
+    {
+        std::cerr << "Failed to write " << options.outputPath << std::endl;
+        return -1;
+    }
+
+    std::cout << "Wrote " << results.size() << " results to " << options.outputPath << std::endl;
+    return 0;
+}
+
+// Steps of each memory report scene, enough for the pair buffers to reach their working size
+const int MEMORY_STEPS = 5;
+
+int RunMemoryReport(int argc, char** argv)
+{
+    // argv[1] is --memory
+    bool quick = false;
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else
+        {
+            std::cerr << "Unknown memory option " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " --memory [--quick]" << std::endl;
+            return -1;
+        }
+    }
+
+    ThreadPool threadPool;
+    const Scenario& scenario = SCENARIOS[SCALING_SCENARIO];
+    for (const int particleCount : quick ? QUICK_PARTICLE_COUNTS : PARTICLE_COUNTS)
+    {
+        // Everything of the previous scene is freed, so the peaks start from the idle sizes
+        MemoryTracker::ResetPeaks();
+        {
+            std::vector<Vec2> positions;
+            Vec2 bottomLeft, topRight;
+            GenerateScene(scenario, particleCount, positions, bottomLeft, topRight);
+
+            SimulationSystem sim(bottomLeft, topRight, PARTICLE_RADIUS, 1920);
+            for (const Vec2& position : positions)
+                sim.AddParticle(position, Vec2(0.0f, 0.0f));
+            sim.InitSpatialGrid();
+
+            FluidSurface surface(sim, threadPool);
+            for (int step = 0; step < MEMORY_STEPS; step++)
+            {
+                UpdatePhysics(sim, DELTA_TIME, true, &threadPool);
+                surface.Update();
+            }
+
+            std::cout << scenario.name << ", " << particleCount << " particles, " << MEMORY_STEPS << " steps" << std::endl;
+            MemoryTracker::WriteReport(std::cout, sim.GetParticleCount());
+            std::cout << std::endl;
+        }
+    }
+    return 0;
+}
+
+// Precision report: particles, steps (2 simulated seconds, enough for the gas to fall the
+// height of its box) and how often the samples are compared
+const int PRECISION_PARTICLES = 100000;
+const int QUICK_PRECISION_PARTICLES = 20000;
+const int PRECISION_STEPS = 720;
+const int QUICK_PRECISION_STEPS = 360;
+const int PRECISION_SAMPLES = 6;
+const int PRECISION_TIMED_STEPS = 30;
+
+// Largest relative difference of the total and the kinetic energy between the two storages,
+// and how much deeper the compact contacts may overlap, relative to the full storage's
+// overlap plus a hundredth of a radius
+const double PRECISION_ENERGY_TOLERANCE = 0.02;
+const double PRECISION_OVERLAP_TOLERANCE = 0.25;
+const double PRECISION_OVERLAP_SLACK = 0.01;
+
+struct PrecisionRun {
+    std::vector<ConservationSample> samples;
+    double msPerStep = 0.0;
+    double particleBytes = 0.0;     // Heap bytes per particle held by the particle storage
+    double trackedBytes = 0.0;      // Same for every tracked subsystem: storage, grid, pairs, step arena
+};
+
+// Step the scene in storage with a conservation monitor, sampling it PRECISION_SAMPLES
+// times, then time a few steps without the monitor
+static PrecisionRun RunPrecision(ParticleStorage storage, const std::vector<Vec2>& positions,
+    const std::vector<Vec2>& velocities, const Vec2& bottomLeft, const Vec2& topRight, int steps, ThreadPool& threadPool)
+{
+    SimulationSystem sim(bottomLeft, topRight, PARTICLE_RADIUS, 1920);
+    sim.SetParticleStorage(storage);
+    for (size_t i = 0; i < positions.size(); i++)
+        sim.AddParticle(positions[i], velocities[i]);
+    sim.InitSpatialGrid();
+
+    PrecisionRun run;
+
+    ConservationMonitor monitor;
+    sim.SetConservationMonitor(&monitor);
+    const int interval = std::max(1, steps / PRECISION_SAMPLES);
+    for (int step = 1; step <= steps; step++)
+    {
+        UpdatePhysics(sim, DELTA_TIME, true, &threadPool);
+        if (step % interval == 0)
+            run.samples.push_back(monitor.GetLastSample());
+    }
+    sim.SetConservationMonitor(nullptr);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < PRECISION_TIMED_STEPS; step++)
+        UpdatePhysics(sim, DELTA_TIME, true, &threadPool);
+    run.msPerStep = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / PRECISION_TIMED_STEPS;
+
+    // Read from the tracker after the steps, so copies and scratch buffers count too. The
+    // other storage's run has freed everything by now
+    const double count = static_cast<double>(sim.GetParticleCount());
+    run.particleBytes = MemoryTracker::GetStats(MemoryTag::Particles).currentBytes / count;
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+        run.trackedBytes += MemoryTracker::GetStats(static_cast<MemoryTag>(tag)).currentBytes / count;
+    return run;
+}
+
+int RunPrecisionReport(int argc, char** argv)
+{
+    // argv[1] is --precision
+    bool quick = false;
+    int particleCount = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (std::strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+            particleCount = std::atoi(argv[++i]);
+        else
+        {
+            std::cerr << "Unknown precision option " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " --precision [--quick] [--particles <n>]" << std::endl;
+            return -1;
+        }
+    }
+    if (particleCount <= 0)
+        particleCount = quick ? QUICK_PRECISION_PARTICLES : PRECISION_PARTICLES;
+    const int steps = quick ? QUICK_PRECISION_STEPS : PRECISION_STEPS;
+
+    ThreadPool threadPool;
+    bool passed = true;
+
+    // Gas falls fast through an empty box, fluid settles into a packed pile
+    for (const Scenario* scenario : { &SCENARIOS[0], &SCENARIOS[SCALING_SCENARIO] })
+    {
+        std::vector<Vec2> positions;
+        Vec2 bottomLeft, topRight;
+        GenerateScene(*scenario, particleCount, positions, bottomLeft, topRight);
+
+        std::mt19937 rng(54321);
+        std::uniform_real_distribution<float> speed(-MAX_INITIAL_SPEED, MAX_INITIAL_SPEED);
+        std::vector<Vec2> velocities;
+        for (size_t i = 0; i < positions.size(); i++)
+            velocities.push_back(Vec2(speed(rng), speed(rng)));
+
+        const PrecisionRun full = RunPrecision(ParticleStorage::Full, positions, velocities, bottomLeft, topRight, steps, threadPool);
+        const PrecisionRun compact = RunPrecision(ParticleStorage::Compact, positions, velocities, bottomLeft, topRight, steps, threadPool);
+
+        std::cout << scenario->name << ", " << particleCount << " particles, " << steps << " steps, fp32 against compact" << std::endl;
+        std::printf("%6s %13s %13s %8s %13s %13s %8s %21s %21s\n", "step", "energy fp32", "energy cp", "diff",
+            "kinetic fp32", "kinetic cp", "diff", "mean overlap fp32/cp", "max overlap fp32/cp");
+
+        double maxEnergyDiff = 0.0;
+        double maxKineticDiff = 0.0;
+        float maxOverlapFull = 0.0f;
+        float maxOverlapCompact = 0.0f;
+        for (size_t i = 0; i < full.samples.size() && i < compact.samples.size(); i++)
+        {
+            const ConservationSample& a = full.samples[i];
+            const ConservationSample& b = compact.samples[i];
+            const double energyDiff = std::abs(b.totalEnergy - a.totalEnergy) / std::max(std::abs(a.totalEnergy), 1e-9);
+            const double kineticDiff = std::abs(b.kineticEnergy - a.kineticEnergy) / std::max(std::abs(a.kineticEnergy), 1e-9);
+            maxEnergyDiff = std::max(maxEnergyDiff, energyDiff);
+            maxKineticDiff = std::max(maxKineticDiff, kineticDiff);
+            maxOverlapFull = std::max(maxOverlapFull, a.maxPenetration);
+            maxOverlapCompact = std::max(maxOverlapCompact, b.maxPenetration);
+
+            std::printf("%6llu %13.6g %13.6g %7.3f%% %13.6g %13.6g %7.3f%% %10.5f/%-10.5f %10.5f/%-10.5f\n",
+                static_cast<unsigned long long>(a.step), a.totalEnergy, b.totalEnergy, 100.0 * energyDiff,
+                a.kineticEnergy, b.kineticEnergy, 100.0 * kineticDiff,
+                a.meanPenetration, b.meanPenetration, a.maxPenetration, b.maxPenetration);
+        }
+
+        const double overlapLimit = maxOverlapFull * (1.0 + PRECISION_OVERLAP_TOLERANCE) + PRECISION_OVERLAP_SLACK * PARTICLE_RADIUS;
+        const bool energyPassed = std::max(maxEnergyDiff, maxKineticDiff) <= PRECISION_ENERGY_TOLERANCE;
+        const bool overlapPassed = maxOverlapCompact <= overlapLimit;
+        passed = passed && energyPassed && overlapPassed;
+
+        std::printf("bytes/particle held: particles %.1f -> %.1f, all tracked %.1f -> %.1f, %.3f -> %.3f ms/step\n",
+            full.particleBytes, compact.particleBytes, full.trackedBytes, compact.trackedBytes, full.msPerStep, compact.msPerStep);
+        std::printf("energy difference %.3f%%, kinetic %.3f%% (limit %.1f%%) %s, max overlap %.5f (limit %.5f) %s\n\n",
+            100.0 * maxEnergyDiff, 100.0 * maxKineticDiff, 100.0 * PRECISION_ENERGY_TOLERANCE, energyPassed ? "ok" : "FAILED",
+            maxOverlapCompact, overlapLimit, overlapPassed ? "ok" : "FAILED");
+    }
+    return passed ? 0 : 1;
+}
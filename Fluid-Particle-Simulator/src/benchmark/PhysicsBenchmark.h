@@ -0,0 +1,25 @@
+#pragma once
+
+// Times the physics phases on their own for a range of particle counts, packings and
+// thread counts, prints a table and writes every measurement as JSON.
+// Started with --benchmark [--quick] [--perf] [--output <file.json>], argv is the full command line.
+// Returns the process exit code
+int RunPhysicsBenchmark(int argc, char** argv);
+
+// Times every phase of whole steps from 1 to all hardware threads, with the same particles
+// (strong scaling) and with particles growing with the threads (weak scaling). Reports the
+// speedup, efficiency, thread imbalance and barrier time of each phase, as a table and JSON.
+// Started with --scaling [--quick] [--particles <n>] [--per-thread <n>] [--output <file.json>],
+// argv is the full command line. Returns the process exit code
+int RunScalingBenchmark(int argc, char** argv);
+
+// Builds the fluid scene for each particle count, runs a few steps with the fluid surface
+// and prints the current and peak heap bytes of every tracked subsystem, per particle too.
+// Started with --memory [--quick], argv is the full command line. Returns the process exit code
+int RunMemoryReport(int argc, char** argv);
+
+// Steps a falling gas and a settling fluid in full and in compact particle storage and
+// compares their energy and contact overlap, then prints the bytes per particle and step
+// time of both. Started with --precision [--quick] [--particles <n>], argv is the full
+// command line. Returns 1 when the compact storage drifts past the tolerances
+int RunPrecisionReport(int argc, char** argv);
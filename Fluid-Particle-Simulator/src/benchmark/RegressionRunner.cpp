@@ -0,0 +1,375 @@
+#include "RegressionRunner.h"
+#include "../physics/Physics.h"
+#include "../core/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Every scenario steps like the application: 60 frames per second, 6 substeps per frame
+const int SUBSTEPS = 6;
+const float FRAME_DELTA_TIME = 1.0f / 60.0f;
+
+// Simulation box of the 1280x960 window
+const Vec2 BOX_BOTTOM_LEFT(-1000.0f, -750.0f);
+const Vec2 BOX_TOP_RIGHT(1000.0f, 750.0f);
+
+const char* DEFAULT_BASELINE_PATH = "res/regression_baseline.txt";
+const int DEFAULT_REPEATS = 5;
+
+// Frames at the start of every run that aren't timed, the grid, the pair lists and the step
+// arena grow to their working size in them
+const int WARMUP_FRAMES = 60;
+
+// Tolerance bands. Throughput may drop by this fraction before it fails, the median of the
+// repeats of one build still moves by up to 8% between runs. The energies may move this
+// fraction either way (contacts are chaotic, any change to the solver or to the floating
+// point order moves them a little), the bounding box may move this fraction of the box
+const double THROUGHPUT_TOLERANCE = 0.20;
+const double ENERGY_TOLERANCE = 0.10;
+const double BOUNDS_TOLERANCE = 0.02;
+
+// --- Golden scenarios. They are copies of the setups, not references to the
+//     application parameters, so tuning Application.cpp doesn't move the baseline ---
+
+// The three stream demo, 3000 particles
+static void SetupDemoStreams(SimulationSystem& sim)
+{
+    sim.AddParticleStream(1000, 150.0f, { 100.0f, -100.0f }, 1.0f, { 0.0f, 0.0f });
+    sim.AddParticleStream(1000, 150.0f, { -100.0f, -100.0f }, 1.0f, { 1996.0f, 0.0f });
+    sim.AddParticleStream(1000, 150.0f, { 100.0f, -100.0f }, 1.0f, { 1000.0f, 0.0f });
+}
+
+// 82x85 block in the top-left corner falling onto the floor
+static void SetupGridBlock(SimulationSystem& sim)
+{
+    sim.AddParticleGrid(82, 85, { 0.0f, 0.0f }, true, 1.0f);
+}
+
+// Touching rows resting on the floor, nearly every particle is in contact
+static void SetupDensePile(SimulationSystem& sim)
+{
+    const float radius = sim.GetParticleRadius();
+    const Bounds& bounds = sim.GetBounds();
+    const int columns = static_cast<int>((bounds.topRight.x - bounds.bottomLeft.x) / (2.0f * radius)) - 1;
+
+    for (int row = 0; row < 40; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            const float x = bounds.bottomLeft.x + radius * (2.0f * column + 1.0f + (row % 2));
+            const float y = bounds.bottomLeft.y + radius * (1.0f + row * std::sqrt(3.0f));
+            sim.AddParticle({ x, y }, { 0.0f, 0.0f });
+        }
+    }
+}
+
+// Few fast particles spread over the whole box
+static void SetupHotGas(SimulationSystem& sim)
+{
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const Bounds& bounds = sim.GetBounds();
+
+    for (int i = 0; i < 5000; i++)
+    {
+        const Vec2 position(bounds.bottomLeft.x + unit(rng) * (bounds.topRight.x - bounds.bottomLeft.x),
+            bounds.bottomLeft.y + unit(rng) * (bounds.topRight.y - bounds.bottomLeft.y));
+        const float angle = unit(rng) * 6.2831853f;
+        sim.AddParticle(position, Vec2(std::cos(angle), std::sin(angle)) * 300.0f);
+    }
+}
+
+struct GoldenScenario {
+    const char* name;
+    float particleRadius;
+    int frames;
+    void (*setup)(SimulationSystem& sim);
+};
+
+const GoldenScenario SCENARIOS[] = {
+    { "demo_streams", 6.0f, 600, SetupDemoStreams },
+    { "grid_block",   6.0f, 300, SetupGridBlock },
+    { "dense_pile",   3.0f, 300, SetupDensePile },
+    { "hot_gas",      3.0f, 300, SetupHotGas }
+};
+
+// How a metric is compared with its baseline
+enum class MetricCheck {
+    HigherIsBetter, // Fails below baseline * (1 - tolerance)
+    Exact,          // Fails on any difference
+    Relative,       // Fails outside baseline * (1 +- tolerance)
+    BoxFraction     // Fails outside baseline +- tolerance * box size
+};
+
+struct MetricSpec {
+    const char* name;
+    MetricCheck check;
+    double tolerance;
+};
+
+// Order of the metrics in the baseline and in the report
+const MetricSpec METRICS[] = {
+    { "particle_steps_per_second", MetricCheck::HigherIsBetter, THROUGHPUT_TOLERANCE },
+    { "particles",                 MetricCheck::Exact,          0.0 },
+    { "kinetic_energy",            MetricCheck::Relative,       ENERGY_TOLERANCE },
+    { "potential_energy",          MetricCheck::Relative,       ENERGY_TOLERANCE },
+    { "min_x",                     MetricCheck::BoxFraction,    BOUNDS_TOLERANCE },
+    { "min_y",                     MetricCheck::BoxFraction,    BOUNDS_TOLERANCE },
+    { "max_x",                     MetricCheck::BoxFraction,    BOUNDS_TOLERANCE },
+    { "max_y",                     MetricCheck::BoxFraction,    BOUNDS_TOLERANCE }
+};
+const int METRIC_COUNT = sizeof(METRICS) / sizeof(METRICS[0]);
+
+struct RegressionOptions {
+    std::string baselinePath = DEFAULT_BASELINE_PATH;
+    bool updateBaseline = false;
+    int repeats = DEFAULT_REPEATS;
+    int threads = 0;
+};
+
+static bool ParseOptions(int argc, char** argv, RegressionOptions& options)
+{
+    // argv[1] is --regression
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            options.baselinePath = argv[++i];
+        else if (std::strcmp(argv[i], "--update-baseline") == 0)
+            options.updateBaseline = true;
+        else if (std::strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+            options.repeats = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = std::max(0, std::atoi(argv[++i]));
+        else
+        {
+            std::cerr << "Unknown regression option " << argv[i] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " --regression [--baseline <file>] [--update-baseline]"
+                " [--repeats <n>] [--threads <n>]" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run the scenario once and fill values in METRICS order
+static void RunScenario(const GoldenScenario& scenario, ThreadPool* threadPool, double* values)
+{
+    SimulationSystem sim(BOX_BOTTOM_LEFT, BOX_TOP_RIGHT, scenario.particleRadius, 1280);
+    scenario.setup(sim);
+
+    for (int frame = 0; frame < WARMUP_FRAMES; frame++)
+    {
+        for (int step = 0; step < SUBSTEPS; step++)
+            UpdatePhysics(sim, FRAME_DELTA_TIME / SUBSTEPS, true, threadPool);
+    }
+
+    // Throughput counts every particle of every step, the streams add particles as they go
+    double particleSteps = 0.0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int frame = WARMUP_FRAMES; frame < scenario.frames; frame++)
+    {
+        for (int step = 0; step < SUBSTEPS; step++)
+        {
+            particleSteps += static_cast<double>(sim.GetParticles().size());
+            UpdatePhysics(sim, FRAME_DELTA_TIME / SUBSTEPS, true, threadPool);
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Energies relative to the floor, the bounding box of the particle centers
+    const ParticleVector& particles = sim.GetParticles();
+    const float gravity = std::abs(GetGravity().y);
+    double kinetic = 0.0;
+    double potential = 0.0;
+    Vec2 minPosition(BOX_TOP_RIGHT);
+    Vec2 maxPosition(BOX_BOTTOM_LEFT);
+    for (const Particle& particle : particles)
+    {
+        kinetic += 0.5 * particle.mass * particle.velocity.length_sq();
+        potential += particle.mass * gravity * (particle.position.y - BOX_BOTTOM_LEFT.y);
+        minPosition.x = std::min(minPosition.x, particle.position.x);
+        minPosition.y = std::min(minPosition.y, particle.position.y);
+        maxPosition.x = std::max(maxPosition.x, particle.position.x);
+        maxPosition.y = std::max(maxPosition.y, particle.position.y);
+    }
+
+    values[0] = seconds > 0.0 ? particleSteps / seconds : 0.0;
+    values[1] = static_cast<double>(particles.size());
+    values[2] = kinetic;
+    values[3] = potential;
+    values[4] = minPosition.x;
+    values[5] = minPosition.y;
+    values[6] = maxPosition.x;
+    values[7] = maxPosition.y;
+}
+
+// "scenario metric value" lines, # starts a comment
+static bool ReadBaseline(const std::string& path, std::map<std::string, double>& baseline)
+{
+    std::ifstream file(path);
+    if (!file.good())
+        return false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string scenario, metric;
+        double value;
+        if (fields >> scenario >> metric >> value)
+            baseline[scenario + " " + metric] = value;
+    }
+    return true;
+}
+
+static bool WriteBaseline(const std::string& path, const std::vector<std::vector<double>>& results, int threads)
+{
+    std::ofstream file(path);
+    if (!file.good())
+        return false;
+
+    file << "# Golden scenario baseline, written by --regression --update-baseline\n";
+    file << "# Throughput depends on the machine, regenerate it on the machine that runs the gate\n";
+    file << "run threads " << threads << "\n";
+
+    char line[128];
+    for (size_t s = 0; s < results.size(); s++)
+    {
+        for (int m = 0; m < METRIC_COUNT; m++)
+        {
+            snprintf(line, sizeof(line), "%s %s %.9g\n", SCENARIOS[s].name, METRICS[m].name, results[s][m]);
+            file << line;
+        }
+    }
+    return file.good();
+}
+
+// Returns true if the value is inside the metric's band around the baseline
+static bool IsWithinTolerance(const MetricSpec& metric, double baseline, double value)
+{
+    const Vec2 boxSize = BOX_TOP_RIGHT - BOX_BOTTOM_LEFT;
+
+    switch (metric.check)
+    {
+    case MetricCheck::HigherIsBetter:
+        return value >= baseline * (1.0 - metric.tolerance);
+    case MetricCheck::Exact:
+        return value == baseline;
+    case MetricCheck::Relative:
+        return std::abs(value - baseline) <= std::abs(baseline) * metric.tolerance;
+    case MetricCheck::BoxFraction:
+        return std::abs(value - baseline) <= metric.tolerance * std::max(boxSize.x, boxSize.y);
+    }
+    return false;
+}
+
+int RunRegression(int argc, char** argv)
+{
+    RegressionOptions options;
+    if (!ParseOptions(argc, argv, options))
+        return -1;
+
+    std::map<std::string, double> baseline;
+    const bool hasBaseline = ReadBaseline(options.baselinePath, baseline);
+    if (!hasBaseline && !options.updateBaseline)
+    {
+        std::cerr << "No baseline at " << options.baselinePath << ", run with --update-baseline to create it" << std::endl;
+        return -1;
+    }
+
+    // A single thread runs the serial code without a pool
+    std::unique_ptr<ThreadPool> threadPool(options.threads != 1 ? new ThreadPool(options.threads) : nullptr);
+    const int threads = threadPool ? threadPool->GetThreadCount() : 1;
+
+    const int scenarioCount = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+    std::vector<std::vector<double>> results(scenarioCount, std::vector<double>(METRIC_COUNT));
+    std::vector<std::vector<double>> throughputs(scenarioCount);
+    bool failed = false;
+
+    // Every repeat runs all the scenarios, so a slow spell of the machine hits them all a
+    // little instead of one of them entirely
+    std::vector<double> repeat(METRIC_COUNT);
+    for (int r = 0; r < options.repeats; r++)
+    {
+        for (int s = 0; s < scenarioCount; s++)
+        {
+            // The checksums must be identical every time
+            std::vector<double>& values = results[s];
+            RunScenario(SCENARIOS[s], threadPool.get(), r == 0 ? values.data() : repeat.data());
+            throughputs[s].push_back(r == 0 ? values[0] : repeat[0]);
+            if (r > 0 && !std::equal(values.begin() + 1, values.end(), repeat.begin() + 1))
+            {
+                std::cerr << SCENARIOS[s].name << ": checksums differ between repeats, the simulation is not deterministic" << std::endl;
+                failed = true;
+            }
+        }
+        std::cout << "Ran repeat " << r + 1 << " of " << options.repeats << std::endl;
+    }
+
+    // Median throughput, a run slowed down by other processes doesn't move it
+    for (int s = 0; s < scenarioCount; s++)
+    {
+        std::vector<double>& runs = throughputs[s];
+        std::sort(runs.begin(), runs.end());
+        const size_t middle = runs.size() / 2;
+        results[s][0] = runs.size() % 2 ? runs[middle] : 0.5 * (runs[middle - 1] + runs[middle]);
+    }
+
+    if (options.updateBaseline)
+    {
+        if (!WriteBaseline(options.baselinePath, results, threads))
+        {
+            std::cerr << "Failed to write " << options.baselinePath << std::endl;
+            return -1;
+        }
+        std::cout << "Wrote baseline to " << options.baselinePath << std::endl;
+        return failed ? 1 : 0;
+    }
+
+    if (baseline.count("run threads") && baseline["run threads"] != threads)
+    {
+        std::cout << "Warning: the baseline ran with " << baseline["run threads"] << " threads, this run uses "
+            << threads << ", throughput is not comparable" << std::endl;
+    }
+
+    printf("%-13s %-26s %16s %16s %9s  %s\n", "scenario", "metric", "baseline", "current", "change", "status");
+    for (int s = 0; s < scenarioCount; s++)
+    {
+        for (int m = 0; m < METRIC_COUNT; m++)
+        {
+            const std::string key = std::string(SCENARIOS[s].name) + " " + METRICS[m].name;
+            const double value = results[s][m];
+            const auto entry = baseline.find(key);
+            if (entry == baseline.end())
+            {
+                printf("%-13s %-26s %16s %16.6g %9s  MISSING\n", SCENARIOS[s].name, METRICS[m].name, "-", value, "-");
+                failed = true;
+                continue;
+            }
+
+            const double reference = entry->second;
+            const bool ok = IsWithinTolerance(METRICS[m], reference, value);
+            const double change = reference != 0.0 ? 100.0 * (value - reference) / std::abs(reference) : 0.0;
+            printf("%-13s %-26s %16.6g %16.6g %8.1f%%  %s\n", SCENARIOS[s].name, METRICS[m].name, reference, value,
+                change, ok ? "ok" : "REGRESSION");
+            failed |= !ok;
+        }
+    }
+
+    std::cout << (failed ? "Regression detected" : "All scenarios within tolerance") << std::endl;
+    return failed ? 1 : 0;
+}
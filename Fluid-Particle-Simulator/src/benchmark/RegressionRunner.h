@@ -0,0 +1,7 @@
+#pragma once
+
+// Runs the golden scenarios headless, compares throughput and physical checksums with a
+// stored baseline and returns 1 if anything falls outside its tolerance band.
+// Started with --regression [--baseline <file>] [--update-baseline] [--repeats <n>] [--threads <n>],
+// argv is the full command line. Returns the process exit code
+int RunRegression(int argc, char** argv);
@@ -0,0 +1,218 @@
+#include "AllocationGuard.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(ALLOCATION_GUARD_ENABLED)
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <dbghelp.h>
+#include <crtdbg.h>
+#pragma comment(lib, "dbghelp.lib")
+#elif defined(__GLIBC__)
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Stack traces printed in Log mode, later violations are only counted
+const uint64_t MAX_LOGGED_VIOLATIONS = 16;
+const int MAX_STACK_FRAMES = 32;
+
+// Plain atomics and thread_locals, zero initialised before any allocation can happen
+std::atomic<bool> s_Armed{ false };
+std::atomic<int> s_Action{ 0 };
+std::atomic<uint64_t> s_Violations{ 0 };
+
+thread_local const char* t_HotRegion = nullptr;
+
+// Set while the thread allocates on behalf of the guard or of operator new, so the
+// malloc hook neither recurses nor counts the same allocation twice
+thread_local int t_Bypass = 0;
+
+void PrintStackTrace()
+{
+#if defined(_WIN32)
+    static bool symbolsLoaded = false;
+    HANDLE process = GetCurrentProcess();
+    if (!symbolsLoaded)
+        symbolsLoaded = SymInitialize(process, nullptr, TRUE) != FALSE;
+
+    void* frames[MAX_STACK_FRAMES];
+    const USHORT frameCount = CaptureStackBackTrace(2, MAX_STACK_FRAMES, frames, nullptr);
+
+    char buffer[sizeof(SYMBOL_INFO) + 256];
+    SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(buffer);
+    symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+    symbol->MaxNameLen = 255;
+    for (USHORT i = 0; i < frameCount; i++)
+    {
+        const DWORD64 address = reinterpret_cast<DWORD64>(frames[i]);
+        if (symbolsLoaded && SymFromAddr(process, address, nullptr, symbol))
+            fprintf(stderr, "    %2d %s\n", i, symbol->Name);
+        else
+            fprintf(stderr, "    %2d 0x%llx\n", i, static_cast<unsigned long long>(address));
+    }
+#elif defined(__GLIBC__)
+    void* frames[MAX_STACK_FRAMES];
+    const int frameCount = backtrace(frames, MAX_STACK_FRAMES);
+    fflush(stderr);
+    backtrace_symbols_fd(frames + 2, frameCount > 2 ? frameCount - 2 : 0, STDERR_FILENO);
+#else
+    fprintf(stderr, "    (no stack traces on this platform)\n");
+#endif
+}
+
+void CheckAllocation(size_t bytes)
+{
+    if (t_HotRegion == nullptr || t_Bypass > 0 || !s_Armed.load(std::memory_order_relaxed))
+        return;
+
+    const uint64_t violation = s_Violations.fetch_add(1, std::memory_order_relaxed);
+    const bool abort = s_Action.load(std::memory_order_relaxed) == static_cast<int>(AllocationGuard::Action::Abort);
+    if (violation >= MAX_LOGGED_VIOLATIONS && !abort)
+        return;
+
+    // Printing allocates too
+    t_Bypass++;
+    fprintf(stderr, "Allocation of %llu bytes inside hot region %s\n", static_cast<unsigned long long>(bytes), t_HotRegion);
+    PrintStackTrace();
+    if (violation + 1 == MAX_LOGGED_VIOLATIONS && !abort)
+        fprintf(stderr, "Further hot region allocations are counted but not printed\n");
+    t_Bypass--;
+
+    if (abort)
+        std::abort();
+}
+
+void* Allocate(size_t bytes)
+{
+    CheckAllocation(bytes);
+
+    t_Bypass++;
+    void* pointer = std::malloc(bytes > 0 ? bytes : 1);
+    t_Bypass--;
+    return pointer;
+}
+
+#if defined(_WIN32) && defined(_DEBUG)
+
+// Debug CRT hook, sees malloc, calloc and realloc of the whole process
+int __cdecl CrtAllocHook(int allocType, void*, size_t size, int blockType, long, const unsigned char*, int)
+{
+    if (blockType != _CRT_BLOCK && (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC))
+        CheckAllocation(size);
+    return TRUE;
+}
+
+#endif
+
+}
+
+#if defined(__GLIBC__)
+
+// glibc lets the program define the allocation functions and forward them to its own
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size)
+{
+    CheckAllocation(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    CheckAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size)
+{
+    // Size 0 frees the block
+    if (size > 0)
+        CheckAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+}
+
+#endif
+
+void* operator new(size_t bytes)
+{
+    void* pointer = Allocate(bytes);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t bytes)
+{
+    void* pointer = Allocate(bytes);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept { return Allocate(bytes); }
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept { return Allocate(bytes); }
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+
+void AllocationGuard::Arm(Action action)
+{
+    s_Action = static_cast<int>(action);
+#if defined(_WIN32) && defined(_DEBUG)
+    _CrtSetAllocHook(CrtAllocHook);
+#endif
+    s_Armed = true;
+}
+
+void AllocationGuard::Disarm()
+{
+    s_Armed = false;
+}
+
+bool AllocationGuard::IsArmed()
+{
+    return s_Armed;
+}
+
+uint64_t AllocationGuard::GetViolationCount()
+{
+    return s_Violations;
+}
+
+const char* AllocationGuard::GetHotRegion()
+{
+    return t_HotRegion;
+}
+
+const char* AllocationGuard::SetHotRegion(const char* name)
+{
+    const char* previous = t_HotRegion;
+    t_HotRegion = name;
+    return previous;
+}
+
+#else
+
+void AllocationGuard::Arm(Action) {}
+void AllocationGuard::Disarm() {}
+bool AllocationGuard::IsArmed() { return false; }
+uint64_t AllocationGuard::GetViolationCount() { return 0; }
+const char* AllocationGuard::GetHotRegion() { return nullptr; }
+const char* AllocationGuard::SetHotRegion(const char*) { return nullptr; }
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Debug builds replace the global operator new (and hook malloc where the C runtime
+// allows it) to catch heap allocations inside hot regions. Define ALLOCATION_GUARD to
+// get the guard in release builds too
+#if !defined(NDEBUG) || defined(ALLOCATION_GUARD)
+#define ALLOCATION_GUARD_ENABLED
+#endif
+
+// Reports heap allocations made inside a HotRegion once the guard is armed. The first
+// steps grow the particle, grid and pair buffers to their working size, so arm it after
+// them: from then on the step loop should not allocate at all
+class AllocationGuard {
+public:
+    enum class Action {
+        Log,    // Print the region and a stack trace, keep running
+        Abort   // Print the same and abort, to stop in the debugger
+    };
+
+    static void Arm(Action action = Action::Log);
+    static void Disarm();
+    static bool IsArmed();
+
+    // Allocations seen inside hot regions while armed
+    static uint64_t GetViolationCount();
+
+    // Innermost hot region of the calling thread, nullptr outside of them
+    static const char* GetHotRegion();
+
+    // Used by HotRegion and ColdRegion, name nullptr leaves the thread cold
+    static const char* SetHotRegion(const char* name);
+
+    static bool IsEnabled()
+    {
+#if defined(ALLOCATION_GUARD_ENABLED)
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+
+// Marks the calling thread hot for its lifetime. ThreadPool carries the region over
+// to the workers running a ParallelFor started inside it. nullptr does nothing
+class HotRegion {
+private:
+    const char* m_Previous;
+    bool m_Active;
+
+public:
+    explicit HotRegion(const char* name)
+        : m_Previous(nullptr), m_Active(name != nullptr)
+    {
+        if (m_Active)
+            m_Previous = AllocationGuard::SetHotRegion(name);
+    }
+
+    ~HotRegion()
+    {
+        if (m_Active)
+            AllocationGuard::SetHotRegion(m_Previous);
+    }
+
+    HotRegion(const HotRegion&) = delete;
+    HotRegion& operator=(const HotRegion&) = delete;
+};
+
+// Lets the calling thread allocate inside a hot region, for rare paths like alert callbacks
+class ColdRegion {
+private:
+    const char* m_Previous;
+
+public:
+    ColdRegion() : m_Previous(AllocationGuard::SetHotRegion(nullptr)) {}
+    ~ColdRegion() { AllocationGuard::SetHotRegion(m_Previous); }
+
+    ColdRegion(const ColdRegion&) = delete;
+    ColdRegion& operator=(const ColdRegion&) = delete;
+};
+
+#define ALLOCATION_GUARD_CONCAT_INNER(a, b) a##b
+#define ALLOCATION_GUARD_CONCAT(a, b) ALLOCATION_GUARD_CONCAT_INNER(a, b)
+
+#if defined(ALLOCATION_GUARD_ENABLED)
+#define HOT_REGION(name) HotRegion ALLOCATION_GUARD_CONCAT(hotRegion, __LINE__)(name)
+#define COLD_REGION() ColdRegion ALLOCATION_GUARD_CONCAT(coldRegion, __LINE__)
+#else
+#define HOT_REGION(name)
+#define COLD_REGION()
+#endif
@@ -0,0 +1,147 @@
+#include "FlightRecorder.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+const char* const FRAME_PHASE_NAMES[FRAME_PHASE_COUNT] = { "physics", "upload", "render", "overlay", "present" };
+
+double ToMs(uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+// Longest frame the percentiles tell apart, in microseconds
+const uint64_t MAX_TRACKED_FRAME_US = 10000000;
+
+uint64_t ToTrackedUs(uint64_t ns)
+{
+    const uint64_t us = ns / 1000;
+    return us < MAX_TRACKED_FRAME_US ? us : MAX_TRACKED_FRAME_US;
+}
+
+}
+
+FlightRecorder::FlightRecorder(size_t frames, float budgetMs, const std::string& dumpPrefix)
+    : m_Frames(frames), m_FrameTimeHistogram(MAX_TRACKED_FRAME_US), m_RecorderStart(Profiler::Now()), m_BudgetMs(budgetMs), m_DumpPrefix(dumpPrefix)
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    if (m_DumpPending)
+        WriteDump();
+}
+
+uint64_t FlightRecorder::GetTrackedAllocations()
+{
+    uint64_t allocations = 0;
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+        allocations += MemoryTracker::GetStats(static_cast<MemoryTag>(tag)).allocations;
+    return allocations;
+}
+
+void FlightRecorder::BeginFrame()
+{
+    m_Current = FlightFrame();
+    m_Current.frame = m_NextFrame++;
+    m_FrameStart = Profiler::Now();
+    m_AllocationsAtStart = GetTrackedAllocations();
+}
+
+void FlightRecorder::RecordPhysicsStep(const PhysicsStepStats& stats)
+{
+    for (int phase = 0; phase < PHYSICS_PHASE_COUNT; phase++)
+        m_Current.physicsPhaseNs[phase] += stats.phaseNs[phase];
+    m_Current.physicsSteps++;
+    m_Current.particles = stats.particles;
+    m_Current.candidatePairs = stats.candidatePairs;
+    m_Current.contacts = stats.contacts;
+}
+
+void FlightRecorder::EndFrame()
+{
+    const uint64_t end = Profiler::Now();
+    m_Current.frameNs = end - m_FrameStart;
+    m_Current.timeSeconds = (m_FrameStart - m_RecorderStart) / 1e9;
+    m_Current.allocations = GetTrackedAllocations() - m_AllocationsAtStart;
+
+    // The oldest frame leaves the percentiles when the ring overwrites it
+    if (m_Frames.Size() == m_Frames.Capacity())
+        m_FrameTimeHistogram.Remove(ToTrackedUs(m_Frames[0].frameNs));
+    m_Frames.Push(m_Current);
+    m_FrameTimeHistogram.Record(ToTrackedUs(m_Current.frameNs));
+
+    // A spike while a dump is pending is already inside its window
+    if (m_BudgetMs > 0.0f && ToMs(m_Current.frameNs) > m_BudgetMs)
+    {
+        m_SpikeCount++;
+        if (!m_DumpPending)
+        {
+            m_DumpPending = true;
+            m_SpikeFrame = m_Current.frame;
+            m_DumpAfterFrame = m_Current.frame + m_Frames.Capacity() / 2;
+        }
+    }
+
+    // Writing the file happens between EndFrame and the next BeginFrame, so it
+    // doesn't count as a spike itself
+    if (m_DumpPending && m_Current.frame >= m_DumpAfterFrame)
+        WriteDump();
+}
+
+void FlightRecorder::WriteDump()
+{
+    m_DumpPending = false;
+
+    const std::string path = m_DumpPrefix + std::to_string(m_SpikeFrame) + ".csv";
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to write " << path << std::endl;
+        return;
+    }
+
+    file << "# Frame " << m_SpikeFrame << " went over the " << m_BudgetMs << " ms budget, times in ms\n";
+    file << "# Frame time over these frames: p50 " << GetFrameTimePercentileMs(50.0) << " p95 " << GetFrameTimePercentileMs(95.0)
+        << " p99 " << GetFrameTimePercentileMs(99.0) << " max " << GetMaxFrameTimeMs() << "\n";
+    file << "frame,time_s,frame_ms,over_budget";
+    for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+        file << ',' << FRAME_PHASE_NAMES[phase] << "_ms";
+    file << ",physics_steps";
+    for (int phase = 0; phase < PHYSICS_PHASE_COUNT; phase++)
+        file << ',' << GetPhysicsPhaseName(static_cast<PhysicsPhase>(phase)) << "_ms";
+    file << ",particles,candidate_pairs,contacts,allocations\n";
+
+    file << std::fixed;
+    for (size_t i = 0; i < m_Frames.Size(); i++)
+    {
+        const FlightFrame& frame = m_Frames[i];
+        file << frame.frame << ',' << std::setprecision(4) << frame.timeSeconds << ','
+            << std::setprecision(3) << ToMs(frame.frameNs) << ',' << (ToMs(frame.frameNs) > m_BudgetMs ? 1 : 0);
+        for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+            file << ',' << ToMs(frame.phaseNs[phase]);
+        file << ',' << frame.physicsSteps;
+        for (int phase = 0; phase < PHYSICS_PHASE_COUNT; phase++)
+            file << ',' << ToMs(frame.physicsPhaseNs[phase]);
+        file << ',' << frame.particles << ',' << frame.candidatePairs << ',' << frame.contacts
+            << ',' << frame.allocations << '\n';
+    }
+
+    m_LastDumpPath = path;
+    std::cout << "Frame " << m_SpikeFrame << " took longer than " << m_BudgetMs << " ms, wrote "
+        << m_Frames.Size() << " frames to " << path << std::endl;
+}
+
+FramePhaseTimer::FramePhaseTimer(FlightRecorder& recorder, FramePhase phase)
+    : m_Recorder(recorder), m_Phase(phase), m_Start(Profiler::Now())
+{
+}
+
+FramePhaseTimer::~FramePhaseTimer()
+{
+    m_Recorder.AddPhaseTime(m_Phase, Profiler::Now() - m_Start);
+}
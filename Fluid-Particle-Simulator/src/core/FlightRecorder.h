@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "HdrHistogram.h"
+#include "RingBuffer.h"
+#include "../physics/PhysicsStats.h"
+
+// Parts of a frame the main loop times
+enum class FramePhase {
+    Physics = 0,
+    Upload = 1,     // Particle instance data to the GPU
+    Render = 2,     // Particle draw calls
+    Overlay = 3,    // Fluid surface, debug layers and HUD
+    Present = 4,    // Buffer swap, includes the vsync wait
+    Count = 5
+};
+
+const int FRAME_PHASE_COUNT = static_cast<int>(FramePhase::Count);
+
+// Timings and counters of one frame. Physics values are summed over the steps of the frame,
+// particle and pair counts are the ones of its last step
+struct FlightFrame {
+    uint64_t frame = 0;
+    double timeSeconds = 0.0;       // Since the recorder was created
+    uint64_t frameNs = 0;
+    uint64_t phaseNs[FRAME_PHASE_COUNT] = {};
+    uint64_t physicsPhaseNs[PHYSICS_PHASE_COUNT] = {};
+    int physicsSteps = 0;
+    int particles = 0;
+    int candidatePairs = 0;
+    int contacts = 0;
+    uint64_t allocations = 0;       // Allocations of the MemoryTracker containers
+};
+
+// Keeps the last frames in a ring and, when one takes longer than the budget, writes the
+// frames around it to <dumpPrefix><frame>.csv: half of the ring before the spike and half
+// after it. Spikes during a pending dump land in the same file. Recording a frame is a
+// copy into the ring, so it can run every frame of a release build
+class FlightRecorder {
+private:
+    RingBuffer<FlightFrame> m_Frames;
+    HdrHistogram m_FrameTimeHistogram;     // Frame times of the ring in microseconds
+    FlightFrame m_Current;
+    uint64_t m_FrameStart = 0;
+    uint64_t m_RecorderStart = 0;
+    uint64_t m_AllocationsAtStart = 0;
+    uint64_t m_NextFrame = 0;
+
+    float m_BudgetMs;
+    std::string m_DumpPrefix;
+
+    // Pending dump: frame that went over the budget and frame after which the file is written
+    bool m_DumpPending = false;
+    uint64_t m_SpikeFrame = 0;
+    uint64_t m_DumpAfterFrame = 0;
+
+    uint64_t m_SpikeCount = 0;
+    std::string m_LastDumpPath;
+
+    static uint64_t GetTrackedAllocations();
+    void WriteDump();
+
+public:
+    // frames is the ring size, budgetMs 0 records without ever dumping
+    FlightRecorder(size_t frames, float budgetMs, const std::string& dumpPrefix);
+
+    // Writes a pending dump with the frames recorded so far
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    void BeginFrame();
+    void AddPhaseTime(FramePhase phase, uint64_t ns) { m_Current.phaseNs[static_cast<int>(phase)] += ns; }
+
+    // Add a finished step, call it after UpdatePhysics
+    void RecordPhysicsStep(const PhysicsStepStats& stats);
+
+    // Close the frame, push it into the ring and dump the window if a spike is due
+    void EndFrame();
+
+    // Frame time percentile (0 to 100) and maximum over the frames in the ring
+    float GetFrameTimePercentileMs(double percentile) const { return m_FrameTimeHistogram.GetValueAtPercentile(percentile) / 1000.0f; }
+    float GetMaxFrameTimeMs() const { return m_FrameTimeHistogram.GetMax() / 1000.0f; }
+
+    uint64_t GetSpikeCount() const { return m_SpikeCount; }
+    const std::string& GetLastDumpPath() const { return m_LastDumpPath; }
+    const RingBuffer<FlightFrame>& GetFrames() const { return m_Frames; }
+};
+
+// Adds the time until the end of the scope to a phase of the current frame
+class FramePhaseTimer {
+private:
+    FlightRecorder& m_Recorder;
+    FramePhase m_Phase;
+    uint64_t m_Start;
+
+public:
+    FramePhaseTimer(FlightRecorder& recorder, FramePhase phase);
+    ~FramePhaseTimer();
+
+    FramePhaseTimer(const FramePhaseTimer&) = delete;
+    FramePhaseTimer& operator=(const FramePhaseTimer&) = delete;
+};
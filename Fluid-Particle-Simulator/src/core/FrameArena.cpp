@@ -0,0 +1,115 @@
+#include "FrameArena.h"
+#include <algorithm>
+
+// Smallest block a LinearArena grows to, so tiny steps don't grow it a few bytes at a time
+const size_t MIN_BLOCK_BYTES = 64 * 1024;
+
+// Blocks start on their own cache line, the arenas of different threads never share one
+const size_t BLOCK_ALIGNMENT = 64;
+
+LinearArena::~LinearArena()
+{
+    FreeOverflow();
+    if (m_Allocation)
+    {
+        MemoryTracker::RecordDeallocation(MemoryTag::FrameArena, m_Capacity + BLOCK_ALIGNMENT);
+        ::operator delete(m_Allocation);
+    }
+}
+
+void LinearArena::FreeOverflow()
+{
+    while (m_Overflow)
+    {
+        Overflow* next = m_Overflow->next;
+        MemoryTracker::RecordDeallocation(MemoryTag::FrameArena, m_Overflow->bytes);
+        ::operator delete(m_Overflow);
+        m_Overflow = next;
+    }
+}
+
+void* LinearArena::Allocate(size_t bytes, size_t alignment)
+{
+    // The block base is cache line aligned, so aligning the offset aligns the address
+    const size_t start = (m_Offset + alignment - 1) & ~(alignment - 1);
+    m_Used += start - m_Offset + bytes;
+    if (start + bytes <= m_Capacity)
+    {
+        m_Offset = start + bytes;
+        return m_Block + start;
+    }
+
+    // Doesn't fit, take it from the heap for this step. The header is padded to 64 bytes
+    // so the memory after it keeps the alignment of operator new
+    const size_t overflowBytes = BLOCK_ALIGNMENT + bytes;
+    Overflow* overflow = static_cast<Overflow*>(::operator new(overflowBytes));
+    MemoryTracker::RecordAllocation(MemoryTag::FrameArena, overflowBytes);
+    overflow->next = m_Overflow;
+    overflow->bytes = overflowBytes;
+    m_Overflow = overflow;
+    m_OverflowCount++;
+    return reinterpret_cast<char*>(overflow) + BLOCK_ALIGNMENT;
+}
+
+void LinearArena::Reset(size_t minBytes)
+{
+    m_PeakUsed = std::max(m_PeakUsed, m_Used);
+    FreeOverflow();
+
+    // Grow geometrically past what the last step needed
+    const size_t needed = std::max(m_Used, minBytes);
+    if (needed > m_Capacity)
+    {
+        size_t capacity = std::max(m_Capacity * 2, MIN_BLOCK_BYTES);
+        while (capacity < needed)
+            capacity *= 2;
+
+        if (m_Allocation)
+        {
+            MemoryTracker::RecordDeallocation(MemoryTag::FrameArena, m_Capacity + BLOCK_ALIGNMENT);
+            ::operator delete(m_Allocation);
+        }
+
+        // operator new only promises 16 byte alignment, the extra bytes let the block
+        // start on a cache line
+        m_Allocation = static_cast<char*>(::operator new(capacity + BLOCK_ALIGNMENT));
+        MemoryTracker::RecordAllocation(MemoryTag::FrameArena, capacity + BLOCK_ALIGNMENT);
+        const uintptr_t address = reinterpret_cast<uintptr_t>(m_Allocation);
+        m_Block = m_Allocation + (BLOCK_ALIGNMENT - address % BLOCK_ALIGNMENT) % BLOCK_ALIGNMENT;
+        m_Capacity = capacity;
+    }
+
+    m_Offset = 0;
+    m_Used = 0;
+}
+
+FrameArena::FrameArena()
+{
+    m_Threads.emplace_back(new LinearArena());
+}
+
+void FrameArena::Reset(int threadCount, size_t sharedBytes, size_t perThreadBytes)
+{
+    while (static_cast<int>(m_Threads.size()) < threadCount)
+        m_Threads.emplace_back(new LinearArena());
+
+    m_Threads[0]->Reset(sharedBytes + perThreadBytes);
+    for (size_t i = 1; i < m_Threads.size(); i++)
+        m_Threads[i]->Reset(perThreadBytes);
+}
+
+size_t FrameArena::GetCapacity() const
+{
+    size_t capacity = 0;
+    for (const std::unique_ptr<LinearArena>& arena : m_Threads)
+        capacity += arena->GetCapacity();
+    return capacity;
+}
+
+uint64_t FrameArena::GetOverflowCount() const
+{
+    uint64_t overflows = 0;
+    for (const std::unique_ptr<LinearArena>& arena : m_Threads)
+        overflows += arena->GetOverflowCount();
+    return overflows;
+}
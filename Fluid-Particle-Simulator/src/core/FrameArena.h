@@ -0,0 +1,155 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "MemoryTracker.h"
+
+// Bump allocator for data that only lives until the next Reset. Allocations take the next
+// bytes of one block and are never freed one by one. When a step asks for more than the
+// block holds the rest comes from the heap, and Reset replaces the block with one at least
+// twice as large, so after a few steps the arena stops touching the heap.
+// Used by one thread at a time
+class LinearArena {
+private:
+    // Heap block taken when the main block is full, freed by the next Reset
+    struct Overflow {
+        Overflow* next;
+        size_t bytes;
+    };
+
+    char* m_Allocation = nullptr;   // What operator new returned, m_Block is aligned inside it
+    char* m_Block = nullptr;
+    size_t m_Capacity = 0;
+    size_t m_Offset = 0;
+    size_t m_Used = 0;          // Bytes asked for since the last Reset, overflow and padding included
+    size_t m_PeakUsed = 0;
+    Overflow* m_Overflow = nullptr;
+    uint64_t m_OverflowCount = 0;
+
+    void FreeOverflow();
+
+public:
+    LinearArena() {}
+    ~LinearArena();
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    // alignment must be a power of two, at most alignof(std::max_align_t)
+    void* Allocate(size_t bytes, size_t alignment);
+
+    // Forget every allocation. The block grows to hold what the last step used, and at
+    // least minBytes, this is the only place the arena allocates its block
+    void Reset(size_t minBytes = 0);
+
+    size_t GetCapacity() const { return m_Capacity; }
+    size_t GetUsed() const { return m_Used; }
+    size_t GetPeakUsed() const { return m_PeakUsed; }
+
+    // Allocations that didn't fit in the block since the arena was created
+    uint64_t GetOverflowCount() const { return m_OverflowCount; }
+};
+
+// One LinearArena per thread of a ThreadPool for the scratch data of a physics step:
+// thread 0 (the calling thread) builds the step's shared lists, the others fill their
+// part of a ParallelFor into their own arena, so threads never share a bump pointer
+class FrameArena {
+private:
+    std::vector<std::unique_ptr<LinearArena>> m_Threads;
+
+public:
+    FrameArena();
+
+    // Rewind every thread's arena, call it at the start of each step. Adds arenas up to
+    // threadCount. sharedBytes is what the calling thread is expected to need on top of
+    // perThreadBytes, the share of a parallel loop every thread may fill
+    void Reset(int threadCount, size_t sharedBytes = 0, size_t perThreadBytes = 0);
+
+    // threadIndex is the one ParallelFor passes to its function
+    LinearArena& GetThreadArena(int threadIndex) { return *m_Threads[threadIndex]; }
+    int GetThreadCount() const { return static_cast<int>(m_Threads.size()); }
+
+    // Blocks of every thread
+    size_t GetCapacity() const;
+    uint64_t GetOverflowCount() const;
+};
+
+// std::allocator taking memory from a LinearArena. Deallocation is a no-op, the arena's
+// Reset reclaims everything at once. Without an arena it allocates from the heap and
+// counts the bytes under Tag, so a container can be used outside of a step too.
+// A container holding arena memory must be assigned a new one after the arena is reset,
+// clear() would keep writing into memory the arena hands out again
+template<typename T, MemoryTag Tag>
+class ArenaAllocator {
+private:
+    LinearArena* m_Arena;
+
+public:
+    typedef T value_type;
+
+    // Moving a container moves its memory and the arena it came from
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template<typename U>
+    struct rebind {
+        typedef ArenaAllocator<U, Tag> other;
+    };
+
+    ArenaAllocator() noexcept : m_Arena(nullptr) {}
+    explicit ArenaAllocator(LinearArena& arena) noexcept : m_Arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U, Tag>& other) noexcept : m_Arena(other.GetArena()) {}
+
+    LinearArena* GetArena() const { return m_Arena; }
+
+    // Copies outlive the step, they go to the heap
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    T* allocate(size_t count)
+    {
+        if (m_Arena)
+            return static_cast<T*>(m_Arena->Allocate(count * sizeof(T), alignof(T)));
+
+        T* pointer = static_cast<T*>(::operator new(count * sizeof(T)));
+        MemoryTracker::RecordAllocation(Tag, count * sizeof(T));
+        return pointer;
+    }
+
+    void deallocate(T* pointer, size_t count) noexcept
+    {
+        if (m_Arena)
+            return;
+
+        MemoryTracker::RecordDeallocation(Tag, count * sizeof(T));
+        ::operator delete(pointer);
+    }
+};
+
+template<typename T, typename U, MemoryTag Tag>
+bool operator==(const ArenaAllocator<T, Tag>& a, const ArenaAllocator<U, Tag>& b) { return a.GetArena() == b.GetArena(); }
+
+template<typename T, typename U, MemoryTag Tag>
+bool operator!=(const ArenaAllocator<T, Tag>& a, const ArenaAllocator<U, Tag>& b) { return a.GetArena() != b.GetArena(); }
+
+// Vector that takes its storage from a step arena, or from the heap counted under Tag
+template<typename T, MemoryTag Tag>
+using ArenaVector = std::vector<T, ArenaAllocator<T, Tag>>;
+
+// Start list over for a new step: backed by the arena when there is one, otherwise by the
+// heap reusing its old storage. Returns the size it had, to size the new list from it
+template<typename T, MemoryTag Tag>
+size_t RestartArenaVector(ArenaVector<T, Tag>& list, LinearArena* arena)
+{
+    const size_t previousSize = list.size();
+    if (arena)
+        list = ArenaVector<T, Tag>(ArenaAllocator<T, Tag>(*arena));
+    else if (list.get_allocator().GetArena())
+        list = ArenaVector<T, Tag>();
+    else
+        list.clear();
+    return previousSize;
+}
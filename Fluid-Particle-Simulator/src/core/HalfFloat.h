@@ -0,0 +1,183 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// IEEE 754 half precision (fp16) conversions for compact storage. Rounding is to nearest
+// even, values above 65504 become infinities and small ones subnormals, like the F16C
+// instructions. Batches of 4 use those instructions when the build targets them, SSE2
+// bit operations otherwise, and the scalar code without SSE2. Every path gives the same
+// halves and floats, NaN payloads aside
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HALF_FLOAT_F16C 1
+#endif
+
+#if defined(HALF_FLOAT_F16C) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HALF_FLOAT_SSE2 1
+#include <immintrin.h>
+#endif
+
+namespace HalfFloat {
+
+inline uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float BitsFloat(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+} // namespace HalfFloat
+
+inline uint16_t FloatToHalf(float value)
+{
+#ifdef HALF_FLOAT_F16C
+    return static_cast<uint16_t>(_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT));
+#else
+    using namespace HalfFloat;
+    uint32_t bits = FloatBits(value);
+    const uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t half;
+    if (bits >= (127u + 16u) << 23)
+    {
+        // Too large for a half, or infinity and NaN
+        half = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+    }
+    else if (bits < (127u - 14u) << 23)
+    {
+        // Subnormal half: adding 0.5 lines the half mantissa up with the float's low
+        // bits and the addition rounds it to nearest even
+        const float magic = BitsFloat(((127u - 15u) + (23u - 10u) + 1u) << 23);
+        half = FloatBits(BitsFloat(bits) + magic) - FloatBits(magic);
+    }
+    else
+    {
+        // Rebias the exponent and round the 13 dropped mantissa bits to nearest even
+        const uint32_t mantissaOdd = (bits >> 13) & 1u;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfffu + mantissaOdd;
+        half = bits >> 13;
+    }
+    return static_cast<uint16_t>(half | (sign >> 16));
+#endif
+}
+
+inline float HalfToFloat(uint16_t half)
+{
+#ifdef HALF_FLOAT_F16C
+    return _cvtsh_ss(half);
+#else
+    using namespace HalfFloat;
+    // Shifted into a float's place the bits are the value times 2^-112, the multiply
+    // rebiases the exponent and normalises subnormals
+    const uint32_t exponentMantissa = static_cast<uint32_t>(half & 0x7fffu);
+    const float scaled = BitsFloat(exponentMantissa << 13) * BitsFloat((254u - 15u) << 23);
+    uint32_t bits = FloatBits(scaled) | (static_cast<uint32_t>(half & 0x8000u) << 16);
+    if (exponentMantissa > 0x7bffu)
+        bits |= 255u << 23;     // Infinity and NaN
+    return BitsFloat(bits);
+#endif
+}
+
+// Stochastic rounding: a normal half is rounded up with a probability equal to the
+// fraction dropped, taken from the top 13 bits of noise. Repeated small changes, like
+// gravity added to a velocity every step, then keep their average where rounding to
+// nearest would lose or exaggerate them. Subnormals and specials round to nearest even
+inline uint16_t FloatToHalfDithered(float value, uint32_t noise)
+{
+    using namespace HalfFloat;
+    uint32_t bits = FloatBits(value);
+    const uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+    if (bits < (127u - 14u) << 23 || bits >= (127u + 16u) << 23)
+        return FloatToHalf(value);
+
+    const uint32_t half = (bits - ((127u - 15u) << 23) + (noise >> 19)) >> 13;
+    return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+#ifdef HALF_FLOAT_SSE2
+
+// 4 halves in the low 64 bits to 4 floats
+inline __m128 HalfToFloat4(__m128i halves)
+{
+#ifdef HALF_FLOAT_F16C
+    return _mm_cvtph_ps(halves);
+#else
+    const __m128i words = _mm_unpacklo_epi16(halves, _mm_setzero_si128());
+    const __m128i exponentMantissa = _mm_and_si128(words, _mm_set1_epi32(0x7fff));
+    const __m128i sign = _mm_slli_epi32(_mm_xor_si128(words, exponentMantissa), 16);
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)),
+        _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    const __m128i infNan = _mm_and_si128(_mm_cmpgt_epi32(exponentMantissa, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNan)));
+#endif
+}
+
+namespace HalfFloat {
+
+// FloatToHalf4 in SSE2 operations. Dither rounds normal halves up with a probability equal
+// to the dropped fraction, taken from the top 13 bits of each noise lane, instead of to
+// nearest even
+template<bool Dither>
+inline __m128i FloatToHalf4Soft(__m128 values, __m128i noise)
+{
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u)));
+    const __m128 sign = _mm_and_ps(values, signMask);
+    const __m128 absolute = _mm_xor_ps(values, sign);
+    const __m128i bits = _mm_castps_si128(absolute);
+
+    // Too large for a half, or infinity and NaN
+    const __m128i isRegular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), bits);
+    const __m128i nanBit = _mm_and_si128(_mm_castps_si128(_mm_cmpunord_ps(absolute, absolute)), _mm_set1_epi32(0x200));
+    const __m128i infNan = _mm_or_si128(nanBit, _mm_set1_epi32(0x7c00));
+
+    // Subnormal halves, rounded by the addition as in FloatToHalf
+    const __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), bits);
+    const __m128i magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absolute, _mm_castsi128_ps(magic))), magic);
+
+    // Normal halves: rebias the exponent and add the rounding before dropping 13 bits.
+    // To nearest even the odd mantissa bit (as 0 or -1) breaks the ties
+    const __m128i rebiased = _mm_sub_epi32(bits, _mm_set1_epi32((127 - 15) << 23));
+    __m128i rounded;
+    if (Dither)
+        rounded = _mm_add_epi32(rebiased, _mm_srli_epi32(noise, 19));
+    else
+        rounded = _mm_sub_epi32(_mm_add_epi32(rebiased, _mm_set1_epi32(0xfff)), _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31));
+    const __m128i normal = _mm_srli_epi32(rounded, 13);
+
+    const __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    const __m128i magnitude = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infNan));
+
+    // Sign extended into the upper half of each lane, which keeps the signed pack exact
+    const __m128i halves = _mm_or_si128(magnitude, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+    return _mm_packs_epi32(halves, halves);
+}
+
+} // namespace HalfFloat
+
+// 4 floats to 4 halves in the low 64 bits
+inline __m128i FloatToHalf4(__m128 values)
+{
+#ifdef HALF_FLOAT_F16C
+    return _mm_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT);
+#else
+    return HalfFloat::FloatToHalf4Soft<false>(values, _mm_setzero_si128());
+#endif
+}
+
+// FloatToHalf4 with FloatToHalfDithered rounding, noise holds one value per lane
+inline __m128i FloatToHalf4Dithered(__m128 values, __m128i noise)
+{
+    return HalfFloat::FloatToHalf4Soft<true>(values, noise);
+}
+
+#endif
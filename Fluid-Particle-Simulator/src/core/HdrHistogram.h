@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Log-linear histogram of integer values with the HdrHistogram bucket layout: values
+// below 128 get a bucket each, above that every power of two is split into 64 buckets,
+// so a value is stored within 1/64 (1.6%) of itself. Values can be removed again, which
+// keeps a histogram of a sliding window. Storage is allocated once in the constructor and
+// no operation depends on the number of recorded values
+class HdrHistogram {
+private:
+    static const int SUB_BUCKET_BITS = 7;
+    static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const int SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+
+    std::vector<uint32_t> m_Counts;
+    uint64_t m_MaxValue;
+    uint64_t m_TotalCount = 0;
+    int m_MaxIndex = -1;    // Highest bucket holding a value, -1 when empty
+
+    static int GetIndex(uint64_t value)
+    {
+        int bucket = 0;
+        while ((value >> bucket) >= static_cast<uint64_t>(SUB_BUCKET_COUNT))
+            bucket++;
+        return bucket * SUB_BUCKET_HALF + static_cast<int>(value >> bucket);
+    }
+
+    // Largest value stored in the same bucket as index
+    static uint64_t GetHighestValue(int index)
+    {
+        const int bucket = index < SUB_BUCKET_COUNT ? 0 : index / SUB_BUCKET_HALF - 1;
+        const uint64_t subBucket = static_cast<uint64_t>(index - bucket * SUB_BUCKET_HALF);
+        return (subBucket << bucket) + (uint64_t(1) << bucket) - 1;
+    }
+
+    int ClampedIndex(uint64_t value) const { return GetIndex(value < m_MaxValue ? value : m_MaxValue); }
+
+public:
+    // Larger values are counted as maxValue
+    explicit HdrHistogram(uint64_t maxValue)
+        : m_Counts(GetIndex(maxValue) + 1, 0), m_MaxValue(maxValue)
+    {
+    }
+
+    void Record(uint64_t value)
+    {
+        const int index = ClampedIndex(value);
+        m_Counts[index]++;
+        m_TotalCount++;
+        if (index > m_MaxIndex)
+            m_MaxIndex = index;
+    }
+
+    // Forget one value recorded before. Removing the last value of the highest bucket
+    // walks down to the next one that holds a value
+    void Remove(uint64_t value)
+    {
+        const int index = ClampedIndex(value);
+        uint32_t& count = m_Counts[index];
+        if (count == 0)
+            return;
+        count--;
+        m_TotalCount--;
+        if (index == m_MaxIndex)
+        {
+            while (m_MaxIndex >= 0 && m_Counts[m_MaxIndex] == 0)
+                m_MaxIndex--;
+        }
+    }
+
+    void Clear()
+    {
+        for (uint32_t& count : m_Counts)
+            count = 0;
+        m_TotalCount = 0;
+        m_MaxIndex = -1;
+    }
+
+    uint64_t GetTotalCount() const { return m_TotalCount; }
+
+    // Value that percentile percent (0 to 100) of the recorded values don't exceed, rounded
+    // up to the end of its bucket. 0 when empty
+    uint64_t GetValueAtPercentile(double percentile) const
+    {
+        if (m_TotalCount == 0)
+            return 0;
+
+        uint64_t target = static_cast<uint64_t>(percentile / 100.0 * m_TotalCount + 0.5);
+        target = target < 1 ? 1 : (target > m_TotalCount ? m_TotalCount : target);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_Counts.size(); i++)
+        {
+            seen += m_Counts[i];
+            if (seen >= target)
+                return GetHighestValue(static_cast<int>(i));
+        }
+        return m_MaxValue;
+    }
+
+    // Largest recorded value, rounded up to the end of its bucket. 0 when empty
+    uint64_t GetMax() const { return m_MaxIndex < 0 ? 0 : GetHighestValue(m_MaxIndex); }
+};
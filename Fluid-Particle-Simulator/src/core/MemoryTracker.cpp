@@ -0,0 +1,92 @@
+#include "MemoryTracker.h"
+#include <cstdio>
+
+namespace {
+
+struct TagCounters {
+    std::atomic<int64_t> currentBytes{ 0 };
+    std::atomic<int64_t> peakBytes{ 0 };
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> deallocations{ 0 };
+};
+
+// Zero initialised before any dynamic initialisation, so containers of other globals are counted too
+TagCounters s_Counters[MEMORY_TAG_COUNT];
+
+const char* TAG_NAMES[MEMORY_TAG_COUNT] = { "particles", "spatial_grid", "collision_pairs", "renderer", "fluid_surface", "frame_arena" };
+
+}
+
+void MemoryTracker::RecordAllocation(MemoryTag tag, size_t bytes)
+{
+    TagCounters& counters = s_Counters[static_cast<int>(tag)];
+    const int64_t current = counters.currentBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+    while (current > peak && !counters.peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+    {
+    }
+}
+
+void MemoryTracker::RecordDeallocation(MemoryTag tag, size_t bytes)
+{
+    TagCounters& counters = s_Counters[static_cast<int>(tag)];
+    counters.currentBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    counters.deallocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+MemoryTagStats MemoryTracker::GetStats(MemoryTag tag)
+{
+    const TagCounters& counters = s_Counters[static_cast<int>(tag)];
+    MemoryTagStats stats;
+    stats.currentBytes = counters.currentBytes.load(std::memory_order_relaxed);
+    stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+    stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+    stats.deallocations = counters.deallocations.load(std::memory_order_relaxed);
+    return stats;
+}
+
+const char* MemoryTracker::GetTagName(MemoryTag tag)
+{
+    return TAG_NAMES[static_cast<int>(tag)];
+}
+
+void MemoryTracker::ResetPeaks()
+{
+    for (TagCounters& counters : s_Counters)
+        counters.peakBytes.store(counters.currentBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void MemoryTracker::WriteReport(std::ostream& stream, size_t particleCount)
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%-16s %12s %12s %12s %12s %10s %10s\n",
+        "subsystem", "current KB", "peak KB", "allocs", "frees", "B/part", "peak B/p");
+    stream << line;
+
+    MemoryTagStats total;
+    for (int i = 0; i < MEMORY_TAG_COUNT; i++)
+    {
+        const MemoryTagStats stats = GetStats(static_cast<MemoryTag>(i));
+        total.currentBytes += stats.currentBytes;
+        total.peakBytes += stats.peakBytes;
+        total.allocations += stats.allocations;
+        total.deallocations += stats.deallocations;
+
+        snprintf(line, sizeof(line), "%-16s %12.1f %12.1f %12llu %12llu %10.1f %10.1f\n",
+            TAG_NAMES[i], stats.currentBytes / 1024.0, stats.peakBytes / 1024.0,
+            static_cast<unsigned long long>(stats.allocations), static_cast<unsigned long long>(stats.deallocations),
+            particleCount > 0 ? static_cast<double>(stats.currentBytes) / particleCount : 0.0,
+            particleCount > 0 ? static_cast<double>(stats.peakBytes) / particleCount : 0.0);
+        stream << line;
+    }
+
+    // Peaks of different tags may not coincide, the total peak is an upper bound
+    snprintf(line, sizeof(line), "%-16s %12.1f %12.1f %12llu %12llu %10.1f %10.1f\n",
+        "total", total.currentBytes / 1024.0, total.peakBytes / 1024.0,
+        static_cast<unsigned long long>(total.allocations), static_cast<unsigned long long>(total.deallocations),
+        particleCount > 0 ? static_cast<double>(total.currentBytes) / particleCount : 0.0,
+        particleCount > 0 ? static_cast<double>(total.peakBytes) / particleCount : 0.0);
+    stream << line;
+}
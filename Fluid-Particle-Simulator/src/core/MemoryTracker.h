@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <ostream>
+#include <vector>
+
+// Subsystems whose containers are accounted for
+enum class MemoryTag {
+    Particles = 0,      // Particle arrays
+    SpatialGrid = 1,    // Grid cell arrays
+    CollisionPairs = 2, // Broadphase pair buffers
+    Renderer = 3,       // Instance data and software renderer buffers
+    FluidSurface = 4,   // Density field, sorted particles and strips
+    FrameArena = 5,     // Per-step scratch blocks, pair lists built during a step live here
+    Count = 6
+};
+
+const int MEMORY_TAG_COUNT = static_cast<int>(MemoryTag::Count);
+
+// Bytes and allocations of one tag since the program started (peak since ResetPeaks)
+struct MemoryTagStats {
+    int64_t currentBytes = 0;
+    int64_t peakBytes = 0;
+    uint64_t allocations = 0;
+    uint64_t deallocations = 0;
+};
+
+// Heap bytes held by each subsystem, fed by TrackingAllocator. Counters are atomic so
+// containers filled by pool threads are counted too
+class MemoryTracker {
+public:
+    static void RecordAllocation(MemoryTag tag, size_t bytes);
+    static void RecordDeallocation(MemoryTag tag, size_t bytes);
+
+    static MemoryTagStats GetStats(MemoryTag tag);
+    static const char* GetTagName(MemoryTag tag);
+
+    // Start the peaks again from the current sizes, to measure one phase of the program
+    static void ResetPeaks();
+
+    // One line per tag: current and peak size, allocation counts, and bytes per particle when
+    // particleCount is not 0
+    static void WriteReport(std::ostream& stream, size_t particleCount = 0);
+};
+
+// std::allocator that reports every allocation to MemoryTracker under Tag
+template<typename T, MemoryTag Tag>
+class TrackingAllocator {
+public:
+    typedef T value_type;
+
+    // The tag is a non-type parameter, so allocator_traits can't rebind on its own
+    template<typename U>
+    struct rebind {
+        typedef TrackingAllocator<U, Tag> other;
+    };
+
+    TrackingAllocator() noexcept {}
+    template<typename U>
+    TrackingAllocator(const TrackingAllocator<U, Tag>&) noexcept {}
+
+    T* allocate(size_t count)
+    {
+        T* pointer = static_cast<T*>(::operator new(count * sizeof(T)));
+        MemoryTracker::RecordAllocation(Tag, count * sizeof(T));
+        return pointer;
+    }
+
+    void deallocate(T* pointer, size_t count) noexcept
+    {
+        MemoryTracker::RecordDeallocation(Tag, count * sizeof(T));
+        ::operator delete(pointer);
+    }
+};
+
+template<typename T, typename U, MemoryTag Tag>
+bool operator==(const TrackingAllocator<T, Tag>&, const TrackingAllocator<U, Tag>&) { return true; }
+
+template<typename T, typename U, MemoryTag Tag>
+bool operator!=(const TrackingAllocator<T, Tag>&, const TrackingAllocator<U, Tag>&) { return false; }
+
+// Vector whose storage is counted under Tag
+template<typename T, MemoryTag Tag>
+using TrackedVector = std::vector<T, TrackingAllocator<T, Tag>>;
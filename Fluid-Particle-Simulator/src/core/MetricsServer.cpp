@@ -0,0 +1,337 @@
+#include "MetricsServer.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET SocketHandle;
+typedef int SocketLength;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int SocketHandle;
+typedef socklen_t SocketLength;
+#endif
+
+namespace {
+
+// Step rate is measured over windows of this length
+const uint64_t RATE_WINDOW_NS = 1000000000ull;
+
+// How often the server thread checks for Stop while no client connects
+const int ACCEPT_TIMEOUT_MS = 200;
+
+// Time a client gets to send its request line and headers
+const int RECEIVE_TIMEOUT_MS = 1000;
+const int MAX_REQUEST_BYTES = 4096;
+
+#if defined(_WIN32)
+const int SEND_FLAGS = 0;
+void CloseSocket(SocketHandle socket) { closesocket(socket); }
+#else
+// A scraper closing early must not kill the process with SIGPIPE
+#if defined(MSG_NOSIGNAL)
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+void CloseSocket(SocketHandle socket) { close(socket); }
+#endif
+
+SocketHandle ToSocket(uintptr_t handle) { return static_cast<SocketHandle>(handle); }
+
+// Balances the WSAStartup of Start
+void ReleaseSockets()
+{
+#if defined(_WIN32)
+    WSACleanup();
+#endif
+}
+
+bool SendAll(SocketHandle socket, const std::string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        const int result = send(socket, data.data() + sent, static_cast<int>(data.size() - sent), SEND_FLAGS);
+        if (result <= 0)
+            return false;
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+void AppendHeader(std::string& text, const char* name, const char* help, const char* type)
+{
+    text += "# HELP ";
+    text += name;
+    text += ' ';
+    text += help;
+    text += "\n# TYPE ";
+    text += name;
+    text += ' ';
+    text += type;
+    text += '\n';
+}
+
+void AppendValue(std::string& text, const char* name, const char* labels, double value)
+{
+    char line[256];
+    if (labels)
+        snprintf(line, sizeof(line), "%s{%s} %.9g\n", name, labels, value);
+    else
+        snprintf(line, sizeof(line), "%s %.9g\n", name, value);
+    text += line;
+}
+
+}
+
+MetricsServer::MetricsServer(int port, bool loopbackOnly)
+    : m_Port(port), m_LoopbackOnly(loopbackOnly)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    Stop();
+}
+
+bool MetricsServer::Start()
+{
+    if (m_Listening)
+        return true;
+
+#if defined(_WIN32)
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+    {
+        m_Error = "WSAStartup failed";
+        return false;
+    }
+#endif
+
+    const SocketHandle listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#if defined(_WIN32)
+    if (listenSocket == INVALID_SOCKET)
+#else
+    if (listenSocket < 0)
+#endif
+    {
+        m_Error = "can't create a socket";
+        ReleaseSockets();
+        return false;
+    }
+
+    // Restarting a run right away must not fail on the previous run's TIME_WAIT socket
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<unsigned short>(m_Port));
+    address.sin_addr.s_addr = htonl(m_LoopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+
+    if (bind(listenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenSocket, 4) != 0)
+    {
+        m_Error = "can't listen on port " + std::to_string(m_Port);
+        CloseSocket(listenSocket);
+        ReleaseSockets();
+        return false;
+    }
+
+    m_ListenSocket = static_cast<uintptr_t>(listenSocket);
+    m_Listening = true;
+    m_Stop = false;
+    m_Thread = std::thread(&MetricsServer::ServeLoop, this);
+    return true;
+}
+
+void MetricsServer::Stop()
+{
+    if (!m_Listening)
+        return;
+
+    m_Stop = true;
+    m_Thread.join();
+    CloseSocket(ToSocket(m_ListenSocket));
+    m_Listening = false;
+    ReleaseSockets();
+}
+
+void MetricsServer::RecordStep(const PhysicsStepStats& stats, int substeps)
+{
+    const uint64_t now = Profiler::Now();
+    if (m_RateWindowStart == 0)
+        m_RateWindowStart = now;
+
+    m_Pending.steps++;
+    m_Pending.stepNsTotal += stats.stepNs;
+    for (int phase = 0; phase < PHYSICS_PHASE_COUNT; phase++)
+        m_Pending.phaseNsTotal[phase] += stats.phaseNs[phase];
+    m_Pending.candidatePairsTotal += static_cast<uint64_t>(stats.candidatePairs);
+    m_Pending.contactsTotal += static_cast<uint64_t>(stats.contacts);
+    m_Pending.lastStep = stats;
+    m_Pending.substeps = substeps;
+
+    m_RateWindowSteps++;
+    if (now - m_RateWindowStart >= RATE_WINDOW_NS)
+    {
+        m_Pending.stepRate = m_RateWindowSteps * 1e9 / static_cast<double>(now - m_RateWindowStart);
+        m_RateWindowStart = now;
+        m_RateWindowSteps = 0;
+    }
+
+    // The server only holds the lock while copying, if it has it the next step publishes
+    if (m_SnapshotMutex.try_lock())
+    {
+        m_Published = m_Pending;
+        m_SnapshotMutex.unlock();
+    }
+}
+
+void MetricsServer::ServeLoop()
+{
+    const SocketHandle listenSocket = ToSocket(m_ListenSocket);
+    while (!m_Stop)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listenSocket, &readable);
+        timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = ACCEPT_TIMEOUT_MS * 1000;
+
+        if (select(static_cast<int>(listenSocket) + 1, &readable, nullptr, nullptr, &timeout) <= 0)
+            continue;
+
+        sockaddr_in clientAddress;
+        SocketLength addressLength = sizeof(clientAddress);
+        const SocketHandle client = accept(listenSocket, reinterpret_cast<sockaddr*>(&clientAddress), &addressLength);
+#if defined(_WIN32)
+        if (client == INVALID_SOCKET)
+#else
+        if (client < 0)
+#endif
+            continue;
+
+        HandleClient(static_cast<uintptr_t>(client));
+        CloseSocket(client);
+    }
+}
+
+void MetricsServer::HandleClient(uintptr_t clientHandle)
+{
+    const SocketHandle client = ToSocket(clientHandle);
+
+#if defined(_WIN32)
+    DWORD receiveTimeout = RECEIVE_TIMEOUT_MS;
+#else
+    timeval receiveTimeout;
+    receiveTimeout.tv_sec = RECEIVE_TIMEOUT_MS / 1000;
+    receiveTimeout.tv_usec = (RECEIVE_TIMEOUT_MS % 1000) * 1000;
+#endif
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&receiveTimeout), sizeof(receiveTimeout));
+
+    // Read up to the end of the headers, the request body (if any) is ignored
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < static_cast<size_t>(MAX_REQUEST_BYTES))
+    {
+        const int received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+            break;
+        request.append(buffer, static_cast<size_t>(received));
+    }
+
+    const bool isMetrics = request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0;
+    if (!isMetrics)
+    {
+        SendAll(client, "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\nnot found\n");
+        return;
+    }
+
+    Snapshot snapshot;
+    {
+        std::lock_guard<std::mutex> lock(m_SnapshotMutex);
+        snapshot = m_Published;
+    }
+
+    const std::string body = FormatMetrics(snapshot);
+    SendAll(client, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: " +
+        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+}
+
+std::string MetricsServer::FormatMetrics(const Snapshot& snapshot) const
+{
+    std::string text;
+    char labels[64];
+
+    AppendHeader(text, "particle_sim_steps_total", "Physics steps simulated.", "counter");
+    AppendValue(text, "particle_sim_steps_total", nullptr, static_cast<double>(snapshot.steps));
+
+    AppendHeader(text, "particle_sim_step_rate", "Physics steps per second over the last second.", "gauge");
+    AppendValue(text, "particle_sim_step_rate", nullptr, snapshot.stepRate);
+
+    AppendHeader(text, "particle_sim_step_seconds_total", "Wall time spent in physics steps.", "counter");
+    AppendValue(text, "particle_sim_step_seconds_total", nullptr, snapshot.stepNsTotal * 1e-9);
+
+    AppendHeader(text, "particle_sim_phase_seconds_total", "Wall time spent in each physics phase.", "counter");
+    for (int phase = 0; phase < PHYSICS_PHASE_COUNT; phase++)
+    {
+        snprintf(labels, sizeof(labels), "phase=\"%s\"", GetPhysicsPhaseName(static_cast<PhysicsPhase>(phase)));
+        AppendValue(text, "particle_sim_phase_seconds_total", labels, snapshot.phaseNsTotal[phase] * 1e-9);
+    }
+
+    AppendHeader(text, "particle_sim_phase_last_seconds", "Wall time of each physics phase in the last step.", "gauge");
+    for (int phase = 0; phase < PHYSICS_PHASE_COUNT; phase++)
+    {
+        snprintf(labels, sizeof(labels), "phase=\"%s\"", GetPhysicsPhaseName(static_cast<PhysicsPhase>(phase)));
+        AppendValue(text, "particle_sim_phase_last_seconds", labels, snapshot.lastStep.phaseNs[phase] * 1e-9);
+    }
+
+    AppendHeader(text, "particle_sim_particles", "Particles in the last step.", "gauge");
+    AppendValue(text, "particle_sim_particles", nullptr, snapshot.lastStep.particles);
+
+    AppendHeader(text, "particle_sim_candidate_pairs", "Pairs the broadphase handed to the solver in the last step.", "gauge");
+    AppendValue(text, "particle_sim_candidate_pairs", nullptr, snapshot.lastStep.candidatePairs);
+
+    AppendHeader(text, "particle_sim_contact_pairs", "Candidate pairs in contact when solved in the last step.", "gauge");
+    AppendValue(text, "particle_sim_contact_pairs", nullptr, snapshot.lastStep.contacts);
+
+    AppendHeader(text, "particle_sim_candidate_pairs_total", "Candidate pairs over every step.", "counter");
+    AppendValue(text, "particle_sim_candidate_pairs_total", nullptr, static_cast<double>(snapshot.candidatePairsTotal));
+
+    AppendHeader(text, "particle_sim_contact_pairs_total", "Contact pairs over every step.", "counter");
+    AppendValue(text, "particle_sim_contact_pairs_total", nullptr, static_cast<double>(snapshot.contactsTotal));
+
+    AppendHeader(text, "particle_sim_substeps", "Physics steps per frame.", "gauge");
+    AppendValue(text, "particle_sim_substeps", nullptr, snapshot.substeps);
+
+    // The tracker's counters are atomic, read them directly
+    AppendHeader(text, "particle_sim_memory_bytes", "Heap bytes held by each subsystem.", "gauge");
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+    {
+        snprintf(labels, sizeof(labels), "subsystem=\"%s\"", MemoryTracker::GetTagName(static_cast<MemoryTag>(tag)));
+        AppendValue(text, "particle_sim_memory_bytes", labels, static_cast<double>(MemoryTracker::GetStats(static_cast<MemoryTag>(tag)).currentBytes));
+    }
+
+    AppendHeader(text, "particle_sim_memory_peak_bytes", "Largest heap size of each subsystem.", "gauge");
+    for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++)
+    {
+        snprintf(labels, sizeof(labels), "subsystem=\"%s\"", MemoryTracker::GetTagName(static_cast<MemoryTag>(tag)));
+        AppendValue(text, "particle_sim_memory_peak_bytes", labels, static_cast<double>(MemoryTracker::GetStats(static_cast<MemoryTag>(tag)).peakBytes));
+    }
+
+    return text;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "../physics/PhysicsStats.h"
+
+// Minimal HTTP server answering GET /metrics in the Prometheus text exposition format:
+// step count and rate, time per physics phase, particles, candidate and contact pairs,
+// substeps and the MemoryTracker sizes. It serves one connection at a time on its own
+// thread. The simulation thread only copies its counters into a snapshot when the
+// server isn't reading it, so scrapes never make a step wait.
+//   curl http://localhost:<port>/metrics
+class MetricsServer {
+private:
+    // Counters since the server was created
+    struct Snapshot {
+        uint64_t steps = 0;
+        double stepRate = 0.0;                          // Steps per second over the last rate window
+        uint64_t stepNsTotal = 0;
+        uint64_t phaseNsTotal[PHYSICS_PHASE_COUNT] = {};
+        uint64_t candidatePairsTotal = 0;
+        uint64_t contactsTotal = 0;
+        PhysicsStepStats lastStep;
+        int substeps = 0;
+    };
+
+    Snapshot m_Pending;         // Simulation thread only
+    Snapshot m_Published;       // Copy the server reads, guarded by m_SnapshotMutex
+    std::mutex m_SnapshotMutex;
+    uint64_t m_RateWindowStart = 0;
+    uint64_t m_RateWindowSteps = 0;
+
+    int m_Port;
+    bool m_LoopbackOnly;
+    uintptr_t m_ListenSocket = 0;
+    bool m_Listening = false;
+    std::atomic<bool> m_Stop{ false };
+    std::thread m_Thread;
+    std::string m_Error;
+
+    void ServeLoop();
+    void HandleClient(uintptr_t client);
+    std::string FormatMetrics(const Snapshot& snapshot) const;
+
+public:
+    // loopbackOnly binds 127.0.0.1, otherwise every interface is reachable
+    explicit MetricsServer(int port, bool loopbackOnly = true);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Open the port and start the server thread. Returns false if the port can't be
+    // opened, GetError says why
+    bool Start();
+    void Stop();
+    bool IsRunning() const { return m_Listening; }
+    const std::string& GetError() const { return m_Error; }
+    int GetPort() const { return m_Port; }
+
+    // Add a finished step, call it from the simulation thread after UpdatePhysics.
+    // substeps is the number of steps per frame
+    void RecordStep(const PhysicsStepStats& stats, int substeps);
+};
@@ -0,0 +1,253 @@
+#include "PerfCounters.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char* EVENT_NAMES[PERF_EVENT_COUNT] = { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses" };
+
+std::mutex s_ZoneMutex;
+std::vector<PerfZone*> s_Zones;
+
+bool s_Enabled = false;
+std::thread::id s_Owner;
+std::string s_Status = "not enabled";
+
+#if defined(__linux__)
+
+// File descriptor of every event, -1 when the CPU or kernel doesn't provide it.
+// Cycles lead the group, the others are scheduled together with it
+int s_Fds[PERF_EVENT_COUNT] = { -1, -1, -1, -1, -1 };
+int s_Slots[PERF_EVENT_COUNT] = { -1, -1, -1, -1, -1 };     // Position of the event in the group read
+int s_OpenCount = 0;
+
+const uint64_t CACHE_READ_MISS = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+const EventConfig EVENT_CONFIGS[PERF_EVENT_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | CACHE_READ_MISS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | CACHE_READ_MISS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+// Calling thread only, user space only so it works with perf_event_paranoid up to 2
+int OpenEvent(const EventConfig& event, int groupFd)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = groupFd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+
+void CloseEvents()
+{
+    for (int i = PERF_EVENT_COUNT - 1; i >= 0; i--)
+    {
+        if (s_Fds[i] != -1)
+            close(s_Fds[i]);
+        s_Fds[i] = -1;
+        s_Slots[i] = -1;
+    }
+    s_OpenCount = 0;
+}
+
+#endif
+
+double Ratio(uint64_t value, uint64_t per)
+{
+    return per > 0 ? static_cast<double>(value) / static_cast<double>(per) : 0.0;
+}
+
+}
+
+PerfZone::PerfZone(const char* zoneName) : name(zoneName)
+{
+    std::lock_guard<std::mutex> lock(s_ZoneMutex);
+    s_Zones.push_back(this);
+}
+
+bool PerfCounters::Enable()
+{
+    Disable();
+
+#if defined(__linux__)
+    s_Fds[0] = OpenEvent(EVENT_CONFIGS[0], -1);
+    if (s_Fds[0] == -1)
+    {
+        const int error = errno;
+        s_Status = std::string("perf_event_open failed: ") + strerror(error);
+        if (error == EACCES || error == EPERM)
+            s_Status += " (lower /proc/sys/kernel/perf_event_paranoid or grant CAP_PERFMON)";
+        else if (error == ENOENT || error == ENODEV || error == EOPNOTSUPP)
+            s_Status += " (no hardware counters, common in containers and VMs)";
+        return false;
+    }
+    s_Slots[0] = s_OpenCount++;
+
+    std::string missing;
+    for (int i = 1; i < PERF_EVENT_COUNT; i++)
+    {
+        s_Fds[i] = OpenEvent(EVENT_CONFIGS[i], s_Fds[0]);
+        if (s_Fds[i] == -1)
+            missing += std::string(missing.empty() ? "" : ", ") + EVENT_NAMES[i];
+        else
+            s_Slots[i] = s_OpenCount++;
+    }
+
+    ioctl(s_Fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    if (ioctl(s_Fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1)
+    {
+        s_Status = std::string("enabling the counters failed: ") + strerror(errno);
+        CloseEvents();
+        return false;
+    }
+
+    s_Enabled = true;
+    s_Owner = std::this_thread::get_id();
+    s_Status = missing.empty() ? "all events available" : "unavailable events: " + missing;
+    return true;
+#else
+    s_Status = "hardware counters need Linux perf_event_open";
+    return false;
+#endif
+}
+
+void PerfCounters::Disable()
+{
+#if defined(__linux__)
+    CloseEvents();
+#endif
+    s_Enabled = false;
+    s_Status = "not enabled";
+}
+
+bool PerfCounters::IsEnabled()
+{
+    return s_Enabled;
+}
+
+bool PerfCounters::IsEventAvailable(PerfEvent event)
+{
+#if defined(__linux__)
+    return s_Enabled && s_Fds[static_cast<int>(event)] != -1;
+#else
+    (void)event;
+    return false;
+#endif
+}
+
+const std::string& PerfCounters::GetStatus()
+{
+    return s_Status;
+}
+
+bool PerfCounters::Read(uint64_t* counts)
+{
+    if (!s_Enabled || std::this_thread::get_id() != s_Owner)
+        return false;
+
+#if defined(__linux__)
+    // nr, time enabled, time running, then one value per event in open order
+    uint64_t buffer[3 + PERF_EVENT_COUNT];
+    const ssize_t size = read(s_Fds[0], buffer, sizeof(buffer));
+    if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)) || buffer[0] != static_cast<uint64_t>(s_OpenCount))
+        return false;
+
+    // More events than counters makes the kernel time share them, extrapolate to the full time
+    const double scale = buffer[2] > 0 ? static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]) : 1.0;
+    for (int i = 0; i < PERF_EVENT_COUNT; i++)
+    {
+        if (s_Slots[i] == -1)
+            counts[i] = 0;
+        else
+            counts[i] = scale == 1.0 ? buffer[3 + s_Slots[i]] : static_cast<uint64_t>(buffer[3 + s_Slots[i]] * scale);
+    }
+    return true;
+#else
+    (void)counts;
+    return false;
+#endif
+}
+
+void PerfCounters::Reset()
+{
+    std::lock_guard<std::mutex> lock(s_ZoneMutex);
+    for (PerfZone* zone : s_Zones)
+    {
+        zone->calls = 0;
+        zone->items = 0;
+        memset(zone->counts, 0, sizeof(zone->counts));
+    }
+}
+
+void PerfCounters::WriteReport(std::ostream& stream)
+{
+    if (!s_Enabled)
+    {
+        stream << "Hardware counters unavailable: " << s_Status << "\n";
+        return;
+    }
+
+    const int cycles = static_cast<int>(PerfEvent::Cycles);
+    const int instructions = static_cast<int>(PerfEvent::Instructions);
+    const int l1d = static_cast<int>(PerfEvent::L1DMisses);
+    const int llc = static_cast<int>(PerfEvent::LLCMisses);
+    const int branch = static_cast<int>(PerfEvent::BranchMisses);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-24s %8s %10s %6s %10s %10s %10s %10s\n",
+        "zone", "calls", "items/call", "IPC", "cyc/item", "L1D/item", "LLC/item", "br/item");
+    stream << line;
+
+    std::lock_guard<std::mutex> lock(s_ZoneMutex);
+    for (const PerfZone* zone : s_Zones)
+    {
+        if (zone->calls == 0)
+            continue;
+
+        // Missing events print as n/a instead of a misleading zero
+        char ipc[16];
+        if (IsEventAvailable(PerfEvent::Instructions))
+            snprintf(ipc, sizeof(ipc), "%.2f", Ratio(zone->counts[instructions], zone->counts[cycles]));
+        else
+            snprintf(ipc, sizeof(ipc), "n/a");
+
+        char misses[3][16];
+        const int events[3] = { l1d, llc, branch };
+        for (int i = 0; i < 3; i++)
+        {
+            if (IsEventAvailable(static_cast<PerfEvent>(events[i])))
+                snprintf(misses[i], sizeof(misses[i]), "%.3f", Ratio(zone->counts[events[i]], zone->items));
+            else
+                snprintf(misses[i], sizeof(misses[i]), "n/a");
+        }
+
+        snprintf(line, sizeof(line), "%-24s %8llu %10.0f %6s %10.2f %10s %10s %10s\n",
+            zone->name, static_cast<unsigned long long>(zone->calls), Ratio(zone->items, zone->calls),
+            ipc, Ratio(zone->counts[cycles], zone->items), misses[0], misses[1], misses[2]);
+        stream << line;
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Hardware events counted around the PERF_SCOPE zones
+enum class PerfEvent {
+    Cycles = 0,
+    Instructions = 1,
+    L1DMisses = 2,      // L1 data cache read misses
+    LLCMisses = 3,      // Last level cache read misses
+    BranchMisses = 4,
+    Count = 5
+};
+
+const int PERF_EVENT_COUNT = static_cast<int>(PerfEvent::Count);
+
+// Totals of one zone since the last PerfCounters::Reset. Zones register themselves
+// when they are constructed, PERF_SCOPE creates one static zone per call site
+struct PerfZone {
+    const char* name;
+    uint64_t calls = 0;
+    uint64_t items = 0;             // Particles (or pairs) handled, for the per item columns
+    uint64_t counts[PERF_EVENT_COUNT] = {};
+
+    explicit PerfZone(const char* zoneName);
+};
+
+// Hardware performance counters through Linux perf_event_open, read as one group so
+// every event covers the same instructions. Optional at runtime: nothing is counted
+// until Enable succeeds, and Enable fails cleanly (GetStatus says why) on other
+// platforms, without a PMU (most containers and VMs) or when perf_event_paranoid
+// forbids it. Events the CPU doesn't have are left out of the group.
+// Counters follow the thread that called Enable, zones running on other threads are
+// skipped, so time threaded phases with a single thread
+class PerfCounters {
+public:
+    // Open the counter group for the calling thread. Returns false if no counter is available
+    static bool Enable();
+    static void Disable();
+    static bool IsEnabled();
+    static bool IsEventAvailable(PerfEvent event);
+
+    // Why Enable failed, or which events are missing
+    static const std::string& GetStatus();
+
+    // Current totals, scaled when the kernel multiplexed the group. Returns false when
+    // disabled or called from another thread than the one that enabled the counters
+    static bool Read(uint64_t* counts);
+
+    // Zero every zone
+    static void Reset();
+
+    // One line per zone that ran: calls, IPC and cycles, misses per item
+    static void WriteReport(std::ostream& stream);
+};
+
+// Adds the events counted during its lifetime to a zone
+class PerfScope {
+private:
+    PerfZone& m_Zone;
+    uint64_t m_Items;
+    bool m_Active;
+    uint64_t m_Start[PERF_EVENT_COUNT];
+
+public:
+    PerfScope(PerfZone& zone, size_t items)
+        : m_Zone(zone), m_Items(items), m_Active(PerfCounters::IsEnabled() && PerfCounters::Read(m_Start))
+    {
+    }
+
+    ~PerfScope()
+    {
+        uint64_t end[PERF_EVENT_COUNT];
+        if (!m_Active || !PerfCounters::Read(end))
+            return;
+
+        m_Zone.calls++;
+        m_Zone.items += m_Items;
+        for (int i = 0; i < PERF_EVENT_COUNT; i++)
+            m_Zone.counts[i] += end[i] - m_Start[i];
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+};
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+
+// Count the enclosing scope into the zone called name, items is the work it handles
+#define PERF_SCOPE(name, items) \
+    static PerfZone PERF_CONCAT(perfZone, __LINE__)(name); \
+    PerfScope PERF_CONCAT(perfScope, __LINE__)(PERF_CONCAT(perfZone, __LINE__), items)
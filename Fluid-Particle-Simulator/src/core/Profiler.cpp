@@ -0,0 +1,136 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Ring of one thread, only that thread writes it
+struct ThreadBuffer {
+    std::vector<ProfileEvent> events;
+    std::atomic<uint64_t> written{ 0 };     // Total zones recorded, the ring holds the last EVENTS_PER_THREAD
+    int threadId = 0;
+    std::string name;
+};
+
+// Buffers outlive their threads so zones of finished threads can still be exported
+std::mutex s_RegistryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> s_Buffers;
+
+thread_local ThreadBuffer* t_Buffer = nullptr;
+
+ThreadBuffer& GetThreadBuffer()
+{
+    if (!t_Buffer)
+    {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+        buffer->events.resize(Profiler::EVENTS_PER_THREAD);
+
+        std::lock_guard<std::mutex> lock(s_RegistryMutex);
+        buffer->threadId = static_cast<int>(s_Buffers.size());
+        buffer->name = "Thread " + std::to_string(buffer->threadId);
+        t_Buffer = buffer.get();
+        s_Buffers.push_back(std::move(buffer));
+    }
+    return *t_Buffer;
+}
+
+// Zone names are literals, only quotes and backslashes need escaping
+void WriteJsonString(std::ofstream& file, const char* text)
+{
+    file << '"';
+    for (const char* c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            file << '\\';
+        file << *c;
+    }
+    file << '"';
+}
+
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+    ThreadBuffer& buffer = GetThreadBuffer();
+    const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+
+    ProfileEvent& event = buffer.events[index % EVENTS_PER_THREAD];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+
+    // Publish after the event is written, the exporter reads up to this count
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+    ThreadBuffer& buffer = GetThreadBuffer();
+
+    std::lock_guard<std::mutex> lock(s_RegistryMutex);
+    buffer.name = name;
+}
+
+bool Profiler::ExportChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file.good())
+        return false;
+
+    std::lock_guard<std::mutex> lock(s_RegistryMutex);
+
+    // Timestamps start at the oldest zone still recorded
+    uint64_t origin = UINT64_MAX;
+    for (const auto& buffer : s_Buffers)
+    {
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        const uint64_t first = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+        for (uint64_t i = first; i < written; i++)
+            origin = std::min(origin, buffer->events[i % EVENTS_PER_THREAD].start);
+    }
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool firstEvent = true;
+    char numbers[96];
+    for (const auto& buffer : s_Buffers)
+    {
+        file << (firstEvent ? "" : ",\n");
+        firstEvent = false;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+        WriteJsonString(file, buffer->name.c_str());
+        file << "}}";
+
+        const uint64_t written = buffer->written.load(std::memory_order_acquire);
+        const uint64_t first = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+        for (uint64_t i = first; i < written; i++)
+        {
+            // Complete events, times in microseconds
+            const ProfileEvent& event = buffer->events[i % EVENTS_PER_THREAD];
+            file << ",\n{\"name\":";
+            WriteJsonString(file, event.name);
+            snprintf(numbers, sizeof(numbers), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f",
+                (event.start - origin) * 1.0e-3, (event.end - event.start) * 1.0e-3);
+            file << numbers << ",\"pid\":1,\"tid\":" << buffer->threadId << "}";
+        }
+    }
+    file << "\n]}\n";
+    return file.good();
+}
+
+void Profiler::Clear()
+{
+    std::lock_guard<std::mutex> lock(s_RegistryMutex);
+    for (const auto& buffer : s_Buffers)
+        buffer->written.store(0, std::memory_order_release);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Scoped timing zones exported as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+// Zones are only recorded when PROFILER_ENABLED is defined (add it to the project's
+// preprocessor definitions). Without it PROFILE_SCOPE expands to nothing, so the
+// instrumented code is exactly the uninstrumented one.
+//
+// Every thread writes to its own ring buffer, registered the first time the thread
+// records a zone, so recording never locks. Each ring keeps the last
+// EVENTS_PER_THREAD zones of its thread.
+class Profiler {
+public:
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    // Nanoseconds on a monotonic clock
+    static uint64_t Now()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Store a finished zone in the calling thread's ring. name must outlive the profiler (a literal)
+    static void Record(const char* name, uint64_t start, uint64_t end);
+
+    // Name shown for the calling thread in the trace, threads without one are "Thread <n>"
+    static void SetThreadName(const char* name);
+
+    // Write every zone still in the rings as Chrome trace JSON. Call it while no other
+    // thread is recording, between frames for example. Returns false if the file can't be written
+    static bool ExportChromeTrace(const std::string& path);
+
+    // Drop every recorded zone, same threading rule as ExportChromeTrace
+    static void Clear();
+
+    static bool IsEnabled()
+    {
+#if defined(PROFILER_ENABLED)
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+
+// Times the scope it lives in
+class ProfileZone {
+private:
+    const char* m_Name;
+    uint64_t m_Start;
+
+public:
+    explicit ProfileZone(const char* name) : m_Name(name), m_Start(Profiler::Now()) {}
+    ~ProfileZone() { Profiler::Record(m_Name, m_Start, Profiler::Now()); }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if defined(PROFILER_ENABLED)
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
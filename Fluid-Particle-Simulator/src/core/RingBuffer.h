@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+
+// Fixed capacity history, pushing into a full buffer overwrites the oldest element.
+// Storage is allocated once in the constructor
+template<typename T>
+class RingBuffer {
+private:
+    std::vector<T> m_Items;
+    size_t m_Next;      // Slot the next Push writes
+    size_t m_Size;
+
+public:
+    explicit RingBuffer(size_t capacity)
+        : m_Items(capacity > 0 ? capacity : 1), m_Next(0), m_Size(0)
+    {
+    }
+
+    void Push(const T& item)
+    {
+        m_Items[m_Next] = item;
+        m_Next = (m_Next + 1) % m_Items.size();
+        if (m_Size < m_Items.size())
+            m_Size++;
+    }
+
+    void Clear() { m_Next = 0; m_Size = 0; }
+
+    size_t Size() const { return m_Size; }
+    size_t Capacity() const { return m_Items.size(); }
+    bool Empty() const { return m_Size == 0; }
+
+    // 0 is the oldest element, Size() - 1 the newest
+    const T& operator[](size_t index) const
+    {
+        return m_Items[(m_Next + m_Items.size() - m_Size + index) % m_Items.size()];
+    }
+
+    // Newest element, the buffer must not be empty
+    const T& Back() const { return (*this)[m_Size - 1]; }
+};
@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+#include "AllocationGuard.h"
+#include "Profiler.h"
+#include <algorithm>
+
+// Chunks handed out per thread, more chunks balance uneven work better
+const int CHUNKS_PER_THREAD = 4;
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0) {
+        threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    m_ThreadBusy.resize(threadCount);
+
+    // The calling thread is thread 0
+    for (int i = 1; i < threadCount; i++) {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_WakeCondition.notify_all();
+
+    for (auto& worker : m_Workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::WorkerLoop(int threadIndex)
+{
+    if (Profiler::IsEnabled()) {
+        Profiler::SetThreadName(("Worker " + std::to_string(threadIndex)).c_str());
+    }
+
+    uint64_t lastGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WakeCondition.wait(lock, [&] { return m_Stop || m_Generation != lastGeneration; });
+            if (m_Stop) return;
+            lastGeneration = m_Generation;
+        }
+
+        RunChunks(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (--m_PendingWorkers == 0)
+                m_DoneCondition.notify_one();
+        }
+    }
+}
+
+void ThreadPool::RunChunks(int threadIndex)
+{
+    HotRegion hotRegion(threadIndex > 0 ? m_JobHotRegion : nullptr);
+    while (true)
+    {
+        const int begin = m_NextBegin.fetch_add(m_ChunkSize);
+        if (begin >= m_Count) return;
+
+        PROFILE_SCOPE("ParallelFor chunk");
+        if (m_CollectTimings)
+        {
+            const uint64_t start = Profiler::Now();
+            (*m_Job)(begin, std::min(begin + m_ChunkSize, m_Count), threadIndex);
+            m_ThreadBusy[threadIndex].ns += Profiler::Now() - start;
+        }
+        else
+            (*m_Job)(begin, std::min(begin + m_ChunkSize, m_Count), threadIndex);
+    }
+}
+
+void ThreadPool::ParallelFor(int count, const RangeFunction& func, int minChunk)
+{
+    if (count <= 0) return;
+
+    const uint64_t start = m_CollectTimings ? Profiler::Now() : 0;
+
+    // Not worth waking the workers
+    if (m_Workers.empty() || count <= minChunk) {
+        func(0, count, 0);
+        if (m_CollectTimings)
+        {
+            const uint64_t elapsed = Profiler::Now() - start;
+            m_ThreadBusy[0].ns += elapsed;
+            m_TimedWallNs += elapsed;
+            m_TimedCalls++;
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Job = &func;
+        m_JobHotRegion = AllocationGuard::GetHotRegion();
+        m_Count = count;
+        m_ChunkSize = std::max(minChunk, count / (GetThreadCount() * CHUNKS_PER_THREAD));
+        m_NextBegin = 0;
+        m_PendingWorkers = static_cast<int>(m_Workers.size());
+        m_Generation++;
+    }
+    m_WakeCondition.notify_all();
+
+    RunChunks(0);
+
+    // Workers may still be finishing their last chunk
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_DoneCondition.wait(lock, [&] { return m_PendingWorkers == 0; });
+    m_Job = nullptr;
+
+    if (m_CollectTimings)
+    {
+        m_TimedWallNs += Profiler::Now() - start;
+        m_TimedCalls++;
+    }
+}
+
+void ThreadPool::ResetTimings()
+{
+    for (auto& busy : m_ThreadBusy)
+        busy.ns = 0;
+    m_TimedCalls = 0;
+    m_TimedWallNs = 0;
+}
+
+ThreadPoolTimings ThreadPool::GetTimings() const
+{
+    ThreadPoolTimings timings;
+    timings.parallelCalls = m_TimedCalls;
+    timings.wallNs = m_TimedWallNs;
+    for (const auto& busy : m_ThreadBusy)
+        timings.busyNs.push_back(busy.ns);
+    return timings;
+}
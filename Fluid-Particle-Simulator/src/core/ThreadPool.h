@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Time spent in ParallelFor since the timings were last reset, see SetCollectTimings
+struct ThreadPoolTimings {
+    uint64_t parallelCalls = 0;
+    uint64_t wallNs = 0;                // From dispatching the chunks to the last one finishing, summed over the calls
+    std::vector<uint64_t> busyNs;       // Time each thread spent running chunks, calling thread first
+};
+
+// Fixed set of worker threads used to split loops over particles, tiles or cells.
+// The calling thread works too, so a pool of N threads has N - 1 workers.
+class ThreadPool {
+public:
+    // Work function called with the range [begin, end) and the index of the
+    // thread running it (0 is the calling thread), use it for per-thread buffers.
+    // Refers to the callable it is made from without copying it: a std::function
+    // would allocate for lambdas capturing more than a couple of references
+    class RangeFunction {
+    private:
+        void* m_Callable;
+        void (*m_Invoke)(void* callable, int begin, int end, int threadIndex);
+
+        template<typename F>
+        static void Invoke(void* callable, int begin, int end, int threadIndex)
+        {
+            (*static_cast<F*>(callable))(begin, end, threadIndex);
+        }
+
+    public:
+        // The callable must outlive every call, true for a lambda passed to ParallelFor
+        template<typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, RangeFunction>::value>::type>
+        RangeFunction(F&& callable)
+            : m_Callable(const_cast<void*>(static_cast<const void*>(std::addressof(callable)))),
+            m_Invoke(&Invoke<typename std::remove_reference<F>::type>)
+        {
+        }
+
+        void operator()(int begin, int end, int threadIndex) const { m_Invoke(m_Callable, begin, end, threadIndex); }
+    };
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeCondition;
+    std::condition_variable m_DoneCondition;
+
+    // Current job, only valid while ParallelFor is running
+    const RangeFunction* m_Job = nullptr;
+    const char* m_JobHotRegion = nullptr;     // Hot region of the caller, the workers run in it too
+    int m_Count = 0;
+    int m_ChunkSize = 1;
+    std::atomic<int> m_NextBegin{ 0 };
+    int m_PendingWorkers = 0;
+    uint64_t m_Generation = 0;
+    bool m_Stop = false;
+
+    // Per thread busy time, padded so the threads don't share cache lines while timing
+    struct ThreadBusy {
+        uint64_t ns = 0;
+        char padding[56];
+    };
+    bool m_CollectTimings = false;
+    std::vector<ThreadBusy> m_ThreadBusy;
+    uint64_t m_TimedCalls = 0;
+    uint64_t m_TimedWallNs = 0;
+
+    void WorkerLoop(int threadIndex);
+    void RunChunks(int threadIndex);
+
+public:
+    // threadCount includes the calling thread, 0 uses every hardware thread
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in ParallelFor, calling thread included
+    int GetThreadCount() const { return static_cast<int>(m_Workers.size()) + 1; }
+
+    // Run func over [0, count) split into chunks of at least minChunk items.
+    // Chunks are handed out dynamically, returns once every chunk is done
+    void ParallelFor(int count, const RangeFunction& func, int minChunk = 1);
+
+    // Time the chunks of every thread and the wall time of each ParallelFor. Off by default,
+    // it reads the clock around every chunk. Change it and read the timings between ParallelFor calls
+    void SetCollectTimings(bool collect) { m_CollectTimings = collect; }
+    bool IsCollectingTimings() const { return m_CollectTimings; }
+    void ResetTimings();
+    ThreadPoolTimings GetTimings() const;
+};
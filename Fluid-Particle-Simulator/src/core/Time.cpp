@@ -1,35 +1,44 @@
 #include "Time.h"
 #include <cmath>
 #include <algorithm>
-#include <deque>
 
 const int MAXSTEPS = 100;
 
+// Frames kept for the averages and percentiles, 2 seconds at 60fps
+const size_t FRAME_HISTORY_SIZE = 120;
+
+// Longest frame the histogram tells apart, in microseconds
+const uint64_t MAX_TRACKED_FRAME_US = 10000000;
+
 Time::Time(float fixedDeltaTime)
     : m_FixedDeltaTime(fixedDeltaTime), m_LastTime(glfwGetTime()),
-    m_Accumulator(0.0f), m_LastFrameTime(0.0f)
+    m_Accumulator(0.0f), m_LastFrameTime(0.0f),
+    m_FrameTimeHistory(FRAME_HISTORY_SIZE), m_FrameTimeHistogram(MAX_TRACKED_FRAME_US),
+    m_FrameTimeSumUs(0)
 {
-    // Initialize tracking variables for averages
-    m_FrameTimeHistory.clear();
-    m_MaxFrameHistorySize = 120; // Track last 2 seconds at 60fps
 }
 
 int Time::update()
 {
     double currentTime = glfwGetTime();
     float frameTime = static_cast<float>(currentTime - m_LastTime);
+
+    // Add this frame's time to our history before the cap, so spikes show in the stats.
+    // The oldest frame drops out of the sum and histogram when the history is full
+    const uint32_t frameTimeUs = static_cast<uint32_t>(std::min<double>(frameTime * 1e6, MAX_TRACKED_FRAME_US));
+    if (m_FrameTimeHistory.Size() == m_FrameTimeHistory.Capacity()) {
+        const uint32_t oldestUs = m_FrameTimeHistory[0];
+        m_FrameTimeHistogram.Remove(oldestUs);
+        m_FrameTimeSumUs -= oldestUs;
+    }
+    m_FrameTimeHistory.Push(frameTimeUs);
+    m_FrameTimeHistogram.Record(frameTimeUs);
+    m_FrameTimeSumUs += frameTimeUs;
+
     frameTime = std::min(frameTime, 0.25f); // Cap at 250ms prevent errors (?)
     m_LastTime = currentTime;
     m_LastFrameTime = frameTime;
 
-    // Add this frame's time to our history
-    m_FrameTimeHistory.push_back(frameTime);
-
-    // Keep history at maximum size by removing oldest entries
-    while (m_FrameTimeHistory.size() > m_MaxFrameHistorySize) {
-        m_FrameTimeHistory.pop_front();
-    }
-
     m_Accumulator += frameTime;
     // Calculate the number of fixed steps needed to cover the elapsed time.
     int steps = std::min(MAXSTEPS, static_cast<int>(std::floor(m_Accumulator / m_FixedDeltaTime)));
@@ -63,37 +72,28 @@ float Time::getLastfps() const
 // Get average FPS over history window
 float Time::getAverageFPS() const
 {
-    if (m_FrameTimeHistory.empty()) {
-        return 0.0f;
-    }
-
-    // Calculate average frame time
-    float totalTime = 0.0f;
-    for (const auto& frameTime : m_FrameTimeHistory) {
-        totalTime += frameTime;
-    }
-
-    float avgFrameTime = totalTime / m_FrameTimeHistory.size();
+    float avgFrameTimeMs = getAverageFrameTimeMs();
 
     // Convert to FPS
-    return (avgFrameTime > 0.0f) ? (1.0f / avgFrameTime) : 0.0f;
+    return (avgFrameTimeMs > 0.0f) ? (1000.0f / avgFrameTimeMs) : 0.0f;
 }
 
 // Get average milliseconds per frame over history window
 float Time::getAverageFrameTimeMs() const
 {
-    if (m_FrameTimeHistory.empty()) {
+    if (m_FrameTimeHistory.Empty()) {
         return 0.0f;
     }
 
-    // Calculate average frame time
-    float totalTime = 0.0f;
-    for (const auto& frameTime : m_FrameTimeHistory) {
-        totalTime += frameTime;
-    }
+    return static_cast<float>(m_FrameTimeSumUs) / m_FrameTimeHistory.Size() / 1000.0f;
+}
 
-    float avgFrameTime = totalTime / m_FrameTimeHistory.size();
+float Time::getFrameTimePercentileMs(double percentile) const
+{
+    return m_FrameTimeHistogram.GetValueAtPercentile(percentile) / 1000.0f;
+}
 
-    // Convert to milliseconds
-    return avgFrameTime * 1000.0f;
-}
\ No newline at end of file
+float Time::getMaxFrameTimeMs() const
+{
+    return m_FrameTimeHistogram.GetMax() / 1000.0f;
+}
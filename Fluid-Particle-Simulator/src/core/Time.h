@@ -1,6 +1,8 @@
 #pragma once
 #include <GLFW/glfw3.h>
-#include <deque>
+#include <cstdint>
+#include "HdrHistogram.h"
+#include "RingBuffer.h"
 
 class Time {
 private:
@@ -9,9 +11,11 @@ private:
     float m_Accumulator;
     float m_LastFrameTime;
     
-    // For tracking average performance
-    std::deque<float> m_FrameTimeHistory;
-    size_t m_MaxFrameHistorySize;
+    // Frame times of the last frames in microseconds, with their sum and histogram so
+    // averages and percentiles don't walk the history
+    RingBuffer<uint32_t> m_FrameTimeHistory;
+    HdrHistogram m_FrameTimeHistogram;
+    uint64_t m_FrameTimeSumUs;
 
 public:
     Time(float fixedDeltaTime);
@@ -24,4 +28,8 @@ public:
     // better metrics functions
     float getAverageFPS() const;
     float getAverageFrameTimeMs() const;
+
+    // Frame time percentile (0 to 100) and maximum over the history window
+    float getFrameTimePercentileMs(double percentile) const;
+    float getMaxFrameTimeMs() const;
 };
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "CompactParticles.h"
+
+constexpr double CompactParticles::FIXED_SCALE;
+constexpr double CompactParticles::FIXED_LIMIT;
+
+CompactParticles::CompactParticles(const Vec2& bottomLeft, const Vec2& topRight)
+{
+    m_OriginX = (static_cast<double>(bottomLeft.x) + topRight.x) * 0.5;
+    m_OriginY = (static_cast<double>(bottomLeft.y) + topRight.y) * 0.5;
+
+    const double halfWidth = std::abs(static_cast<double>(topRight.x) - bottomLeft.x) * 0.5;
+    const double halfHeight = std::abs(static_cast<double>(topRight.y) - bottomLeft.y) * 0.5;
+    m_ToFixedX = FIXED_SCALE / halfWidth;
+    m_ToFixedY = FIXED_SCALE / halfHeight;
+    m_FromFixedX = halfWidth / FIXED_SCALE;
+    m_FromFixedY = halfHeight / FIXED_SCALE;
+}
+
+void CompactParticles::reserve(size_t count)
+{
+    m_PositionX.reserve(count);
+    m_PositionY.reserve(count);
+    m_VelocityX.reserve(count);
+    m_VelocityY.reserve(count);
+    m_Temperature.reserve(count);
+    if (!m_Masses.empty())
+        m_Masses.reserve(count);
+}
+
+void CompactParticles::Release()
+{
+    TrackedVector<int32_t, MemoryTag::Particles>().swap(m_PositionX);
+    TrackedVector<int32_t, MemoryTag::Particles>().swap(m_PositionY);
+    TrackedVector<uint16_t, MemoryTag::Particles>().swap(m_VelocityX);
+    TrackedVector<uint16_t, MemoryTag::Particles>().swap(m_VelocityY);
+    TrackedVector<uint16_t, MemoryTag::Particles>().swap(m_Temperature);
+    TrackedVector<float, MemoryTag::Particles>().swap(m_Masses);
+    m_SharedMass = 1.0f;
+}
+
+void CompactParticles::Add(const Particle& particle)
+{
+    // The first particle sets the shared mass, the mass array is only created once
+    // one of them differs
+    if (empty())
+        m_SharedMass = particle.mass;
+    else if (m_Masses.empty() && particle.mass != m_SharedMass)
+    {
+        m_Masses.reserve(capacity());
+        m_Masses.assign(size(), m_SharedMass);
+    }
+    if (!m_Masses.empty())
+        m_Masses.push_back(particle.mass);
+
+    m_PositionX.push_back(0);
+    m_PositionY.push_back(0);
+    m_VelocityX.push_back(0);
+    m_VelocityY.push_back(0);
+    m_Temperature.push_back(0);
+
+    // Added particles round to nearest, there is no step to vary the noise over
+    const int index = static_cast<int>(size()) - 1;
+    m_PositionX[index] = EncodeX(particle.position.x);
+    m_PositionY[index] = EncodeY(particle.position.y);
+    m_VelocityX[index] = FloatToHalf(particle.velocity.x);
+    m_VelocityY[index] = FloatToHalf(particle.velocity.y);
+    m_Temperature[index] = FloatToHalf(particle.temperature);
+}
+
+void CompactParticles::Pack(const ParticleVector& particles)
+{
+    Release();
+    reserve(particles.capacity());
+    for (const Particle& particle : particles)
+        Add(particle);
+}
+
+void CompactParticles::Unpack(ParticleVector& particles) const
+{
+    const int count = static_cast<int>(size());
+    if (particles.capacity() < capacity())
+        particles.reserve(capacity());
+    particles.clear();
+    for (int i = 0; i < count; i++)
+        particles.push_back(Load(i));
+}
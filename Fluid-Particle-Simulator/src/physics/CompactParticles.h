@@ -0,0 +1,199 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include "Particle.h"
+#include "../core/HalfFloat.h"
+#include "../core/MemoryTracker.h"
+
+// How SimulationSystem stores its particles
+enum class ParticleStorage {
+    Full = 0,       // ParticleVector, 32-bit floats
+    Compact = 1     // CompactParticles
+};
+
+// Particles decoded by CompactParticles::LoadBatch, one lane per particle
+struct ParticleBatch {
+    static const int SIZE = 4;
+
+    float positionX[SIZE];
+    float positionY[SIZE];
+    float velocityX[SIZE];
+    float velocityY[SIZE];
+    float temperature[SIZE];
+    float mass[SIZE];
+};
+
+// Reduced precision particle storage for scenes too large for the memory bandwidth:
+// positions as 32-bit fixed point relative to the bounds, velocities and temperatures as
+// fp16, one array per field. Masses take no space while they are all equal. That is 14
+// bytes per particle against the 40 of a Particle, force, density and pressure aren't kept.
+// Kernels decode into floats, update and encode back. Stores round velocities and
+// temperatures stochastically with noise from the particle index and a seed, see
+// FloatToHalfDithered, so changes smaller than an fp16 step aren't lost
+class CompactParticles {
+private:
+    // The fixed point spans twice the bounds around their centre, particles pushed a little
+    // outside by a contact still fit. The step is the same everywhere inside, 2^-30 of half
+    // the width (height). A float can't hold 30 bits, so the offset from the centre and the
+    // scaling are done in doubles: encoding doesn't round to a float's resolution around the
+    // centre, and decoding rounds once, to the float nearest the stored position. Where a
+    // float is coarser than the step (a few units from the origin) positions round trip exactly
+    static constexpr double FIXED_SCALE = 1073741824.0;     // 2^30
+    static constexpr double FIXED_LIMIT = 2147483647.0;     // Largest int32
+
+    double m_OriginX, m_OriginY;
+    double m_ToFixedX, m_ToFixedY;
+    double m_FromFixedX, m_FromFixedY;
+
+    TrackedVector<int32_t, MemoryTag::Particles> m_PositionX;
+    TrackedVector<int32_t, MemoryTag::Particles> m_PositionY;
+    TrackedVector<uint16_t, MemoryTag::Particles> m_VelocityX;
+    TrackedVector<uint16_t, MemoryTag::Particles> m_VelocityY;
+    TrackedVector<uint16_t, MemoryTag::Particles> m_Temperature;
+    TrackedVector<float, MemoryTag::Particles> m_Masses;    // Empty while every particle weighs m_SharedMass
+    float m_SharedMass = 1.0f;
+
+    int32_t EncodeX(float x) const { return EncodeFixed((x - m_OriginX) * m_ToFixedX); }
+    int32_t EncodeY(float y) const { return EncodeFixed((y - m_OriginY) * m_ToFixedY); }
+
+    static int32_t EncodeFixed(double value)
+    {
+        value = value < -FIXED_LIMIT ? -FIXED_LIMIT : (value > FIXED_LIMIT ? FIXED_LIMIT : value);
+        return static_cast<int32_t>(std::lrint(value));
+    }
+
+#ifdef HALF_FLOAT_SSE2
+    // EncodeFixed of 4 coordinates and its inverse, two lanes of doubles at a time
+    static __m128i EncodeFixed4(__m128 values, double origin, double toFixed)
+    {
+        const __m128d originLanes = _mm_set1_pd(origin);
+        const __m128d scale = _mm_set1_pd(toFixed);
+        const __m128d limit = _mm_set1_pd(FIXED_LIMIT);
+        const __m128d negativeLimit = _mm_set1_pd(-FIXED_LIMIT);
+        const __m128d low = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(values), originLanes), scale);
+        const __m128d high = _mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(values, values)), originLanes), scale);
+        return _mm_unpacklo_epi64(_mm_cvtpd_epi32(_mm_max_pd(_mm_min_pd(low, limit), negativeLimit)),
+            _mm_cvtpd_epi32(_mm_max_pd(_mm_min_pd(high, limit), negativeLimit)));
+    }
+
+    static __m128 DecodeFixed4(__m128i fixed, double origin, double fromFixed)
+    {
+        const __m128d originLanes = _mm_set1_pd(origin);
+        const __m128d scale = _mm_set1_pd(fromFixed);
+        const __m128d low = _mm_add_pd(originLanes, _mm_mul_pd(_mm_cvtepi32_pd(fixed), scale));
+        const __m128d high = _mm_add_pd(originLanes, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(fixed, fixed)), scale));
+        return _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+    }
+#endif
+
+    // Noise the store of particle index rounds with: a Weyl sequence, neighbouring particles
+    // round differently and the seeds of consecutive steps move it for each particle
+    static uint32_t GetRoundingNoise(int index, uint32_t seed) { return static_cast<uint32_t>(index) * 0x9e3779b9u + seed; }
+
+    // Different noise for each field of a particle
+    static const uint32_t VELOCITY_Y_NOISE = 0x6a09e667u;
+    static const uint32_t TEMPERATURE_NOISE = 0xbb67ae85u;
+
+public:
+    CompactParticles(const Vec2& bottomLeft, const Vec2& topRight);
+
+    size_t size() const { return m_PositionX.size(); }
+    size_t capacity() const { return m_PositionX.capacity(); }
+    bool empty() const { return m_PositionX.empty(); }
+    void reserve(size_t count);
+
+    // Remove every particle and free the arrays
+    void Release();
+
+    void Add(const Particle& particle);
+
+    // Replace the contents with particles / write them all into particles
+    void Pack(const ParticleVector& particles);
+    void Unpack(ParticleVector& particles) const;
+
+    float GetMass(int index) const { return m_Masses.empty() ? m_SharedMass : m_Masses[index]; }
+
+    Vec2 LoadPosition(int index) const
+    {
+        return Vec2(static_cast<float>(m_OriginX + m_PositionX[index] * m_FromFixedX),
+            static_cast<float>(m_OriginY + m_PositionY[index] * m_FromFixedY));
+    }
+
+    // Decoded particle, force, density and pressure are 0
+    Particle Load(int index) const
+    {
+        Particle particle(LoadPosition(index), Vec2(HalfToFloat(m_VelocityX[index]), HalfToFloat(m_VelocityY[index])), GetMass(index));
+        particle.temperature = HalfToFloat(m_Temperature[index]);
+        return particle;
+    }
+
+    // Encode position, velocity and temperature of particle, the mass isn't written.
+    // Stores of one step should share a seed that differs from the previous steps'
+    void Store(int index, const Particle& particle, uint32_t seed)
+    {
+        const uint32_t noise = GetRoundingNoise(index, seed);
+        m_PositionX[index] = EncodeX(particle.position.x);
+        m_PositionY[index] = EncodeY(particle.position.y);
+        m_VelocityX[index] = FloatToHalfDithered(particle.velocity.x, noise);
+        m_VelocityY[index] = FloatToHalfDithered(particle.velocity.y, noise + VELOCITY_Y_NOISE);
+        m_Temperature[index] = FloatToHalfDithered(particle.temperature, noise + TEMPERATURE_NOISE);
+    }
+
+    // Load and Store of the particles [first, first + ParticleBatch::SIZE), converted with
+    // SSE2 (F16C when the build has it). Same values as the single particle versions
+    void LoadBatch(int first, ParticleBatch& batch) const
+    {
+#ifdef HALF_FLOAT_SSE2
+        const __m128i positionX = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_PositionX[first]));
+        const __m128i positionY = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_PositionY[first]));
+        _mm_storeu_ps(batch.positionX, DecodeFixed4(positionX, m_OriginX, m_FromFixedX));
+        _mm_storeu_ps(batch.positionY, DecodeFixed4(positionY, m_OriginY, m_FromFixedY));
+        _mm_storeu_ps(batch.velocityX, HalfToFloat4(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&m_VelocityX[first]))));
+        _mm_storeu_ps(batch.velocityY, HalfToFloat4(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&m_VelocityY[first]))));
+        _mm_storeu_ps(batch.temperature, HalfToFloat4(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&m_Temperature[first]))));
+        _mm_storeu_ps(batch.mass, m_Masses.empty() ? _mm_set1_ps(m_SharedMass) : _mm_loadu_ps(&m_Masses[first]));
+#else
+        for (int lane = 0; lane < ParticleBatch::SIZE; lane++)
+        {
+            const Particle particle = Load(first + lane);
+            batch.positionX[lane] = particle.position.x;
+            batch.positionY[lane] = particle.position.y;
+            batch.velocityX[lane] = particle.velocity.x;
+            batch.velocityY[lane] = particle.velocity.y;
+            batch.temperature[lane] = particle.temperature;
+            batch.mass[lane] = particle.mass;
+        }
+#endif
+    }
+
+    void StoreBatch(int first, const ParticleBatch& batch, uint32_t seed)
+    {
+#ifdef HALF_FLOAT_SSE2
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&m_PositionX[first]), EncodeFixed4(_mm_loadu_ps(batch.positionX), m_OriginX, m_ToFixedX));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&m_PositionY[first]), EncodeFixed4(_mm_loadu_ps(batch.positionY), m_OriginY, m_ToFixedY));
+
+        const uint32_t firstNoise = GetRoundingNoise(first, seed);
+        const __m128i noise = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(firstNoise)),
+            _mm_setr_epi32(0, static_cast<int>(0x9e3779b9u), static_cast<int>(2u * 0x9e3779b9u), static_cast<int>(3u * 0x9e3779b9u)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&m_VelocityX[first]), FloatToHalf4Dithered(_mm_loadu_ps(batch.velocityX), noise));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&m_VelocityY[first]),
+            FloatToHalf4Dithered(_mm_loadu_ps(batch.velocityY), _mm_add_epi32(noise, _mm_set1_epi32(static_cast<int>(VELOCITY_Y_NOISE)))));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&m_Temperature[first]),
+            FloatToHalf4Dithered(_mm_loadu_ps(batch.temperature), _mm_add_epi32(noise, _mm_set1_epi32(static_cast<int>(TEMPERATURE_NOISE)))));
+#else
+        for (int lane = 0; lane < ParticleBatch::SIZE; lane++)
+        {
+            Particle particle(Vec2(batch.positionX[lane], batch.positionY[lane]), Vec2(batch.velocityX[lane], batch.velocityY[lane]), batch.mass[lane]);
+            particle.temperature = batch.temperature[lane];
+            Store(first + lane, particle, seed);
+        }
+#endif
+    }
+
+    // Distance between two neighbouring fixed point positions on each axis
+    Vec2 GetPositionResolution() const { return Vec2(static_cast<float>(m_FromFixedX), static_cast<float>(m_FromFixedY)); }
+};
+
+// Particle index of either storage, for code templated on it. Compact particles are decoded
+inline const Particle& LoadParticle(const ParticleVector& particles, int index) { return particles[index]; }
+inline Particle LoadParticle(const CompactParticles& particles, int index) { return particles.Load(index); }
@@ -0,0 +1,224 @@
+#include "ConservationMonitor.h"
+#include "Physics.h"
+#include "../core/AllocationGuard.h"
+#include "../core/Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Particles or pairs in one reduction block. The block layout only depends on the count,
+// which keeps the summation order, and so the sample, independent of the threads
+const int REDUCTION_BLOCK_SIZE = 4096;
+
+static int GetBlockCount(size_t count)
+{
+    return static_cast<int>((count + REDUCTION_BLOCK_SIZE - 1) / REDUCTION_BLOCK_SIZE);
+}
+
+// Run func over the blocks on the pool, or directly without one
+static void ForEachBlock(ThreadPool* threadPool, int blockCount, const ThreadPool::RangeFunction& func)
+{
+    if (threadPool)
+        threadPool->ParallelFor(blockCount, func, 1);
+    else
+        func(0, blockCount, 0);
+}
+
+ConservationMonitor::ConservationMonitor(const ConservationThresholds& thresholds)
+    : m_Thresholds(thresholds), m_History(HISTORY_STEPS)
+{
+}
+
+template<typename Particles>
+void ConservationMonitor::ReduceParticles(const SimulationSystem& sim, const Particles& particles, ThreadPool* threadPool,
+    LinearArena* arena, ConservationSample& sample)
+{
+    const Bounds& bounds = sim.GetBounds();
+    const Vec2& gravity = GetGravity();
+    const int count = static_cast<int>(particles.size());
+    const int blockCount = GetBlockCount(particles.size());
+
+    BlockList blocks = arena ? BlockList(ArenaAllocator<BlockSums, MemoryTag::FrameArena>(*arena)) : BlockList();
+    blocks.assign(blockCount, BlockSums());
+
+    ForEachBlock(threadPool, blockCount, [&](int beginBlock, int endBlock, int)
+    {
+        for (int block = beginBlock; block < endBlock; block++)
+        {
+            BlockSums sums = {};
+            const int end = std::min(count, (block + 1) * REDUCTION_BLOCK_SIZE);
+            for (int i = block * REDUCTION_BLOCK_SIZE; i < end; i++)
+            {
+                const Particle& particle = LoadParticle(particles, i);
+                const Vec2& p = particle.position;
+                const Vec2& v = particle.velocity;
+
+                if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(v.x) || !std::isfinite(v.y))
+                {
+                    // Kept out of the sums, one NaN would hide every other invariant
+                    sums.nonFinite++;
+                    continue;
+                }
+
+                if (p.x < bounds.bottomLeft.x || p.x > bounds.topRight.x || p.y < bounds.bottomLeft.y || p.y > bounds.topRight.y)
+                    sums.outOfBounds++;
+
+                // Potential energy of the gravity field, -m g.h with h measured from the bottom left corner
+                const double mass = particle.mass;
+                sums.mass += mass;
+                sums.kinetic += 0.5 * mass * (static_cast<double>(v.x) * v.x + static_cast<double>(v.y) * v.y);
+                sums.potential -= mass * (static_cast<double>(gravity.x) * (p.x - bounds.bottomLeft.x) +
+                    static_cast<double>(gravity.y) * (p.y - bounds.bottomLeft.y));
+                sums.momentumX += mass * v.x;
+                sums.momentumY += mass * v.y;
+                sums.momentumMagnitude += mass * v.length();
+            }
+            blocks[block] = sums;
+        }
+    });
+
+    for (const BlockSums& sums : blocks)
+    {
+        sample.totalMass += sums.mass;
+        sample.kineticEnergy += sums.kinetic;
+        sample.potentialEnergy += sums.potential;
+        sample.momentumX += sums.momentumX;
+        sample.momentumY += sums.momentumY;
+        sample.momentumMagnitudeSum += sums.momentumMagnitude;
+        sample.outOfBounds += sums.outOfBounds;
+        sample.nonFinite += sums.nonFinite;
+    }
+    sample.totalEnergy = sample.kineticEnergy + sample.potentialEnergy;
+}
+
+template<typename Particles>
+void ConservationMonitor::ReducePenetration(const SimulationSystem& sim, const Particles& particles, const CollisionPairList& collisionPairs,
+    ThreadPool* threadPool, LinearArena* arena, ConservationSample& sample)
+{
+    const float contactDistance = 2.0f * sim.GetParticleRadius();
+    const int count = static_cast<int>(collisionPairs.size());
+    const int blockCount = GetBlockCount(collisionPairs.size());
+    BlockList blocks = arena ? BlockList(ArenaAllocator<BlockSums, MemoryTag::FrameArena>(*arena)) : BlockList();
+    blocks.assign(blockCount, BlockSums());
+
+    ForEachBlock(threadPool, blockCount, [&](int beginBlock, int endBlock, int)
+    {
+        for (int block = beginBlock; block < endBlock; block++)
+        {
+            BlockSums sums = {};
+            const int end = std::min(count, (block + 1) * REDUCTION_BLOCK_SIZE);
+            for (int i = block * REDUCTION_BLOCK_SIZE; i < end; i++)
+            {
+                const Vec2 delta = GetParticlePosition(particles, collisionPairs[i].first) - GetParticlePosition(particles, collisionPairs[i].second);
+                const float depth = contactDistance - delta.length();
+                if (depth <= 0.0f) continue;
+
+                sums.penetratingPairs++;
+                sums.penetrationSum += depth;
+                sums.maxPenetration = std::max(sums.maxPenetration, depth);
+            }
+            blocks[block] = sums;
+        }
+    });
+
+    double penetrationSum = 0.0;
+    for (const BlockSums& sums : blocks)
+    {
+        sample.penetratingPairs += sums.penetratingPairs;
+        sample.maxPenetration = std::max(sample.maxPenetration, sums.maxPenetration);
+        penetrationSum += sums.penetrationSum;
+    }
+    sample.meanPenetration = sample.penetratingPairs > 0 ? static_cast<float>(penetrationSum / sample.penetratingPairs) : 0.0f;
+}
+
+uint32_t ConservationMonitor::EvaluateAlerts(const ConservationSample& sample, float particleRadius, float deltaTime) const
+{
+    uint32_t alerts = ALERT_NONE;
+
+    if (m_Thresholds.alertOnNonFinite && sample.nonFinite > 0)
+        alerts |= ALERT_NON_FINITE;
+
+    if (m_Thresholds.maxOutOfBounds >= 0 && sample.outOfBounds > m_Thresholds.maxOutOfBounds)
+        alerts |= ALERT_OUT_OF_BOUNDS;
+
+    // NaN was caught above, a NaN depth would fail every comparison
+    if (m_Thresholds.maxPenetration > 0.0f && sample.maxPenetration > m_Thresholds.maxPenetration * particleRadius)
+        alerts |= ALERT_PENETRATION;
+
+    // Drift checks compare consecutive steps with the same particles, spawned particles change the sums
+    const bool comparable = !m_History.Empty() && m_Last.step + 1 == sample.step && m_Last.particles == sample.particles;
+    if (!comparable)
+        return alerts;
+
+    if (m_Thresholds.maxEnergyGain > 0.0f && m_Last.totalEnergy > 0.0 &&
+        (sample.totalEnergy - m_Last.totalEnergy) > m_Thresholds.maxEnergyGain * m_Last.totalEnergy)
+        alerts |= ALERT_ENERGY_GAIN;
+
+    if (m_Thresholds.maxMomentumDrift > 0.0f && sample.momentumMagnitudeSum > 0.0)
+    {
+        // Gravity adds M g dt every step, anything else came from the solver or the walls
+        const Vec2& gravity = GetGravity();
+        const double driftX = sample.momentumX - m_Last.momentumX - sample.totalMass * gravity.x * deltaTime;
+        const double driftY = sample.momentumY - m_Last.momentumY - sample.totalMass * gravity.y * deltaTime;
+        if (std::sqrt(driftX * driftX + driftY * driftY) > m_Thresholds.maxMomentumDrift * sample.momentumMagnitudeSum)
+            alerts |= ALERT_MOMENTUM_DRIFT;
+    }
+    return alerts;
+}
+
+const ConservationSample& ConservationMonitor::Check(const SimulationSystem& sim, const CollisionPairList* collisionPairs,
+    float deltaTime, uint64_t step, ThreadPool* threadPool, FrameArena* arena)
+{
+    PROFILE_SCOPE("ConservationMonitor");
+
+    ConservationSample sample;
+    sample.step = step;
+    sample.particles = static_cast<int>(sim.GetParticleCount());
+
+    LinearArena* scratch = arena ? &arena->GetThreadArena(0) : nullptr;
+    if (sim.GetParticleStorage() == ParticleStorage::Compact)
+    {
+        ReduceParticles(sim, sim.GetCompactParticles(), threadPool, scratch, sample);
+        if (collisionPairs)
+            ReducePenetration(sim, sim.GetCompactParticles(), *collisionPairs, threadPool, scratch, sample);
+    }
+    else
+    {
+        ReduceParticles(sim, sim.GetParticles(), threadPool, scratch, sample);
+        if (collisionPairs)
+            ReducePenetration(sim, sim.GetParticles(), *collisionPairs, threadPool, scratch, sample);
+    }
+
+    sample.alerts = EvaluateAlerts(sample, sim.GetParticleRadius(), deltaTime);
+    if (sample.alerts != ALERT_NONE)
+        m_AlertCount++;
+
+    // Only the alerts that weren't raised by the previous step
+    const uint32_t previous = m_History.Empty() ? ALERT_NONE : m_Last.alerts;
+    const uint32_t started = sample.alerts & ~previous;
+    m_Last = sample;
+    m_History.Push(sample);
+
+    // Alerts are rare and their callback usually logs, so it may allocate inside the step
+    if (started != ALERT_NONE && m_OnAlert)
+    {
+        COLD_REGION();
+        m_OnAlert(m_Last, started);
+    }
+    return m_Last;
+}
+
+std::string ConservationMonitor::DescribeAlerts(uint32_t alerts)
+{
+    static const char* NAMES[] = { "energy gain", "momentum drift", "penetration", "out of bounds", "non finite" };
+
+    std::string description;
+    for (int bit = 0; bit < 5; bit++)
+    {
+        if (!(alerts & (1u << bit))) continue;
+        if (!description.empty())
+            description += ", ";
+        description += NAMES[bit];
+    }
+    return description.empty() ? "none" : description;
+}
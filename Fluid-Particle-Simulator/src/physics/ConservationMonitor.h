@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../core/RingBuffer.h"
+#include "SpatialGrid.h"
+
+class SimulationSystem;
+class ThreadPool;
+
+// Alert bits of a ConservationSample
+enum ConservationAlert : uint32_t {
+    ALERT_NONE = 0,
+    ALERT_ENERGY_GAIN = 1 << 0,
+    ALERT_MOMENTUM_DRIFT = 1 << 1,
+    ALERT_PENETRATION = 1 << 2,
+    ALERT_OUT_OF_BOUNDS = 1 << 3,
+    ALERT_NON_FINITE = 1 << 4
+};
+
+// Alert limits, a limit of 0 turns its check off unless its field says otherwise
+struct ConservationThresholds {
+    // Total energy rise in one step, relative to the energy before it. Contacts and
+    // walls are elastic, so energy only grows when the solver injects it
+    float maxEnergyGain = 0.01f;
+
+    // Momentum change gravity doesn't explain, relative to the sum of |m v|. Walls
+    // reverse momentum every bounce, so this is only meaningful in open or periodic setups
+    float maxMomentumDrift = 0.0f;
+
+    // Deepest interpenetration left after the solve, in particle radii
+    float maxPenetration = 0.5f;
+
+    // Particle centres allowed outside Bounds. 0 alerts on any of them, -1 turns the check off
+    int maxOutOfBounds = 0;
+
+    // Any NaN or infinite position or velocity
+    bool alertOnNonFinite = true;
+};
+
+// Invariants of the particles at the end of one step
+struct ConservationSample {
+    uint64_t step = 0;
+    int particles = 0;
+    double totalMass = 0.0;
+
+    // Energies are double sums, potential is measured from the bottom of Bounds
+    double kineticEnergy = 0.0;
+    double potentialEnergy = 0.0;
+    double totalEnergy = 0.0;
+    double momentumX = 0.0;
+    double momentumY = 0.0;
+    double momentumMagnitudeSum = 0.0;  // Sum of |m v|, the scale of the momentum drift
+
+    // Over the pairs the broadphase found, all zero without the grid
+    int penetratingPairs = 0;
+    float maxPenetration = 0.0f;        // Simulation units
+    float meanPenetration = 0.0f;
+
+    int outOfBounds = 0;
+    int nonFinite = 0;                  // Particles with a NaN or infinite component
+
+    uint32_t alerts = ALERT_NONE;       // ConservationAlert bits raised this step
+};
+
+// Energy, momentum, interpenetration, escaped and NaN particle checks run at the end of
+// every step, to catch fast solver settings that silently change the physics.
+// Attach it with SimulationSystem::SetConservationMonitor, UpdatePhysics then calls Check.
+// The sums are reduced over fixed blocks of particles and added in block order, so a
+// sample is the same whatever the thread count
+class ConservationMonitor {
+public:
+    // Called when an alert starts, not on every step it lasts. alerts holds the new bits
+    using AlertCallback = std::function<void(const ConservationSample& sample, uint32_t alerts)>;
+
+    static const size_t HISTORY_STEPS = 3600;
+
+private:
+    // Partial sums of one block of particles or pairs
+    struct BlockSums {
+        double mass;
+        double kinetic;
+        double potential;
+        double momentumX;
+        double momentumY;
+        double momentumMagnitude;
+        double penetrationSum;
+        float maxPenetration;
+        int penetratingPairs;
+        int outOfBounds;
+        int nonFinite;
+    };
+
+    ConservationThresholds m_Thresholds;
+    AlertCallback m_OnAlert;
+    ConservationSample m_Last;
+    RingBuffer<ConservationSample> m_History;
+    uint64_t m_AlertCount = 0;      // Steps that raised at least one alert
+
+    // Per block sums, in the arena of the calling thread or on the heap without one
+    typedef ArenaVector<BlockSums, MemoryTag::FrameArena> BlockList;
+
+    // Particles is the storage the simulation uses, a ParticleVector or CompactParticles
+    template<typename Particles>
+    void ReduceParticles(const SimulationSystem& sim, const Particles& particles, ThreadPool* threadPool,
+        LinearArena* arena, ConservationSample& sample);
+    template<typename Particles>
+    void ReducePenetration(const SimulationSystem& sim, const Particles& particles, const CollisionPairList& collisionPairs,
+        ThreadPool* threadPool, LinearArena* arena, ConservationSample& sample);
+    uint32_t EvaluateAlerts(const ConservationSample& sample, float particleRadius, float deltaTime) const;
+
+public:
+    explicit ConservationMonitor(const ConservationThresholds& thresholds = ConservationThresholds());
+
+    void SetThresholds(const ConservationThresholds& thresholds) { m_Thresholds = thresholds; }
+    const ConservationThresholds& GetThresholds() const { return m_Thresholds; }
+
+    void SetAlertCallback(const AlertCallback& callback) { m_OnAlert = callback; }
+
+    // Measure the particles after a step. collisionPairs are the pairs the step solved,
+    // nullptr skips the penetration checks (the brute force path has no pair list).
+    // The reduction scratch comes from arena when given, the step arena inside UpdatePhysics
+    const ConservationSample& Check(const SimulationSystem& sim, const CollisionPairList* collisionPairs,
+        float deltaTime, uint64_t step, ThreadPool* threadPool = nullptr, FrameArena* arena = nullptr);
+
+    // Sample of the last checked step
+    const ConservationSample& GetLastSample() const { return m_Last; }
+
+    // The last checked steps, oldest first
+    const RingBuffer<ConservationSample>& GetHistory() const { return m_History; }
+
+    uint64_t GetAlertCount() const { return m_AlertCount; }
+
+    // "energy gain, penetration" for the bits set in alerts
+    static std::string DescribeAlerts(uint32_t alerts);
+};
@@ -0,0 +1,1036 @@
+#include "FluidSurface.h"
+#include "../core/Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+// Density samples per spatial grid cell along each axis
+const int SAMPLES_PER_CELL = 2;
+
+// Kernel radius as a fraction of the spatial grid cell. At most half a cell so a sample
+// only needs the 2x2 cells around it
+const float SUPPORT_CELL_FRACTION = 0.45f;
+
+// Above this fraction of changed spatial grid cells an update scans the whole grid
+// and rebuilds every strip instead of following lists of changes
+const float SPARSE_CHANGE_FRACTION = 0.02f;
+
+// Bands of square rows per thread when every strip is rebuilt, more than one so a band
+// with long strips doesn't hold the other threads back
+const int STRIP_BANDS_PER_THREAD = 4;
+
+// Marks in m_SegmentStrip while the bands walk their pieces: a visited segment, and
+// PIECE_END - piece at the ends of a piece that continues into another band
+const int VISITED_SEGMENT = -2;
+const int PIECE_END = -3;
+
+// Square corners in order: bottom-left, bottom-right, top-right, top-left.
+// Edges: 0 bottom, 1 right, 2 top, 3 left. Each case lists up to two segments
+// as pairs of edges, -1 ends the list. Saddles (5, 10) are resolved separately
+const int CASE_EDGES[16][4] = {
+    { -1, -1, -1, -1 },
+    {  3,  0, -1, -1 },
+    {  0,  1, -1, -1 },
+    {  3,  1, -1, -1 },
+    {  1,  2, -1, -1 },
+    { -1, -1, -1, -1 },   // Saddle
+    {  0,  2, -1, -1 },
+    {  3,  2, -1, -1 },
+    {  2,  3, -1, -1 },
+    {  0,  2, -1, -1 },
+    { -1, -1, -1, -1 },   // Saddle
+    {  1,  2, -1, -1 },
+    {  1,  3, -1, -1 },
+    {  0,  1, -1, -1 },
+    {  3,  0, -1, -1 },
+    { -1, -1, -1, -1 }
+};
+
+// Saddle segments when the center of the square is inside [0] or outside [1] the fluid
+const int SADDLE_5_EDGES[2][4] = { { 0, 1, 2, 3 }, { 3, 0, 1, 2 } };
+const int SADDLE_10_EDGES[2][4] = { { 3, 0, 1, 2 }, { 0, 1, 2, 3 } };
+
+static inline uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+FluidSurface::FluidSurface(const SimulationSystem& simulation, ThreadPool& threadPool, float isoLevel)
+    : m_Simulation(simulation), m_ThreadPool(threadPool), m_IsoLevel(isoLevel),
+    m_Grid(nullptr), m_Spacing(1.0f), m_SupportRadius(1.0f), m_NodesX(0), m_NodesY(0),
+    m_GridWidth(0), m_GridHeight(0), m_FullUpdate(true), m_UpdatedNodes(0), m_LivePoints(0)
+{
+}
+
+void FluidSurface::Resize(const SpatialGrid& grid)
+{
+    const Bounds& bounds = m_Simulation.GetBounds();
+
+    m_Grid = &grid;
+    m_Origin = bounds.bottomLeft;
+    m_Spacing = grid.GetCellSize() / SAMPLES_PER_CELL;
+    m_SupportRadius = grid.GetCellSize() * SUPPORT_CELL_FRACTION;
+    m_NodesX = static_cast<int>(std::ceil((bounds.topRight.x - bounds.bottomLeft.x) / m_Spacing)) + 1;
+    m_NodesY = static_cast<int>(std::ceil((bounds.topRight.y - bounds.bottomLeft.y) / m_Spacing)) + 1;
+
+    // A sample reads the cells within half a cell of it, that is two columns and two rows
+    const float cellSize = grid.GetCellSize();
+    const Vec2& gridMin = grid.GetMinBound();
+    m_NodeCellsX.resize(m_NodesX);
+    for (int nodeX = 0; nodeX < m_NodesX; nodeX++) {
+        const float x = m_Origin.x + nodeX * m_Spacing - cellSize * 0.5f;
+        m_NodeCellsX[nodeX] = std::min(std::max(static_cast<int>(std::floor((x - gridMin.x) / cellSize)), 0), grid.GetGridWidth() - 1);
+    }
+    m_NodeCellsY.resize(m_NodesY);
+    for (int nodeY = 0; nodeY < m_NodesY; nodeY++) {
+        const float y = m_Origin.y + nodeY * m_Spacing - cellSize * 0.5f;
+        m_NodeCellsY[nodeY] = std::min(std::max(static_cast<int>(std::floor((y - gridMin.y) / cellSize)), 0), grid.GetGridHeight() - 1);
+    }
+
+    // Inverse of the above, the samples reading a column are those whose first column is the one before or the column itself
+    m_CellNodesX.resize(grid.GetGridWidth() + 1);
+    for (int cellX = 0; cellX <= grid.GetGridWidth(); cellX++) {
+        m_CellNodesX[cellX] = static_cast<int>(std::lower_bound(m_NodeCellsX.begin(), m_NodeCellsX.end(), cellX) - m_NodeCellsX.begin());
+    }
+    m_CellNodesY.resize(grid.GetGridHeight() + 1);
+    for (int cellY = 0; cellY <= grid.GetGridHeight(); cellY++) {
+        m_CellNodesY[cellY] = static_cast<int>(std::lower_bound(m_NodeCellsY.begin(), m_NodeCellsY.end(), cellY) - m_NodeCellsY.begin());
+    }
+
+    const size_t nodeCount = static_cast<size_t>(m_NodesX) * m_NodesY;
+    m_Density.assign(nodeCount, 0.0f);
+    m_NodeChanged.assign(nodeCount, 0);
+
+    const size_t squareCount = static_cast<size_t>(m_NodesX - 1) * (m_NodesY - 1);
+    m_SquareSegmentCount.assign(squareCount, 0);
+    m_SquareSegments.resize(squareCount * 2);
+    m_SquareChanged.assign(squareCount, 0);
+    m_EdgeSegments.assign(nodeCount * 2 * 2, -1);
+    m_SegmentStrip.assign(squareCount * 2, -1);
+
+    m_GridWidth = grid.GetGridWidth();
+    m_GridHeight = grid.GetGridHeight();
+    const size_t cellCount = static_cast<size_t>(m_GridWidth) * m_GridHeight;
+    m_CellStart.assign(cellCount + 1, 0);
+    m_CellChanged.assign(cellCount, 0);
+    m_ChangedCells.clear();
+
+    // No stored positions, every particle is new to the next update
+    m_ParticleCell.clear();
+    m_FullUpdate = true;
+}
+
+void FluidSurface::Update()
+{
+    PROFILE_SCOPE("FluidSurface::Update");
+
+    const SpatialGrid* grid = m_Simulation.GetSpatialGrid();
+    if (!grid) return;
+
+    if (grid != m_Grid) {
+        Resize(*grid);
+    }
+
+    const bool moved = m_Simulation.GetParticleStorage() == ParticleStorage::Compact ?
+        UpdateCells(m_Simulation.GetCompactParticles()) : UpdateCells(m_Simulation.GetParticles());
+
+    // Without a moved particle the samples, squares and strips from the last update still hold
+    if (!moved && !m_FullUpdate) {
+        m_UpdatedNodes = 0;
+        return;
+    }
+
+    const size_t cellCount = static_cast<size_t>(m_GridWidth) * m_GridHeight;
+    if (m_FullUpdate || m_ChangedCells.size() > cellCount * SPARSE_CHANGE_FRACTION)
+    {
+        UpdateDensity();
+        UpdateSquares();
+        BuildStrips();
+    }
+    else
+    {
+        UpdateChangedNodes();
+        UpdateChangedSquares();
+        RelinkStrips();
+    }
+
+    for (const int cell : m_ChangedCells) {
+        m_CellChanged[cell] = 0;
+    }
+    m_ChangedCells.clear();
+    m_FullUpdate = false;
+}
+
+template<typename Particles>
+bool FluidSurface::UpdateCells(const Particles& particles)
+{
+    const int particleCount = static_cast<int>(particles.size());
+    const int previousCount = static_cast<int>(m_ParticleCell.size());
+    const size_t cellCount = static_cast<size_t>(m_GridWidth) * m_GridHeight;
+    const float invCellSize = 1.0f / m_Grid->GetCellSize();
+    const Vec2& gridMin = m_Grid->GetMinBound();
+
+    // One chunk of particles per thread
+    const int chunkCount = m_ThreadPool.GetThreadCount();
+    const int chunkSize = (particleCount + chunkCount - 1) / chunkCount;
+    std::vector<uint8_t> chunkResort(chunkCount, 0);
+    m_ChunkChangedCells.resize(chunkCount);
+    m_ChunkCellMoves.resize(chunkCount);
+
+    // Each changed cell is listed once
+    auto markCell = [&](int cell)
+    {
+        if (!m_CellChanged[cell]) {
+            m_CellChanged[cell] = 1;
+            m_ChangedCells.push_back(cell);
+        }
+    };
+
+    // Removed particles leave their cells
+    for (int i = particleCount; i < previousCount; i++) {
+        markCell(m_ParticleCell[i]);
+    }
+    m_ParticleCell.resize(particleCount);
+
+    // Compare each particle with its stored position. A move inside the cell is written
+    // in place, a particle that changed cell or is new makes the cells be sorted again
+    m_ThreadPool.ParallelFor(chunkCount, [&](int chunkBegin, int chunkEnd, int)
+    {
+        for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+        {
+            auto& changedCells = m_ChunkChangedCells[chunk];
+            auto& cellMoves = m_ChunkCellMoves[chunk];
+            changedCells.clear();
+            cellMoves.clear();
+            const int end = std::min(particleCount, (chunk + 1) * chunkSize);
+            for (int i = chunk * chunkSize; i < end; i++)
+            {
+                // Same cell mapping as SpatialGrid, clamped to the grid
+                const Vec2& position = GetParticlePosition(particles, i);
+                int x = static_cast<int>((position.x - gridMin.x) * invCellSize);
+                int y = static_cast<int>((position.y - gridMin.y) * invCellSize);
+                x = std::min(std::max(x, 0), m_GridWidth - 1);
+                y = std::min(std::max(y, 0), m_GridHeight - 1);
+                const int cell = x + y * m_GridWidth;
+
+                if (i >= previousCount)
+                {
+                    m_ParticleCell[i] = cell;
+                    changedCells.push_back(cell);
+                    chunkResort[chunk] = 1;
+                    continue;
+                }
+
+                const int slot = m_ParticleSlot[i];
+                const Vec2& stored = m_CellPositions[slot];
+                if (FloatBits(position.x) == FloatBits(stored.x) && FloatBits(position.y) == FloatBits(stored.y))
+                    continue;
+
+                changedCells.push_back(cell);
+                if (cell != m_ParticleCell[i]) {
+                    changedCells.push_back(m_ParticleCell[i]);
+                    cellMoves.push_back({ i, m_ParticleCell[i] });
+                    m_ParticleCell[i] = cell;
+                    chunkResort[chunk] = 1;
+                }
+                else {
+                    m_CellPositions[slot] = position;
+                }
+            }
+        }
+    });
+
+    bool resort = particleCount != previousCount;
+    for (int chunk = 0; chunk < chunkCount; chunk++)
+    {
+        resort = resort || chunkResort[chunk] != 0;
+        for (const int cell : m_ChunkChangedCells[chunk]) {
+            markCell(cell);
+        }
+    }
+    if (!resort && m_ChangedCells.empty())
+        return false;
+
+    // A few particles that moved to nearby cells are shifted into place, cheaper than sorting
+    // every particle as long as the slots and cell starts in between add up to less than the cells
+    if (resort && particleCount == previousCount)
+    {
+        size_t distance = 0;
+        for (const auto& cellMoves : m_ChunkCellMoves) {
+            for (const CellMove& move : cellMoves)
+                distance += std::abs(m_ParticleCell[move.particle] - move.fromCell);
+        }
+
+        if (distance <= cellCount)
+        {
+            for (const auto& cellMoves : m_ChunkCellMoves) {
+                for (const CellMove& move : cellMoves)
+                    MoveToCell(move.particle, move.fromCell, GetParticlePosition(particles, move.particle));
+            }
+            resort = false;
+        }
+    }
+
+    if (resort)
+    {
+        // Each chunk counts its particles per cell
+        m_ChunkCellCounts.assign(cellCount * chunkCount, 0);
+        m_ThreadPool.ParallelFor(chunkCount, [&](int chunkBegin, int chunkEnd, int)
+        {
+            for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+            {
+                int* counts = &m_ChunkCellCounts[cellCount * chunk];
+                const int end = std::min(particleCount, (chunk + 1) * chunkSize);
+                for (int i = chunk * chunkSize; i < end; i++)
+                    counts[m_ParticleCell[i]]++;
+            }
+        });
+
+        // Cell major then chunk, so particles keep their index order inside a cell
+        int offset = 0;
+        for (size_t cell = 0; cell < cellCount; cell++)
+        {
+            m_CellStart[cell] = offset;
+            for (int chunk = 0; chunk < chunkCount; chunk++)
+            {
+                int& count = m_ChunkCellCounts[cellCount * chunk + cell];
+                const int chunkParticles = count;
+                count = offset;
+                offset += chunkParticles;
+            }
+        }
+        m_CellStart[cellCount] = offset;
+        m_CellPositions.resize(offset);
+        m_SlotParticle.resize(offset);
+        m_ParticleSlot.resize(particleCount);
+
+        m_ThreadPool.ParallelFor(chunkCount, [&](int chunkBegin, int chunkEnd, int)
+        {
+            for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+            {
+                int* cursors = &m_ChunkCellCounts[cellCount * chunk];
+                const int end = std::min(particleCount, (chunk + 1) * chunkSize);
+                for (int i = chunk * chunkSize; i < end; i++)
+                {
+                    const int slot = cursors[m_ParticleCell[i]]++;
+                    m_CellPositions[slot] = GetParticlePosition(particles, i);
+                    m_ParticleSlot[i] = slot;
+                    m_SlotParticle[slot] = i;
+                }
+            }
+        });
+    }
+    return true;
+}
+
+void FluidSurface::MoveToCell(int particle, int fromCell, const Vec2& position)
+{
+    const int toCell = m_ParticleCell[particle];
+    const int from = m_ParticleSlot[particle];
+
+    // Particles of a cell stay in index order, like after a sort
+    int to = m_CellStart[toCell];
+    while (to < m_CellStart[toCell + 1] && m_SlotParticle[to] < particle)
+        to++;
+
+    if (toCell > fromCell)
+    {
+        // Its old slot is before the new one and frees up
+        to--;
+        for (int slot = from; slot < to; slot++)
+        {
+            m_CellPositions[slot] = m_CellPositions[slot + 1];
+            m_SlotParticle[slot] = m_SlotParticle[slot + 1];
+            m_ParticleSlot[m_SlotParticle[slot]] = slot;
+        }
+        for (int cell = fromCell + 1; cell <= toCell; cell++)
+            m_CellStart[cell]--;
+    }
+    else
+    {
+        for (int slot = from; slot > to; slot--)
+        {
+            m_CellPositions[slot] = m_CellPositions[slot - 1];
+            m_SlotParticle[slot] = m_SlotParticle[slot - 1];
+            m_ParticleSlot[m_SlotParticle[slot]] = slot;
+        }
+        for (int cell = toCell + 1; cell <= fromCell; cell++)
+            m_CellStart[cell]++;
+    }
+
+    m_CellPositions[to] = position;
+    m_SlotParticle[to] = particle;
+    m_ParticleSlot[particle] = to;
+}
+
+float FluidSurface::SampleDensity(int nodeX, int nodeY) const
+{
+    const int gridWidth = m_GridWidth;
+    const float sampleX = m_Origin.x + nodeX * m_Spacing;
+    const float sampleY = m_Origin.y + nodeY * m_Spacing;
+    const float invSupportSq = 1.0f / (m_SupportRadius * m_SupportRadius);
+
+    const int firstX = m_NodeCellsX[nodeX];
+    const int lastX = std::min(firstX + 1, gridWidth - 1);
+    const int firstY = m_NodeCellsY[nodeY];
+    const int lastY = std::min(firstY + 1, m_GridHeight - 1);
+
+    // Poly6 style kernel (1 - r^2 / h^2)^3, 1 at the particle center.
+    // The two cells of a row are contiguous in m_CellPositions
+    float density = 0.0f;
+    for (int y = firstY; y <= lastY; y++)
+    {
+        const size_t rowStart = static_cast<size_t>(y) * gridWidth;
+        const int begin = m_CellStart[rowStart + firstX];
+        const int end = m_CellStart[rowStart + lastX + 1];
+        for (int i = begin; i < end; i++)
+        {
+            const float dx = m_CellPositions[i].x - sampleX;
+            const float dy = m_CellPositions[i].y - sampleY;
+            // Branchless so the loop vectorizes, particles outside the support add 0
+            const float t = std::max(1.0f - (dx * dx + dy * dy) * invSupportSq, 0.0f);
+            density += t * t * t;
+        }
+    }
+    return density;
+}
+
+void FluidSurface::UpdateDensity()
+{
+    const int gridWidth = m_GridWidth;
+    const int gridHeight = m_GridHeight;
+    std::vector<int> threadUpdates(m_ThreadPool.GetThreadCount(), 0);
+
+    m_ThreadPool.ParallelFor(m_NodesY, [&](int begin, int end, int threadIndex)
+    {
+        for (int nodeY = begin; nodeY < end; nodeY++)
+        {
+            const int firstY = m_NodeCellsY[nodeY];
+            const int lastY = std::min(firstY + 1, gridHeight - 1);
+
+            for (int nodeX = 0; nodeX < m_NodesX; nodeX++)
+            {
+                const size_t node = nodeX + static_cast<size_t>(nodeY) * m_NodesX;
+
+                // A sample changes only if one of the cells it reads changed
+                bool changed = m_FullUpdate;
+                if (!changed)
+                {
+                    const int firstX = m_NodeCellsX[nodeX];
+                    const int lastX = std::min(firstX + 1, gridWidth - 1);
+                    for (int y = firstY; y <= lastY && !changed; y++)
+                        for (int x = firstX; x <= lastX && !changed; x++)
+                            changed = m_CellChanged[x + static_cast<size_t>(y) * gridWidth] != 0;
+                }
+
+                m_NodeChanged[node] = changed;
+                if (changed) {
+                    m_Density[node] = SampleDensity(nodeX, nodeY);
+                    threadUpdates[threadIndex]++;
+                }
+            }
+        }
+    });
+
+    m_UpdatedNodes = 0;
+    for (const int count : threadUpdates) {
+        m_UpdatedNodes += count;
+    }
+}
+
+int FluidSurface::TraceSquare(int squareX, int squareY, Segment* segments) const
+{
+    const size_t bottomLeft = squareX + static_cast<size_t>(squareY) * m_NodesX;
+    const size_t topLeft = bottomLeft + m_NodesX;
+    const float values[4] = { m_Density[bottomLeft], m_Density[bottomLeft + 1], m_Density[topLeft + 1], m_Density[topLeft] };
+
+    int caseIndex = 0;
+    for (int corner = 0; corner < 4; corner++) {
+        if (values[corner] > m_IsoLevel)
+            caseIndex |= 1 << corner;
+    }
+    if (caseIndex == 0 || caseIndex == 15)
+        return 0;
+
+    const int* edges = CASE_EDGES[caseIndex];
+    if (caseIndex == 5 || caseIndex == 10)
+    {
+        const bool centerInside = (values[0] + values[1] + values[2] + values[3]) * 0.25f > m_IsoLevel;
+        edges = (caseIndex == 5) ? SADDLE_5_EDGES[centerInside ? 0 : 1] : SADDLE_10_EDGES[centerInside ? 0 : 1];
+    }
+
+    // Corners at the ends of each edge and the edge's global id. Horizontal edges
+    // are numbered 2 * node of their left end, vertical ones 2 * node of their bottom end + 1
+    const int edgeCorners[4][2] = { { 0, 1 }, { 1, 2 }, { 3, 2 }, { 0, 3 } };
+    const int edgeIds[4] = {
+        static_cast<int>(bottomLeft * 2),
+        static_cast<int>((bottomLeft + 1) * 2 + 1),
+        static_cast<int>(topLeft * 2),
+        static_cast<int>(bottomLeft * 2 + 1)
+    };
+    const float x0 = m_Origin.x + squareX * m_Spacing;
+    const float y0 = m_Origin.y + squareY * m_Spacing;
+    const Vec2 corners[4] = {
+        Vec2(x0, y0), Vec2(x0 + m_Spacing, y0), Vec2(x0 + m_Spacing, y0 + m_Spacing), Vec2(x0, y0 + m_Spacing)
+    };
+
+    int count = 0;
+    for (int i = 0; i < 4 && edges[i] >= 0; i += 2)
+    {
+        Segment& segment = segments[count++];
+        for (int end = 0; end < 2; end++)
+        {
+            const int edge = edges[i + end];
+            const int a = edgeCorners[edge][0];
+            const int b = edgeCorners[edge][1];
+            const float t = (m_IsoLevel - values[a]) / (values[b] - values[a]);
+            const Vec2 point = corners[a] + (corners[b] - corners[a]) * t;
+
+            if (end == 0) {
+                segment.start = point;
+                segment.startEdge = edgeIds[edge];
+            }
+            else {
+                segment.end = point;
+                segment.endEdge = edgeIds[edge];
+            }
+        }
+    }
+    return count;
+}
+
+void FluidSurface::UpdateSquares()
+{
+    const int squaresX = m_NodesX - 1;
+
+    m_ThreadPool.ParallelFor(m_NodesY - 1, [&](int begin, int end, int)
+    {
+        for (int squareY = begin; squareY < end; squareY++)
+        {
+            for (int squareX = 0; squareX < squaresX; squareX++)
+            {
+                const size_t bottomLeft = squareX + static_cast<size_t>(squareY) * m_NodesX;
+                const size_t topLeft = bottomLeft + m_NodesX;
+                if (!m_NodeChanged[bottomLeft] && !m_NodeChanged[bottomLeft + 1] &&
+                    !m_NodeChanged[topLeft] && !m_NodeChanged[topLeft + 1])
+                    continue;
+
+                const size_t square = squareX + static_cast<size_t>(squareY) * squaresX;
+                m_SquareSegmentCount[square] = static_cast<uint8_t>(TraceSquare(squareX, squareY, &m_SquareSegments[square * 2]));
+                LinkSquare(static_cast<int>(square));
+            }
+        }
+    });
+
+    std::fill(m_NodeChanged.begin(), m_NodeChanged.end(), 0);
+}
+
+void FluidSurface::UpdateChangedNodes()
+{
+    // Samples reading a changed cell
+    m_ChangedNodes.clear();
+    for (const int cell : m_ChangedCells)
+    {
+        const int cellX = cell % m_GridWidth;
+        const int cellY = cell / m_GridWidth;
+        const int beginX = m_CellNodesX[std::max(cellX - 1, 0)];
+        const int endX = m_CellNodesX[cellX + 1];
+        const int beginY = m_CellNodesY[std::max(cellY - 1, 0)];
+        const int endY = m_CellNodesY[cellY + 1];
+
+        for (int nodeY = beginY; nodeY < endY; nodeY++)
+        {
+            for (int nodeX = beginX; nodeX < endX; nodeX++)
+            {
+                const int node = nodeX + nodeY * m_NodesX;
+                if (!m_NodeChanged[node]) {
+                    m_NodeChanged[node] = 1;
+                    m_ChangedNodes.push_back(node);
+                }
+            }
+        }
+    }
+
+    m_ThreadPool.ParallelFor(static_cast<int>(m_ChangedNodes.size()), [&](int begin, int end, int)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            const int node = m_ChangedNodes[i];
+            m_Density[node] = SampleDensity(node % m_NodesX, node / m_NodesX);
+        }
+    });
+
+    m_UpdatedNodes = static_cast<int>(m_ChangedNodes.size());
+}
+
+void FluidSurface::UpdateChangedSquares()
+{
+    const int squaresX = m_NodesX - 1;
+    const int squaresY = m_NodesY - 1;
+
+    // Squares with a changed corner
+    m_ChangedSquares.clear();
+    for (const int node : m_ChangedNodes)
+    {
+        const int nodeX = node % m_NodesX;
+        const int nodeY = node / m_NodesX;
+        for (int squareY = std::max(nodeY - 1, 0); squareY <= std::min(nodeY, squaresY - 1); squareY++)
+        {
+            for (int squareX = std::max(nodeX - 1, 0); squareX <= std::min(nodeX, squaresX - 1); squareX++)
+            {
+                const int square = squareX + squareY * squaresX;
+                if (!m_SquareChanged[square]) {
+                    m_SquareChanged[square] = 1;
+                    m_ChangedSquares.push_back(square);
+                }
+            }
+        }
+        m_NodeChanged[node] = 0;
+    }
+
+    // The strips through their old segments are removed
+    for (const int square : m_ChangedSquares)
+    {
+        for (int segment = square * 2; segment < square * 2 + m_SquareSegmentCount[square]; segment++) {
+            if (m_SegmentStrip[segment] >= 0)
+                RemoveStrip(m_SegmentStrip[segment]);
+        }
+    }
+
+    m_ThreadPool.ParallelFor(static_cast<int>(m_ChangedSquares.size()), [&](int begin, int end, int)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            const int square = m_ChangedSquares[i];
+            m_SquareSegmentCount[square] = static_cast<uint8_t>(TraceSquare(square % squaresX, square / squaresX, &m_SquareSegments[static_cast<size_t>(square) * 2]));
+            LinkSquare(square);
+        }
+    });
+}
+
+void FluidSurface::LinkSquare(int square)
+{
+    // Each edge has a slot for the square on either side, so squares can be linked in parallel.
+    // Slot 1 of the bottom and left edges and slot 0 of the right and top edges are this square's
+    const int squaresX = m_NodesX - 1;
+    const size_t bottomLeft = square % squaresX + static_cast<size_t>(square / squaresX) * m_NodesX;
+    m_EdgeSegments[bottomLeft * 2 * 2 + 1] = -1;
+    m_EdgeSegments[(bottomLeft * 2 + 1) * 2 + 1] = -1;
+    m_EdgeSegments[((bottomLeft + 1) * 2 + 1) * 2] = -1;
+    m_EdgeSegments[(bottomLeft + m_NodesX) * 2 * 2] = -1;
+
+    for (int segment = square * 2; segment < square * 2 + m_SquareSegmentCount[square]; segment++)
+    {
+        const int edges[2] = { GetSegment(segment).startEdge, GetSegment(segment).endEdge };
+        for (const int edge : edges) {
+            const size_t slot = static_cast<size_t>(edge) / 2 == bottomLeft ? 1 : 0;
+            m_EdgeSegments[static_cast<size_t>(edge) * 2 + slot] = segment;
+        }
+    }
+}
+
+int FluidSurface::NextSegment(int edge, int current) const
+{
+    const int* slots = &m_EdgeSegments[static_cast<size_t>(edge) * 2];
+    return slots[0] == current ? slots[1] : slots[0];
+}
+
+int FluidSurface::FindStripStart(int segment) const
+{
+    // Forward to the end or around the loop, then backward from the start
+    int lowest = segment;
+    for (int direction = 0; direction < 2; direction++)
+    {
+        int current = segment;
+        int edge = direction == 0 ? GetSegment(segment).endEdge : GetSegment(segment).startEdge;
+        while (true)
+        {
+            const int next = NextSegment(edge, current);
+            if (next < 0) break;
+            if (next == segment) return lowest;
+
+            lowest = std::min(lowest, next);
+            const Segment& nextSegment = GetSegment(next);
+            edge = nextSegment.startEdge == edge ? nextSegment.endEdge : nextSegment.startEdge;
+            current = next;
+        }
+    }
+    return lowest;
+}
+
+bool FluidSurface::WalkStrip(int first, int handle, StripPool& pool, int segmentBegin, int segmentEnd, int next[2])
+{
+    const size_t pointBegin = pool.points.size();
+    pool.points.push_back(GetSegment(first).start);
+    pool.points.push_back(GetSegment(first).end);
+    pool.segments.push_back(first);
+    m_SegmentStrip[first] = handle;
+
+    // Walk forward from the end of the first segment
+    bool closed = false;
+    int current = first;
+    int edge = GetSegment(first).endEdge;
+    next[0] = next[1] = -1;
+    while (true)
+    {
+        const int following = NextSegment(edge, current);
+        if (following < 0) break;
+        if (following == first) { closed = true; break; }
+        if (following < segmentBegin || following >= segmentEnd) { next[0] = following; break; }
+        if (m_SegmentStrip[following] >= 0) break;
+
+        m_SegmentStrip[following] = handle;
+        const Segment& segment = GetSegment(following);
+        const bool forward = segment.startEdge == edge;
+        pool.points.push_back(forward ? segment.end : segment.start);
+        pool.segments.push_back(following);
+        edge = forward ? segment.endEdge : segment.startEdge;
+        current = following;
+    }
+    pool.segments.push_back(-1);
+
+    // Open strips may also continue before the first segment
+    if (!closed)
+    {
+        pool.backwardPoints.clear();
+        pool.backwardSegments.clear();
+        current = first;
+        edge = GetSegment(first).startEdge;
+        while (true)
+        {
+            const int following = NextSegment(edge, current);
+            if (following < 0) break;
+            if (following < segmentBegin || following >= segmentEnd) { next[1] = following; break; }
+            if (m_SegmentStrip[following] >= 0) break;
+
+            m_SegmentStrip[following] = handle;
+            const Segment& segment = GetSegment(following);
+            const bool forward = segment.startEdge == edge;
+            pool.backwardPoints.push_back(forward ? segment.end : segment.start);
+            pool.backwardSegments.push_back(following);
+            edge = forward ? segment.endEdge : segment.startEdge;
+            current = following;
+        }
+
+        if (!pool.backwardPoints.empty()) {
+            pool.points.insert(pool.points.begin() + pointBegin, pool.backwardPoints.rbegin(), pool.backwardPoints.rend());
+            pool.segments.insert(pool.segments.begin() + pointBegin, pool.backwardSegments.rbegin(), pool.backwardSegments.rend());
+        }
+    }
+    return closed;
+}
+
+int FluidSurface::AddStrip(int first)
+{
+    int handle;
+    if (!m_FreeStrips.empty()) {
+        handle = m_FreeStrips.back();
+        m_FreeStrips.pop_back();
+    }
+    else {
+        handle = static_cast<int>(m_Strips.size());
+        m_Strips.emplace_back();
+    }
+
+    const int pointBegin = static_cast<int>(m_StripPool.points.size());
+    int next[2];
+    const bool closed = WalkStrip(first, handle, m_StripPool, 0, static_cast<int>(m_SquareSegments.size()), next);
+
+    Strip& strip = m_Strips[handle];
+    strip.first = first;
+    strip.pointBegin = pointBegin;
+    strip.pointCount = static_cast<int>(m_StripPool.points.size()) - pointBegin;
+    strip.closed = closed;
+    m_LivePoints += strip.pointCount;
+    return handle;
+}
+
+void FluidSurface::RemoveStrip(int handle)
+{
+    // Its segments are linked again by the next relink, its points become garbage
+    Strip& strip = m_Strips[handle];
+    for (int i = strip.pointBegin; i < strip.pointBegin + strip.pointCount - 1; i++)
+    {
+        const int segment = m_StripPool.segments[i];
+        m_SegmentStrip[segment] = -1;
+        m_RelinkSegments.push_back(segment);
+    }
+    m_LivePoints -= strip.pointCount;
+    strip.pointCount = 0;
+    m_StripOrder[FindStripOrder(strip.first)] = ~handle;
+    m_RemovedStrips.push_back(handle);
+}
+
+int FluidSurface::FindStripOrder(int first) const
+{
+    // Removed strips keep their first segment until their handle is reused after the relink
+    return static_cast<int>(std::lower_bound(m_StripOrder.begin(), m_StripOrder.end(), first,
+        [&](int handle, int value) { return m_Strips[handle < 0 ? ~handle : handle].first < value; }) - m_StripOrder.begin());
+}
+
+int FluidSurface::FindPiece(int piece)
+{
+    // Root of the piece's component, halving the path on the way
+    while (m_PieceParent[piece] != piece) {
+        m_PieceParent[piece] = m_PieceParent[m_PieceParent[piece]];
+        piece = m_PieceParent[piece];
+    }
+    return piece;
+}
+
+void FluidSurface::BuildStrips()
+{
+    const int squaresX = m_NodesX - 1;
+    const int squareRows = m_NodesY - 1;
+    const int segmentCount = static_cast<int>(m_SquareSegments.size());
+    const int bandTarget = m_ThreadPool.GetThreadCount() * STRIP_BANDS_PER_THREAD;
+    const int bandRows = std::max((squareRows + bandTarget - 1) / bandTarget, 1);
+    const int bandSegments = bandRows * squaresX * 2;
+    const int bandCount = (segmentCount + bandSegments - 1) / bandSegments;
+    m_StripBands.resize(bandCount);
+
+    // Each band walks the part of every strip inside it. The first segment not visited yet is
+    // the lowest of its strip, so a strip that doesn't leave the band is walked like a fresh
+    // build walks it. The parts of the others are dropped, their pieces are stitched below
+    m_ThreadPool.ParallelFor(bandCount, [&](int begin, int end, int)
+    {
+        for (int band = begin; band < end; band++)
+        {
+            StripBand& stripBand = m_StripBands[band];
+            StripPool& pool = stripBand.pool;
+            stripBand.strips.clear();
+            stripBand.starts.clear();
+            stripBand.pieces.clear();
+            pool.points.clear();
+            pool.segments.clear();
+            const int segmentBegin = band * bandSegments;
+            const int segmentEnd = std::min(segmentBegin + bandSegments, segmentCount);
+            std::fill(m_SegmentStrip.begin() + segmentBegin, m_SegmentStrip.begin() + segmentEnd, -1);
+
+            for (int segment = segmentBegin; segment < segmentEnd; segment++)
+            {
+                if (!HasSegment(segment) || m_SegmentStrip[segment] != -1) continue;
+
+                Strip strip;
+                strip.first = segment;
+                strip.pointBegin = static_cast<int>(pool.points.size());
+                StripPiece piece;
+                strip.closed = WalkStrip(segment, VISITED_SEGMENT, pool, segmentBegin, segmentEnd, piece.next);
+                strip.pointCount = static_cast<int>(pool.points.size()) - strip.pointBegin;
+
+                if (piece.next[0] < 0 && piece.next[1] < 0) {
+                    stripBand.strips.push_back(strip);
+                    continue;
+                }
+
+                // The ends remember their piece so the band across the border can find it
+                const int pieceIndex = static_cast<int>(stripBand.pieces.size());
+                const auto segmentsBegin = pool.segments.begin() + strip.pointBegin;
+                const auto segmentsEnd = segmentsBegin + strip.pointCount - 1;
+                piece.lowest = *std::min_element(segmentsBegin, segmentsEnd);
+                if (piece.next[0] >= 0)
+                    m_SegmentStrip[*(segmentsEnd - 1)] = PIECE_END - pieceIndex;
+                if (piece.next[1] >= 0)
+                    m_SegmentStrip[*segmentsBegin] = PIECE_END - pieceIndex;
+                stripBand.pieces.push_back(piece);
+                pool.points.resize(strip.pointBegin);
+                pool.segments.resize(strip.pointBegin);
+            }
+        }
+    });
+
+    // Pieces meeting across a band border are parts of the same strip, which starts at their lowest segment
+    int pieceCount = 0;
+    for (StripBand& stripBand : m_StripBands) {
+        stripBand.pieceOffset = pieceCount;
+        pieceCount += static_cast<int>(stripBand.pieces.size());
+    }
+    m_PieceParent.resize(pieceCount);
+    m_PieceLowest.resize(pieceCount);
+    for (const StripBand& stripBand : m_StripBands)
+    {
+        for (int piece = 0; piece < static_cast<int>(stripBand.pieces.size()); piece++) {
+            m_PieceParent[stripBand.pieceOffset + piece] = stripBand.pieceOffset + piece;
+            m_PieceLowest[stripBand.pieceOffset + piece] = stripBand.pieces[piece].lowest;
+        }
+    }
+    for (const StripBand& stripBand : m_StripBands)
+    {
+        for (int piece = 0; piece < static_cast<int>(stripBand.pieces.size()); piece++)
+        {
+            for (const int next : stripBand.pieces[piece].next)
+            {
+                if (next < 0) continue;
+                const int other = m_StripBands[next / bandSegments].pieceOffset + PIECE_END - m_SegmentStrip[next];
+                m_PieceParent[FindPiece(stripBand.pieceOffset + piece)] = FindPiece(other);
+            }
+        }
+    }
+    for (int piece = 0; piece < pieceCount; piece++) {
+        const int root = FindPiece(piece);
+        m_PieceLowest[root] = std::min(m_PieceLowest[root], m_PieceLowest[piece]);
+    }
+    for (int piece = 0; piece < pieceCount; piece++) {
+        if (m_PieceParent[piece] == piece)
+            m_StripBands[m_PieceLowest[piece] / bandSegments].starts.push_back(m_PieceLowest[piece]);
+    }
+
+    // Strips are numbered by first segment, so band by band
+    int stripCount = 0;
+    for (StripBand& stripBand : m_StripBands) {
+        stripBand.stripOffset = stripCount;
+        stripCount += static_cast<int>(stripBand.strips.size() + stripBand.starts.size());
+    }
+
+    // Every band walks the stitched strips starting in it, merges them with its other strips
+    // and marks the segments of each with its handle
+    m_ThreadPool.ParallelFor(bandCount, [&](int begin, int end, int)
+    {
+        for (int band = begin; band < end; band++)
+        {
+            StripBand& stripBand = m_StripBands[band];
+            const size_t completeStrips = stripBand.strips.size();
+            std::sort(stripBand.starts.begin(), stripBand.starts.end());
+
+            for (const int first : stripBand.starts)
+            {
+                Strip strip;
+                strip.first = first;
+                strip.pointBegin = static_cast<int>(stripBand.pool.points.size());
+                int next[2];
+                strip.closed = WalkStrip(first, VISITED_SEGMENT, stripBand.pool, 0, segmentCount, next);
+                strip.pointCount = static_cast<int>(stripBand.pool.points.size()) - strip.pointBegin;
+                stripBand.strips.push_back(strip);
+            }
+            std::inplace_merge(stripBand.strips.begin(), stripBand.strips.begin() + completeStrips, stripBand.strips.end(),
+                [](const Strip& a, const Strip& b) { return a.first < b.first; });
+
+            for (int i = 0; i < static_cast<int>(stripBand.strips.size()); i++)
+            {
+                const Strip& strip = stripBand.strips[i];
+                for (int point = strip.pointBegin; point < strip.pointBegin + strip.pointCount - 1; point++)
+                    m_SegmentStrip[stripBand.pool.segments[point]] = stripBand.stripOffset + i;
+            }
+        }
+    });
+
+    // Gather the bands' pools
+    int pointCount = 0;
+    for (StripBand& stripBand : m_StripBands) {
+        stripBand.pointOffset = pointCount;
+        pointCount += static_cast<int>(stripBand.pool.points.size());
+    }
+    m_StripPool.points.resize(pointCount);
+    m_StripPool.segments.resize(pointCount);
+    m_Strips.resize(stripCount);
+
+    m_ThreadPool.ParallelFor(bandCount, [&](int begin, int end, int)
+    {
+        for (int band = begin; band < end; band++)
+        {
+            const StripBand& stripBand = m_StripBands[band];
+            std::copy(stripBand.pool.points.begin(), stripBand.pool.points.end(), m_StripPool.points.begin() + stripBand.pointOffset);
+            std::copy(stripBand.pool.segments.begin(), stripBand.pool.segments.end(), m_StripPool.segments.begin() + stripBand.pointOffset);
+            for (int i = 0; i < static_cast<int>(stripBand.strips.size()); i++) {
+                Strip& strip = m_Strips[stripBand.stripOffset + i];
+                strip = stripBand.strips[i];
+                strip.pointBegin += stripBand.pointOffset;
+            }
+        }
+    });
+
+    m_StripOrder.resize(stripCount);
+    for (int strip = 0; strip < stripCount; strip++) {
+        m_StripOrder[strip] = strip;
+    }
+    m_FreeStrips.clear();
+    m_LivePoints = pointCount;
+}
+
+void FluidSurface::RelinkStrips()
+{
+    // New segments of the retraced squares
+    for (const int square : m_ChangedSquares)
+    {
+        for (int segment = square * 2; segment < square * 2 + m_SquareSegmentCount[square]; segment++) {
+            m_RelinkSegments.push_back(segment);
+        }
+        m_SquareChanged[square] = 0;
+    }
+
+    // Strips through the new segments and the segments of removed strips. Other
+    // strips don't reach a retraced square, they are the same as a fresh build's
+    m_AddedStrips.clear();
+    for (const int segment : m_RelinkSegments) {
+        if (HasSegment(segment) && m_SegmentStrip[segment] < 0)
+            m_AddedStrips.push_back(AddStrip(FindStripStart(segment)));
+    }
+    std::sort(m_AddedStrips.begin(), m_AddedStrips.end(), [&](int a, int b) { return m_Strips[a].first < m_Strips[b].first; });
+
+    // Merge them into the strips that stay, by first segment
+    m_MergedOrder.clear();
+    const int orderCount = static_cast<int>(m_StripOrder.size());
+    int position = 0;
+    for (const int handle : m_AddedStrips)
+    {
+        const int insertAt = FindStripOrder(m_Strips[handle].first);
+        for (; position < insertAt; position++) {
+            if (m_StripOrder[position] >= 0)
+                m_MergedOrder.push_back(m_StripOrder[position]);
+        }
+        m_MergedOrder.push_back(handle);
+    }
+    for (; position < orderCount; position++) {
+        if (m_StripOrder[position] >= 0)
+            m_MergedOrder.push_back(m_StripOrder[position]);
+    }
+    m_StripOrder.swap(m_MergedOrder);
+
+    // Removed handles are reused only now, until the merge they still had their first segment
+    m_FreeStrips.insert(m_FreeStrips.end(), m_RemovedStrips.begin(), m_RemovedStrips.end());
+    m_RemovedStrips.clear();
+    m_RelinkSegments.clear();
+
+    CompactStrips();
+}
+
+void FluidSurface::CompactStrips()
+{
+    if (m_StripPool.points.size() <= static_cast<size_t>(m_LivePoints) * 2)
+        return;
+
+    m_CompactedPoints.clear();
+    m_CompactedSegments.clear();
+    for (const int handle : m_StripOrder)
+    {
+        Strip& strip = m_Strips[handle];
+        const int pointBegin = static_cast<int>(m_CompactedPoints.size());
+        m_CompactedPoints.insert(m_CompactedPoints.end(), m_StripPool.points.begin() + strip.pointBegin, m_StripPool.points.begin() + strip.pointBegin + strip.pointCount);
+        m_CompactedSegments.insert(m_CompactedSegments.end(), m_StripPool.segments.begin() + strip.pointBegin, m_StripPool.segments.begin() + strip.pointBegin + strip.pointCount);
+        strip.pointBegin = pointBegin;
+    }
+    m_StripPool.points.swap(m_CompactedPoints);
+    m_StripPool.segments.swap(m_CompactedSegments);
+}
+
+bool FluidSurface::ExportStrips(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file.good())
+        return false;
+
+    for (int strip = 0; strip < GetStripCount(); strip++)
+    {
+        const Vec2* points = GetStripPoints(strip);
+        const int count = GetStripPointCount(strip);
+        file << "strip " << count << " " << (IsStripClosed(strip) ? "closed" : "open") << "\n";
+        for (int i = 0; i < count; i++) {
+            file << points[i].x << " " << points[i].y << "\n";
+        }
+    }
+    return file.good();
+}
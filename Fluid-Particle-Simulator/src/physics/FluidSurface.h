@@ -0,0 +1,201 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SimulationSystem.h"
+#include "../core/MemoryTracker.h"
+#include "../core/ThreadPool.h"
+
+// Extracts the outline of the fluid as line strips.
+// A smoothed density field is sampled on a grid aligned with the simulation bounds,
+// with samples every half spatial grid cell, and marching squares traces the iso line
+// through it. Particles are binned into the spatial grid's cells (counting sort on the
+// current positions, so they are read in order and stored contiguously per cell) and a
+// sample only reads the 2x2 cells its kernel overlaps. Each update compares the particles
+// with the positions stored for them: moves inside a cell are written in place, and only
+// a particle that changed cell (or a particle count that changed) sorts them again. Only
+// the samples next to cells a particle moved in, into or out of, and the squares around
+// those samples, are recomputed. When few cells changed they are followed through lists
+// and only the strips crossing a retraced square are relinked. Otherwise the passes scan
+// the whole grid and every strip is rebuilt, each band of square rows assembling its part
+// of the strips before the pieces crossing band borders are stitched. Sampling, tracing
+// and the rebuild are split over the thread pool.
+class FluidSurface {
+private:
+    // Piece of the iso line inside one square, its ends lie on the square's edges.
+    // Segment ids are 2 * square + slot, the order a fresh build finds them in
+    struct Segment {
+        Vec2 start, end;
+        int startEdge, endEdge;     // Global edge ids, shared with the neighbouring square
+    };
+
+    // Particle that changed cell since the last update
+    struct CellMove {
+        int particle;
+        int fromCell;
+    };
+
+    // Strips are stored by handle, their points and segments at the same place in the pool
+    struct Strip {
+        int first;                  // Lowest segment id, strips are listed in this order
+        int pointBegin;
+        int pointCount;             // 0 once the strip is removed
+        bool closed;
+    };
+
+    // Points of strips and the segment from each point to the next, -1 after the last
+    struct StripPool {
+        TrackedVector<Vec2, MemoryTag::FluidSurface> points;
+        TrackedVector<int, MemoryTag::FluidSurface> segments;
+        TrackedVector<Vec2, MemoryTag::FluidSurface> backwardPoints;       // Scratch of a walk
+        TrackedVector<int, MemoryTag::FluidSurface> backwardSegments;
+    };
+
+    // Part of a strip inside one band that continues into another band
+    struct StripPiece {
+        int lowest;                 // Lowest segment id of the part
+        int next[2];                // Segment across the border after the forward and backward ends, -1 at an open end
+    };
+
+    // Band of square rows, assembles its strips while the whole surface is rebuilt
+    struct StripBand {
+        StripPool pool;
+        TrackedVector<Strip, MemoryTag::FluidSurface> strips;
+        TrackedVector<int, MemoryTag::FluidSurface> starts;               // Lowest segment of the stitched strips starting in the band
+        TrackedVector<StripPiece, MemoryTag::FluidSurface> pieces;
+        int pieceOffset;
+        int stripOffset;
+        int pointOffset;
+    };
+
+    const SimulationSystem& m_Simulation;
+    ThreadPool& m_ThreadPool;
+    float m_IsoLevel;
+
+    // Sample grid, rebuilt when the spatial grid changes
+    const SpatialGrid* m_Grid;
+    Vec2 m_Origin;
+    float m_Spacing;
+    float m_SupportRadius;
+    int m_NodesX;
+    int m_NodesY;
+
+    TrackedVector<int, MemoryTag::FluidSurface> m_NodeCellsX;              // First spatial grid column read by each sample column (the next one is read too)
+    TrackedVector<int, MemoryTag::FluidSurface> m_NodeCellsY;              // Same for rows
+    TrackedVector<int, MemoryTag::FluidSurface> m_CellNodesX;              // First sample column whose first column is at least each spatial grid column, size columns + 1
+    TrackedVector<int, MemoryTag::FluidSurface> m_CellNodesY;              // Same for rows
+    TrackedVector<float, MemoryTag::FluidSurface> m_Density;               // Per sample, 1 at the center of an isolated particle
+    TrackedVector<uint8_t, MemoryTag::FluidSurface> m_NodeChanged;
+    TrackedVector<int, MemoryTag::FluidSurface> m_ChangedNodes;
+
+    // Particle positions sorted by spatial grid cell, so sampling reads them sequentially
+    int m_GridWidth;
+    int m_GridHeight;
+    TrackedVector<int, MemoryTag::FluidSurface> m_ParticleCell;            // Cell of each particle at its stored position
+    TrackedVector<int, MemoryTag::FluidSurface> m_ParticleSlot;            // Where each particle's position is in m_CellPositions
+    TrackedVector<int, MemoryTag::FluidSurface> m_SlotParticle;            // Inverse of m_ParticleSlot
+    TrackedVector<int, MemoryTag::FluidSurface> m_ChunkCellCounts;         // Per chunk counters used while sorting
+    TrackedVector<int, MemoryTag::FluidSurface> m_CellStart;               // First position of each cell, size cells + 1
+    TrackedVector<Vec2, MemoryTag::FluidSurface> m_CellPositions;
+    std::vector<TrackedVector<int, MemoryTag::FluidSurface>> m_ChunkChangedCells; // Cells each chunk saw a particle move in, into or out of
+    std::vector<TrackedVector<CellMove, MemoryTag::FluidSurface>> m_ChunkCellMoves;
+    TrackedVector<uint8_t, MemoryTag::FluidSurface> m_CellChanged;         // Per cell, listed in m_ChangedCells
+    TrackedVector<int, MemoryTag::FluidSurface> m_ChangedCells;
+
+    // At most two segments cross a square (saddle cases)
+    TrackedVector<uint8_t, MemoryTag::FluidSurface> m_SquareSegmentCount;  // Per square between 4 samples
+    TrackedVector<Segment, MemoryTag::FluidSurface> m_SquareSegments;      // Two slots per square
+    TrackedVector<uint8_t, MemoryTag::FluidSurface> m_SquareChanged;       // Per square, listed in m_ChangedSquares
+    TrackedVector<int, MemoryTag::FluidSurface> m_ChangedSquares;
+    bool m_FullUpdate;
+    int m_UpdatedNodes;
+
+    // Strip assembly, kept between updates
+    TrackedVector<int, MemoryTag::FluidSurface> m_EdgeSegments;            // Two segment ids per edge id, -1 when empty. Slot 0 belongs to the square below or left of the edge
+    TrackedVector<int, MemoryTag::FluidSurface> m_SegmentStrip;            // Strip handle of each segment id, -1 when not linked
+    TrackedVector<Strip, MemoryTag::FluidSurface> m_Strips;
+    TrackedVector<int, MemoryTag::FluidSurface> m_StripOrder;              // Live strip handles by first segment, ~handle for a strip removed since the last relink
+    TrackedVector<int, MemoryTag::FluidSurface> m_FreeStrips;
+    StripPool m_StripPool;
+    int m_LivePoints;                                                      // Points of live strips, the rest of the pool is garbage
+
+    // Scratch of a rebuild
+    std::vector<StripBand> m_StripBands;
+    TrackedVector<int, MemoryTag::FluidSurface> m_PieceParent;             // Union find over the pieces of every band
+    TrackedVector<int, MemoryTag::FluidSurface> m_PieceLowest;
+
+    // Scratch of a relink
+    TrackedVector<int, MemoryTag::FluidSurface> m_RelinkSegments;
+    TrackedVector<int, MemoryTag::FluidSurface> m_RemovedStrips;
+    TrackedVector<int, MemoryTag::FluidSurface> m_AddedStrips;
+    TrackedVector<int, MemoryTag::FluidSurface> m_MergedOrder;
+    TrackedVector<Vec2, MemoryTag::FluidSurface> m_CompactedPoints;
+    TrackedVector<int, MemoryTag::FluidSurface> m_CompactedSegments;
+
+    void Resize(const SpatialGrid& grid);
+    // Returns false when no particle moved, every cell is as the last update left it.
+    // Particles is the simulation's storage, compact particles are decoded here
+    template<typename Particles>
+    bool UpdateCells(const Particles& particles);
+    // Moves a particle's position from its slot in fromCell to its slot in its new cell,
+    // shifting the slots and cell starts in between by one
+    void MoveToCell(int particle, int fromCell, const Vec2& position);
+
+    // Whole grid passes, for the first update and when many cells changed
+    void UpdateDensity();
+    void UpdateSquares();
+    void BuildStrips();
+
+    // Passes over the lists of changed cells, samples and squares
+    void UpdateChangedNodes();
+    void UpdateChangedSquares();
+    void RelinkStrips();
+
+    float SampleDensity(int nodeX, int nodeY) const;
+    int TraceSquare(int squareX, int squareY, Segment* segments) const;
+
+    const Segment& GetSegment(int segment) const { return m_SquareSegments[segment]; }
+    bool HasSegment(int segment) const { return (segment & 1) < m_SquareSegmentCount[segment >> 1]; }
+    // Writes the square's segments to its slots of its four edges
+    void LinkSquare(int square);
+    // Segment connected to current through edge, -1 at an open end
+    int NextSegment(int edge, int current) const;
+    // Lowest segment id of the strip through segment
+    int FindStripStart(int segment) const;
+    // Walks the strip from its lowest segment the way a fresh build does, appends its points and
+    // segments to pool and marks its segments with handle. The walk stops before segments outside
+    // [segmentBegin, segmentEnd) and stores them in next (forward end, backward end), -1 where the
+    // strip ends. Returns true for a closed strip
+    bool WalkStrip(int first, int handle, StripPool& pool, int segmentBegin, int segmentEnd, int next[2]);
+    int FindPiece(int piece);
+    int AddStrip(int first);
+    void RemoveStrip(int handle);
+    // Where a strip starting at first is or goes in m_StripOrder
+    int FindStripOrder(int first) const;
+    // Copies the live strips to the front of the pools once garbage outgrows them
+    void CompactStrips();
+
+public:
+    // isoLevel is the field value on the surface, 0.5 puts the outline of a lone particle near its radius
+    FluidSurface(const SimulationSystem& simulation, ThreadPool& threadPool, float isoLevel = 0.5f);
+
+    // Recompute the surface from the current particles. Does nothing until the
+    // simulation has created its spatial grid
+    void Update();
+
+    // Force the next Update to recompute every sample
+    void Invalidate() { m_FullUpdate = true; }
+
+    int GetStripCount() const { return static_cast<int>(m_StripOrder.size()); }
+    const Vec2* GetStripPoints(int strip) const { return &m_StripPool.points[m_Strips[m_StripOrder[strip]].pointBegin]; }
+    int GetStripPointCount(int strip) const { return m_Strips[m_StripOrder[strip]].pointCount; }
+    bool IsStripClosed(int strip) const { return m_Strips[m_StripOrder[strip]].closed; }
+
+    // Samples recomputed by the last update
+    int GetUpdatedNodeCount() const { return m_UpdatedNodes; }
+
+    // Write the strips as text, one "strip <points> <closed|open>" header per strip
+    // followed by one "x y" line per point. Returns false if the file can't be written
+    bool ExportStrips(const std::string& path) const;
+};
@@ -2,6 +2,7 @@
 
 #include "glm/glm.hpp"
 #include "Vec2.h"
+#include "../core/MemoryTracker.h"
 
 struct Particle
 {
@@ -19,4 +20,7 @@ struct Particle
 		density(0.0f), pressure(0.0f), mass(m), temperature(20.0f)
 	{
 	}
-};
\ No newline at end of file
+};
+
+// Particle arrays, counted as MemoryTag::Particles
+typedef TrackedVector<Particle, MemoryTag::Particles> ParticleVector;
\ No newline at end of file
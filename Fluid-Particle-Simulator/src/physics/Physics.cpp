@@ -1,86 +1,136 @@
 #include "physics.h"
 #include "SpatialGrid.h"
+#include "PhysicsStepper.h"
+#include "SimulationCore.h"
  
 
+constexpr std::pair<int, int> SpatialGrid::NEIGHBOR_OFFSETS[SpatialGrid::NEIGHBOR_COUNT];
+
 const Vec2 G(0.0f, -20.80665f);
 const float AIR_RESISTANCE = 0.0f;
 
-void UpdatePhysics(SimulationSystem& sim, float deltaTime, bool useSpacePart)
+const Vec2& GetGravity()
+{
+    return G;
+}
+
+float GetAirResistance()
+{
+    return AIR_RESISTANCE;
+}
+
+void IntegrateParticles(SimulationSystem& sim, float deltaTime, ThreadPool* threadPool)
+{
+    if (GetStepperConfig(sim, true).gravityOnly)
+        RunIntegrator(sim, GravityEulerIntegrator(sim, deltaTime), threadPool);
+    else
+        RunIntegrator(sim, EulerIntegrator(sim, deltaTime), threadPool);
+}
+
+void SolveBorderCollisions(SimulationSystem& sim, ThreadPool* threadPool)
 {
-    std::vector<Particle>& particles = sim.GetParticles();
-    const int N = particles.size();
+    RunBoundary(sim, ReflectingBoundary(sim), threadPool);
+}
 
-    for (int i = 0; i < N; i++)
+void BuildSpatialGrid(SimulationSystem& sim)
+{
+    PROFILE_SCOPE("BuildSpatialGrid");
+    const ParticleVector& particles = sim.GetParticles();
+    PERF_SCOPE("BuildSpatialGrid", particles.size());
+
+    // The grid is owned by the simulation so the renderer can reuse it for culling
+    if (!sim.GetSpatialGrid())
+        sim.InitSpatialGrid();
+    SpatialGrid& grid = *sim.GetSpatialGrid();
+
+    // Rebuild the reused grid from all particles
+    grid.Build(particles);
+}
+
+CollisionPairList& FindCollisionPairs(SimulationSystem& sim, ThreadPool* threadPool)
+{
+    PROFILE_SCOPE("FindCollisionPairs");
+    PERF_SCOPE("FindCollisionPairs", sim.GetParticles().size());
+    SpatialGrid& grid = *sim.GetSpatialGrid();
+    const float maxDistance = 2 * sim.GetParticleRadius();
+
+    if (threadPool)
+        return grid.GetPotentialCollisionPairs(sim.GetParticles(), maxDistance, *threadPool, &sim.GetStepArena());
+    return grid.GetPotentialCollisionPairs(sim.GetParticles(), maxDistance, &sim.GetStepArena());
+}
+
+template<bool UniformMass>
+static int SolveWithRestitution(SimulationSystem& sim, const CollisionPairList& collisionPairs, ContactRestitution restitution)
+{
+    switch (restitution)
     {
-        Particle& particleA = particles[i];
+    case ContactRestitution::Elastic:   return RunContacts(sim, collisionPairs, ImpulseContact<UniformMass, ContactRestitution::Elastic>(sim));
+    case ContactRestitution::Inelastic: return RunContacts(sim, collisionPairs, ImpulseContact<UniformMass, ContactRestitution::Inelastic>(sim));
+    default:                            return RunContacts(sim, collisionPairs, ImpulseContact<UniformMass, ContactRestitution::Any>(sim));
+    }
+}
 
-        // Force calculation
-        particleA.force.x = particleA.mass * G.x;
-        particleA.force.y = particleA.mass * G.y;
+int SolveParticleCollisions(SimulationSystem& sim, const CollisionPairList& collisionPairs)
+{
+    // Same contact kernel UpdatePhysics would pick for the scene
+    const StepperConfig config = GetStepperConfig(sim, true);
+    if (config.uniformMass)
+        return SolveWithRestitution<true>(sim, collisionPairs, config.restitution);
+    return SolveWithRestitution<false>(sim, collisionPairs, config.restitution);
+}
 
-        // Air resistance
-        particleA.force.x -= particleA.velocity.x * AIR_RESISTANCE;
-        particleA.force.y -= particleA.velocity.y * AIR_RESISTANCE;
+// Overlap counters of the pairs, particles is the storage the simulation uses
+template<typename Particles>
+static void CollectOverlapStats(const SimulationSystem& sim, const Particles& particles, const CollisionPairList& collisionPairs,
+    PhysicsStepStats& stats)
+{
+    const float contactDistance = 2.0f * sim.GetParticleRadius();
+    double overlapSum = 0.0;
+    for (const auto& pair : collisionPairs)
+    {
+        const Vec2 delta = GetParticlePosition(particles, pair.first) - GetParticlePosition(particles, pair.second);
+        const float overlap = contactDistance - delta.length();
+        if (overlap <= 0.0f) continue;
 
-        // Velocity integration
-        particleA.velocity.x += (particleA.force.x / particleA.mass) * deltaTime;
-        particleA.velocity.y += (particleA.force.y / particleA.mass) * deltaTime;
+        stats.overlappingPairs++;
+        overlapSum += overlap;
+        stats.maxOverlap = std::max(stats.maxOverlap, overlap);
+    }
+    stats.meanOverlap = stats.overlappingPairs > 0 ? static_cast<float>(overlapSum / stats.overlappingPairs) : 0.0f;
+}
 
-        // Position integration
-        particleA.position.x += particleA.velocity.x * deltaTime;
-        particleA.position.y += particleA.velocity.y * deltaTime;
+void CollectGridStats(const SimulationSystem& sim, const CollisionPairList& collisionPairs,
+    PhysicsStepStats& stats)
+{
+    PROFILE_SCOPE("CollectGridStats");
+    const SpatialGrid& grid = *sim.GetSpatialGrid();
 
-        // Temperature calculation
-        const float speed = particleA.velocity.length();
-        if (speed > 5.0f) 
-        {
-            particleA.temperature = std::min(100.0f, particleA.temperature + 0.1f);
-        }
-        else 
-        {
-            particleA.temperature = std::max(20.0f, particleA.temperature - 0.05f);
-        }
+    stats.testedPairs = grid.CountPairTests();
 
-        SolveCollisionBorder(particleA, sim.GetBounds(), sim.GetParticleRadius());
-        
-        // Choose if using or not space partitioning 
-        if (!useSpacePart) 
+    int occupied = 0;
+    stats.cells = grid.GetGridWidth() * grid.GetGridHeight();
+    for (int y = 0; y < grid.GetGridHeight(); y++)
+    {
+        for (int x = 0; x < grid.GetGridWidth(); x++)
         {
-            for (int j = 0; j < N; j++)
-            {
-                if (j != i)
-                {
-                    Particle& particleB = particles[j];
-                    SolveCollisionParticle(particleA, particleB, sim.GetBounds(), sim.GetParticleRadius());
-                }
-            }
+            const int count = static_cast<int>(grid.GetCell(x, y).size());
+            stats.occupancyHistogram[std::min(count, OCCUPANCY_BUCKETS - 1)]++;
+            stats.maxPerCell = std::max(stats.maxPerCell, count);
+            occupied += count > 0;
         }
     }
-    if (useSpacePart)
-    {
-        static SpatialGrid grid(
-            sim.GetBounds().bottomLeft,
-            sim.GetBounds().topRight,
-            2.1f * 2.0f * sim.GetParticleRadius(), // Cell size (compute once)
-            N
-        );
-
-        grid.Clear();
-
-        // Insert all particles into the reused grid
-        for (int i = 0; i < N; i++) {
-            grid.InsertParticle(i, particles[i].position);
-        }
+    stats.meanPerCell = static_cast<float>(grid.GetInsertedCount()) / stats.cells;
+    stats.meanPerOccupiedCell = occupied > 0 ? static_cast<float>(grid.GetInsertedCount()) / occupied : 0.0f;
+    stats.emptyCellFraction = static_cast<float>(stats.cells - occupied) / stats.cells;
 
-        // Get collision pairs and resolve collisions
-        std::vector<std::pair<int, int>> collisionPairs = grid.GetPotentialCollisionPairs(
-                                                                sim.GetParticles(),
-                                                                2 * sim.GetParticleRadius());
+    if (sim.GetParticleStorage() == ParticleStorage::Compact)
+        CollectOverlapStats(sim, sim.GetCompactParticles(), collisionPairs, stats);
+    else
+        CollectOverlapStats(sim, sim.GetParticles(), collisionPairs, stats);
+}
 
-        // Solve collision pairs
-        for (const auto& pair : collisionPairs) 
-            SolveCollisionParticle(particles[pair.first], particles[pair.second], sim.GetBounds(), sim.GetParticleRadius());
-        
-    }
-    sim.UpdateStreams(deltaTime);
-}
\ No newline at end of file
+void UpdatePhysics(SimulationSystem& sim, float deltaTime, bool useSpacePart, ThreadPool* threadPool)
+{
+    // The whole step runs in the core compiled for the scene
+    GetPhysicsStepper(GetStepperConfig(sim, useSpacePart)).Step(sim, deltaTime, threadPool);
+}
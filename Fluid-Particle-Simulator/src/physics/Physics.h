@@ -1,8 +1,47 @@
 #pragma once
 
+#include <utility>
+#include <vector>
 #include "SimulationSystem.h"
 #include "SolveCollision.h"
+#include "../core/ThreadPool.h"
 
 
-// Update particles inside simulation system particle vector in fixed deltaTime
-void UpdatePhysics(SimulationSystem& sim, float deltaTime, bool useSpacePart);
\ No newline at end of file
+// Update particles inside simulation system particle vector in fixed deltaTime.
+// With a thread pool the integration, border and pair search phases are split over
+// its threads, the contacts are always solved in order on the calling thread.
+// Records the step's counters and phase timings in the simulation (the grid counters only
+// while it collects stats) and runs its ConservationMonitor when one is attached.
+// The step runs in the SimulationCore compiled for the scene (see PhysicsStepper.h)
+void UpdatePhysics(SimulationSystem& sim, float deltaTime, bool useSpacePart, ThreadPool* threadPool = nullptr);
+
+// Gravity acceleration applied by IntegrateParticles
+const Vec2& GetGravity();
+
+// Drag coefficient of the air, 0 lets the steps use the gravity only integrator
+float GetAirResistance();
+
+// Phases of the space partitioned update, in the order UpdatePhysics runs them.
+// They are exposed so each one can be timed on its own (see PhysicsBenchmark)
+
+// The phases pick the same kernels as UpdatePhysics for the scene, and work on
+// ParticleStorage::Full only
+
+// Apply gravity and move every particle, also updates the temperatures
+void IntegrateParticles(SimulationSystem& sim, float deltaTime, ThreadPool* threadPool = nullptr);
+
+// Push the particles back inside the simulation bounds
+void SolveBorderCollisions(SimulationSystem& sim, ThreadPool* threadPool = nullptr);
+
+// Sort every particle into its spatial grid cell, the grid is created on first use
+void BuildSpatialGrid(SimulationSystem& sim);
+
+// Pairs closer than a particle diameter, in the same order with or without threads
+CollisionPairList& FindCollisionPairs(SimulationSystem& sim, ThreadPool* threadPool = nullptr);
+
+// Resolve the pairs one after the other, returns how many were in contact
+int SolveParticleCollisions(SimulationSystem& sim, const CollisionPairList& collisionPairs);
+
+// Grid occupancy and the overlap left by the solve, added to stats. The cells still hold
+// the particles as the broadphase saw them
+void CollectGridStats(const SimulationSystem& sim, const CollisionPairList& collisionPairs, PhysicsStepStats& stats);
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+
+// Occupancy histogram buckets: cells holding 0, 1 ... OCCUPANCY_BUCKETS - 2 particles,
+// the last bucket also counts every fuller cell
+const int OCCUPANCY_BUCKETS = 8;
+
+// Phases of UpdatePhysics, timed every step
+enum class PhysicsPhase {
+    Integrate = 0,
+    SolveBorder = 1,
+    BuildGrid = 2,
+    FindPairs = 3,
+    SolvePairs = 4,
+    BruteForce = 5,     // Integration, border and contacts of the path without the grid
+    Monitor = 6,        // ConservationMonitor checks
+    Streams = 7,
+    Count = 8
+};
+
+const int PHYSICS_PHASE_COUNT = static_cast<int>(PhysicsPhase::Count);
+
+// Lower case name of a phase, for reports and metric labels
+inline const char* GetPhysicsPhaseName(PhysicsPhase phase)
+{
+    static const char* const NAMES[PHYSICS_PHASE_COUNT] = {
+        "integrate", "solve_border", "build_grid", "find_pairs", "solve_pairs", "brute_force", "monitor", "streams" };
+    return NAMES[static_cast<int>(phase)];
+}
+
+// Broadphase and solver counters of one physics step. Pair counts drive the cell size,
+// the residual overlap drives the substep count. The step, particle, pair and contact
+// counts and the timings are filled every step, the rest only while collecting stats
+struct PhysicsStepStats {
+    uint64_t step = 0;                  // Steps since the simulation started
+    int particles = 0;
+
+    // Wall time of each phase and of the whole step, phases that didn't run stay 0
+    uint64_t phaseNs[PHYSICS_PHASE_COUNT] = {};
+    uint64_t stepNs = 0;
+
+    // Broadphase
+    int64_t testedPairs = 0;            // Distance tests done by the cell stencil (every ordered pair without the grid)
+    int candidatePairs = 0;             // Pairs the broadphase handed to the solver
+    int contacts = 0;                   // Candidates still closer than 2r when solved, earlier contacts may separate them
+    float candidateRatio = 0.0f;        // candidatePairs / testedPairs, low values mean cells are too large
+    float contactRatio = 0.0f;          // contacts / candidatePairs
+
+    // Spatial grid occupancy, all zero without the grid
+    int cells = 0;
+    int maxPerCell = 0;
+    float meanPerCell = 0.0f;
+    float meanPerOccupiedCell = 0.0f;
+    float emptyCellFraction = 0.0f;
+    int occupancyHistogram[OCCUPANCY_BUCKETS] = {};
+
+    // Overlap left after the solve, over the candidate pairs still closer than 2r
+    int overlappingPairs = 0;
+    float meanOverlap = 0.0f;           // Simulation units
+    float maxOverlap = 0.0f;
+};
@@ -0,0 +1,82 @@
+#include "PhysicsStepper.h"
+#include "SimulationCore.h"
+#include <cstdio>
+
+// PhysicsStepper running one SimulationCore
+template<typename Broadphase, typename Integrator, typename Boundary, typename Contact>
+class CoreStepper : public PhysicsStepper {
+private:
+    // Fixed size, steppers are created inside the hot region of the first step using them
+    char m_Name[96];
+
+public:
+    CoreStepper()
+    {
+        snprintf(m_Name, sizeof(m_Name), "%s/%s/%s/%s",
+            Broadphase::GetName(), Integrator::GetName(), Boundary::GetName(), Contact::GetName());
+    }
+
+    void Step(SimulationSystem& sim, float deltaTime, ThreadPool* threadPool) const override
+    {
+        SimulationCore<Broadphase, Integrator, Boundary, Contact>::Step(sim, deltaTime, threadPool);
+    }
+
+    const char* GetName() const override { return m_Name; }
+};
+
+template<typename Broadphase, typename Integrator, typename Contact>
+static const PhysicsStepper& GetStepper()
+{
+    static const CoreStepper<Broadphase, Integrator, ReflectingBoundary, Contact> stepper;
+    return stepper;
+}
+
+template<typename Broadphase, typename Integrator, bool UniformMass>
+static const PhysicsStepper& SelectRestitution(ContactRestitution restitution)
+{
+    switch (restitution)
+    {
+    case ContactRestitution::Elastic:   return GetStepper<Broadphase, Integrator, ImpulseContact<UniformMass, ContactRestitution::Elastic>>();
+    case ContactRestitution::Inelastic: return GetStepper<Broadphase, Integrator, ImpulseContact<UniformMass, ContactRestitution::Inelastic>>();
+    default:                            return GetStepper<Broadphase, Integrator, ImpulseContact<UniformMass, ContactRestitution::Any>>();
+    }
+}
+
+template<typename Broadphase, typename Integrator>
+static const PhysicsStepper& SelectContact(const StepperConfig& config)
+{
+    if (config.uniformMass)
+        return SelectRestitution<Broadphase, Integrator, true>(config.restitution);
+    return SelectRestitution<Broadphase, Integrator, false>(config.restitution);
+}
+
+template<typename Broadphase>
+static const PhysicsStepper& SelectIntegrator(const StepperConfig& config)
+{
+    if (config.gravityOnly)
+        return SelectContact<Broadphase, GravityEulerIntegrator>(config);
+    return SelectContact<Broadphase, EulerIntegrator>(config);
+}
+
+const PhysicsStepper& GetPhysicsStepper(const StepperConfig& config)
+{
+    if (config.compactStorage)
+        return SelectIntegrator<CompactGridBroadphase>(config);
+    if (config.spatialGrid)
+        return SelectIntegrator<GridBroadphase>(config);
+    return SelectIntegrator<BruteForceBroadphase>(config);
+}
+
+StepperConfig GetStepperConfig(const SimulationSystem& sim, bool useSpacePart)
+{
+    StepperConfig config;
+    config.spatialGrid = useSpacePart;
+    config.compactStorage = sim.GetParticleStorage() == ParticleStorage::Compact;
+    if (!sim.IsUsingSpecializedKernels())
+        return config;
+
+    config.gravityOnly = GetAirResistance() == 0.0f;
+    config.uniformMass = sim.GetUniformMass() > 0.0f;
+    config.restitution = GetContactRestitution();
+    return config;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "SimulationSystem.h"
+#include "SolveCollision.h"
+#include "../core/ThreadPool.h"
+
+// Policies a step can be compiled for, see SimulationCore.h
+struct StepperConfig {
+    bool spatialGrid = true;        // Grid broadphase, brute force otherwise
+    bool compactStorage = false;    // ParticleStorage::Compact, always on the grid
+    bool gravityOnly = false;       // No air resistance
+    bool uniformMass = false;       // Every particle has the same mass
+    ContactRestitution restitution = ContactRestitution::Any;
+};
+
+// Cheapest configuration the scene qualifies for. Only the broadphase and the storage are
+// set when the simulation doesn't use specialised kernels
+StepperConfig GetStepperConfig(const SimulationSystem& sim, bool useSpacePart);
+
+// Type-erased SimulationCore for the GUI and the runners: one virtual call per step,
+// the step itself is compiled for its policies
+class PhysicsStepper {
+public:
+    virtual ~PhysicsStepper() {}
+
+    virtual void Step(SimulationSystem& sim, float deltaTime, ThreadPool* threadPool) const = 0;
+
+    // Policies it runs, e.g. "grid/gravity_euler/reflect/uniform_elastic"
+    virtual const char* GetName() const = 0;
+};
+
+// Stepper compiled for config. Every configuration has one, created on first use without
+// touching the heap, so it can be picked again every step
+const PhysicsStepper& GetPhysicsStepper(const StepperConfig& config);
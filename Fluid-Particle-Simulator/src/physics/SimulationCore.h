@@ -0,0 +1,483 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include "Physics.h"
+#include "ConservationMonitor.h"
+#include "../core/AllocationGuard.h"
+#include "../core/PerfCounters.h"
+#include "../core/Profiler.h"
+
+// Policy-based physics step. SimulationCore is compiled for one broadphase, integrator,
+// boundary and contact model. The integrator, boundary and contact policies are small
+// classes built once per step from the simulation, and their per particle calls inline
+// into the loops, so a step has no virtual calls or configuration branches inside its
+// kernels. PhysicsStepper.h picks one of a fixed set of cores at runtime.
+
+// Smallest number of particles handed to a thread, below this the threads cost more than they save
+const int MIN_PARTICLES_PER_CHUNK = 2048;
+
+// Run func over [0, count) on the pool, or directly without one
+inline void ForEachParticleRange(ThreadPool* threadPool, int count, const ThreadPool::RangeFunction& func)
+{
+    if (threadPool)
+        threadPool->ParallelFor(count, func, MIN_PARTICLES_PER_CHUNK);
+    else
+        func(0, count, 0);
+}
+
+// Adds the wall time of its scope to one phase of the step
+class PhaseTimer {
+private:
+    PhysicsStepStats& m_Stats;
+    PhysicsPhase m_Phase;
+    uint64_t m_Start;
+
+public:
+    PhaseTimer(PhysicsStepStats& stats, PhysicsPhase phase) : m_Stats(stats), m_Phase(phase), m_Start(Profiler::Now()) {}
+    ~PhaseTimer() { m_Stats.phaseNs[static_cast<int>(m_Phase)] += Profiler::Now() - m_Start; }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+// --------- INTEGRATORS ---------
+
+// Fast particles heat up, slow ones cool down to 20
+inline void UpdateParticleTemperature(Particle& particle)
+{
+    const float speed = particle.velocity.length();
+    if (speed > 5.0f)
+    {
+        particle.temperature = std::min(100.0f, particle.temperature + 0.1f);
+    }
+    else
+    {
+        particle.temperature = std::max(20.0f, particle.temperature - 0.05f);
+    }
+}
+
+// Semi-implicit Euler with gravity and air resistance
+class EulerIntegrator {
+private:
+    Vec2 m_Gravity;
+    float m_AirResistance;
+    float m_DeltaTime;
+
+public:
+    EulerIntegrator(const SimulationSystem&, float deltaTime)
+        : m_Gravity(GetGravity()), m_AirResistance(GetAirResistance()), m_DeltaTime(deltaTime) {}
+
+    static const char* GetName() { return "euler"; }
+
+    void Integrate(Particle& particle) const
+    {
+        // Force calculation
+        particle.force.x = particle.mass * m_Gravity.x;
+        particle.force.y = particle.mass * m_Gravity.y;
+
+        // Air resistance
+        particle.force.x -= particle.velocity.x * m_AirResistance;
+        particle.force.y -= particle.velocity.y * m_AirResistance;
+
+        // Velocity integration
+        particle.velocity.x += (particle.force.x / particle.mass) * m_DeltaTime;
+        particle.velocity.y += (particle.force.y / particle.mass) * m_DeltaTime;
+
+        // Position integration
+        particle.position.x += particle.velocity.x * m_DeltaTime;
+        particle.position.y += particle.velocity.y * m_DeltaTime;
+
+        UpdateParticleTemperature(particle);
+    }
+};
+
+// Semi-implicit Euler with gravity as the only force. The acceleration is the gravity
+// whatever the mass, so the velocity change is computed once per step
+class GravityEulerIntegrator {
+private:
+    Vec2 m_Gravity;
+    Vec2 m_VelocityStep;
+    float m_DeltaTime;
+
+public:
+    GravityEulerIntegrator(const SimulationSystem&, float deltaTime)
+        : m_Gravity(GetGravity()), m_VelocityStep(GetGravity().x * deltaTime, GetGravity().y * deltaTime),
+        m_DeltaTime(deltaTime) {}
+
+    static const char* GetName() { return "gravity_euler"; }
+
+    void Integrate(Particle& particle) const
+    {
+        particle.force.x = particle.mass * m_Gravity.x;
+        particle.force.y = particle.mass * m_Gravity.y;
+
+        particle.velocity.x += m_VelocityStep.x;
+        particle.velocity.y += m_VelocityStep.y;
+
+        particle.position.x += particle.velocity.x * m_DeltaTime;
+        particle.position.y += particle.velocity.y * m_DeltaTime;
+
+        UpdateParticleTemperature(particle);
+    }
+};
+
+// --------- BOUNDARIES ---------
+
+// Walls on the simulation bounds, a particle crossing one has its velocity reflected
+class ReflectingBoundary {
+private:
+    Bounds m_Bounds;
+    float m_Radius;
+
+public:
+    explicit ReflectingBoundary(const SimulationSystem& sim) : m_Bounds(sim.GetBounds()), m_Radius(sim.GetParticleRadius()) {}
+
+    static const char* GetName() { return "reflect"; }
+
+    void Solve(Particle& particle) const { SolveCollisionBorder(particle, m_Bounds, m_Radius); }
+};
+
+// --------- CONTACTS ---------
+
+// Position correction and restitution impulse of SolveContact. UniformMass needs a
+// simulation whose GetUniformMass() isn't 0
+template<bool UniformMass, ContactRestitution Restitution>
+class ImpulseContact {
+private:
+    float m_Radius;
+    float m_UniformMass;
+    float m_Bounciness;
+
+public:
+    explicit ImpulseContact(const SimulationSystem& sim)
+        : m_Radius(sim.GetParticleRadius()), m_UniformMass(sim.GetUniformMass()), m_Bounciness(GetBounciness()) {}
+
+    static const char* GetName()
+    {
+        return UniformMass ?
+            (Restitution == ContactRestitution::Elastic ? "uniform_elastic" : Restitution == ContactRestitution::Inelastic ? "uniform_inelastic" : "uniform") :
+            (Restitution == ContactRestitution::Elastic ? "elastic" : Restitution == ContactRestitution::Inelastic ? "inelastic" : "impulse");
+    }
+
+    // Returns true if the particles were in contact
+    bool Solve(Particle& particleA, Particle& particleB) const
+    {
+        return SolveContact<UniformMass, Restitution>(particleA, particleB, m_Radius, m_UniformMass, m_Bounciness);
+    }
+};
+
+// --------- PHASES ---------
+
+template<typename Integrator>
+void RunIntegrator(SimulationSystem& sim, const Integrator& integrator, ThreadPool* threadPool)
+{
+    PROFILE_SCOPE("IntegrateParticles");
+    ParticleVector& particles = sim.GetParticles();
+    PERF_SCOPE("IntegrateParticles", particles.size());
+
+    ForEachParticleRange(threadPool, static_cast<int>(particles.size()), [&](int begin, int end, int)
+    {
+        for (int i = begin; i < end; i++)
+            integrator.Integrate(particles[i]);
+    });
+}
+
+template<typename Boundary>
+void RunBoundary(SimulationSystem& sim, const Boundary& boundary, ThreadPool* threadPool)
+{
+    PROFILE_SCOPE("SolveBorderCollisions");
+    ParticleVector& particles = sim.GetParticles();
+    PERF_SCOPE("SolveBorderCollisions", particles.size());
+
+    ForEachParticleRange(threadPool, static_cast<int>(particles.size()), [&](int begin, int end, int)
+    {
+        for (int i = begin; i < end; i++)
+            boundary.Solve(particles[i]);
+    });
+}
+
+// Pairs share particles, so they are solved in order. Returns the contacts
+template<typename Contact>
+int RunContacts(SimulationSystem& sim, const CollisionPairList& collisionPairs, const Contact& contact)
+{
+    PROFILE_SCOPE("SolveParticleCollisions");
+    ParticleVector& particles = sim.GetParticles();
+    PERF_SCOPE("SolveParticleCollisions", particles.size());
+
+    int contacts = 0;
+    for (const auto& pair : collisionPairs)
+        contacts += contact.Solve(particles[pair.first], particles[pair.second]);
+    return contacts;
+}
+
+// Integration and walls of compact particles in one pass. Each batch is decoded, run
+// through the policies as Particles and encoded back
+template<typename Integrator, typename Boundary>
+void RunCompactIntegrator(SimulationSystem& sim, const Integrator& integrator, const Boundary& boundary,
+    uint32_t seed, ThreadPool* threadPool)
+{
+    PROFILE_SCOPE("IntegrateCompactParticles");
+    CompactParticles& particles = sim.GetCompactParticles();
+    PERF_SCOPE("IntegrateCompactParticles", particles.size());
+
+    ForEachParticleRange(threadPool, static_cast<int>(particles.size()), [&](int begin, int end, int)
+    {
+        int i = begin;
+        ParticleBatch batch;
+        for (; i + ParticleBatch::SIZE <= end; i += ParticleBatch::SIZE)
+        {
+            particles.LoadBatch(i, batch);
+            for (int lane = 0; lane < ParticleBatch::SIZE; lane++)
+            {
+                Particle particle(Vec2(batch.positionX[lane], batch.positionY[lane]),
+                    Vec2(batch.velocityX[lane], batch.velocityY[lane]), batch.mass[lane]);
+                particle.temperature = batch.temperature[lane];
+
+                integrator.Integrate(particle);
+                boundary.Solve(particle);
+
+                batch.positionX[lane] = particle.position.x;
+                batch.positionY[lane] = particle.position.y;
+                batch.velocityX[lane] = particle.velocity.x;
+                batch.velocityY[lane] = particle.velocity.y;
+                batch.temperature[lane] = particle.temperature;
+            }
+            particles.StoreBatch(i, batch, seed);
+        }
+
+        for (; i < end; i++)
+        {
+            Particle particle = particles.Load(i);
+            integrator.Integrate(particle);
+            boundary.Solve(particle);
+            particles.Store(i, particle, seed);
+        }
+    });
+}
+
+// RunContacts on compact particles. Consecutive pairs mostly share their first particle,
+// it stays decoded until the pairs move on to the next one
+template<typename Contact>
+int RunCompactContacts(SimulationSystem& sim, const CollisionPairList& collisionPairs, const Contact& contact, uint32_t seed)
+{
+    PROFILE_SCOPE("SolveCompactCollisions");
+    CompactParticles& particles = sim.GetCompactParticles();
+    PERF_SCOPE("SolveCompactCollisions", particles.size());
+
+    int contacts = 0;
+    int current = -1;
+    bool changed = false;
+    Particle particleA(Vec2(0.0f, 0.0f), Vec2(0.0f, 0.0f));
+    for (const auto& pair : collisionPairs)
+    {
+        if (pair.first != current)
+        {
+            if (changed)
+                particles.Store(current, particleA, seed);
+            current = pair.first;
+            changed = false;
+            particleA = particles.Load(current);
+        }
+
+        Particle particleB = particles.Load(pair.second);
+        if (contact.Solve(particleA, particleB))
+        {
+            particles.Store(pair.second, particleB, seed);
+            changed = true;
+            contacts++;
+        }
+    }
+    if (changed)
+        particles.Store(current, particleA, seed);
+    return contacts;
+}
+
+// --------- BROADPHASES ---------
+// A broadphase runs the particle phases of a step and returns the pairs it solved,
+// nullptr when it has no pair list
+
+// Spatial grid: integration, walls, grid, pair search and contacts as separate phases
+class GridBroadphase {
+public:
+    static const char* GetName() { return "grid"; }
+
+    template<typename Integrator, typename Boundary, typename Contact>
+    static const CollisionPairList* Step(SimulationSystem& sim, const Integrator& integrator, const Boundary& boundary,
+        const Contact& contact, ThreadPool* threadPool, PhysicsStepStats& stats)
+    {
+        {
+            PhaseTimer timer(stats, PhysicsPhase::Integrate);
+            RunIntegrator(sim, integrator, threadPool);
+        }
+        {
+            PhaseTimer timer(stats, PhysicsPhase::SolveBorder);
+            RunBoundary(sim, boundary, threadPool);
+        }
+        {
+            PhaseTimer timer(stats, PhysicsPhase::BuildGrid);
+            BuildSpatialGrid(sim);
+        }
+
+        // Get collision pairs and resolve collisions
+        const CollisionPairList* collisionPairs;
+        {
+            PhaseTimer timer(stats, PhysicsPhase::FindPairs);
+            collisionPairs = &FindCollisionPairs(sim, threadPool);
+        }
+        {
+            PhaseTimer timer(stats, PhysicsPhase::SolvePairs);
+            stats.candidatePairs = static_cast<int>(collisionPairs->size());
+            stats.contacts = RunContacts(sim, *collisionPairs, contact);
+        }
+
+        if (sim.IsCollectingStats())
+            CollectGridStats(sim, *collisionPairs, stats);
+        return collisionPairs;
+    }
+};
+
+// Every ordered pair, the reference for the grid. Each particle is moved and kept inside
+// the walls right before its contacts are solved, all on the calling thread
+class BruteForceBroadphase {
+public:
+    static const char* GetName() { return "brute_force"; }
+
+    template<typename Integrator, typename Boundary, typename Contact>
+    static const CollisionPairList* Step(SimulationSystem& sim, const Integrator& integrator, const Boundary& boundary,
+        const Contact& contact, ThreadPool*, PhysicsStepStats& stats)
+    {
+        PROFILE_SCOPE("BruteForceCollisions");
+        PhaseTimer timer(stats, PhysicsPhase::BruteForce);
+        ParticleVector& particles = sim.GetParticles();
+        PERF_SCOPE("BruteForceCollisions", particles.size());
+        const int N = particles.size();
+
+        // Every ordered pair is tested and handed to the solver
+        stats.testedPairs = static_cast<int64_t>(N) * (N > 0 ? N - 1 : 0);
+        stats.candidatePairs = static_cast<int>(std::min<int64_t>(stats.testedPairs, INT32_MAX));
+
+        for (int i = 0; i < N; i++)
+        {
+            Particle& particleA = particles[i];
+            integrator.Integrate(particleA);
+            boundary.Solve(particleA);
+
+            // Every other particle, the brute force reference for the grid
+            for (int j = 0; j < N; j++)
+            {
+                if (j != i)
+                    stats.contacts += contact.Solve(particleA, particles[j]);
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Spatial grid over ParticleStorage::Compact. The grid and the pair search decode the
+// stored positions as they read them, the contacts decode and encode the particles of
+// each pair. Nothing decoded is kept, the step holds no particle copy
+class CompactGridBroadphase {
+public:
+    static const char* GetName() { return "compact_grid"; }
+
+    template<typename Integrator, typename Boundary, typename Contact>
+    static const CollisionPairList* Step(SimulationSystem& sim, const Integrator& integrator, const Boundary& boundary,
+        const Contact& contact, ThreadPool* threadPool, PhysicsStepStats& stats)
+    {
+        const CompactParticles& particles = sim.GetCompactParticles();
+        const int count = static_cast<int>(particles.size());
+
+        // Each step rounds with other noise, the contacts with other noise than the integration
+        const uint32_t seed = static_cast<uint32_t>(stats.step) * 0x85ebca6bu;
+
+        {
+            PhaseTimer timer(stats, PhysicsPhase::Integrate);
+            RunCompactIntegrator(sim, integrator, boundary, seed, threadPool);
+        }
+
+        {
+            PROFILE_SCOPE("BuildSpatialGrid");
+            PhaseTimer timer(stats, PhysicsPhase::BuildGrid);
+            PERF_SCOPE("BuildSpatialGrid", count);
+            if (!sim.GetSpatialGrid())
+                sim.InitSpatialGrid();
+            sim.GetSpatialGrid()->Build(particles);
+        }
+
+        const CollisionPairList* collisionPairs;
+        {
+            PROFILE_SCOPE("FindCollisionPairs");
+            PhaseTimer timer(stats, PhysicsPhase::FindPairs);
+            PERF_SCOPE("FindCollisionPairs", count);
+            SpatialGrid& grid = *sim.GetSpatialGrid();
+            const float maxDistance = 2 * sim.GetParticleRadius();
+            if (threadPool)
+                collisionPairs = &grid.GetPotentialCollisionPairs(particles, maxDistance, *threadPool, &sim.GetStepArena());
+            else
+                collisionPairs = &grid.GetPotentialCollisionPairs(particles, maxDistance, &sim.GetStepArena());
+        }
+        {
+            PhaseTimer timer(stats, PhysicsPhase::SolvePairs);
+            stats.candidatePairs = static_cast<int>(collisionPairs->size());
+            stats.contacts = RunCompactContacts(sim, *collisionPairs, contact, seed ^ 0xc2b2ae35u);
+        }
+
+        if (sim.IsCollectingStats())
+            CollectGridStats(sim, *collisionPairs, stats);
+        return collisionPairs;
+    }
+};
+
+// --------- CORE ---------
+
+template<typename Broadphase, typename Integrator, typename Boundary, typename Contact>
+class SimulationCore {
+public:
+    // One step of deltaTime, see UpdatePhysics
+    static void Step(SimulationSystem& sim, float deltaTime, ThreadPool* threadPool)
+    {
+        PROFILE_SCOPE("UpdatePhysics");
+        PERF_SCOPE("UpdatePhysics", sim.GetParticleCount());
+        HOT_REGION("UpdatePhysics");
+        const uint64_t stepStart = Profiler::Now();
+
+        // Everything the previous step built in the arena is dropped here
+        sim.ResetStepArena(threadPool ? threadPool->GetThreadCount() : 1);
+
+        PhysicsStepStats stats;
+        stats.step = sim.NextStep();
+        stats.particles = static_cast<int>(sim.GetParticleCount());
+
+        const Integrator integrator(sim, deltaTime);
+        const Boundary boundary(sim);
+        const Contact contact(sim);
+
+        // Pairs the solve went through, the brute force path has no list
+        const CollisionPairList* solvedPairs = Broadphase::Step(sim, integrator, boundary, contact, threadPool, stats);
+
+        if (sim.IsCollectingStats())
+        {
+            if (stats.testedPairs > 0)
+                stats.candidateRatio = static_cast<float>(static_cast<double>(stats.candidatePairs) / stats.testedPairs);
+            if (stats.candidatePairs > 0)
+                stats.contactRatio = static_cast<float>(stats.contacts) / stats.candidatePairs;
+        }
+
+        // Before the streams, so consecutive checks see the same particles unless one spawned
+        if (ConservationMonitor* monitor = sim.GetConservationMonitor())
+        {
+            PhaseTimer timer(stats, PhysicsPhase::Monitor);
+            monitor->Check(sim, solvedPairs, deltaTime, stats.step, threadPool, &sim.GetStepArena());
+        }
+
+        {
+            PROFILE_SCOPE("UpdateStreams");
+            PhaseTimer timer(stats, PhysicsPhase::Streams);
+            PERF_SCOPE("UpdateStreams", sim.GetParticleCount());
+            sim.UpdateStreams(deltaTime);
+        }
+
+        stats.stepNs = Profiler::Now() - stepStart;
+        sim.RecordStepStats(stats);
+    }
+};
@@ -2,9 +2,16 @@
 #include <iostream>
 #include <algorithm>
 
+// Steps kept in the counters history, 10 seconds at 60 fps with 6 substeps
+const size_t STATS_HISTORY_STEPS = 3600;
+
+// Particles reserved for one stream at most, longer streams grow the vector as they spawn
+const int MAX_STREAM_RESERVE = 1 << 16;
+
 SimulationSystem::SimulationSystem(const Vec2& bottomLeft, const Vec2& topRight, float particleRadius, unsigned int windowWidth)
     : m_Bounds({ bottomLeft, topRight }), m_ParticleRadius(particleRadius),
-    m_Zoom(1.0f), m_WindowWidth(windowWidth)
+    m_Zoom(1.0f), m_WindowWidth(windowWidth), m_StatsHistory(STATS_HISTORY_STEPS),
+    m_CompactParticles(bottomLeft, topRight)
 {
     m_SimHeight = std::abs(topRight.y - bottomLeft.y);
     m_SimWidth = std::abs(topRight.x - bottomLeft.x);
@@ -22,13 +29,66 @@ SimulationSystem::~SimulationSystem()
 void SimulationSystem::AddParticle(const Vec2& position, const Vec2& velocity, float mass)
 {
     Particle newParticle(position, velocity, mass);
-    m_Particles.push_back(newParticle);
+
+    // The first particle sets the mass the others have to match
+    if (GetParticleCount() == 0)
+        m_UniformMass = mass > 0.0f ? mass : 0.0f;
+    else if (mass != m_UniformMass)
+        m_UniformMass = 0.0f;
+
+    if (m_Storage == ParticleStorage::Compact)
+        m_CompactParticles.Add(newParticle);
+    else
+        m_Particles.push_back(newParticle);
+}
+
+size_t SimulationSystem::GetParticleCapacity() const
+{
+    return m_Storage == ParticleStorage::Compact ? m_CompactParticles.capacity() : m_Particles.capacity();
+}
+
+void SimulationSystem::ReserveParticles(size_t count)
+{
+    if (m_Storage == ParticleStorage::Compact)
+        m_CompactParticles.reserve(count);
+    else
+        m_Particles.reserve(count);
+}
+
+void SimulationSystem::SetParticleStorage(ParticleStorage storage)
+{
+    if (storage == m_Storage)
+        return;
+
+    if (storage == ParticleStorage::Compact)
+    {
+        m_CompactParticles.Pack(m_Particles);
+        ParticleVector().swap(m_Particles);
+    }
+    else
+    {
+        m_CompactParticles.Unpack(m_Particles);
+        m_CompactParticles.Release();
+    }
+    m_Storage = storage;
+}
+
+void SimulationSystem::SyncParticles()
+{
+    if (m_Storage == ParticleStorage::Compact)
+        m_CompactParticles.Unpack(m_Particles);
+}
+
+void SimulationSystem::ReleaseSyncedParticles()
+{
+    if (m_Storage == ParticleStorage::Compact)
+        ParticleVector().swap(m_Particles);
 }
 
 void SimulationSystem::AddParticleGrid(int rows, int cols, Vec2 spacing, bool withInitialVelocity, float mass)
 {
     // Reserve memory at the start
-    m_Particles.reserve(m_Particles.size() + rows * cols);
+    ReserveParticles(GetParticleCount() + rows * cols);
 
     // Calculate the starting position (top-left corner of the simulation area)
     float startX = m_Bounds.bottomLeft.x + m_ParticleRadius;
@@ -99,6 +159,22 @@ glm::mat4 SimulationSystem::GetViewMatrix() const
     return view;
 }
 
+Bounds SimulationSystem::GetViewBounds() const
+{
+    // Same extent as the projection matrix, centered like the view matrix
+    const float halfWidth = m_SimWidth / m_Zoom * 0.5f;
+    const float halfHeight = m_SimHeight / m_Zoom * 0.5f;
+    const Vec2 simulationCenter = {
+        (m_Bounds.topRight.x + m_Bounds.bottomLeft.x) * 0.5f,
+        (m_Bounds.topRight.y + m_Bounds.bottomLeft.y) * 0.5f
+    };
+
+    return {
+        { simulationCenter.x - halfWidth, simulationCenter.y - halfHeight },
+        { simulationCenter.x + halfWidth, simulationCenter.y + halfHeight }
+    };
+}
+
 void SimulationSystem::AddParticleStream(int totalParticles, float spawnRate, const Vec2& velocity,
     float mass, const Vec2& initialOffset)
 {
@@ -117,6 +193,12 @@ void SimulationSystem::AddParticleStream(int totalParticles, float spawnRate, co
     newStream.mass = mass;
 
     m_Streams.push_back(newStream);
+
+    // Room for every particle the streams have left, so spawning inside the step loop doesn't reallocate
+    size_t pending = 0;
+    for (const auto& stream : m_Streams)
+        pending += std::min(stream.total - stream.spawned, MAX_STREAM_RESERVE);
+    ReserveParticles(GetParticleCount() + pending);
 }
 void SimulationSystem::UpdateStreams(float deltaTime)
 {
@@ -141,7 +223,34 @@ void SimulationSystem::InitSpatialGrid()
     }
 
     // size should be slightly larger than twice the particle diameter
-    float cellSize = 3.1f * 2.0f * m_ParticleRadius;
+    float cellSize = 2.1f * 2.0f * m_ParticleRadius;
     const auto& bounds = GetBounds();
-    m_SpatialGrid = new SpatialGrid(bounds.bottomLeft, bounds.topRight, cellSize, m_Particles.size());
-}
\ No newline at end of file
+    m_SpatialGrid = new SpatialGrid(bounds.bottomLeft, bounds.topRight, cellSize, GetParticleCount());
+}
+
+void SimulationSystem::ResetStepArena(int threadCount)
+{
+    // Sized from the particle capacity like the other buffers, so streams filling the
+    // reserved particles don't make the arena grow during a step. The threaded pair search
+    // writes every pair twice, once into the band of a thread and once into the merged list
+    const size_t capacity = GetParticleCapacity();
+    const size_t pairBytes = m_SpatialGrid ? m_SpatialGrid->GetPairCapacity(capacity) * sizeof(std::pair<int, int>) : 0;
+    m_StepArena.Reset(threadCount, pairBytes, threadCount > 1 ? 2 * pairBytes / threadCount : 0);
+}
+
+void SimulationSystem::UpdateUniformMass()
+{
+    // Compact particles can't be changed in place, AddParticle keeps the mass right
+    if (m_Storage == ParticleStorage::Compact)
+        return;
+
+    m_UniformMass = m_Particles.empty() || m_Particles[0].mass <= 0.0f ? 0.0f : m_Particles[0].mass;
+    for (const Particle& particle : m_Particles)
+    {
+        if (particle.mass != m_UniformMass)
+        {
+            m_UniformMass = 0.0f;
+            break;
+        }
+    }
+}
@@ -4,6 +4,12 @@
 #include "Particle.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include "SpatialGrid.h" 
+#include "CompactParticles.h"
+#include "PhysicsStats.h"
+#include "../core/FrameArena.h"
+#include "../core/RingBuffer.h"
+
+class ConservationMonitor;
 
 struct Bounds {
     Vec2 bottomLeft;
@@ -14,7 +20,7 @@ struct Bounds {
 class SimulationSystem
 {
 private:
-    std::vector<Particle> m_Particles;     
+    ParticleVector m_Particles;     
     Bounds m_Bounds;
     float m_ParticleRadius;
     float m_Zoom;
@@ -37,6 +43,31 @@ private:
 
     std::vector<ParticleStream> m_Streams;
 
+    // Per step counters, only filled while m_CollectStats is set
+    bool m_CollectStats = false;
+    uint64_t m_StepCount = 0;
+    PhysicsStepStats m_LastStepStats;
+    RingBuffer<PhysicsStepStats> m_StatsHistory;
+
+    // Invariant checks run at the end of every step, not owned
+    ConservationMonitor* m_ConservationMonitor = nullptr;
+
+    // Scratch memory of one step, rewound by UpdatePhysics before the step starts
+    FrameArena m_StepArena;
+
+    // Mass shared by every particle, 0 once two of them differ
+    float m_UniformMass = 0.0f;
+    bool m_UseSpecializedKernels = true;
+
+    // Where the particles are in ParticleStorage::Compact, m_Particles is then empty or a
+    // copy made by SyncParticles
+    ParticleStorage m_Storage = ParticleStorage::Full;
+    CompactParticles m_CompactParticles;
+
+    // Particles the storage in use has room for, and reserve room for count of them
+    size_t GetParticleCapacity() const;
+    void ReserveParticles(size_t count);
+
 public:
     // bottomLeft is the bottom-left corner of the simulation rectangle and
     // topRight is the top-right corner of the simulation rectangle.
@@ -70,8 +101,28 @@ public:
     // Method to get active stream count
     size_t GetActiveStreamCount() const { return m_Streams.size(); }
 
-    const std::vector<Particle>& GetParticles() const { return m_Particles; } // THIS ONE IS JUST OT COPY 
-    std::vector<Particle>& GetParticles() { return m_Particles; } // THIS ONE IS TO MODIFY THE VECTORIT
+    const ParticleVector& GetParticles() const { return m_Particles; } // THIS ONE IS JUST OT COPY 
+    ParticleVector& GetParticles() { return m_Particles; } // THIS ONE IS TO MODIFY THE VECTORIT
+
+    // Particles in the storage in use, GetParticles().size() only counts them in full storage
+    size_t GetParticleCount() const { return m_Storage == ParticleStorage::Compact ? m_CompactParticles.size() : m_Particles.size(); }
+
+    // Switch storage, converting the particles there are. Compact frees the particle vector,
+    // UpdatePhysics then steps the compact particles and GetParticles() only holds what the
+    // last SyncParticles copied. Streams and AddParticle write to the storage in use. The
+    // renderers, the fluid surface, the conservation monitor and the stats read either
+    // storage, templated on it through LoadParticle and GetParticlePosition
+    void SetParticleStorage(ParticleStorage storage);
+    ParticleStorage GetParticleStorage() const { return m_Storage; }
+
+    CompactParticles& GetCompactParticles() { return m_CompactParticles; }
+    const CompactParticles& GetCompactParticles() const { return m_CompactParticles; }
+
+    // Decode the compact particles into GetParticles() for code that only reads a particle
+    // vector. Changes to the copy aren't written back, and it holds 40 bytes per particle
+    // until ReleaseSyncedParticles. Does nothing in full storage
+    void SyncParticles();
+    void ReleaseSyncedParticles();
 
     const Bounds& GetBounds() const { return m_Bounds; }
     
@@ -81,6 +132,9 @@ public:
     // Return a view matrix for the simulation
     glm::mat4 GetViewMatrix() const;
 
+    // Return the rectangle of the simulation visible with the current zoom
+    Bounds GetViewBounds() const;
+
     // Return particle radius
     float GetParticleRadius() const { return m_ParticleRadius; }
 
@@ -99,12 +153,65 @@ public:
     // Return window width
     void SetWindowWidth(unsigned int width) { m_WindowWidth = width; }
 
+    // Return window width in pixels
+    unsigned int GetWindowWidth() const { return m_WindowWidth; }
+
+    // Return screen pixels covered by one simulation unit, the projection shows
+    // (simWidth / zoom) units over the whole window width
+    float GetPixelsPerUnit() const { return m_WindowWidth * m_Zoom / m_SimWidth; }
+
     bool IsUsingSpatialGrid() const { return m_UseSpatialGrid; }
     void SetUseSpatialGrid(bool use) { m_UseSpatialGrid = use; }
 
     // Initialize the spatial grid
     void InitSpatialGrid();
 
-    // Get the spatial grid
+    // Broadphase and solver counters. Collecting them adds a pass over the grid cells
+    // and the collision pairs to every step, so it is off by default
+    void SetCollectStats(bool collect) { m_CollectStats = collect; }
+    bool IsCollectingStats() const { return m_CollectStats; }
+
+    // Counters and timings of the last step, see PhysicsStepStats for the fields filled
+    // without collecting stats
+    const PhysicsStepStats& GetLastStepStats() const { return m_LastStepStats; }
+
+    // The last steps that collected counters, oldest first
+    const RingBuffer<PhysicsStepStats>& GetStatsHistory() const { return m_StatsHistory; }
+
+    // Number the next step gets in its counters, and store a finished step's counters (used by UpdatePhysics).
+    // Only steps that collected stats go to the history
+    uint64_t NextStep() { return m_StepCount++; }
+    void RecordStepStats(const PhysicsStepStats& stats)
+    {
+        m_LastStepStats = stats;
+        if (m_CollectStats)
+            m_StatsHistory.Push(stats);
+    }
+
+    // Monitor checked by UpdatePhysics after every step, nullptr (the default) skips the checks.
+    // The monitor must outlive the simulation or be detached first
+    void SetConservationMonitor(ConservationMonitor* monitor) { m_ConservationMonitor = monitor; }
+    ConservationMonitor* GetConservationMonitor() const { return m_ConservationMonitor; }
+
+    // Mass shared by every particle, 0 when they differ. Kept up to date by AddParticle,
+    // call UpdateUniformMass after changing masses through GetParticles()
+    float GetUniformMass() const { return m_UniformMass; }
+    void UpdateUniformMass();
+
+    // Let UpdatePhysics run the kernels compiled for the scene (uniform mass, fixed
+    // bounciness, gravity only) when it qualifies. Off always runs the general kernels
+    void SetUseSpecializedKernels(bool use) { m_UseSpecializedKernels = use; }
+    bool IsUsingSpecializedKernels() const { return m_UseSpecializedKernels; }
+
+    // Get the spatial grid, nullptr until InitSpatialGrid is called
     SpatialGrid* GetSpatialGrid() { return m_SpatialGrid; }
+    const SpatialGrid* GetSpatialGrid() const { return m_SpatialGrid; }
+
+    // Arena the pair lists and other buffers of the current step are built in
+    FrameArena& GetStepArena() { return m_StepArena; }
+    const FrameArena& GetStepArena() const { return m_StepArena; }
+
+    // Rewind the step arena for a step run on threadCount threads. Lists built in it by
+    // the previous step are invalid afterwards
+    void ResetStepArena(int threadCount);
 };
\ No newline at end of file
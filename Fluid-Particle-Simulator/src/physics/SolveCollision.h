@@ -1,14 +1,150 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include "SimulationSystem.h"
 
-// Solve collision between particle (particleA) and simulation 
-void SolveCollisionBorder(Particle& particleA,
+// Bounciness a contact kernel is compiled for. Elastic and Inelastic fold the
+// coefficient into a constant, Any reads it at runtime
+enum class ContactRestitution {
+    Elastic = 0,    // Bounciness 1
+    Inelastic = 1,  // Bounciness 0
+    Any = 2
+};
+
+// Value between 0 (inelastic) and 1 (perfectly elastic) used by the contacts
+float GetBounciness();
+
+// Cheapest restitution kernel that matches GetBounciness()
+ContactRestitution GetContactRestitution();
+
+// Solve collision between particle (particleA) and simulation, inline so the
+// boundary policies of SimulationCore compile it into their loops
+inline void SolveCollisionBorder(Particle& particleA,
     const Bounds bounds,
-    float particleRadius);
+    float particleRadius)
+{
+    // Extract boundary coordinates
+    const Vec2& bottomLeft = bounds.bottomLeft;
+    const Vec2& topRight = bounds.topRight;
+
+    // Calculate particle radius in simulation units
+    float radius = static_cast<float>(particleRadius);
+
+    // Horizontal bounds check
+    if (particleA.position.x - radius < bottomLeft.x) {
+        particleA.position.x = bottomLeft.x + radius;
+        particleA.velocity.x = -particleA.velocity.x;
+    }
+    else if (particleA.position.x + radius > topRight.x) {
+        particleA.position.x = topRight.x - radius;
+        particleA.velocity.x = -particleA.velocity.x;
+    }
+
+    // Vertical bounds check
+    if (particleA.position.y - radius < bottomLeft.y) {
+        particleA.position.y = bottomLeft.y + radius;
+        particleA.velocity.y = -particleA.velocity.y;
+    }
+    else if (particleA.position.y + radius > topRight.y) {
+        particleA.position.y = topRight.y - radius;
+        particleA.velocity.y = -particleA.velocity.y;
+    }
+}
 
 // Solve collision between particle A and particle B.
-// At the moment this function doesn't use the GLM vector library because 
-// it was slowing down my code too much 
-void SolveCollisionParticle(Particle& particleA, Particle& particleB,
+// At the moment this function doesn't use the GLM vector library because
+// it was slowing down my code too much
+// Returns true if the particles were closer than two radii (a contact)
+bool SolveCollisionParticle(Particle& particleA, Particle& particleB,
     const Bounds bounds,
-    float particleRadius);
\ No newline at end of file
+    float particleRadius);
+
+// (1 + bounciness), a constant for the fixed restitution kernels
+template<ContactRestitution Restitution>
+inline float GetRestitutionFactor(float bounciness)
+{
+    return Restitution == ContactRestitution::Elastic ? 2.0f :
+        Restitution == ContactRestitution::Inelastic ? 1.0f : 1.0f + bounciness;
+}
+
+// SolveCollisionParticle compiled for one kind of scene. With UniformMass every particle
+// weighs uniformMass: the position correction is split in half and the mass cancels out of
+// the velocity change, which leaves no divisions but the normalisation. The result matches
+// the general kernel exactly for unit masses and up to rounding for other uniform masses
+template<bool UniformMass, ContactRestitution Restitution>
+inline bool SolveContact(Particle& particleA, Particle& particleB,
+    float particleRadius, float uniformMass, float bounciness)
+{
+    const float dx = particleA.position.x - particleB.position.x;
+    const float dy = particleA.position.y - particleB.position.y;
+    const float distanceSquared = dx * dx + dy * dy;
+    const float minDistanceSquared = 4.0f * particleRadius * particleRadius;
+
+    if (distanceSquared >= minDistanceSquared)
+        return false;
+
+    const float distance = std::sqrt(distanceSquared);
+    if (distance < 1e-5f) return true;
+
+    const float invDistance = 1.0f / distance;
+    const float nx = dx * invDistance;
+    const float ny = dy * invDistance;
+
+    // Position correction, split by the mass ratios
+    const float overlap = 2.0f * particleRadius - distance;
+    if (UniformMass)
+    {
+        particleA.position.x += nx * overlap * 0.5f;
+        particleA.position.y += ny * overlap * 0.5f;
+        particleB.position.x -= nx * overlap * 0.5f;
+        particleB.position.y -= ny * overlap * 0.5f;
+    }
+    else
+    {
+        const float totalMass = particleA.mass + particleB.mass;
+        const float ratioA = particleB.mass / totalMass;
+        const float ratioB = particleA.mass / totalMass;
+
+        particleA.position.x += nx * overlap * ratioA;
+        particleA.position.y += ny * overlap * ratioA;
+        particleB.position.x -= nx * overlap * ratioB;
+        particleB.position.y -= ny * overlap * ratioB;
+    }
+
+    // Velocity resolution
+    const float vx = particleA.velocity.x - particleB.velocity.x;
+    const float vy = particleA.velocity.y - particleB.velocity.y;
+    const float velocityAlongNormal = vx * nx + vy * ny;
+
+    if (velocityAlongNormal < 0)
+    {
+        const float impulseScalar = -GetRestitutionFactor<Restitution>(bounciness) * velocityAlongNormal;
+        float impulse;
+        if (UniformMass)
+        {
+            // impulse / mass with impulse = impulseScalar / (2 / mass)
+            const float deltaVelocity = 0.5f * impulseScalar;
+            impulse = deltaVelocity * uniformMass;
+
+            particleA.velocity.x += deltaVelocity * nx;
+            particleA.velocity.y += deltaVelocity * ny;
+            particleB.velocity.x -= deltaVelocity * nx;
+            particleB.velocity.y -= deltaVelocity * ny;
+        }
+        else
+        {
+            impulse = impulseScalar / (1.0f / particleA.mass + 1.0f / particleB.mass);
+
+            particleA.velocity.x += impulse * nx / particleA.mass;
+            particleA.velocity.y += impulse * ny / particleA.mass;
+            particleB.velocity.x -= impulse * nx / particleB.mass;
+            particleB.velocity.y -= impulse * ny / particleB.mass;
+        }
+
+        // Temperature update (optional)
+        const float collisionIntensity = std::sqrt(impulse * impulse) * 0.01f;
+        particleA.temperature = std::min(100.0f, particleA.temperature + collisionIntensity);
+        particleB.temperature = std::min(100.0f, particleB.temperature + collisionIntensity);
+    }
+    return true;
+}
@@ -1,21 +1,77 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <utility>
 #include "Vec2.h"
+#include "Particle.h"
+#include "CompactParticles.h"
+#include "../core/FrameArena.h"
+#include "../core/MemoryTracker.h"
+#include "../core/ThreadPool.h"
+
+// Broadphase output, pairs of particle indices. Built in the step arena during a step,
+// on the heap otherwise
+typedef ArenaVector<std::pair<int, int>, MemoryTag::CollisionPairs> CollisionPairList;
+
+// Where the grid reads the position of a particle from, a particle vector or compact
+// particles, decoded on each read
+inline const Vec2& GetParticlePosition(const ParticleVector& particles, int index) { return particles[index].position; }
+inline Vec2 GetParticlePosition(const CompactParticles& particles, int index) { return particles.LoadPosition(index); }
 
 class SpatialGrid {
+public:
+    // Particle indices of one cell, in increasing order. Points into the grid, valid until the next Build
+    class Cell {
+    private:
+        const int* m_Begin;
+        const int* m_End;
+
+    public:
+        Cell(const int* begin, const int* end) : m_Begin(begin), m_End(end) {}
+
+        const int* begin() const { return m_Begin; }
+        const int* end() const { return m_End; }
+        size_t size() const { return static_cast<size_t>(m_End - m_Begin); }
+        bool empty() const { return m_Begin == m_End; }
+        int operator[](size_t i) const { return m_Begin[i]; }
+    };
+
 private:
     float m_CellSize;
     Vec2 m_MinBound;
     Vec2 m_MaxBound;
     int m_GridWidth;
     int m_GridHeight;
-    std::vector<std::vector<int>> m_Grid;
-    std::vector<std::pair<int, int>> m_CollisionPairs;
+
+    // Cells stored one after the other, counting sorted by Build. Every array keeps its
+    // size between builds, so rebuilding the grid each step doesn't allocate
+    TrackedVector<int, MemoryTag::SpatialGrid> m_CellStart;        // First entry of each cell in m_CellParticles, size cells + 1
+    TrackedVector<int, MemoryTag::SpatialGrid> m_CellParticles;    // Particle indices grouped by cell
+    TrackedVector<int, MemoryTag::SpatialGrid> m_ParticleCells;    // Cell of each particle, between the count and scatter passes
+    CollisionPairList m_CollisionPairs;
+    TrackedVector<CollisionPairList, MemoryTag::CollisionPairs> m_BandPairs;  // Per row band, reused by the threaded pair search
     int m_ParticleCount;
+    int m_InsertedCount = 0; // Particles inserted by the last Build
+
+    // Neighbor offsets as pairs (dx, dy). Half of the 8 neighbours, each pair of adjacent
+    // cells is searched once from the cell that has the other one in this list.
+    // Defined in Physics.cpp too, C++14 needs a definition for the range for loops
+    static constexpr int NEIGHBOR_COUNT = 4;
+    static constexpr std::pair<int, int> NEIGHBOR_OFFSETS[NEIGHBOR_COUNT] = { {1, 0}, {1, 1}, {0, 1}, {-1, 1} };
 
-    // Neighbor offsets as pairs (dx, dy)
-    static constexpr std::pair<int, int> NEIGHBOR_OFFSETS[3] = { {1, 0}, {1, 1}, {0, 1} };
+    // Row bands per thread in the threaded pair search, more bands balance crowded rows better
+    static const int BANDS_PER_THREAD = 4;
+
+    // Pair capacity expected per particle, a packed particle touches 6 neighbours
+    static const int PAIRS_PER_PARTICLE = 6;
+
+    // Arena of the thread, nullptr (the heap) without an arena or when it has fewer
+    // threads than the pool
+    static LinearArena* GetPairArena(FrameArena* arena, int threadIndex)
+    {
+        return (arena && threadIndex < arena->GetThreadCount()) ? &arena->GetThreadArena(threadIndex) : nullptr;
+    }
 
     // Directly compute 1D cell index from position
     inline int GetCellIndex(const Vec2& position) const
@@ -45,23 +101,60 @@ public:
     {
         m_GridWidth = static_cast<int>((maxBound.x - minBound.x) / cellSize) + 1;
         m_GridHeight = static_cast<int>((maxBound.y - minBound.y) / cellSize) + 1;
-        m_Grid.resize(m_GridWidth * m_GridHeight);
-
-        const int avgParticlesPerCell = std::max(1, particleCount / (m_GridWidth * m_GridHeight));
-        for (auto& cell : m_Grid) {
-            cell.reserve(avgParticlesPerCell * 2);
-        }
+        m_CellStart.assign(m_GridWidth * m_GridHeight + 1, 0);
+        m_CellParticles.reserve(particleCount);
+        m_ParticleCells.reserve(particleCount);
     }
 
+    // Empty every cell
     void Clear()
     {
-        for (auto& cell : m_Grid) {
-            cell.clear();
-        }
+        std::fill(m_CellStart.begin(), m_CellStart.end(), 0);
         m_CollisionPairs.clear();
+        m_InsertedCount = 0;
     }
 
-    inline bool AreParticlesCloseEnough(int a, int b, const std::vector<Particle>& particles, float maxDistance) const
+    // Put every particle in its cell, replacing the previous contents. A counting sort:
+    // count the particles per cell, turn the counts into cell starts and scatter the
+    // indices in order, so each cell lists its particles in increasing index order.
+    // Positions is a ParticleVector or CompactParticles
+    template<typename Positions>
+    void Build(const Positions& particles)
+    {
+        const int count = static_cast<int>(particles.size());
+        const int cellCount = m_GridWidth * m_GridHeight;
+
+        // Grow with the particle vector's capacity, streams reserve theirs up front
+        if (m_CellParticles.capacity() < particles.capacity())
+        {
+            m_CellParticles.reserve(particles.capacity());
+            m_ParticleCells.reserve(particles.capacity());
+        }
+        m_CellParticles.resize(count);
+        m_ParticleCells.resize(count);
+
+        std::fill(m_CellStart.begin(), m_CellStart.end(), 0);
+        for (int i = 0; i < count; i++)
+        {
+            const int cell = GetCellIndex(GetParticlePosition(particles, i));
+            m_ParticleCells[i] = cell;
+            m_CellStart[cell + 1]++;
+        }
+
+        for (int cell = 0; cell < cellCount; cell++)
+            m_CellStart[cell + 1] += m_CellStart[cell];
+
+        // Scatter with the starts as write cursors, then shift them back by one cell
+        for (int i = 0; i < count; i++)
+            m_CellParticles[m_CellStart[m_ParticleCells[i]]++] = i;
+        for (int cell = cellCount; cell > 0; cell--)
+            m_CellStart[cell] = m_CellStart[cell - 1];
+        m_CellStart[0] = 0;
+
+        m_InsertedCount = count;
+    }
+
+    inline bool AreParticlesCloseEnough(int a, int b, const ParticleVector& particles, float maxDistance) const
     {
         const auto& posA = particles[a].position;
         const auto& posB = particles[b].position;
@@ -72,40 +165,90 @@ public:
         return (dx * dx + dy * dy) <= maxDistance * maxDistance;
     }
 
-    inline void InsertParticle(int particleIndex, const Vec2& position)
+    float GetCellSize() const { return m_CellSize; }
+    const Vec2& GetMinBound() const { return m_MinBound; }
+    int GetGridWidth() const { return m_GridWidth; }
+    int GetGridHeight() const { return m_GridHeight; }
+
+    // Number of particles inserted by the last Build, these are the indices [0, count)
+    int GetInsertedCount() const { return m_InsertedCount; }
+
+    // Particle indices stored in cell (x, y)
+    Cell GetCell(int x, int y) const { return GetCellByIndex(x + y * m_GridWidth); }
+
+    Cell GetCellByIndex(int cellIndex) const
+    {
+        const int* particles = m_CellParticles.data();
+        return Cell(particles + m_CellStart[cellIndex], particles + m_CellStart[cellIndex + 1]);
+    }
+
+    // Inclusive range of cells overlapping the rectangle, clamped to the grid
+    void GetCellRange(const Vec2& bottomLeft, const Vec2& topRight, int& minX, int& minY, int& maxX, int& maxY) const
     {
-        m_Grid[GetCellIndex(position)].push_back(particleIndex);
+        const int first = GetCellIndex(bottomLeft);
+        const int last = GetCellIndex(topRight);
+        minX = first % m_GridWidth;
+        minY = first / m_GridWidth;
+        maxX = last % m_GridWidth;
+        maxY = last / m_GridWidth;
     }
 
-    std::vector<std::pair<int, int>>& GetPotentialCollisionPairs(
-        const std::vector<Particle>& particles,
-        float maxDistance)
+    // Distance tests GetPotentialCollisionPairs does with the particles currently in the
+    // cells: every pair inside a cell plus every pair with the stencil neighbours
+    int64_t CountPairTests() const
+    {
+        int64_t tests = 0;
+        for (int y = 0; y < m_GridHeight; ++y)
+        {
+            for (int x = 0; x < m_GridWidth; ++x)
+            {
+                const int64_t count = static_cast<int64_t>(GetCellByIndex(x + y * m_GridWidth).size());
+                if (count == 0) continue;
+
+                tests += count * (count - 1) / 2;
+                for (const auto& offset : NEIGHBOR_OFFSETS)
+                {
+                    const int neighborX = x + offset.first;
+                    const int neighborY = y + offset.second;
+                    if (neighborX < 0 || neighborX >= m_GridWidth || neighborY >= m_GridHeight) continue;
+                    tests += count * static_cast<int64_t>(GetCellByIndex(neighborX + neighborY * m_GridWidth).size());
+                }
+            }
+        }
+        return tests;
+    }
+
+    // Append the pairs whose first particle lies in the rows [rowBegin, rowEnd)
+    template<typename Positions>
+    void CollectCollisionPairs(
+        const Positions& particles,
+        float maxDistance,
+        int rowBegin, int rowEnd,
+        CollisionPairList& pairs) const
     {
-        m_CollisionPairs.clear();
         const float maxDistanceSq = maxDistance * maxDistance;
-        m_CollisionPairs.reserve(m_ParticleCount * 6);
 
-        for (int y = 0; y < m_GridHeight; ++y) 
+        for (int y = rowBegin; y < rowEnd; ++y) 
         {
             for (int x = 0; x < m_GridWidth; ++x) 
             {
                 const int cellIndex = x + y * m_GridWidth;
-                const auto& cellParticles = m_Grid[cellIndex];
+                const Cell cellParticles = GetCellByIndex(cellIndex);
                 if (cellParticles.empty()) continue;
 
                 const size_t cellSize = cellParticles.size();
                 for (size_t i = 0; i < cellSize; ++i) 
                 {
                     const int particleA = cellParticles[i];
-                    const Vec2& posA = particles[particleA].position;
+                    const Vec2& posA = GetParticlePosition(particles, particleA);
 
                     // Intra-cell pairs
                     for (size_t j = i + 1; j < cellSize; ++j) 
                     {
                         const int particleB = cellParticles[j];
-                        if (AreParticlesCloseEnoughSq(posA, particles[particleB].position, maxDistanceSq)) 
+                        if (AreParticlesCloseEnoughSq(posA, GetParticlePosition(particles, particleB), maxDistanceSq)) 
                         {
-                            m_CollisionPairs.emplace_back(particleA, particleB);
+                            pairs.emplace_back(particleA, particleB);
                         }
                     }
 
@@ -114,22 +257,78 @@ public:
                     {
                         const int neighborX = x + offset.first;
                         const int neighborY = y + offset.second;
-                        if (neighborX >= m_GridWidth || neighborY >= m_GridHeight) continue;
+                        if (neighborX < 0 || neighborX >= m_GridWidth || neighborY >= m_GridHeight) continue;
 
                         const int neighborIndex = neighborX + neighborY * m_GridWidth;
-                        const auto& neighborParticles = m_Grid[neighborIndex];
+                        const Cell neighborParticles = GetCellByIndex(neighborIndex);
                         if (neighborParticles.empty()) continue;
 
                         for (const int particleB : neighborParticles) {
-                            if (AreParticlesCloseEnoughSq(posA, particles[particleB].position, maxDistanceSq)) 
+                            if (AreParticlesCloseEnoughSq(posA, GetParticlePosition(particles, particleB), maxDistanceSq)) 
                             {
-                                m_CollisionPairs.emplace_back(particleA, particleB);
+                                pairs.emplace_back(particleA, particleB);
                             }
                         }
                     }
                 }
             }
         }
+    }
+
+    // Pairs the step arena should hold for a particle vector of this capacity, the
+    // merged list and the bands of the threaded search each need about this much
+    size_t GetPairCapacity(size_t particleCapacity) const
+    {
+        return std::max(static_cast<size_t>(m_ParticleCount), particleCapacity) * PAIRS_PER_PARTICLE;
+    }
+
+    // With an arena the lists are built in it and stay valid until it is reset. Each list
+    // reserves the size it had last time plus a quarter, fuller steps grow it in the arena
+    template<typename Positions>
+    CollisionPairList& GetPotentialCollisionPairs(
+        const Positions& particles,
+        float maxDistance,
+        FrameArena* arena = nullptr)
+    {
+        const size_t previousCount = RestartArenaVector(m_CollisionPairs, GetPairArena(arena, 0));
+        m_CollisionPairs.reserve(previousCount + previousCount / 4);
+        CollectCollisionPairs(particles, maxDistance, 0, m_GridHeight, m_CollisionPairs);
+        return m_CollisionPairs;
+    }
+
+    // Same pairs in the same order, the rows are split into bands searched in parallel
+    // and the bands are appended one after the other. Each band goes to the arena of the
+    // thread searching it
+    template<typename Positions>
+    CollisionPairList& GetPotentialCollisionPairs(
+        const Positions& particles,
+        float maxDistance,
+        ThreadPool& threadPool,
+        FrameArena* arena = nullptr)
+    {
+        const int bandCount = std::min(m_GridHeight, threadPool.GetThreadCount() * BANDS_PER_THREAD);
+        if (m_BandPairs.size() < static_cast<size_t>(bandCount))
+            m_BandPairs.resize(bandCount);
+
+        threadPool.ParallelFor(bandCount, [&](int begin, int end, int threadIndex)
+        {
+            for (int band = begin; band < end; band++)
+            {
+                const size_t previousCount = RestartArenaVector(m_BandPairs[band], GetPairArena(arena, threadIndex));
+                m_BandPairs[band].reserve(previousCount + previousCount / 4);
+                CollectCollisionPairs(particles, maxDistance,
+                    band * m_GridHeight / bandCount, (band + 1) * m_GridHeight / bandCount, m_BandPairs[band]);
+            }
+        });
+
+        size_t pairCount = 0;
+        for (int band = 0; band < bandCount; band++)
+            pairCount += m_BandPairs[band].size();
+
+        RestartArenaVector(m_CollisionPairs, GetPairArena(arena, 0));
+        m_CollisionPairs.reserve(pairCount);
+        for (int band = 0; band < bandCount; band++)
+            m_CollisionPairs.insert(m_CollisionPairs.end(), m_BandPairs[band].begin(), m_BandPairs[band].end());
         return m_CollisionPairs;
     }
-};
\ No newline at end of file
+};